@@ -3,6 +3,8 @@
 
 void cli(void);
 void sei(void );
+extern uint8_t SREG;
+#define SREG_I 7
 #define PB7 7
 #define F_CPU 16000000L
 #define TXEN0 3
@@ -65,6 +67,10 @@ extern uint8_t UCSR3A;
 #define UDRE1 5
 #define UDRE2 5
 #define UDRE3 5
+#define DOR0 3
+#define DOR1 3
+#define DOR2 3
+#define DOR3 3
 void _delay_ms(int a);
 void _delay_us(int a);
 extern uint8_t DDRB;
@@ -147,18 +153,29 @@ extern uint8_t PORTE;
 #define PH4 4
 
 extern uint8_t DDRH;
+extern uint8_t TCCR1A;
 extern uint8_t TCCR1B;
 extern uint16_t OCR1A;
+extern uint16_t OCR1B;
+#define OCIE1B 2
+#define OCF1B 2
+extern uint16_t OCR1C;
+#define OCIE1C 3
+#define OCF1C 3
 extern uint8_t TIMSK1;
+extern uint8_t TIFR1;
 extern uint8_t PORTH;
 
 #define WGM12 3
 #define CS11 1
 #define OCIE1A 1
+#define TOIE1 0
+#define TOV1 0
+#define OCF1A 1
 
 extern uint8_t DDRK;
 extern uint8_t PORTK;
-extern uint8_t TCNT1;
+extern uint16_t TCNT1;
 extern uint8_t PINK;
 
 #define PK6 6
@@ -189,19 +206,37 @@ extern uint8_t DIDR2;
 #define PK1 1
 #define PK2 2
 #define ADSC 6
+extern uint8_t DIDR0;
+#define ADATE 5
+#define ADIF 4
+#define ADIE 3
+#define ADTS2 2
+#define ADTS1 1
+#define ADTS0 0
 
 
 extern uint8_t TCCR3A;
 extern uint8_t TCCR3B;
-extern uint8_t OCR3A;
-extern uint8_t OCR5A;
+extern uint16_t OCR3A;
+extern uint16_t ICR3;
+extern uint8_t TIFR3;
+extern uint16_t OCR5A;
 extern uint8_t TIMSK3;
 extern uint8_t TIMSK5;
 extern uint8_t OCR3B;
 extern uint8_t OCR3C;
 
 #define CS32 2
+#define CS31 1
 #define CS30 0
+#define WGM33 4
+#define WGM32 3
+#define WGM31 1
+#define WGM30 0
+#define COM3A1 7
+#define COM3A0 6
+#define TOIE3 0
+#define TOV3 0
 #define OCIE3A 1
 #define OCIE3B 2
 #define OCIE3C 3
@@ -254,6 +289,8 @@ extern uint8_t PINK;
 
 #define PCIE2 2
 #define PCINT20 4
+#define PCINT21 5
+#define PCINT22 6
 extern uint8_t PCICR;
 extern uint8_t PCMSK2;
 
@@ -263,6 +300,14 @@ extern uint8_t PCMSK2;
 extern uint8_t TCCR2A;
 extern uint8_t TCCR2B;
 extern uint8_t TCNT2;
+extern uint8_t OCR2A;
+extern uint8_t TIMSK2;
+#define WGM21 1
+#define OCIE2A 1
+
+// Flash tables are plain memory on the host
+#define PROGMEM
+#define pgm_read_word(address) (*(const uint16_t *)(address))
 
         // Busy-wait
 #define CS22 2
@@ -289,4 +334,31 @@ extern uint8_t TIFR4;
 
 extern uint8_t TIMSK4;
 #define OCIE4B 2
-#define OCIE5A 1
\ No newline at end of file
+#define OCIE5A 1
+
+extern uint16_t TCNT5;
+extern uint8_t TIFR5;
+#define OCF5A 1
+extern uint16_t ICR5;
+#define ICF5 5
+#define ICIE5 5
+#define ICNC5 7
+#define ICES5 6
+#define WGM52 3
+#define CS51 1
+#define CS50 0
+
+extern uint8_t SPCR;
+extern uint8_t SPSR;
+extern uint8_t SPDR;
+#define SPIE 7
+#define SPE 6
+#define DORD 5
+#define MSTR 4
+#define CPOL 3
+#define CPHA 2
+#define SPR1 1
+#define SPR0 0
+#define SPIF 7
+#define WCOL 6
+#define SPI2X 0
@@ -0,0 +1,201 @@
+/**
+ * @file adc.c
+ * @brief Background ADC scan implementation for ATmega2560
+ *
+ * The ADC runs in auto trigger mode on the Timer1 overflow flag, so the conversions
+ * are paced in hardware and the CPU only sees one interrupt per conversion. The
+ * interrupt selects the next channel right away; the multiplexer is read when the
+ * next trigger starts a conversion, 32 ms later.
+ */
+
+#include "adc.h"
+#include "includes.h"
+#include "timers.h"
+
+#if ADC_NOISE_REDUCTION
+#include <avr/sleep.h>
+#endif
+
+typedef struct
+{
+    uint8_t input;
+    uint8_t extra_bits;
+    uint16_t samples;  // conversions summed so far
+    uint32_t sum;
+    uint16_t latest;
+    uint16_t results;
+} adc_channel_state_t;
+
+static volatile adc_channel_state_t channels[ADC_MAX_CHANNELS];
+static volatile uint8_t channel_count;
+static volatile uint8_t current; // channel the next conversion is for
+
+#if ADC_NOISE_REDUCTION
+static volatile uint8_t quiet, quiet_done;
+static volatile uint16_t quiet_result;
+#endif
+
+static void adc_select(uint8_t input)
+{
+    ADMUX = (1 << REFS0) | (input & 0x07);
+    if (input & 0x08)
+        ADCSRB |= (1 << MUX5);
+    else
+        ADCSRB &= ~(1 << MUX5);
+}
+
+void adc_init(void)
+{
+    // An enabled ADC is already set up, with the channels of other drivers
+    if (ADCSRA & (1 << ADEN))
+        return;
+
+    uint8_t sreg = SREG;
+    cli();
+    channel_count = 0;
+    current = 0;
+    timer1_start();
+    ADMUX = (1 << REFS0);
+    // Trigger on the Timer1 overflow
+    ADCSRB = (1 << ADTS2) | (1 << ADTS1);
+    // Prescaler 128: 16 MHz / 128 = 125 kHz, within 50-200 kHz for the full 10 bits
+    ADCSRA = (1 << ADEN) | (1 << ADATE) | (1 << ADIE) | (1 << ADIF) |
+             (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0);
+    SREG = sreg;
+}
+
+adc_channel_t adc_add(uint8_t input, uint8_t extra_bits)
+{
+    if (input > 15 || extra_bits > ADC_MAX_EXTRA_BITS)
+        return ADC_CHANNEL_NONE;
+
+    adc_channel_t channel = ADC_CHANNEL_NONE;
+    uint8_t sreg = SREG;
+    cli();
+    for (uint8_t i = 0; i < channel_count; i++)
+        if (channels[i].input == input)
+            channel = i;
+
+    if (channel == ADC_CHANNEL_NONE && channel_count < ADC_MAX_CHANNELS)
+    {
+        channel = channel_count;
+        volatile adc_channel_state_t *c = &channels[channel];
+        c->input = input;
+        c->extra_bits = extra_bits;
+        c->samples = 0;
+        c->sum = 0;
+        c->latest = 0;
+        c->results = 0;
+        if (channel_count++ == 0)
+            adc_select(input);
+
+        // The digital input buffer only costs power on an analog pin
+        if (input < 8)
+            DIDR0 |= (1 << input);
+        else
+            DIDR2 |= (1 << (input - 8));
+    }
+    SREG = sreg;
+    return channel;
+}
+
+uint16_t adc_latest(adc_channel_t channel)
+{
+    if (channel < 0 || channel >= channel_count)
+        return 0;
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t latest = channels[channel].latest;
+    SREG = sreg;
+    return latest;
+}
+
+uint16_t adc_results(adc_channel_t channel)
+{
+    if (channel < 0 || channel >= channel_count)
+        return 0;
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t results = channels[channel].results;
+    SREG = sreg;
+    return results;
+}
+
+#ifndef WINDOWS_TEST
+ISR(ADC_vect)
+#else
+void ADC_vect(void)
+#endif
+{
+    // ADCL must be read first, then ADCH
+    uint16_t value = ADCL;
+    value |= (ADCH << 8);
+
+#if ADC_NOISE_REDUCTION
+    if (quiet)
+    {
+        quiet_result = value;
+        quiet_done = 1;
+        return;
+    }
+#endif
+
+    uint8_t n = channel_count;
+    if (n == 0)
+        return;
+
+    volatile adc_channel_state_t *c = &channels[current];
+    c->sum += value;
+    if (++c->samples >= (1U << (2 * c->extra_bits)))
+    {
+        c->latest = c->sum >> c->extra_bits;
+        c->results++;
+        c->samples = 0;
+        c->sum = 0;
+    }
+
+    uint8_t next = current + 1;
+    if (next >= n)
+        next = 0;
+    current = next;
+    adc_select(channels[next].input);
+}
+
+#if ADC_NOISE_REDUCTION
+uint16_t adc_convert_quiet(adc_channel_t channel)
+{
+    if (channel < 0 || channel >= channel_count)
+        return 0;
+
+    // Take the ADC off the trigger and let a running conversion finish
+    ADCSRA &= ~(1 << ADATE);
+    while (ADCSRA & (1 << ADSC))
+        ;
+    quiet = 1;
+    quiet_done = 0;
+    adc_select(channels[channel].input);
+
+    // Entering the sleep mode starts the conversion. Another interrupt may wake the CPU
+    // first; the conversion goes on, sleep again until it is complete
+    uint8_t smcr = SMCR;
+    set_sleep_mode(SLEEP_MODE_ADC);
+    while (!quiet_done)
+    {
+        cli();
+        if (!quiet_done)
+        {
+            sleep_enable();
+            sei();
+            sleep_cpu();
+            sleep_disable();
+        }
+        sei();
+    }
+    SMCR = smcr;
+
+    quiet = 0;
+    adc_select(channels[current].input);
+    ADCSRA |= (1 << ADATE);
+    return quiet_result;
+}
+#endif
@@ -0,0 +1,98 @@
+/**
+ * @file adc.h
+ * @brief Background ADC scan for ATmega2560
+ *
+ * One driver owns the ADC and converts every registered channel in turn, in the
+ * background. Each Timer1 overflow (every 32.768 ms) triggers one conversion in
+ * hardware, and the conversion complete interrupt adds it to its channel and selects
+ * the next channel. Nothing waits for a conversion: a reader fetches the latest result
+ * of its channel with adc_latest().
+ *
+ * A channel can be oversampled: with n extra bits, 4^n conversions are summed and the
+ * sum is shifted right by n, a result of 10 + n bits with the noise averaged out. The
+ * channels take turns per conversion, so with c channels one result of a channel takes
+ * c * 4^n * 32.768 ms.
+ *
+ * Drivers sharing the ADC call adc_init() and adc_add() in their init function and
+ * leave the ADC registers alone.
+ */
+
+#pragma once
+#include <stdint.h>
+
+/**
+ * @brief Number of channels that can be registered.
+ *
+ */
+#ifndef ADC_MAX_CHANNELS
+#define ADC_MAX_CHANNELS 4
+#endif
+
+/**
+ * @brief Largest number of oversampling bits of a channel (4096 conversions).
+ *
+ */
+#define ADC_MAX_EXTRA_BITS 6
+
+/**
+ * @brief Set to 1 for adc_convert_quiet(), a conversion in ADC noise reduction sleep.
+ *
+ */
+#ifndef ADC_NOISE_REDUCTION
+#define ADC_NOISE_REDUCTION 0
+#endif
+
+/**
+ * @brief Handle of a channel, ADC_CHANNEL_NONE if none could be registered.
+ *
+ */
+typedef int8_t adc_channel_t;
+#define ADC_CHANNEL_NONE ((adc_channel_t)-1)
+
+/**
+ * @brief Set up the ADC (AVCC reference, 125 kHz, triggered by the Timer1 overflow)
+ * and start Timer1. Safe to call from every driver that uses the ADC; only the first
+ * call changes anything.
+ *
+ */
+void adc_init(void);
+
+/**
+ * @brief Add an input to the scan and turn off its digital input buffer.
+ *
+ * @param input ADC input, 0 to 15 (ADC0 to ADC15).
+ * @param extra_bits Oversampling bits, 0 to ADC_MAX_EXTRA_BITS.
+ * @return adc_channel_t Handle of the channel; the existing one if the input is
+ * already scanned. ADC_CHANNEL_NONE if all channels are in use or an argument is out
+ * of range.
+ */
+adc_channel_t adc_add(uint8_t input, uint8_t extra_bits);
+
+/**
+ * @brief The latest result of a channel.
+ *
+ * @param channel Handle of the channel.
+ * @return uint16_t The result, 10 + extra_bits bits; 0 until the first one is complete.
+ */
+uint16_t adc_latest(adc_channel_t channel);
+
+/**
+ * @brief Number of results of a channel so far, to tell whether adc_latest() has a
+ * new one. Wraps at 65536.
+ *
+ * @param channel Handle of the channel.
+ * @return uint16_t The number of results.
+ */
+uint16_t adc_results(adc_channel_t channel);
+
+#if ADC_NOISE_REDUCTION
+/**
+ * @brief Convert one input in ADC noise reduction sleep, with the CPU and the I/O
+ * clock stopped, and wait for it. The scan pauses meanwhile. Timer1 stops as well, so
+ * the system time falls behind by about 0.1 ms per call.
+ *
+ * @param channel Handle of the channel; its oversampling is not used.
+ * @return uint16_t The 10-bit result.
+ */
+uint16_t adc_convert_quiet(adc_channel_t channel);
+#endif
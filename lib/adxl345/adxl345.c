@@ -1,13 +1,16 @@
 #include "adxl345.h"
 #include "includes.h"
+#include "spi.h"
 
 /* -------------------------------------------------------------------------- */
 /*  When we are **not** building for the AVR target (i.e. unit tests running
  *  on the host), we must provide storage for the GPIO registers that the
  *  driver touches and simple delay stubs so the linker can resolve them.
- *  We also expose a thin shim so that the production code keeps calling
- *  spi_transfer(), but the unit-test spy (defined in the test file as
- *  __wrap_spi_transfer) actually runs.
+ *  lib/spi is left out (EXCLUDE_SPI) and a thin shim stands in for it, so
+ *  that the production code keeps calling spi_transfer(), but the unit-test
+ *  spy (defined in the test file as __wrap_spi_transfer) actually runs.
+ *  The pins are those of the firmware that is built, CS on PB1 unless
+ *  ADXL345_HW_SPI is set.
  */
 #ifndef __AVR__
 #include "mock_avr_io.h"
@@ -16,6 +19,7 @@
 uint8_t DDRB, PORTB, PINB;
 uint8_t DDRG, PORTG;
 uint8_t DDRD, PORTD;
+uint8_t DDRK, PINK, PCICR, PCMSK2;
 
 /* ------------- delay stubs ----------------------------------------------- */
 void _delay_ms(int ms) { (void)ms; }
@@ -28,13 +32,30 @@ uint8_t spi_transfer(uint8_t data)                  /* used by driver      */
 {
     return __wrap_spi_transfer(data);
 }
+
+void spi_device_init(spi_device_t *device, volatile uint8_t *cs_ddr,
+                     volatile uint8_t *cs_port, uint8_t cs_bit,
+                     uint32_t clock_hz, uint8_t mode)
+{
+    (void)clock_hz; (void)mode;
+    device->cs_port = cs_port;
+    device->cs_mask = (1 << cs_bit);
+    *cs_port |= device->cs_mask;
+    *cs_ddr  |= device->cs_mask;
+}
+
+void spi_select(const spi_device_t *device)   { *device->cs_port &= ~device->cs_mask; }
+void spi_deselect(const spi_device_t *device) { *device->cs_port |=  device->cs_mask; }
 #endif  /* !__AVR__ */
 /* -------------------------------------------------------------------------- */
 
 
-/* === pin / register definitions – unchanged ============================== */
-/* (for readability the big comment-block with the alternative pin-mapping
- *  has been left out, but you can keep it if you like)                      */
+/* === pin / register definitions ========================================== */
+/* The sensor extension board wires J9 as SCL → PB0, CS → PB1, SDO → PB2 and
+ * SDA → PB3, which crosses the SPI pins of the ATmega2560 (SS, SCK, MOSI,
+ * MISO). On that wiring the bus is bit-banged. With ADXL345_HW_SPI the
+ * module sits on the SPI pins (SCL → SCK, SDA → MOSI, SDO → MISO) with CS on
+ * PB0, and lib/spi drives it.                                               */
 #define GND_BIT PG1
 #define GND_DDR DDRG
 #define GND_PORT PORTG
@@ -43,7 +64,11 @@ uint8_t spi_transfer(uint8_t data)                  /* used by driver      */
 #define VCC_DDR DDRD
 #define VCC_PORT PORTD
 
+#if ADXL345_HW_SPI
+#define CS_BIT  PB0
+#else
 #define CS_BIT  PB1
+#endif
 #define CS_DDR  DDRB
 #define CS_PORT PORTB
 
@@ -59,96 +84,246 @@ uint8_t spi_transfer(uint8_t data)                  /* used by driver      */
 #define SCL_DDR  DDRB
 #define SCL_PORT PORTB
 
+/* INT1 → PK5 (PCINT21), INT2 → PK6 (PCINT22), both active high            */
+#define INT_DDR  DDRK
+#define INT_PIN  PINK
+#define INT_MASK ((1 << PK5) | (1 << PK6))
+
+/* The ADXL345 takes up to 5 MHz, in SPI mode 3 (clock idles high)          */
+#define ADXL345_SPI_CLOCK 5000000UL
+
 /* ADXL345 register addresses and constants */
+#define ADXL345_THRESH_TAP    0x1D
+#define ADXL345_DUR           0x21
+#define ADXL345_THRESH_ACT    0x24
+#define ADXL345_THRESH_INACT  0x25
+#define ADXL345_TIME_INACT    0x26
+#define ADXL345_ACT_INACT_CTL 0x27
+#define ADXL345_TAP_AXES      0x2A
 #define ADXL345_POWER_CTL     0x2D
+#define ADXL345_INT_ENABLE    0x2E
+#define ADXL345_INT_MAP       0x2F
+#define ADXL345_INT_SOURCE    0x30
 #define ADXL345_DATA_FORMAT   0x31
 #define ADXL345_DATAX0        0x32
+#define ADXL345_FIFO_CTL      0x38
+#define ADXL345_FIFO_STATUS   0x39
 #define ADXL345_MEASURE_MODE  0x08
+#define ADXL345_LINK          0x20
+#define ADXL345_FIFO_STREAM   0x80
 
-/* -------------------------------------------------------------------------- */
-void adxl345_init(void)
-{
-    /* configure pins */
-    MOSI_DDR |= (1 << MOSI_BIT);
-    SCL_DDR  |= (1 << SCL_BIT);
-    CS_DDR   |= (1 << CS_BIT);
-    MISO_DDR &= ~(1 << MISO_BIT);
-
-    /* deselect chip, set clock high (idle) */
-    CS_PORT  |= (1 << CS_BIT);
-    SCL_PORT |= (1 << SCL_BIT);
-
-    _delay_ms(20);
-
-    /* put the device in measurement mode and ±16 g range / 13-bit */
-    adxl345_write_register(ADXL345_POWER_CTL,    ADXL345_MEASURE_MODE);
-    adxl345_write_register(ADXL345_DATA_FORMAT,  0b00000101);
-}
+#define ADXL345_READ          0x80
+#define ADXL345_MULTI_BYTE    0x40
 
 
 /* -------------------------------------------------------------------------- */
-#ifdef __AVR__
-/*  Real bit-bang SPI implementation – compiled only for the embedded build  */
-uint8_t spi_transfer(uint8_t data)
+#if defined(__AVR__) && !ADXL345_HW_SPI
+/*  Bit-banged SPI on the J9 wiring – compiled only for the embedded build.
+ *  Each half clock takes a few cycles, about 1 MHz SCK, well within the
+ *  ADXL345's 5 MHz, so it needs no delays.                                  */
+static uint8_t adxl345_transfer(uint8_t data)
 {
     uint8_t received = 0;
 
     for (uint8_t i = 0; i < 8; i++) {
-        if (data & (1 << (7 - i)))
+        if (data & 0x80)
             MOSI_PORT |=  (1 << MOSI_BIT);
         else
             MOSI_PORT &= ~(1 << MOSI_BIT);
+        data <<= 1;
 
-        /* clock low → high */
+        /* clock low → high, the ADXL345 samples on the rising edge */
         SCL_PORT &= ~(1 << SCL_BIT);
-        _delay_us(1);
 
         received <<= 1;
         if (MISO_PIN & (1 << MISO_BIT))
             received |= 1;
 
         SCL_PORT |=  (1 << SCL_BIT);
-        _delay_us(1);
     }
     return received;
 }
-#endif  /* __AVR__ */
+
+static void adxl345_bus_init(void)
+{
+    MOSI_DDR |= (1 << MOSI_BIT);
+    SCL_DDR  |= (1 << SCL_BIT);
+    MISO_DDR &= ~(1 << MISO_BIT);
+    SCL_PORT |= (1 << SCL_BIT);                 /* clock idles high */
+    CS_PORT  |= (1 << CS_BIT);                  /* deselected       */
+    CS_DDR   |= (1 << CS_BIT);
+}
+
+static void adxl345_select(void)   { CS_PORT &= ~(1 << CS_BIT); }
+static void adxl345_deselect(void) { CS_PORT |=  (1 << CS_BIT); }
+#else
+/*  Hardware SPI through lib/spi                                            */
+#define adxl345_transfer spi_transfer
+
+static spi_device_t adxl345_spi;
+
+static void adxl345_bus_init(void)
+{
+    spi_device_init(&adxl345_spi, &CS_DDR, &CS_PORT, CS_BIT,
+                    ADXL345_SPI_CLOCK, SPI_MODE3);
+}
+
+static void adxl345_select(void)   { spi_select(&adxl345_spi); }
+static void adxl345_deselect(void) { spi_deselect(&adxl345_spi); }
+#endif
 /* -------------------------------------------------------------------------- */
 
 
-void adxl345_write_register(uint8_t reg, uint8_t value)
+/* Interrupts enabled on the chip and the ones routed to INT2; the others  */
+/* go to INT1                                                              */
+static uint8_t int_enable, int_map;
+static volatile uint8_t int_pending;
+static adxl345_callback_t event_callback;
+
+void adxl345_init(void)
 {
-    CS_PORT &= ~(1 << CS_BIT);      /* select */
-    _delay_us(1);
+    adxl345_bus_init();
+    int_enable = int_map = 0;
+    int_pending = 0;
+    _delay_ms(20);
 
-    spi_transfer(reg);
-    spi_transfer(value);
+    /* put the device in measurement mode and ±16 g range / 13-bit */
+    adxl345_write_register(ADXL345_POWER_CTL,    ADXL345_MEASURE_MODE);
+    adxl345_write_register(ADXL345_DATA_FORMAT,  0b00000101);
+}
 
-    CS_PORT |=  (1 << CS_BIT);      /* deselect */
+void adxl345_write_register(uint8_t reg, uint8_t value)
+{
+    adxl345_select();
+    adxl345_transfer(reg);
+    adxl345_transfer(value);
+    adxl345_deselect();
 }
 
 uint8_t adxl345_read_register(uint8_t reg)
 {
-    CS_PORT &= ~(1 << CS_BIT);
-    spi_transfer(0x80 | reg);       /* read bit set */
-    uint8_t v = spi_transfer(0x00);
-    CS_PORT |=  (1 << CS_BIT);
+    adxl345_select();
+    adxl345_transfer(ADXL345_READ | reg);
+    uint8_t v = adxl345_transfer(0x00);
+    adxl345_deselect();
     return v;
 }
 
 void adxl345_read_xyz(int16_t *x, int16_t *y, int16_t *z)
 {
-    CS_PORT &= ~(1 << CS_BIT);
-    spi_transfer(0xC0 | ADXL345_DATAX0);   /* multibyte read starting at DATAX0 */
+    uint8_t data[6];
+
+    /* multibyte read starting at DATAX0, the whole burst with CS held low */
+    adxl345_select();
+    adxl345_transfer(ADXL345_READ | ADXL345_MULTI_BYTE | ADXL345_DATAX0);
+    for (uint8_t i = 0; i < sizeof data; i++)
+        data[i] = adxl345_transfer(0x00);
+    adxl345_deselect();
+
+    *x = (int16_t)(data[0] | (data[1] << 8));
+    *y = (int16_t)(data[2] | (data[3] << 8));
+    *z = (int16_t)(data[4] | (data[5] << 8));
+}
 
-    *x  =  spi_transfer(0x00);
-    *x |= (spi_transfer(0x00) << 8);
 
-    *y  =  spi_transfer(0x00);
-    *y |= (spi_transfer(0x00) << 8);
+/* ---- FIFO and interrupts ------------------------------------------------- */
+#ifndef WINDOWS_TEST
+ISR(PCINT2_vect)
+#else
+void PCINT2_vect(void)
+#endif
+{
+    /* The SPI bus may be in use; only note it and wake the main loop       */
+    if (INT_PIN & INT_MASK)
+        int_pending = 1;
+}
 
-    *z  =  spi_transfer(0x00);
-    *z |= (spi_transfer(0x00) << 8);
+/* Write the routing and enable changed interrupts; the chip wants its     */
+/* interrupts configured while they are disabled                           */
+static void adxl345_set_interrupts(uint8_t enable, uint8_t to_int2)
+{
+    adxl345_write_register(ADXL345_INT_ENABLE, 0);
+    int_map = (int_map & ~enable) | to_int2;
+    int_enable |= enable;
+    adxl345_write_register(ADXL345_INT_MAP, int_map);
+    adxl345_write_register(ADXL345_INT_ENABLE, int_enable);
+}
 
-    CS_PORT |=  (1 << CS_BIT);
+static void adxl345_setup_events(void)
+{
+    if (PCMSK2 & INT_MASK)
+        return;
+    INT_DDR &= ~INT_MASK;
+    PCMSK2  |= INT_MASK;
+    PCICR   |= (1 << PCIE2);
+}
+
+void adxl345_on_event(adxl345_callback_t callback)
+{
+    event_callback = callback;
+}
+
+void adxl345_fifo_stream(uint8_t watermark)
+{
+    if (watermark > 31)
+        watermark = 31;
+    adxl345_write_register(ADXL345_FIFO_CTL, ADXL345_FIFO_STREAM | watermark);
+    if (watermark) {
+        adxl345_setup_events();
+        adxl345_set_interrupts(ADXL345_EVENT_WATERMARK, ADXL345_EVENT_WATERMARK);
+    }
+}
+
+void adxl345_enable_activity(uint8_t threshold, uint8_t inactivity_threshold, uint8_t inactivity_s)
+{
+    adxl345_setup_events();
+    adxl345_write_register(ADXL345_THRESH_ACT,    threshold);
+    adxl345_write_register(ADXL345_THRESH_INACT,  inactivity_threshold);
+    adxl345_write_register(ADXL345_TIME_INACT,    inactivity_s);
+    adxl345_write_register(ADXL345_ACT_INACT_CTL, 0xFF);     /* ac, x/y/z  */
+
+    /* Linked: after an activity the chip waits for inactivity before it   */
+    /* reports activity again, one interrupt per shake instead of a stream */
+    adxl345_write_register(ADXL345_POWER_CTL, ADXL345_LINK | ADXL345_MEASURE_MODE);
+    adxl345_set_interrupts(ADXL345_EVENT_ACTIVITY | ADXL345_EVENT_INACTIVITY, 0);
+}
+
+void adxl345_enable_tap(uint8_t threshold, uint8_t duration)
+{
+    adxl345_setup_events();
+    adxl345_write_register(ADXL345_THRESH_TAP, threshold);
+    adxl345_write_register(ADXL345_DUR,        duration);
+    adxl345_write_register(ADXL345_TAP_AXES,   0x07);        /* x/y/z       */
+    adxl345_set_interrupts(ADXL345_EVENT_SINGLE_TAP, 0);
+}
+
+void adxl345_poll(void)
+{
+    /* Also look at the pins: an edge before the pin change interrupt was  */
+    /* set up, or one while the pin was already high, is never signalled   */
+    if (!int_pending && !(INT_PIN & INT_MASK))
+        return;
+    int_pending = 0;
+
+    /* Reading INT_SOURCE clears the activity and tap bits; the watermark  */
+    /* clears when the FIFO is read below it                               */
+    uint8_t sources = adxl345_read_register(ADXL345_INT_SOURCE) & int_enable;
+    if (sources && event_callback)
+        event_callback(sources);
+}
+
+uint8_t adxl345_read_fifo(adxl345_sample_t *samples, uint8_t max)
+{
+    uint8_t entries = adxl345_read_register(ADXL345_FIFO_STATUS) & 0x3F;
+    if (entries > max)
+        entries = max;
+
+    /* Each entry is one X/Y/Z burst; the chip moves the next one into the  */
+    /* data registers 5 us after CS goes high                               */
+    for (uint8_t i = 0; i < entries; i++) {
+        if (i)
+            _delay_us(5);
+        adxl345_read_xyz(&samples[i].x, &samples[i].y, &samples[i].z);
+    }
+    return entries;
 }
@@ -1,6 +1,11 @@
 #pragma once
 #include <inttypes.h>
 
+/* 1: the module is wired to the hardware SPI pins and driven by lib/spi.    */
+/* 0: the J9 wiring of the sensor extension board, bit-banged                */
+#ifndef ADXL345_HW_SPI
+#define ADXL345_HW_SPI 0
+#endif
 
 
 void adxl345_init(void);
@@ -16,4 +21,55 @@ void adxl345_write_register(uint8_t reg, uint8_t value);
 /// @param x 
 /// @param y 
 /// @param z 
-void adxl345_read_xyz(int16_t *x, int16_t *y, int16_t *z);
\ No newline at end of file
+void adxl345_read_xyz(int16_t *x, int16_t *y, int16_t *z);
+
+/* ---- FIFO and interrupts --------------------------------------------------
+ * In stream mode the chip's FIFO always holds the last 32 samples, at 100 Hz
+ * the last 320 ms, and adxl345_read_fifo() drains them in one go when they
+ * are needed. The activity and tap engines watch every sample on the chip and
+ * raise INT1 (PK5); the FIFO watermark raises INT2 (PK6). A pin change
+ * interrupt on PK5/PK6 only wakes the main loop: adxl345_poll() reads which
+ * events happened and hands them to the callback, so nothing is polled over
+ * SPI while the sensor is quiet.
+ */
+
+/* Event bits passed to the callback, as in the INT_SOURCE register          */
+#define ADXL345_EVENT_SINGLE_TAP 0x40
+#define ADXL345_EVENT_ACTIVITY   0x10
+#define ADXL345_EVENT_INACTIVITY 0x08
+#define ADXL345_EVENT_WATERMARK  0x02
+
+typedef struct {
+    int16_t x, y, z;
+} adxl345_sample_t;
+
+typedef void (*adxl345_callback_t)(uint8_t events);
+
+/// @brief Set the function adxl345_poll() reports events to.
+void adxl345_on_event(adxl345_callback_t callback);
+
+/// @brief Keep the last 32 samples in the FIFO.
+/// @param watermark With 1 to 31, INT2 is raised while the FIFO holds that many
+/// samples, until it is read below; 0 for no interrupt.
+void adxl345_fifo_stream(uint8_t watermark);
+
+/// @brief Report a change in acceleration of more than threshold on any axis as
+/// ADXL345_EVENT_ACTIVITY, then ADXL345_EVENT_INACTIVITY once it stayed below
+/// inactivity_threshold for inactivity_s seconds. Each is reported once, in turn.
+/// @param threshold 62.5 mg per step.
+/// @param inactivity_threshold 62.5 mg per step.
+/// @param inactivity_s 1 s per step.
+void adxl345_enable_activity(uint8_t threshold, uint8_t inactivity_threshold, uint8_t inactivity_s);
+
+/// @brief Report a shock above threshold that is shorter than duration as
+/// ADXL345_EVENT_SINGLE_TAP.
+/// @param threshold 62.5 mg per step.
+/// @param duration 625 us per step.
+void adxl345_enable_tap(uint8_t threshold, uint8_t duration);
+
+/// @brief Call from the main loop. Returns at once unless INT1/INT2 is raised.
+void adxl345_poll(void);
+
+/// @brief Read up to max samples from the FIFO, oldest first.
+/// @return The number of samples read.
+uint8_t adxl345_read_fifo(adxl345_sample_t *samples, uint8_t max);
@@ -1,5 +1,6 @@
 #include "buttons.h"
 #include "includes.h"
+#include "timers.h"
 
 /* -------------------------------------------------------------------------- */
 /*  Windows/unit-test build: provide dummy I/O-register storage               */
@@ -9,6 +10,8 @@ uint8_t DDRF, PORTF, PINF;
 #endif
 /* -------------------------------------------------------------------------- */
 
+TIMERS_CLAIM(TIMER1_COMPC);
+
 #define B_1   PF1
 #define B_2   PF2
 #define B_3   PF3
@@ -17,11 +20,113 @@ uint8_t DDRF, PORTF, PINF;
 #define B_PORT PORTF
 #define B_PIN  PINF
 
+#define B_MASK ((1 << B_1) | (1 << B_2) | (1 << B_3))
+
+#define SCAN_TICKS   ((uint16_t)BUTTONS_SCAN_MS * TIMER1_TICKS_PER_MS)
+#define LONG_SCANS   (BUTTONS_LONG_MS / BUTTONS_SCAN_MS)
+#define DOUBLE_SCANS (BUTTONS_DOUBLE_MS / BUTTONS_SCAN_MS)
+
+#if LONG_SCANS > 255 || DOUBLE_SCANS > 255
+#error "BUTTONS_LONG_MS and BUTTONS_DOUBLE_MS must be at most 255 scans"
+#endif
+
+static const uint8_t bits[BUTTONS_COUNT] = { B_1, B_2, B_3 };
+
+typedef struct {
+    uint8_t pressed;    /* debounced state                                  */
+    uint8_t stable;     /* scans the pin differed from it in a row          */
+    uint8_t held;       /* scans since the press, up to LONG_SCANS          */
+    uint8_t released;   /* scans since the release, up to DOUBLE_SCANS      */
+} button_state_t;
+
+static button_state_t state[BUTTONS_COUNT];
+
+/* Events: the interrupt writes head, the main context tail                  */
+static volatile buttons_event_t queue[BUTTONS_QUEUE_SIZE];
+static volatile uint8_t queue_head, queue_tail;
+
+static void buttons_push(uint8_t button, buttons_event_type_t type)
+{
+    uint8_t next = (queue_head + 1) & (BUTTONS_QUEUE_SIZE - 1);
+    if (next == queue_tail)
+        return;                     /* full: nobody is reading              */
+    queue[queue_head].button = button;
+    queue[queue_head].type = type;
+    queue_head = next;
+}
+
 void buttons_init(void)
 {
     /* inputs with pull-ups */
-    B_DDR  &= ~((1 << B_1) | (1 << B_2) | (1 << B_3));
-    B_PORT |=  ((1 << B_1) | (1 << B_2) | (1 << B_3));
+    B_DDR  &= ~B_MASK;
+    B_PORT |=  B_MASK;
+
+    for (uint8_t i = 0; i < BUTTONS_COUNT; i++) {
+        state[i].pressed = state[i].stable = state[i].held = 0;
+        state[i].released = DOUBLE_SCANS;
+    }
+    queue_head = queue_tail = 0;
+
+    /* Timer1 runs free; the compare value moves one scan ahead per interrupt */
+    uint8_t sreg = SREG;
+    cli();
+    timer1_start();
+    OCR1C = timer1_now() + SCAN_TICKS;
+    TIFR1 = (1 << OCF1C);
+    TIMSK1 |= (1 << OCIE1C);
+    SREG = sreg;
+}
+
+#ifndef WINDOWS_TEST
+ISR(TIMER1_COMPC_vect)
+#else
+void TIMER1_COMPC_vect(void)
+#endif
+{
+    OCR1C += SCAN_TICKS;
+
+    uint8_t pins = ~B_PIN;          /* active low                           */
+    for (uint8_t i = 0; i < BUTTONS_COUNT; i++) {
+        button_state_t *b = &state[i];
+        uint8_t down = (pins >> bits[i]) & 1;
+
+        if (b->pressed) {
+            if (b->held < LONG_SCANS && ++b->held == LONG_SCANS)
+                buttons_push(i + 1, BUTTONS_LONG_PRESS);
+        } else if (b->released < DOUBLE_SCANS) {
+            b->released++;
+        }
+
+        if (down == b->pressed) {
+            b->stable = 0;
+            continue;
+        }
+        if (++b->stable < BUTTONS_DEBOUNCE_SCANS)
+            continue;
+
+        b->stable = 0;
+        b->pressed = down;
+        if (down) {
+            buttons_push(i + 1, BUTTONS_PRESS);
+            if (b->released < DOUBLE_SCANS)
+                buttons_push(i + 1, BUTTONS_DOUBLE_PRESS);
+            b->held = 0;
+        } else {
+            buttons_push(i + 1, BUTTONS_RELEASE);
+            b->released = 0;
+        }
+    }
+}
+
+uint8_t buttons_read_event(buttons_event_t *event)
+{
+    uint8_t tail = queue_tail;
+    if (tail == queue_head)
+        return 0;
+    event->button = queue[tail].button;
+    event->type = queue[tail].type;
+    queue_tail = (tail + 1) & (BUTTONS_QUEUE_SIZE - 1);
+    return 1;
 }
 
 uint8_t buttons_1_pressed(void) { return !(B_PIN & (1 << B_1)); }
@@ -1,7 +1,68 @@
+/*  buttons.h – the three push buttons of the multi-function shield, PF1-PF3
+ *
+ *  PORTF has no pin change interrupts on the ATmega2560, so a Timer-1
+ *  compare interrupt samples the buttons every BUTTONS_SCAN_MS. A button
+ *  changes state once it read the same for BUTTONS_DEBOUNCE_SCANS scans in
+ *  a row, and the interrupt puts the events into a queue. The main loop
+ *  takes them with buttons_read_event(), so each press acts exactly once:
+ *
+ *      buttons_event_t e;
+ *      while (buttons_read_event(&e))
+ *          if (e.button == 1 && e.type == BUTTONS_PRESS) ...
+ *
+ *  Every press gives BUTTONS_PRESS and BUTTONS_RELEASE. Holding a button for
+ *  BUTTONS_LONG_MS adds one BUTTONS_LONG_PRESS; a press within
+ *  BUTTONS_DOUBLE_MS of the previous release adds BUTTONS_DOUBLE_PRESS.
+ */
+#pragma once
 #include <stdint.h>
 
+#define BUTTONS_COUNT 3
+
+#ifndef BUTTONS_SCAN_MS
+#define BUTTONS_SCAN_MS 10
+#endif
+
+#ifndef BUTTONS_DEBOUNCE_SCANS
+#define BUTTONS_DEBOUNCE_SCANS 3
+#endif
+
+#ifndef BUTTONS_LONG_MS
+#define BUTTONS_LONG_MS 800
+#endif
+
+#ifndef BUTTONS_DOUBLE_MS
+#define BUTTONS_DOUBLE_MS 300
+#endif
+
+/* Events the queue holds; a power of two                                    */
+#ifndef BUTTONS_QUEUE_SIZE
+#define BUTTONS_QUEUE_SIZE 8
+#endif
+
+#if (BUTTONS_QUEUE_SIZE & (BUTTONS_QUEUE_SIZE - 1)) != 0 || BUTTONS_QUEUE_SIZE > 128
+#error "BUTTONS_QUEUE_SIZE must be a power of two and at most 128"
+#endif
+
+typedef enum {
+    BUTTONS_PRESS,
+    BUTTONS_RELEASE,
+    BUTTONS_LONG_PRESS,
+    BUTTONS_DOUBLE_PRESS,
+} buttons_event_type_t;
+
+typedef struct {
+    uint8_t button;                 /* 1 to BUTTONS_COUNT                   */
+    buttons_event_type_t type;
+} buttons_event_t;
+
+/* Set up the pins and start the scan interrupt                              */
 void buttons_init();
-// Returns 1 if pressed and 0 if not pressed
+
+/* Take the oldest event. Returns 0 if there is none                         */
+uint8_t buttons_read_event(buttons_event_t *event);
+
+// Returns 1 if pressed and 0 if not pressed, the level of the pin right now
 uint8_t buttons_1_pressed(void);
 uint8_t buttons_2_pressed(void);
-uint8_t buttons_3_pressed(void);
\ No newline at end of file
+uint8_t buttons_3_pressed(void);
@@ -1,10 +1,14 @@
 #include "buzzer.h"
 #include "includes.h"
+#include "timers.h"
 
 #define BUZ_BIT PE5
 #define BUZ_DDR DDRE
 #define BUZ_PORT PORTE
 
+// PE5 is OC3C, driven as a plain GPIO
+TIMERS_CLAIM(TIMER3_COMPC);
+
 void buzzer_beep(){
 
     //Save the state of the 2 registers
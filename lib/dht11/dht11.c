@@ -1,109 +1,259 @@
 #include "dht11.h"
 #include "includes.h"
+#include "timers.h"
 
-//Data (The data goes both ways)
-#ifdef __AVR__
-    #define DATA_BIT PL1
-    #define DATA_PIN PINL
-    #define DATA_DDR DDRL
-    #define DATA_PORT PORTL
-#endif
+//Data (The data goes both ways). PL1 is ICP5, the capture input of Timer5
+#define DATA_BIT PL1
+#define DATA_PIN PINL
+#define DATA_DDR DDRL
+#define DATA_PORT PORTL
+
+TIMERS_CLAIM(TIMER5_CAPT);
+
+// The host holds the line low this long to wake the sensor (at least 18 ms)
+#define START_PULSE_MS 20
+// Response and 40 bits take about 4.5 ms
+#define FRAME_TIMEOUT_MS 10
+
+// Falling edges of a frame: the response, then the start of each of the 40 bits and
+// the low level after the last one. A bit is the time from its falling edge to the
+// next: 50 us low, then 26-28 us high for a 0 and 70 us high for a 1
+#define FRAME_EDGES 42
+#define BIT_MIN_TICKS (60 * TIMER1_TICKS_PER_US)
+#define BIT_ONE_TICKS (100 * TIMER1_TICKS_PER_US)
+#define BIT_MAX_TICKS (160 * TIMER1_TICKS_PER_US)
+
+// Timer1 ticks per count of Timer5 (16 MHz / 64, periodic_task)
+#define TIMER5_COUNT_TICKS 8
 
+enum
+{
+    IDLE,
+    WAITING,    // for the minimum interval since the last reading
+    START,      // start pulse on the line
+    RECEIVING   // capture interrupt decoding the frame
+};
 
-//#define DATA_BIT PD1
-//#define DATA_PIN PIND
-//#define DATA_DDR DDRD
-//#define DATA_PORT PORTD
+static uint8_t state = IDLE;
+static uint8_t attempts;
+static uint32_t deadline;
+static uint8_t has_read;
+static uint32_t last_read_ms; // start of the last reading
+static dht11_callback_t callback;
 
-//VCC
-//#define VCC_BIT PD0
-//#define VCC_DDR DDRD
-//#define VCC_PORT PORTD
+static DHT11_ERROR_MESSAGE_t status = DHT11_FAIL;
+static uint8_t values[4];
 
-//GND
-//#define GND_BIT PD2
-//#define GND_DDR DDRD
-//#define GND_PORT PORTD
+// Written by the capture interrupt while RECEIVING
+static volatile uint8_t edges;
+static volatile uint8_t frame_error;
+static volatile uint16_t last_edge;
+static volatile uint8_t data[5];
 
+static void dht11_capture_stop(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    TIMSK5 &= ~(1 << ICIE5);
+    SREG = sreg;
+}
 
 void dht11_init() {
+    timer1_start();
+    dht11_capture_stop();
+    state = IDLE;
+    has_read = 0;
+    status = DHT11_FAIL;
+    DATA_DDR &= ~(1 << DATA_BIT);
+    DATA_PORT |= (1 << DATA_BIT);
+}
+
+#ifndef WINDOWS_TEST
+ISR(TIMER5_CAPT_vect)
+#else
+void TIMER5_CAPT_vect(void)
+#endif
+{
+    // ICR5 holds the Timer5 count at the edge; how long ago that was is taken off the
+    // current Timer1 time. Timer5 counts up to OCR5A and restarts from 0. If it is
+    // stopped, ICR5 equals TCNT5 and the edge is timestamped now
+    uint16_t now = timer1_now();
+    uint16_t counts = TCNT5;
+    uint16_t captured = ICR5;
+    uint16_t age = counts >= captured ? counts - captured : counts + OCR5A + 1 - captured;
+    uint16_t edge = now - age * TIMER5_COUNT_TICKS;
+
+    uint8_t n = edges;
+    if (n >= 2)
+    {
+        uint16_t interval = edge - last_edge;
+        if (interval < BIT_MIN_TICKS || interval > BIT_MAX_TICKS)
+            frame_error = 1;
+        uint8_t byte = (n - 2) >> 3;
+        data[byte] <<= 1;
+        if (interval > BIT_ONE_TICKS)
+            data[byte] |= 1;
+    }
+    last_edge = edge;
+    if (++n >= FRAME_EDGES)
+        TIMSK5 &= ~(1 << ICIE5);
+    edges = n;
+}
+
+static void dht11_finish(DHT11_ERROR_MESSAGE_t result)
+{
+    state = IDLE;
+    status = result;
+    if (callback)
+        callback(result);
+}
+
+static uint8_t dht11_frame_ok(void)
+{
+    if (edges < FRAME_EDGES || frame_error)
+        return 0;
+    return data[4] == ((data[0] + data[1] + data[2] + data[3]) & 0xFF);
+}
 
-//Vcc
-//VCC_DDR|=(1<<VCC_BIT);
-//VCC_PORT|=(1<<VCC_BIT);
+DHT11_ERROR_MESSAGE_t dht11_start(dht11_callback_t done)
+{
+    if (state != IDLE)
+        return DHT11_BUSY;
+    callback = done;
+    attempts = 0;
+    state = WAITING;
+    dht11_poll();
+    return DHT11_OK;
+}
+
+void dht11_poll(void)
+{
+    uint32_t now = timers_millis();
+
+    switch (state)
+    {
+    case WAITING:
+        if (has_read && (int32_t)(now - (last_read_ms + DHT11_MIN_INTERVAL_MS)) < 0)
+            return;
+        has_read = 1;
+        last_read_ms = now;
+        DATA_DDR |= (1 << DATA_BIT);
+        DATA_PORT &= ~(1 << DATA_BIT);
+        deadline = now + START_PULSE_MS;
+        state = START;
+        break;
+
+    case START:
+        if ((int32_t)(now - deadline) < 0)
+            return;
+        {
+            uint8_t sreg = SREG;
+            cli();
+            edges = 0;
+            frame_error = 0;
+            for (uint8_t i = 0; i < sizeof(data); i++)
+                data[i] = 0;
+            // Falling edges, with the noise canceler; only the capture bits of TCCR5B
+            TCCR5B = (TCCR5B | (1 << ICNC5)) & ~(1 << ICES5);
+            TIFR5 = (1 << ICF5);
+            TIMSK5 |= (1 << ICIE5);
+            // Release the line; the pull-up holds it high until the sensor answers
+            DATA_DDR &= ~(1 << DATA_BIT);
+            DATA_PORT |= (1 << DATA_BIT);
+            SREG = sreg;
+        }
+        deadline = now + FRAME_TIMEOUT_MS;
+        state = RECEIVING;
+        break;
+
+    case RECEIVING:
+        if (edges < FRAME_EDGES && (int32_t)(now - deadline) < 0)
+            return;
+        dht11_capture_stop();
+        if (dht11_frame_ok())
+        {
+            for (uint8_t i = 0; i < sizeof(values); i++)
+                values[i] = data[i];
+            dht11_finish(DHT11_OK);
+        }
+        else if (attempts < DHT11_RETRIES)
+        {
+            attempts++;
+            state = WAITING;
+        }
+        else
+            dht11_finish(DHT11_FAIL);
+        break;
+
+    default:
+        break;
+    }
+}
+
+uint8_t dht11_busy(void)
+{
+    return state != IDLE;
+}
+
+uint32_t dht11_idle_ms(void)
+{
+    uint32_t until;
+
+    switch (state)
+    {
+    case WAITING:
+        if (!has_read)
+            return 0;
+        until = last_read_ms + DHT11_MIN_INTERVAL_MS;
+        break;
+    case START:
+        until = deadline;
+        break;
+    case RECEIVING:
+        if (edges >= FRAME_EDGES)
+            return 0;
+        until = deadline;
+        break;
+    default:
+        return UINT32_MAX;
+    }
 
-//GND
-//GND_DDR|=(1<<GND_BIT);
-//GND_PORT&=~(1<<GND_BIT);
+    int32_t left = (int32_t)(until - timers_millis());
+    return left > 0 ? (uint32_t)left : 0;
 }
 
+DHT11_ERROR_MESSAGE_t dht11_result(uint8_t* humidity_integer, uint8_t* humidity_decimal, uint8_t* temperature_integer, uint8_t* temperature_decimal)
+{
+    if (status != DHT11_OK)
+        return status;
+    if (humidity_integer != NULL)
+        *humidity_integer = values[0];
+    if (humidity_decimal != NULL)
+        *humidity_decimal = values[1];
+    if (temperature_integer != NULL)
+        *temperature_integer = values[2];
+    if (temperature_decimal != NULL)
+        *temperature_decimal = values[3];
+    return DHT11_OK;
+}
 
-#define MAX_TIMINGS	85
 DHT11_ERROR_MESSAGE_t dht11_get(uint8_t* humidity_integer, uint8_t*  humidity_decimal, uint8_t* temperature_integer, uint8_t* temperature_decimal)
 {
-    
-	uint8_t laststate	= 1;
-	uint8_t counter		= 0;
-	uint8_t j			= 0, i;
-    uint8_t data[5] ;
-	data[0] = data[1] = data[2] = data[3] = data[4] = 0;
-	/* pull pin down for 18 milliseconds */
-	
-    DATA_DDR |= (1 << DATA_BIT);
-    DATA_PORT &= ~(1<<DATA_BIT);
-    _delay_ms(18);
-
-    DATA_PORT |= (1<<DATA_BIT);
-    _delay_us(40);
-
-	/* prepare to read the pin */
-    DATA_DDR &= ~(1<<DATA_BIT);
-    DATA_PORT |= (1<<DATA_BIT); // Do I have to pullup?
-
-	/* detect change and read data */
-	for ( i = 0; i < MAX_TIMINGS; i++ )
-	{
-		counter = 0;
-		while ( (DATA_PIN&(1<<DATA_BIT)) == laststate )
-		{
-			counter++;
-			_delay_us( 1 );
-			if ( counter == 255 )
-			{
-				break;
-			}
-		}
-		laststate = (DATA_PIN&(1<<DATA_BIT));
-		if ( counter == 255 )
-			break;
-		/* ignore first 3 transitions */
-		if ( (i >= 4) && (i % 2 == 0) )
-		{
-			/* shove each bit into the storage bytes */
-			data[j / 8] <<= 1;
-			if ( counter > 26 )
-				data[j / 8] |= 1;
-			j++;
-		}
-	}
-	/*
-	 * check we read 40 bits (8bit x 5 ) + verify checksum in the last byte
-	 * print it out if data is good
-	 */
-	if ( (j >= 40) &&
-	     (data[4] == ( (data[0] + data[1] + data[2] + data[3]) & 0xFF) ) )
-	{
-		if (humidity_integer!=NULL)
-            *humidity_integer=data[0];
-		if (humidity_decimal!=NULL)
-            *humidity_decimal=data[1];
-        if (temperature_integer!=NULL)
-            *temperature_integer = data[2];
-        if (temperature_decimal!=NULL)
-            *temperature_decimal = data[3];
+    if (dht11_start(NULL) != DHT11_OK)
+        return DHT11_BUSY;
+    while (dht11_busy())
+        dht11_poll();
+
+    if (dht11_result(humidity_integer, humidity_decimal, temperature_integer, temperature_decimal) == DHT11_OK)
         return DHT11_OK;
-	}else  {
-        *humidity_integer=*humidity_decimal=*temperature_integer=*temperature_decimal =0;
-        return DHT11_FAIL;
-	}
-}
\ No newline at end of file
+
+    if (humidity_integer != NULL)
+        *humidity_integer = 0;
+    if (humidity_decimal != NULL)
+        *humidity_decimal = 0;
+    if (temperature_integer != NULL)
+        *temperature_integer = 0;
+    if (temperature_decimal != NULL)
+        *temperature_decimal = 0;
+    return DHT11_FAIL;
+}
@@ -1,56 +1,134 @@
 /**
  * @file dht11.h
  * @brief DHT11 Sensor Driver Header File
- * 
- * This header file provides the interface for interfacing with a DHT11 
+ *
+ * This header file provides the interface for interfacing with a DHT11
  * humidity and temperature sensor.
+ *
+ * A reading runs in the background. dht11_start() begins it and dht11_poll(), called
+ * from the main loop, moves it along: the 20 ms start pulse, the frame and the retries
+ * are deadlines on timers_millis(), so nothing waits. The data pin PL1 is ICP5, the
+ * input capture pin of Timer5; the capture interrupt timestamps every falling edge of
+ * the frame in hardware, and the bits are decoded from the time between the edges,
+ * undisturbed by other interrupts.
+ *
+ * The capture counts with the clock of Timer5, which periodic_task runs. Without it
+ * the edges are timestamped with Timer1 in the interrupt, which still decodes, but
+ * with the interrupt latency in every bit.
  */
 
 #pragma once
 
 #include <stdint.h>
 
+/**
+ * @brief Shortest time from the start of one reading to the start of the next. The
+ * sensor locks up when it is read more often.
+ *
+ */
+#ifndef DHT11_MIN_INTERVAL_MS
+#define DHT11_MIN_INTERVAL_MS 2000
+#endif
+
+/**
+ * @brief Number of times a reading is repeated after a bad frame (timeout or wrong
+ * checksum) before it fails. Every retry waits DHT11_MIN_INTERVAL_MS.
+ *
+ */
+#ifndef DHT11_RETRIES
+#define DHT11_RETRIES 2
+#endif
+
 /**
  * @brief DHT11 Error messages.
  */
 typedef enum{
     DHT11_OK,                         /**< Command successful. */
     DHT11_FAIL,                       /**< General failure or operation not successful. */
+    DHT11_BUSY,                       /**< A reading is already running. */
 } DHT11_ERROR_MESSAGE_t;
 
+/**
+ * @brief Called by dht11_poll() when a reading is finished.
+ *
+ * @param status DHT11_OK if the values can be fetched with dht11_result(), DHT11_FAIL
+ * if every attempt failed.
+ */
+typedef void (*dht11_callback_t)(DHT11_ERROR_MESSAGE_t status);
+
 /**
  * @brief Fetches humidity and temperature readings from the DHT11 sensor.
- * 
+ *
  * This function fetches the humidity and temperature readings from the DHT11 sensor.
- * The function can only be called once every 2 seconds to avoid sensor lock-up.
- * 
+ * It starts a reading and waits for it, so it blocks for at least 25 ms, and for
+ * DHT11_MIN_INTERVAL_MS more for each retry or when the last reading is too recent.
+ * Use dht11_start() where that is too long.
+ *
  * To only get specific data, pass NULL for the arguments that are not needed.
  * For example, to only get the humidity integer part, pass NULL for all other arguments.
- * 
+ *
  * @param[out] humidity_integer Pointer where the integer part of the humidity will be stored. Pass NULL if not needed.
  * @param[out] humidity_decimal Pointer where the decimal part of the humidity will be stored. Pass NULL if not needed.
  * @param[out] temperature_integer Pointer where the integer part of the temperature will be stored. Pass NULL if not needed.
  * @param[out] temperature_decimal Pointer where the decimal part of the temperature will be stored. Pass NULL if not needed.
- * 
- * @return DHT11_ERROR_MESSAGE_t Status of the read operation (DHT11_OK if successful, DHT11_FAIL otherwise).
- * 
- * @note This function should be called once every 2 seconds at most.
- * 
+ *
+ * @return DHT11_ERROR_MESSAGE_t Status of the read operation (DHT11_OK if successful,
+ * DHT11_BUSY if dht11_start() is still reading, DHT11_FAIL otherwise; the values are 0 then).
+ *
  * @code{.c}
  *  Example usage:
  *      uint8_t humidity_integer, humidity_decimal, temperature_integer, temperature_decimal;
  *      char str[64];
  *      if (dht11_get(&humidity_integer, &humidity_decimal, &temperature_integer, &temperature_decimal) == DHT11_OK) {
- *          sprintf(str, "Humidity = %d.%d%% and the temperature = %d.%d C\n\n", 
+ *          sprintf(str, "Humidity = %d.%d%% and the temperature = %d.%d C\n\n",
  *              humidity_integer, humidity_decimal, temperature_integer, temperature_decimal);
  *      }
  * @endcode
  */
 DHT11_ERROR_MESSAGE_t dht11_get(uint8_t* humidity_integer, uint8_t*  humidity_decimal, uint8_t* temperature_integer, uint8_t* temperature_decimal);
 
+/**
+ * @brief Start a reading in the background. It begins as soon as DHT11_MIN_INTERVAL_MS
+ * have passed since the last one.
+ *
+ * @param callback Called from dht11_poll() when the reading is finished, or NULL.
+ * @return DHT11_ERROR_MESSAGE_t DHT11_OK, or DHT11_BUSY if a reading is already running.
+ */
+DHT11_ERROR_MESSAGE_t dht11_start(dht11_callback_t callback);
+
+/**
+ * @brief Move a running reading along. Call it from the main loop.
+ *
+ */
+void dht11_poll(void);
+
+/**
+ * @brief Check whether a reading is running.
+ *
+ * @return uint8_t 1 from dht11_start() until the reading is finished.
+ */
+uint8_t dht11_busy(void);
+
+/**
+ * @brief Time until dht11_poll() has something to do, to sleep in between.
+ *
+ * @return uint32_t 0 if it has something to do now, the milliseconds until its next
+ * deadline otherwise, UINT32_MAX if no reading is running.
+ */
+uint32_t dht11_idle_ms(void);
+
+/**
+ * @brief Fetch the values of the last finished reading. NULL arguments are skipped,
+ * as in dht11_get().
+ *
+ * @return DHT11_ERROR_MESSAGE_t DHT11_OK if the last reading succeeded, DHT11_FAIL if
+ * it failed or there was none yet (the values are left unchanged then).
+ */
+DHT11_ERROR_MESSAGE_t dht11_result(uint8_t* humidity_integer, uint8_t* humidity_decimal, uint8_t* temperature_integer, uint8_t* temperature_decimal);
+
 
 void dht11_init();
 
 #ifdef __AVR__
 #include <avr/io.h>
-#endif
\ No newline at end of file
+#endif
@@ -1,5 +1,6 @@
 #include "display.h"
 #include "includes.h"
+#include "timers.h"
 
 #ifdef __AVR__
 #include <avr/io.h>
@@ -19,6 +20,8 @@
 #define CLOCK_DDR DDRH
 #define CLOCK_PORT PORTH
 
+TIMERS_CLAIM(TIMER1_COMPA);
+
 const static uint8_t hex_digits[] = {
     0b00111111, // 0
     0b00000110, // 1
@@ -107,24 +110,23 @@ void display_init()
     DATA_DDR |= (1 << DATA_BIT); 
     CLOCK_DDR|= (1 << CLOCK_BIT);
 
-    // Set up Timer1 for CTC mode (Clear Timer on Compare Match)
-    TCCR1B |= (1 << WGM12);
-
-    // Set the compare value for 1 ms interrupt
-    OCR1A = 16000000 / 8 / 1000 - 1;
+    // Timer1 runs free for everyone; the compare value is moved 1 ms ahead on
+    // every interrupt, so nobody needs to reset or reconfigure the timer
+    timer1_start();
+    OCR1A = timer1_now() + TIMER1_TICKS_PER_MS;
+    TIFR1 = (1 << OCF1A);
 
     // Enable the Timer1 compare match A interrupt
     TIMSK1 |= (1 << OCIE1A);
 
-    // Set the prescaler to 8
-    TCCR1B |= (1 << CS11);
-
     sei();
     display_data[0] = display_data[1] = display_data[2] = display_data[3] = 17;
 }
 #ifndef WINDOWS_TEST
 ISR(TIMER1_COMPA_vect)
 {
+    OCR1A += TIMER1_TICKS_PER_MS;
+
     uint8_t static current_digit = 0;
     LATCH_PORT &= ~(1 << LATCH_BIT);
     shift_out(~hex_digits[display_data[current_digit]]);
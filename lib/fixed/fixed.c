@@ -0,0 +1,83 @@
+/**
+ * @file fixed.c
+ * @brief Fixed-point arithmetic implementation
+ *
+ * Divisions work on magnitudes and round with the remainder, so no intermediate sum
+ * can overflow; the sign is applied at the end.
+ */
+
+#include "fixed.h"
+
+static uint32_t fixed_magnitude(int32_t x)
+{
+    return x < 0 ? (uint32_t)0 - (uint32_t)x : (uint32_t)x;
+}
+
+// numerator / denominator rounded to nearest, ties away from zero
+static uint32_t fixed_divide_round(uint32_t numerator, uint32_t denominator)
+{
+    uint32_t quotient = numerator / denominator;
+    uint32_t remainder = numerator % denominator;
+    if (remainder >= denominator - remainder)
+        quotient++;
+    return quotient;
+}
+
+static int32_t fixed_signed_ratio(int32_t numerator, int32_t denominator, uint8_t shift, uint32_t max)
+{
+    uint8_t negative = (numerator < 0) != (denominator < 0);
+    uint32_t quotient = fixed_divide_round(fixed_magnitude(numerator) << shift, fixed_magnitude(denominator));
+    if (negative)
+        return quotient >= max + 1 ? -(int32_t)max - 1 : -(int32_t)quotient;
+    return quotient > max ? (int32_t)max : (int32_t)quotient;
+}
+
+q8_8_t fixed_q8_8_mul(q8_8_t a, q8_8_t b)
+{
+    int32_t product = ((int32_t)a * b + 0x80) >> 8;
+    if (product > INT16_MAX)
+        return INT16_MAX;
+    if (product < INT16_MIN)
+        return INT16_MIN;
+    return (q8_8_t)product;
+}
+
+q8_8_t fixed_q8_8_ratio(int32_t numerator, int32_t denominator)
+{
+    return (q8_8_t)fixed_signed_ratio(numerator, denominator, 8, INT16_MAX);
+}
+
+q16_16_t fixed_q16_16_mul(q16_16_t a, q16_16_t b)
+{
+    int64_t product = ((int64_t)a * b + 0x8000) >> 16;
+    if (product > INT32_MAX)
+        return INT32_MAX;
+    if (product < INT32_MIN)
+        return INT32_MIN;
+    return (q16_16_t)product;
+}
+
+q16_16_t fixed_q16_16_ratio(int32_t numerator, int32_t denominator)
+{
+    return fixed_signed_ratio(numerator, denominator, 16, INT32_MAX);
+}
+
+int32_t fixed_map(int32_t x, int32_t in_from, int32_t in_to, int32_t out_from, int32_t out_to)
+{
+    if (in_from < in_to ? x <= in_from : x >= in_from)
+        return out_from;
+    if (in_from < in_to ? x >= in_to : x <= in_to)
+        return out_to;
+
+    // x is strictly inside the input range, so the step is below the output span
+    uint32_t step = fixed_divide_round(fixed_magnitude(x - in_from) * fixed_magnitude(out_to - out_from),
+                                       fixed_magnitude(in_to - in_from));
+    return out_to >= out_from ? out_from + (int32_t)step : out_from - (int32_t)step;
+}
+
+uint8_t fixed_percent(uint32_t part, uint32_t whole)
+{
+    if (part >= whole)
+        return 100;
+    return (uint8_t)fixed_divide_round(part * 100, whole);
+}
@@ -0,0 +1,101 @@
+/**
+ * @file fixed.h
+ * @brief Fixed-point arithmetic for ATmega2560
+ *
+ * The AVR has no floating point unit; a float expression links the soft-float library
+ * (several kB of flash) and costs hundreds of cycles per operation. The sensor and
+ * actuator math only scales integers, so it is done in integers here:
+ *
+ * - Q8.8 (int16_t) and Q16.16 (int32_t): signed numbers with 8 and 16 fraction bits.
+ *   FIXED_Q8_8(0.25) turns a constant into Q8.8 at compile time.
+ * - fixed_map(): a linear map between two ranges, saturated to the output range, e.g.
+ *   a raw ADC reading to percent.
+ * - fixed_percent(): a part of a whole in percent.
+ *
+ * Every result is rounded to nearest, and saturated where it could overflow.
+ */
+
+#pragma once
+#include <stdint.h>
+
+/**
+ * @brief Signed fixed-point numbers: Q8.8 from -128 to 127.996, Q16.16 from -32768 to
+ * 32767.99998.
+ *
+ */
+typedef int16_t q8_8_t;
+typedef int32_t q16_16_t;
+
+#define FIXED_Q8_8_ONE ((q8_8_t)1 << 8)
+#define FIXED_Q16_16_ONE ((q16_16_t)1 << 16)
+
+/**
+ * @brief Convert a constant to fixed point, rounded to nearest. Only for constant
+ * expressions, which the compiler folds; a variable argument would pull in floats.
+ *
+ */
+#define FIXED_Q8_8(c) ((q8_8_t)((c) * 256.0 + ((c) < 0 ? -0.5 : 0.5)))
+#define FIXED_Q16_16(c) ((q16_16_t)((c) * 65536.0 + ((c) < 0 ? -0.5 : 0.5)))
+
+/**
+ * @brief Integer part, rounded towards minus infinity.
+ *
+ */
+#define FIXED_Q8_8_INT(q) ((int16_t)((q) >> 8))
+#define FIXED_Q16_16_INT(q) ((int32_t)((q) >> 16))
+
+/**
+ * @brief Multiply two Q8.8 numbers.
+ *
+ * @return q8_8_t The product, saturated to the Q8.8 range.
+ */
+q8_8_t fixed_q8_8_mul(q8_8_t a, q8_8_t b);
+
+/**
+ * @brief Divide two integers to a Q8.8 number.
+ *
+ * @param numerator The dividend, -16777215 to 16777215.
+ * @param denominator The divisor, not 0.
+ * @return q8_8_t The quotient, saturated to the Q8.8 range.
+ */
+q8_8_t fixed_q8_8_ratio(int32_t numerator, int32_t denominator);
+
+/**
+ * @brief Multiply two Q16.16 numbers.
+ *
+ * @return q16_16_t The product, saturated to the Q16.16 range.
+ */
+q16_16_t fixed_q16_16_mul(q16_16_t a, q16_16_t b);
+
+/**
+ * @brief Divide two integers to a Q16.16 number.
+ *
+ * @param numerator The dividend, -65535 to 65535.
+ * @param denominator The divisor, not 0.
+ * @return q16_16_t The quotient, saturated to the Q16.16 range.
+ */
+q16_16_t fixed_q16_16_ratio(int32_t numerator, int32_t denominator);
+
+/**
+ * @brief Map x linearly from [in_from, in_to] to [out_from, out_to], rounded to nearest.
+ * A value outside the input range gives the nearer end of the output range. Either
+ * range may run downwards, e.g. a sensor whose reading falls as its quantity rises.
+ *
+ * @param x The value to map.
+ * @param in_from Input that maps to out_from.
+ * @param in_to Input that maps to out_to, not equal to in_from.
+ * @param out_from Output for in_from.
+ * @param out_to Output for in_to.
+ * @return int32_t The mapped value, between out_from and out_to. The differences of
+ * the ends of each range must fit in 16 bits.
+ */
+int32_t fixed_map(int32_t x, int32_t in_from, int32_t in_to, int32_t out_from, int32_t out_to);
+
+/**
+ * @brief A part of a whole in percent, rounded to nearest.
+ *
+ * @param part The part, at most 42949672; larger than whole gives 100.
+ * @param whole The whole, not 0.
+ * @return uint8_t 0 to 100.
+ */
+uint8_t fixed_percent(uint32_t part, uint32_t whole);
@@ -1,30 +1,11 @@
 /*  hc_sr04.c – HC-SR04 ultrasonic sensor driver
  *  Builds on AVR targets **and** in the Windows / native unit-test runner.
  */
+#include "hc_sr04.h"
 #include "includes.h"
+#include "timers.h"
 #include <inttypes.h>
 
-/* --------------------------------------------------------------------------
- *  Desktop-test glue
- *  -----------------
- *  The mock header declares an 8-bit `extern uint8_t TCNT1;`, but the
- *  Windows tests need a full 16-bit counter.  Rather than touching the
- *  header we                   *alias* the wide variable to a new name
- *  (`TCNT1_word`) and map all driver references through a macro.  The mock
- *  symbol is left untouched and will simply be ignored.
- * ------------------------------------------------------------------------ */
-#if !defined(__AVR__)                       /* -------- host / unit-tests ---- */
-
-#define TCNT1            TCNT1_word         /* all later code sees “word”     */
-extern uint16_t          TCNT1_word;        /* storage comes from test file   */
-
-#include "mock_avr_io.h"                    /* brings in register names       */
-
-#else                                       /* -------- on real AVR ---------- */
-#include "mock_avr_io.h"
-#endif
-/* ------------------------------------------------------------------------- */
-
 /* ---- Pin aliases (Arduino Mega 2560: 42 = PL7 / 43 = PL6) ---------------- */
 #define DDR_TRIG   DDRL
 #define PORT_TRIG  PORTL
@@ -33,10 +14,31 @@ extern uint16_t          TCNT1_word;        /* storage comes from test file   */
 #define PIN_ECHO   PINL
 #define BIT_ECHO   PL6
 
+/* PL6 has neither an input capture unit nor a pin change interrupt, so the   */
+/* background measurement samples the echo from a Timer-1 compare interrupt   */
+TIMERS_CLAIM(TIMER1_COMPB);
+
+#define SAMPLE_TICKS   (HC_SR04_SAMPLE_US * TIMER1_TICKS_PER_US)
+#define RISE_TIMEOUT   (5U * TIMER1_TICKS_PER_MS)    /* echo starts ~0.5 ms  */
+#define ECHO_MAX       (24U * TIMER1_TICKS_PER_MS)   /* ~4 m, as below       */
+
+enum { IDLE, WAIT_RISE, WAIT_FALL, DONE };
+
+static volatile uint8_t  state = IDLE;
+static volatile uint16_t edge;               /* trigger, then rising edge   */
+static volatile uint16_t echo_ticks;         /* 0: no echo                  */
+
+static int8_t   temperature_c = 20;
+static uint16_t window[HC_SR04_MEDIAN_WINDOW];
+static uint8_t  window_next, window_count;
+
 /* ------------------------------------------------------------------------- */
 void hc_sr04_init(void)
 {
     DDR_TRIG |= (1 << BIT_TRIG);            /* Trigger pin → output          */
+    timer1_start();                         /* shared free-running counter   */
+    state = IDLE;
+    window_next = window_count = 0;
 }
 
 /* ------------------------------------------------------------------------- */
@@ -48,29 +50,139 @@ uint16_t hc_sr04_takeMeasurement(void)
     _delay_us(10);
     PORT_TRIG &= ~(1 << BIT_TRIG);
 
-    /* 2 · Borrow Timer-1 (prescaler 256) ---------------------------------- */
-    uint8_t saved_TCCR1B = TCCR1B;
-    TCCR1B  = (1 << CS12);                  /* 16 MHz / 256 ≈ 62.5 kHz        */
-
-    /* 3 · Wait for rising edge – abort ≥100 ms ---------------------------- */
+    /* 2 · Wait for rising edge – abort ≥100 ms ---------------------------- */
+    /*     Timer-1 runs free at 2 MHz and is shared, so it is only read; the   */
+    /*     wait is summed up over its wrap-arounds                            */
+    uint16_t last = timer1_now();
+    uint32_t waited = 0;
     while (!(PIN_ECHO & (1 << BIT_ECHO))) {
-        if (TCNT1 >= (uint16_t)((F_CPU / 256) * 0.10)) {
-            TCCR1B = saved_TCCR1B;
+        uint16_t now = timer1_now();
+        waited += (uint16_t)(now - last);
+        last = now;
+        if (waited >= 100UL * TIMER1_TICKS_PER_MS)
             return 0;                       /* sensor missing / timeout      */
-        }
     }
 
-    /* 4 · Measure HIGH pulse – clamp at 24 ms (~4 m) ---------------------- */
-    TCNT1 = 0;
+    /* 3 · Measure HIGH pulse – clamp at 24 ms (~4 m) ---------------------- */
+    uint16_t start = timer1_now();
     while (PIN_ECHO & (1 << BIT_ECHO)) {
-        if (TCNT1 >= (uint16_t)((F_CPU / 256) * 0.024))
+        if ((uint16_t)(timer1_now() - start) >= 24U * TIMER1_TICKS_PER_MS)
             break;
     }
 
-    uint16_t ticks = TCNT1;
-    TCCR1B = saved_TCCR1B;                  /* restore prescaler             */
+    uint16_t ticks = timer1_now() - start;
 
-    /* 5 · ticks·256 / 16 MHz = time → distance [cm] = time·34300 / 2
-     *    ⇒ ticks·343 / 125                                              */
-    return (uint16_t)(ticks * 343UL / 125UL);
+    /* 4 · ticks / 2 MHz = time → distance [cm] = time·34300 / 2
+     *    ⇒ ticks·343 / 40000                                            */
+    return (uint16_t)(ticks * 343UL / 40000UL);
+}
+
+
+/* ---- Background measurement --------------------------------------------- */
+#ifndef WINDOWS_TEST
+ISR(TIMER1_COMPB_vect)
+#else
+void TIMER1_COMPB_vect(void)
+#endif
+{
+    /* The edge lies between the previous sample and this one: on average    */
+    /* the rising and the falling edge are off by the same amount            */
+    uint16_t now = timer1_now();
+    uint8_t  high = PIN_ECHO & (1 << BIT_ECHO);
+    uint16_t since = now - edge;
+
+    if (state == WAIT_RISE) {
+        if (high) {
+            edge = now;
+            state = WAIT_FALL;
+        } else if (since >= RISE_TIMEOUT) {
+            echo_ticks = 0;                 /* sensor missing                */
+            state = DONE;
+        }
+    } else if (state == WAIT_FALL) {
+        if (!high || since >= ECHO_MAX) {
+            echo_ticks = since;
+            state = DONE;
+        }
+    }
+
+    /* The next sample counts from now, so a late interrupt does not wait    */
+    /* for the counter to wrap around                                        */
+    if (state == DONE)
+        TIMSK1 &= ~(1 << OCIE1B);
+    else
+        OCR1B = now + SAMPLE_TICKS;
+}
+
+uint8_t hc_sr04_ping(void)
+{
+    if (state != IDLE)
+        return 0;
+
+    _delay_us(10);
+    PORT_TRIG |=  (1 << BIT_TRIG);
+    _delay_us(10);
+    PORT_TRIG &= ~(1 << BIT_TRIG);
+
+    uint8_t sreg = SREG;
+    cli();
+    edge = timer1_now();
+    state = WAIT_RISE;
+    OCR1B = edge + SAMPLE_TICKS;
+    TIFR1 = (1 << OCF1B);
+    TIMSK1 |= (1 << OCIE1B);
+    SREG = sreg;
+    return 1;
+}
+
+uint8_t hc_sr04_busy(void)
+{
+    return state == WAIT_RISE || state == WAIT_FALL;
+}
+
+void hc_sr04_set_temperature(int8_t celsius)
+{
+    temperature_c = celsius;
+}
+
+/* Speed of sound: 331.3 m/s + 0.606 m/s per °C, in 0.1 m/s                  */
+static uint16_t hc_sr04_to_cm(uint16_t ticks)
+{
+    uint16_t speed_dm_s = 3313 + (606 * (int16_t)temperature_c + (temperature_c < 0 ? -50 : 50)) / 100;
+
+    /* ticks / 2 MHz = time → distance [cm] = time · speed · 100 / 2         */
+    /*    ⇒ ticks · speed[0.1 m/s] / 400000, rounded                         */
+    return (uint16_t)(((uint32_t)ticks * speed_dm_s + 200000UL) / 400000UL);
+}
+
+uint8_t hc_sr04_poll(void)
+{
+    if (state != DONE)
+        return 0;
+    uint16_t ticks = echo_ticks;
+    state = IDLE;
+
+    window[window_next] = hc_sr04_to_cm(ticks);
+    if (++window_next >= HC_SR04_MEDIAN_WINDOW)
+        window_next = 0;
+    if (window_count < HC_SR04_MEDIAN_WINDOW)
+        window_count++;
+    return 1;
+}
+
+uint16_t hc_sr04_distance_cm(void)
+{
+    if (window_count == 0)
+        return 0;
+
+    /* Insertion sort of a copy; the window is small                         */
+    uint16_t sorted[HC_SR04_MEDIAN_WINDOW];
+    for (uint8_t i = 0; i < window_count; i++) {
+        uint16_t value = window[i];
+        uint8_t j = i;
+        for (; j > 0 && sorted[j - 1] > value; j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = value;
+    }
+    return sorted[(window_count - 1) / 2];     /* lower one of an even count  */
 }
@@ -1,5 +1,44 @@
+/*  hc_sr04.h – HC-SR04 ultrasonic sensor driver
+ *
+ *  hc_sr04_takeMeasurement() pings and waits for the echo, up to 124 ms.
+ *
+ *  In the background instead: hc_sr04_ping() sends the trigger pulse and
+ *  returns; a Timer-1 compare interrupt samples the echo line every
+ *  HC_SR04_SAMPLE_US on the shared Timer-1 time until the echo has ended.
+ *  hc_sr04_poll(), from the main loop, converts the echo with the speed of
+ *  sound at the temperature given to hc_sr04_set_temperature() and adds it
+ *  to a window of the last HC_SR04_MEDIAN_WINDOW readings, whose median
+ *  hc_sr04_distance_cm() returns. The median drops single stray echoes.
+ */
+#pragma once
 #include <inttypes.h>
 
+/* Echo sampling period: 25 us is 0.43 cm of distance                         */
+#ifndef HC_SR04_SAMPLE_US
+#define HC_SR04_SAMPLE_US 25
+#endif
+
+/* Number of readings the median is taken over, odd                           */
+#ifndef HC_SR04_MEDIAN_WINDOW
+#define HC_SR04_MEDIAN_WINDOW 5
+#endif
+
 void hc_sr04_init(void);
 
-uint16_t hc_sr04_takeMeasurement(void);
\ No newline at end of file
+uint16_t hc_sr04_takeMeasurement(void);
+
+/* Start a measurement. Returns 0 if one is still running or not polled yet   */
+uint8_t hc_sr04_ping(void);
+
+/* 1 while the echo is being measured                                         */
+uint8_t hc_sr04_busy(void);
+
+/* Finish a measurement; returns 1 if one was added to the median window.     */
+/* A missing echo is added as 0 cm                                            */
+uint8_t hc_sr04_poll(void);
+
+/* Median of the last readings in cm, 0 before the first one                  */
+uint16_t hc_sr04_distance_cm(void);
+
+/* Air temperature for the speed of sound, 20 °C until set                    */
+void hc_sr04_set_temperature(int8_t celsius);
@@ -0,0 +1,323 @@
+#include "http_parser.h"
+#include <string.h>
+#include <stdlib.h>
+
+enum
+{
+    STATUS_VERSION,     // "HTTP/1.1"
+    STATUS_CODE,        // "200"
+    STATUS_REASON,      // " OK\r\n"
+    HEADER_START,
+    HEADER_NAME,
+    HEADER_VALUE,
+    HEADERS_END,        // '\r' of the empty line seen, '\n' expected
+    BODY_LENGTH,        // Content-Length bytes
+    BODY_UNTIL_CLOSE,   // no length given, the body ends with the connection
+    CHUNK_SIZE,
+    CHUNK_EXTENSION,    // ";name=value" after the size, ignored
+    CHUNK_DATA,
+    CHUNK_DATA_END,     // "\r\n" after the data
+    TRAILER_START,
+    TRAILER_LINE,
+    DONE
+};
+
+enum
+{
+    HEADER_OTHER,
+    HEADER_CONTENT_LENGTH,
+    HEADER_TRANSFER_ENCODING,
+    HEADER_CONNECTION,
+    HEADER_DATE
+};
+
+static const char *const http_parser_headers[] = {
+    [HEADER_CONTENT_LENGTH] = "Content-Length",
+    [HEADER_TRANSFER_ENCODING] = "Transfer-Encoding",
+    [HEADER_CONNECTION] = "Connection",
+    [HEADER_DATE] = "Date",
+};
+
+void http_parser_init(http_parser_t *parser, http_parser_body_callback_t on_body)
+{
+    memset(parser, 0, sizeof(*parser));
+    parser->state = STATUS_VERSION;
+    parser->content_length = -1;
+    parser->on_body = on_body;
+}
+
+static void http_parser_stop(http_parser_t *parser, uint8_t flags)
+{
+    parser->flags |= flags | HTTP_PARSER_DONE;
+    parser->state = DONE;
+}
+
+static void http_parser_field_add(http_parser_t *parser, uint8_t byte)
+{
+    if (parser->field_length < HTTP_PARSER_FIELD_SIZE - 1)
+        parser->field[parser->field_length++] = byte;
+    parser->field[parser->field_length] = '\0';
+}
+
+static void http_parser_field_clear(http_parser_t *parser)
+{
+    parser->field_length = 0;
+    parser->field[0] = '\0';
+}
+
+static uint8_t http_parser_header_id(const char *name)
+{
+    for (uint8_t i = HEADER_CONTENT_LENGTH; i <= HEADER_DATE; i++)
+        if (strcasecmp(name, http_parser_headers[i]) == 0)
+            return i;
+    return HEADER_OTHER;
+}
+
+static void http_parser_header_value(http_parser_t *parser)
+{
+    // strip trailing white space
+    while (parser->field_length > 0 && parser->field[parser->field_length - 1] == ' ')
+        parser->field[--parser->field_length] = '\0';
+
+    const char *value = parser->field;
+    uint8_t length = parser->field_length;
+
+    switch (parser->header)
+    {
+    case HEADER_CONTENT_LENGTH:
+    {
+        char *end;
+        long content_length = strtol(value, &end, 10);
+        if (length == 0 || *end != '\0' || content_length < 0)
+            http_parser_stop(parser, HTTP_PARSER_ERROR);
+        else
+            parser->content_length = content_length;
+        break;
+    }
+    case HEADER_TRANSFER_ENCODING:
+        // chunked is always the last coding
+        if (length >= 7 && strcasecmp(value + length - 7, "chunked") == 0)
+            parser->flags |= HTTP_PARSER_CHUNKED;
+        break;
+    case HEADER_CONNECTION:
+        if (strcasecmp(value, "close") == 0)
+            parser->flags |= HTTP_PARSER_CONNECTION_CLOSE;
+        break;
+    case HEADER_DATE:
+        strncpy(parser->date, value, HTTP_PARSER_DATE_SIZE - 1);
+        parser->date[HTTP_PARSER_DATE_SIZE - 1] = '\0';
+        break;
+    }
+}
+
+static void http_parser_headers_done(http_parser_t *parser)
+{
+    if (parser->status >= 100 && parser->status < 200)
+    {
+        // An interim response, the real one follows
+        http_parser_init(parser, parser->on_body);
+    }
+    else if (parser->status == 204 || parser->status == 304)
+        http_parser_stop(parser, 0);
+    else if (parser->flags & HTTP_PARSER_CHUNKED)
+    {
+        parser->state = CHUNK_SIZE;
+        parser->remaining = 0;
+    }
+    else if (parser->content_length == 0)
+        http_parser_stop(parser, 0);
+    else if (parser->content_length > 0)
+    {
+        parser->state = BODY_LENGTH;
+        parser->remaining = parser->content_length;
+    }
+    else
+        parser->state = BODY_UNTIL_CLOSE;
+}
+
+static int8_t http_parser_hex(uint8_t byte)
+{
+    if (byte >= '0' && byte <= '9')
+        return byte - '0';
+    if (byte >= 'a' && byte <= 'f')
+        return byte - 'a' + 10;
+    if (byte >= 'A' && byte <= 'F')
+        return byte - 'A' + 10;
+    return -1;
+}
+
+// Hand over as much of the body as is available, returns the number of bytes used
+static uint16_t http_parser_body(http_parser_t *parser, const uint8_t *data, uint16_t length)
+{
+    uint16_t count = length;
+    if (parser->state != BODY_UNTIL_CLOSE && parser->remaining < count)
+        count = parser->remaining;
+
+    if (parser->on_body != NULL && count > 0)
+        parser->on_body(data, count);
+
+    if (parser->state != BODY_UNTIL_CLOSE)
+    {
+        parser->remaining -= count;
+        if (parser->remaining == 0)
+        {
+            if (parser->state == BODY_LENGTH)
+                http_parser_stop(parser, 0);
+            else
+                parser->state = CHUNK_DATA_END;
+        }
+    }
+    return count;
+}
+
+void http_parser_feed(http_parser_t *parser, const uint8_t *data, uint16_t length)
+{
+    uint16_t i = 0;
+
+    while (i < length && parser->state != DONE)
+    {
+        if (parser->state == BODY_LENGTH || parser->state == BODY_UNTIL_CLOSE || parser->state == CHUNK_DATA)
+        {
+            i += http_parser_body(parser, data + i, length - i);
+            continue;
+        }
+
+        uint8_t byte = data[i++];
+
+        switch (parser->state)
+        {
+        case STATUS_VERSION:
+            // "HTTP/1.x"
+            if (parser->field_length == 8 && byte == ' ')
+                parser->state = STATUS_CODE;
+            else if (parser->field_length < 7 && byte == (uint8_t)"HTTP/1."[parser->field_length])
+                parser->field_length++;
+            else if (parser->field_length == 7 && byte >= '0' && byte <= '9')
+                parser->field_length++;
+            else
+                http_parser_stop(parser, HTTP_PARSER_ERROR);
+            break;
+
+        case STATUS_CODE:
+            if (byte >= '0' && byte <= '9' && parser->status < 100)
+                parser->status = parser->status * 10 + (byte - '0');
+            else if (parser->status >= 100 && (byte == ' ' || byte == '\r'))
+                parser->state = STATUS_REASON;
+            else if (parser->status >= 100 && byte == '\n')
+                parser->state = HEADER_START;
+            else
+                http_parser_stop(parser, HTTP_PARSER_ERROR);
+            break;
+
+        case STATUS_REASON:
+            if (byte == '\n')
+            {
+                parser->state = HEADER_START;
+                http_parser_field_clear(parser);
+            }
+            break;
+
+        case HEADER_START:
+            if (byte == '\r')
+            {
+                parser->state = HEADERS_END;
+                break;
+            }
+            if (byte == '\n')
+            {
+                http_parser_headers_done(parser);
+                break;
+            }
+            http_parser_field_clear(parser);
+            parser->state = HEADER_NAME;
+            /* fall through */
+
+        case HEADER_NAME:
+            if (byte == ':')
+            {
+                parser->header = http_parser_header_id(parser->field);
+                http_parser_field_clear(parser);
+                parser->state = HEADER_VALUE;
+            }
+            else if (byte == '\n')
+                http_parser_stop(parser, HTTP_PARSER_ERROR);
+            else
+                http_parser_field_add(parser, byte);
+            break;
+
+        case HEADER_VALUE:
+            if (byte == '\n')
+            {
+                if (parser->header != HEADER_OTHER)
+                    http_parser_header_value(parser);
+                if (parser->state == HEADER_VALUE)
+                    parser->state = HEADER_START;
+            }
+            else if (byte == '\r' || (byte == ' ' && parser->field_length == 0))
+                ; // leading white space and the line ending are not part of the value
+            else if (parser->header != HEADER_OTHER)
+                http_parser_field_add(parser, byte);
+            break;
+
+        case HEADERS_END:
+            if (byte == '\n')
+                http_parser_headers_done(parser);
+            else
+                http_parser_stop(parser, HTTP_PARSER_ERROR);
+            break;
+
+        case CHUNK_SIZE:
+        {
+            int8_t digit = http_parser_hex(byte);
+            if (digit >= 0 && parser->remaining < 0x1000000UL)
+                parser->remaining = (parser->remaining << 4) | digit;
+            else if (byte == ';' || byte == ' ')
+                parser->state = CHUNK_EXTENSION;
+            else if (byte == '\r')
+                ;
+            else if (byte == '\n')
+                parser->state = parser->remaining ? CHUNK_DATA : TRAILER_START;
+            else
+                http_parser_stop(parser, HTTP_PARSER_ERROR);
+            break;
+        }
+
+        case CHUNK_EXTENSION:
+            if (byte == '\n')
+                parser->state = parser->remaining ? CHUNK_DATA : TRAILER_START;
+            break;
+
+        case CHUNK_DATA_END:
+            if (byte == '\n')
+                parser->state = CHUNK_SIZE;
+            else if (byte != '\r')
+                http_parser_stop(parser, HTTP_PARSER_ERROR);
+            break;
+
+        case TRAILER_START:
+            if (byte == '\n')
+                http_parser_stop(parser, 0);
+            else if (byte != '\r')
+                parser->state = TRAILER_LINE;
+            break;
+
+        case TRAILER_LINE:
+            if (byte == '\n')
+                parser->state = TRAILER_START;
+            break;
+        }
+    }
+}
+
+void http_parser_finish(http_parser_t *parser)
+{
+    if (parser->state == BODY_UNTIL_CLOSE)
+        http_parser_stop(parser, 0);
+    else if (parser->state != DONE)
+        http_parser_stop(parser, HTTP_PARSER_ERROR);
+}
+
+uint8_t http_parser_done(const http_parser_t *parser)
+{
+    return parser->state == DONE;
+}
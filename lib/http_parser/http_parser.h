@@ -0,0 +1,97 @@
+/**
+ * @file http_parser.h
+ * @brief Incremental HTTP/1.1 response parser.
+ * 
+ * The response is fed in pieces of any size, as they arrive from the network, and is
+ * parsed in a fixed amount of memory without ever being stored as a whole. The parser
+ * keeps the status code and the headers the firmware needs (Content-Length, Date,
+ * Transfer-Encoding: chunked and Connection: close) and hands the body, with the
+ * chunk framing removed, to a callback.
+ */
+#pragma once
+#include <stdint.h>
+
+/**
+ * @brief Size of the buffer for the Date header, e.g. "Sun, 06 Nov 1994 08:49:37 GMT".
+ * 
+ */
+#define HTTP_PARSER_DATE_SIZE 30
+
+/**
+ * @brief Header names and values are compared in a buffer of this size; longer
+ * values are cut off, which does not matter for the headers that are kept.
+ * 
+ */
+#define HTTP_PARSER_FIELD_SIZE 32
+
+/**
+ * @brief Flags describing the response, see http_parser_t.flags.
+ * 
+ */
+#define HTTP_PARSER_CHUNKED          (1 << 0) /**< Transfer-Encoding: chunked. */
+#define HTTP_PARSER_CONNECTION_CLOSE (1 << 1) /**< The server closes the connection after this response. */
+#define HTTP_PARSER_DONE             (1 << 2) /**< The complete response has been parsed. */
+#define HTTP_PARSER_ERROR            (1 << 3) /**< The response was malformed, parsing stopped. */
+
+/**
+ * @brief Type definition for the body callback.
+ * 
+ * @param data Part of the body. Only valid during the call.
+ * @param length Number of bytes in data.
+ */
+typedef void (*http_parser_body_callback_t)(const uint8_t *data, uint16_t length);
+
+/**
+ * @brief State of one response. The fields after state can be read at any time.
+ * 
+ */
+typedef struct {
+    uint8_t  state;
+    uint16_t status;                        /**< Status code, 0 until the status line is parsed. */
+    int32_t  content_length;                /**< Content-Length, -1 if the header was not sent. */
+    uint8_t  flags;                         /**< HTTP_PARSER_* flags. */
+    char     date[HTTP_PARSER_DATE_SIZE];   /**< Value of the Date header, "" if not sent. */
+
+    uint32_t remaining;                     /* body or chunk bytes still to come */
+    uint8_t  header;                        /* header whose value is being read */
+    uint8_t  field_length;
+    char     field[HTTP_PARSER_FIELD_SIZE];
+    http_parser_body_callback_t on_body;
+} http_parser_t;
+
+/**
+ * @brief Prepare the parser for a new response.
+ * 
+ * @param parser The parser.
+ * @param on_body Called with each part of the body. Can be NULL.
+ */
+void http_parser_init(http_parser_t *parser, http_parser_body_callback_t on_body);
+
+/**
+ * @brief Parse the next part of the response.
+ * 
+ * Bytes after the end of the response are ignored.
+ * 
+ * @param parser The parser.
+ * @param data Received bytes.
+ * @param length Number of bytes in data.
+ */
+void http_parser_feed(http_parser_t *parser, const uint8_t *data, uint16_t length);
+
+/**
+ * @brief Tell the parser the connection has been closed.
+ * 
+ * A body without Content-Length or chunked encoding ends here. Any other response that
+ * is not complete yet is marked with HTTP_PARSER_ERROR.
+ * 
+ * @param parser The parser.
+ */
+void http_parser_finish(http_parser_t *parser);
+
+/**
+ * @brief Check whether the response is complete, or parsing has stopped on an error.
+ * 
+ * @param parser The parser.
+ * @return uint8_t 1 if nothing more is expected.
+ */
+uint8_t http_parser_done(const http_parser_t *parser);
@@ -0,0 +1,313 @@
+#include "http_session.h"
+#include "wifi.h"
+#include "http_parser.h"
+#include "protothread.h"
+#include "includes.h"
+#include "timers.h"
+
+#define HTTP_SESSION_HOST_SIZE 32
+
+static char session_host[HTTP_SESSION_HOST_SIZE];
+static uint16_t session_port;
+static HTTP_SESSION_Transport_t session_transport;
+static uint8_t session_open;
+
+// Response of the request in progress, parsed as it arrives; only the body is stored
+static http_parser_t session_parser;
+static uint16_t session_received;
+static uint16_t session_overflows; // wifi_rx_overflows() when the request went out
+static uint8_t session_overflowed; // bytes of the response were lost
+static char *session_body;
+static uint16_t session_body_size;
+static uint16_t session_body_used;
+
+static void http_session_body(const uint8_t *data, uint16_t length)
+{
+    // what does not fit is dropped, room is kept for the '\0'
+    if (length > session_body_size - 1 - session_body_used)
+        length = session_body_size - 1 - session_body_used;
+    memcpy(session_body + session_body_used, data, length);
+    session_body_used += length;
+    session_body[session_body_used] = '\0';
+}
+
+static void http_session_stream(const uint8_t *data, uint16_t length)
+{
+    // After a gap the rest of the response is garbage; the parser does not see it
+    if (session_overflowed || wifi_rx_overflows() != session_overflows)
+    {
+        session_overflowed = 1;
+        return;
+    }
+    session_received += length;
+    http_parser_feed(&session_parser, data, length);
+}
+
+static uint8_t http_session_is_connected_to(const char *host, uint16_t port, HTTP_SESSION_Transport_t transport)
+{
+    return session_open && wifi_TCP_is_connected() &&
+           session_port == port && session_transport == transport &&
+           strcmp(session_host, host) == 0;
+}
+
+// The request in flight, kept for the protothreads; session_busy is set while there is one
+static uint8_t session_busy;
+static int16_t session_status = -1;
+static const char *request_host;
+static uint16_t request_port;
+static HTTP_SESSION_Transport_t request_transport;
+static uint16_t request_length;
+static WIFI_TCP_Writer_t request_writer;
+static http_parser_body_callback_t request_on_body;
+
+static protothread_t session_pt, connect_pt;
+static uint8_t session_attempt;
+static uint8_t session_sent;
+static uint32_t session_deadline;
+static char session_ip[16];
+
+// Completion of the asynchronous wifi command of the current step
+static volatile uint8_t session_step_done;
+static WIFI_ERROR_MESSAGE_t session_step_result;
+
+static void http_session_step(WIFI_ERROR_MESSAGE_t result)
+{
+    session_step_result = result;
+    session_step_done = 1;
+}
+
+// Start the wifi command of a step. A command that was not sent completes the step at
+// once; a cached DNS answer completes it from inside the call. The wait is a separate line
+#define HTTP_SESSION_START(command)                    \
+    do                                                 \
+    {                                                  \
+        session_step_done = 0;                         \
+        WIFI_ERROR_MESSAGE_t sent_result = (command);  \
+        if (sent_result != WIFI_OK)                    \
+            http_session_step(sent_result);            \
+    } while (0)
+
+static PT_THREAD(http_session_connect(protothread_t *pt))
+{
+    PT_BEGIN(pt);
+    session_open = 0;
+    if (strlen(request_host) >= HTTP_SESSION_HOST_SIZE)
+        PT_EXIT(pt);
+
+    if (wifi_TCP_is_connected())
+    {
+        PT_WAIT_WHILE(pt, wifi_busy());
+        HTTP_SESSION_START(wifi_command_close_TCP_connection_async(http_session_step));
+        PT_WAIT_UNTIL(pt, session_step_done);
+    }
+
+    PT_WAIT_WHILE(pt, wifi_busy());
+    HTTP_SESSION_START(wifi_command_get_ip_from_URL_async((char *)request_host, session_ip, http_session_step));
+    PT_WAIT_UNTIL(pt, session_step_done);
+    if (session_step_result != WIFI_OK)
+        PT_EXIT(pt);
+
+    PT_WAIT_WHILE(pt, wifi_busy());
+    if (request_transport == HTTP_SESSION_SSL)
+        HTTP_SESSION_START(wifi_command_create_SSL_connection_async(session_ip, request_port, http_session_step));
+    else
+        HTTP_SESSION_START(wifi_command_create_TCP_connection_async(session_ip, request_port, http_session_step));
+    PT_WAIT_UNTIL(pt, session_step_done);
+
+    // "ALREADY CONNECTED" answers ERROR, but leaves a usable link
+    if (session_step_result != WIFI_OK && !wifi_TCP_is_connected())
+        PT_EXIT(pt);
+
+    strcpy(session_host, request_host);
+    session_port = request_port;
+    session_transport = request_transport;
+    session_open = 1;
+    PT_END(pt);
+}
+
+static uint8_t http_session_response_ended(void)
+{
+    return http_parser_done(&session_parser) || session_overflowed || !wifi_TCP_is_connected() ||
+           (int32_t)(timers_millis() - session_deadline) >= 0;
+}
+
+static PT_THREAD(http_session_exchange(protothread_t *pt))
+{
+    PT_BEGIN(pt);
+    for (session_attempt = 0; session_attempt < 2; session_attempt++)
+    {
+        http_parser_init(&session_parser, request_on_body);
+        session_received = 0;
+        session_overflowed = 0;
+
+        if (!http_session_is_connected_to(request_host, request_port, request_transport))
+        {
+            PT_SPAWN(pt, &connect_pt, http_session_connect(&connect_pt));
+            if (!session_open)
+                break;
+        }
+        wifi_TCP_set_stream_callback(http_session_stream);
+
+        // The whole request goes out with one AT+CIPSEND
+        PT_WAIT_WHILE(pt, wifi_busy());
+        session_overflows = wifi_rx_overflows();
+        HTTP_SESSION_START(wifi_command_TCP_transmit_stream_async(request_length, request_writer, http_session_step));
+        PT_WAIT_UNTIL(pt, session_step_done);
+        session_sent = session_step_result == WIFI_OK;
+
+        if (session_sent)
+        {
+            session_deadline = timers_millis() + HTTP_SESSION_RESPONSE_TIMEOUT_MS;
+            PT_WAIT_UNTIL(pt, http_session_response_ended());
+            if (!http_parser_done(&session_parser) && !wifi_TCP_is_connected())
+                http_parser_finish(&session_parser);
+        }
+
+        if (session_received > 0 || session_overflowed)
+            break;
+
+        // A late reply must not end up in the next response, so the link is dropped either way
+        uint8_t link_lost = !session_sent || !wifi_TCP_is_connected();
+        http_session_close();
+
+        // The server dropped the idle link, or the send failed: retry on a new link.
+        // A server that is just not answering is not asked again.
+        if (!link_lost)
+            break;
+    }
+
+    if (session_overflowed)
+    {
+        // Part of the response is missing; the rest of it must not be taken as the next one
+        http_session_close();
+        session_status = -1;
+    }
+    else if (session_received > 0)
+    {
+        // After an incomplete or malformed response the link is out of step with the server
+        if ((session_parser.flags & (HTTP_PARSER_CONNECTION_CLOSE | HTTP_PARSER_ERROR)) ||
+            !http_parser_done(&session_parser))
+            http_session_close();
+        session_status = session_parser.status;
+    }
+    else
+        session_status = -1;
+
+    session_busy = 0;
+    PT_END(pt);
+}
+
+// Head and body of a buffer request, sent together by http_session_write_buffers()
+static const uint8_t *session_head;
+static uint16_t session_head_length;
+static const uint8_t *session_request_body;
+static uint16_t session_request_body_length;
+
+static void http_session_write_buffers(void)
+{
+    wifi_TCP_write(session_head, session_head_length);
+    if (session_request_body != NULL)
+        wifi_TCP_write(session_request_body, session_request_body_length);
+}
+
+// Take the session for a request. Called right after the wait for !session_busy,
+// without a wait in between, so no other protothread can take it meanwhile
+static void http_session_take(const char *host, uint16_t port, HTTP_SESSION_Transport_t transport,
+                              uint16_t length, WIFI_TCP_Writer_t writer,
+                              http_parser_body_callback_t on_body)
+{
+    session_busy = 1;
+    session_status = -1;
+    request_host = host;
+    request_port = port;
+    request_transport = transport;
+    request_length = length;
+    request_writer = writer;
+    request_on_body = on_body;
+}
+
+static void http_session_take_buffers(const uint8_t *head, uint16_t head_length,
+                                      const uint8_t *body, uint16_t body_length)
+{
+    session_head = head;
+    session_head_length = head_length;
+    session_request_body = (body_length > 0) ? body : NULL;
+    session_request_body_length = body_length;
+}
+
+PT_THREAD(http_session_request_writer(protothread_t *pt, const char *host, uint16_t port, HTTP_SESSION_Transport_t transport,
+                                      uint16_t length, WIFI_TCP_Writer_t writer,
+                                      http_parser_body_callback_t on_body))
+{
+    PT_BEGIN(pt);
+    PT_WAIT_WHILE(pt, session_busy);
+    http_session_take(host, port, transport, length, writer, on_body);
+    PT_SPAWN(pt, &session_pt, http_session_exchange(&session_pt));
+    PT_END(pt);
+}
+
+PT_THREAD(http_session_request_stream(protothread_t *pt, const char *host, uint16_t port, HTTP_SESSION_Transport_t transport,
+                                      const uint8_t *head, uint16_t head_length,
+                                      const uint8_t *body, uint16_t body_length,
+                                      http_parser_body_callback_t on_body))
+{
+    PT_BEGIN(pt);
+    PT_WAIT_WHILE(pt, session_busy);
+    http_session_take_buffers(head, head_length, body, body_length);
+    http_session_take(host, port, transport, head_length + session_request_body_length,
+                      http_session_write_buffers, on_body);
+    PT_SPAWN(pt, &session_pt, http_session_exchange(&session_pt));
+    PT_END(pt);
+}
+
+PT_THREAD(http_session_request(protothread_t *pt, const char *host, uint16_t port, HTTP_SESSION_Transport_t transport,
+                               const uint8_t *head, uint16_t head_length,
+                               const uint8_t *body, uint16_t body_length,
+                               char *response_body, uint16_t response_body_size))
+{
+    PT_BEGIN(pt);
+    if (response_body_size < 1)
+    {
+        session_status = -1;
+        PT_EXIT(pt);
+    }
+
+    PT_WAIT_WHILE(pt, session_busy);
+    session_body = response_body;
+    session_body_size = response_body_size;
+    session_body_used = 0;
+    response_body[0] = '\0';
+
+    http_session_take_buffers(head, head_length, body, body_length);
+    http_session_take(host, port, transport, head_length + session_request_body_length,
+                      http_session_write_buffers, http_session_body);
+    PT_SPAWN(pt, &session_pt, http_session_exchange(&session_pt));
+    PT_END(pt);
+}
+
+int16_t http_session_status(void)
+{
+    return session_status;
+}
+
+uint8_t http_session_busy(void)
+{
+    return session_busy;
+}
+
+const http_parser_t *http_session_response(void)
+{
+    return &session_parser;
+}
+
+uint8_t http_session_is_open(void)
+{
+    return session_open && wifi_TCP_is_connected();
+}
+
+void http_session_close(void)
+{
+    if (session_open && wifi_TCP_is_connected())
+        wifi_command_close_TCP_connection_async(NULL);
+    session_open = 0;
+}
@@ -0,0 +1,134 @@
+/**
+ * @file http_session.h
+ * @brief Keep-alive HTTP session on top of the ESP8266 TCP/SSL link.
+ * 
+ * The module can only hold one link at a time (single connection mode). The session
+ * keeps that link open between requests, so consecutive requests to the same host
+ * skip the DNS lookup, AT+CIPSTART and AT+CIPCLOSE. A new link is only opened when
+ * the host changes, or when the module reported the link as closed (CLOSED or
+ * WIFI DISCONNECT), or when a send fails. The session assumes it is the only user
+ * of the link.
+ * 
+ * Every step (DNS lookup, AT+CIPSTART, AT+CIPSEND, the response) is an asynchronous
+ * wifi command, so a request is a protothread that waits for them while the main
+ * loop goes on.
+ * 
+ * Requests should be sent with "Connection: keep-alive". The response is parsed by
+ * http_parser as it arrives, so its end is found from Content-Length, from the last
+ * chunk of a chunked body, or from the server closing the connection.
+ */
+#pragma once
+#include <stdint.h>
+#include "http_parser.h"
+#include "wifi.h"
+#include "protothread.h"
+
+/**
+ * @brief Transport used for the link.
+ * 
+ */
+typedef enum {
+    HTTP_SESSION_TCP,       /**< Plain TCP. */
+    HTTP_SESSION_SSL        /**< TLS, handled by the module. */
+} HTTP_SESSION_Transport_t;
+
+/**
+ * @brief How long to wait for a complete response, in milliseconds.
+ * 
+ */
+#ifndef HTTP_SESSION_RESPONSE_TIMEOUT_MS
+#define HTTP_SESSION_RESPONSE_TIMEOUT_MS 5000
+#endif
+
+/**
+ * @brief Send a request and receive the response, reusing the open link when possible.
+ * 
+ * A protothread: it returns while it waits for the module or the server, and the
+ * caller runs it again, e.g. with PT_SPAWN(), until it is done. Nothing blocks, so
+ * wifi_poll() must keep running from the main loop. Only one request is in flight;
+ * a second one waits in this protothread until the first is done. The result is
+ * read with http_session_status() afterwards.
+ * 
+ * If the link turns out to be dead (the send fails, or it closes before any of the
+ * response arrived), it is reopened and the request is sent once more.
+ * 
+ * The host, head and body are not copied and must stay valid until the request is done.
+ * 
+ * @param pt State of the protothread, e.g. a static protothread_t of the caller.
+ * @param host Host name of the server, used for the DNS lookup when connecting.
+ * @param port Port of the server.
+ * @param transport HTTP_SESSION_TCP or HTTP_SESSION_SSL.
+ * @param head Request line and headers, including the empty line.
+ * @param head_length Length of head.
+ * @param body Request body, or NULL.
+ * @param body_length Length of body, 0 if there is none.
+ * @param response_body Buffer for the response body, without headers or chunk framing. Always null terminated.
+ * @param response_body_size Size of the buffer; what does not fit is dropped.
+ */
+PT_THREAD(http_session_request(protothread_t *pt, const char *host, uint16_t port, HTTP_SESSION_Transport_t transport,
+                               const uint8_t *head, uint16_t head_length,
+                               const uint8_t *body, uint16_t body_length,
+                               char *response_body, uint16_t response_body_size));
+
+/**
+ * @brief Same as http_session_request(), but the body is handed to a callback as it arrives.
+ * 
+ * Nothing is stored, so the body can be larger than any buffer. The callback is called
+ * from wifi_poll(); http_session_response() can be used in it, e.g. to check the status.
+ * 
+ * @param on_body Called with each part of the body, without chunk framing.
+ */
+PT_THREAD(http_session_request_stream(protothread_t *pt, const char *host, uint16_t port, HTTP_SESSION_Transport_t transport,
+                                      const uint8_t *head, uint16_t head_length,
+                                      const uint8_t *body, uint16_t body_length,
+                                      http_parser_body_callback_t on_body));
+
+/**
+ * @brief Same as http_session_request_stream(), but the request is generated while it is sent.
+ * 
+ * The writer produces the whole request, head and body, with wifi_TCP_write() and is
+ * called from wifi_poll() once for every attempt, so it must write the same bytes each time.
+ * 
+ * @param length Number of bytes the writer produces.
+ * @param writer Writes the request.
+ * @param on_body Called with each part of the response body, without chunk framing.
+ */
+PT_THREAD(http_session_request_writer(protothread_t *pt, const char *host, uint16_t port, HTTP_SESSION_Transport_t transport,
+                                      uint16_t length, WIFI_TCP_Writer_t writer,
+                                      http_parser_body_callback_t on_body));
+
+/**
+ * @brief Result of the last request.
+ * 
+ * @return int16_t The HTTP status code, 0 if the reply was not HTTP, -1 if nothing was received
+ * or if bytes of the response were lost in the UART receive buffer (see wifi_rx_overflows()).
+ */
+int16_t http_session_status(void);
+
+/**
+ * @brief Check whether a request is in flight.
+ * 
+ * @return uint8_t 1 from the moment a request protothread takes the session until it is done.
+ */
+uint8_t http_session_busy(void);
+
+/**
+ * @brief The parser of the last response, e.g. to read its Date header.
+ * 
+ * @return const http_parser_t* Valid until the next request.
+ */
+const http_parser_t *http_session_response(void);
+
+/**
+ * @brief Check whether the session has a link open.
+ * 
+ * @return uint8_t 1 if the next request to the same host can reuse the link.
+ */
+uint8_t http_session_is_open(void);
+
+/**
+ * @brief Close the link. The next request opens a new one.
+ * 
+ * The AT+CIPCLOSE is sent without waiting for its answer.
+ */
+void http_session_close(void);
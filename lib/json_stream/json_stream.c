@@ -0,0 +1,398 @@
+#include "json_stream.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum
+{
+    VALUE,          // a value is expected
+    OBJECT_START,   // after '{': a key or '}'
+    OBJECT_KEY,     // after ',' in an object: a key
+    KEY,
+    KEY_ESCAPE,
+    COLON,
+    ARRAY_START,    // after '[': a value or ']'
+    AFTER_VALUE,    // ',' or the end of the container
+    STRING,
+    STRING_ESCAPE,
+    STRING_UNICODE,
+    NUMBER,
+    LITERAL,
+    DONE
+};
+
+#define JSON_STREAM_ERROR (1 << 0)
+#define JSON_STREAM_TRUNCATED (1 << 1) // the current value did not fit
+
+void json_stream_init(json_stream_t *json, json_stream_callback_t on_value)
+{
+    memset(json, 0, sizeof(*json));
+    json->state = VALUE;
+    json->on_value = on_value;
+}
+
+static void json_stream_fail(json_stream_t *json)
+{
+    json->flags |= JSON_STREAM_ERROR;
+    json->state = DONE;
+}
+
+static bool json_stream_is_space(uint8_t byte)
+{
+    return byte == ' ' || byte == '\t' || byte == '\r' || byte == '\n';
+}
+
+static bool json_stream_in_array(const json_stream_t *json)
+{
+    return json->arrays & (1 << (json->depth - 1));
+}
+
+/* ---- Path ------------------------------------------------------------------- */
+
+static void json_stream_path_add(json_stream_t *json, char c)
+{
+    if (json->path_length < JSON_STREAM_PATH_SIZE - 2)
+        json->path[json->path_length++] = c;
+    else if (json->path_length == JSON_STREAM_PATH_SIZE - 2)
+        json->path[json->path_length++] = '?'; // cut off, must not match anything
+    json->path[json->path_length] = '\0';
+}
+
+static void json_stream_path_reset(json_stream_t *json)
+{
+    json->path_length = json->base_length[json->depth - 1];
+    json->path[json->path_length] = '\0';
+}
+
+static void json_stream_path_key(json_stream_t *json)
+{
+    json_stream_path_reset(json);
+    if (json->path_length > 0)
+        json_stream_path_add(json, '.');
+}
+
+static void json_stream_path_index(json_stream_t *json)
+{
+    uint8_t index = json->index[json->depth - 1];
+    char digits[3];
+    uint8_t count = 0;
+
+    json_stream_path_reset(json);
+    json_stream_path_add(json, '[');
+    do
+    {
+        digits[count++] = '0' + index % 10;
+        index /= 10;
+    } while (index > 0);
+    while (count > 0)
+        json_stream_path_add(json, digits[--count]);
+    json_stream_path_add(json, ']');
+}
+
+/* ---- Values and containers ----------------------------------------------------- */
+
+static void json_stream_value_add(json_stream_t *json, char c)
+{
+    if (json->value_length < JSON_STREAM_VALUE_SIZE - 1)
+        json->value[json->value_length++] = c;
+    else
+        json->flags |= JSON_STREAM_TRUNCATED;
+}
+
+static void json_stream_after_value(json_stream_t *json)
+{
+    json->state = json->depth == 0 ? DONE : AFTER_VALUE;
+}
+
+static void json_stream_emit(json_stream_t *json, json_stream_type_t type)
+{
+    json->value[json->value_length] = '\0';
+    if (json->on_value != NULL)
+        json->on_value(json->path, type, json->value, (json->flags & JSON_STREAM_TRUNCATED) != 0);
+    json_stream_after_value(json);
+}
+
+static void json_stream_open(json_stream_t *json, bool array)
+{
+    if (json->depth == JSON_STREAM_MAX_DEPTH)
+    {
+        json_stream_fail(json);
+        return;
+    }
+    json->base_length[json->depth] = json->path_length;
+    json->index[json->depth] = 0;
+    if (array)
+        json->arrays |= 1 << json->depth;
+    else
+        json->arrays &= ~(1 << json->depth);
+    json->depth++;
+    json->state = array ? ARRAY_START : OBJECT_START;
+}
+
+static void json_stream_close(json_stream_t *json, uint8_t byte)
+{
+    if ((byte == ']') != json_stream_in_array(json))
+    {
+        json_stream_fail(json);
+        return;
+    }
+    json_stream_path_reset(json);
+    json->depth--;
+    json_stream_after_value(json);
+}
+
+static void json_stream_value_start(json_stream_t *json, uint8_t byte)
+{
+    json->value_length = 0;
+    json->flags &= ~JSON_STREAM_TRUNCATED;
+
+    if (byte == '{')
+        json_stream_open(json, false);
+    else if (byte == '[')
+        json_stream_open(json, true);
+    else if (byte == '"')
+        json->state = STRING;
+    else if (byte == '-' || (byte >= '0' && byte <= '9'))
+    {
+        json_stream_value_add(json, byte);
+        json->state = NUMBER;
+    }
+    else if (byte == 't' || byte == 'f' || byte == 'n')
+    {
+        json_stream_value_add(json, byte);
+        json->literal = 1;
+        json->state = LITERAL;
+    }
+    else if (!json_stream_is_space(byte))
+        json_stream_fail(json);
+}
+
+static char json_stream_unescape(uint8_t byte)
+{
+    switch (byte)
+    {
+    case 'b': return '\b';
+    case 'f': return '\f';
+    case 'n': return '\n';
+    case 'r': return '\r';
+    case 't': return '\t';
+    default: return byte; // '"', '\\' and '/'
+    }
+}
+
+static void json_stream_byte(json_stream_t *json, uint8_t byte)
+{
+    switch (json->state)
+    {
+    case VALUE:
+        json_stream_value_start(json, byte);
+        break;
+
+    case ARRAY_START:
+        if (byte == ']')
+            json_stream_close(json, byte);
+        else if (!json_stream_is_space(byte))
+        {
+            json_stream_path_index(json);
+            json_stream_value_start(json, byte);
+        }
+        break;
+
+    case OBJECT_START:
+        if (byte == '}')
+        {
+            json_stream_close(json, byte);
+            break;
+        }
+        /* fall through */
+    case OBJECT_KEY:
+        if (byte == '"')
+        {
+            json_stream_path_key(json);
+            json->state = KEY;
+        }
+        else if (!json_stream_is_space(byte))
+            json_stream_fail(json);
+        break;
+
+    case KEY:
+        if (byte == '"')
+            json->state = COLON;
+        else if (byte == '\\')
+            json->state = KEY_ESCAPE;
+        else
+            json_stream_path_add(json, byte);
+        break;
+
+    case KEY_ESCAPE:
+        json_stream_path_add(json, json_stream_unescape(byte));
+        json->state = KEY;
+        break;
+
+    case COLON:
+        if (byte == ':')
+            json->state = VALUE;
+        else if (!json_stream_is_space(byte))
+            json_stream_fail(json);
+        break;
+
+    case AFTER_VALUE:
+        if (byte == ',')
+        {
+            if (json_stream_in_array(json))
+            {
+                if (json->index[json->depth - 1] < 255)
+                    json->index[json->depth - 1]++;
+                json_stream_path_index(json);
+                json->state = VALUE;
+            }
+            else
+                json->state = OBJECT_KEY;
+        }
+        else if (byte == '}' || byte == ']')
+            json_stream_close(json, byte);
+        else if (!json_stream_is_space(byte))
+            json_stream_fail(json);
+        break;
+
+    case STRING:
+        if (byte == '"')
+            json_stream_emit(json, JSON_STREAM_STRING);
+        else if (byte == '\\')
+            json->state = STRING_ESCAPE;
+        else
+            json_stream_value_add(json, byte);
+        break;
+
+    case STRING_ESCAPE:
+        if (byte == 'u')
+        {
+            json->literal = 0;
+            json->unicode = 0;
+            json->state = STRING_UNICODE;
+        }
+        else
+        {
+            json_stream_value_add(json, json_stream_unescape(byte));
+            json->state = STRING;
+        }
+        break;
+
+    case STRING_UNICODE:
+    {
+        uint8_t digit;
+        if (byte >= '0' && byte <= '9')
+            digit = byte - '0';
+        else if ((byte | 0x20) >= 'a' && (byte | 0x20) <= 'f')
+            digit = (byte | 0x20) - 'a' + 10;
+        else
+        {
+            json_stream_fail(json);
+            break;
+        }
+        json->unicode = (json->unicode << 4) | digit;
+        if (++json->literal == 4)
+        {
+            // Only ASCII is kept as it is
+            json_stream_value_add(json, json->unicode < 0x80 ? (char)json->unicode : '?');
+            json->state = STRING;
+        }
+        break;
+    }
+
+    case LITERAL:
+    {
+        const char *literal = json->value[0] == 't' ? "true" : json->value[0] == 'f' ? "false" : "null";
+        if (byte != (uint8_t)literal[json->literal])
+        {
+            json_stream_fail(json);
+            break;
+        }
+        json_stream_value_add(json, byte);
+        if (literal[++json->literal] == '\0')
+            json_stream_emit(json, json->value[0] == 't' ? JSON_STREAM_TRUE : json->value[0] == 'f' ? JSON_STREAM_FALSE : JSON_STREAM_NULL);
+        break;
+    }
+    }
+}
+
+void json_stream_feed(json_stream_t *json, const uint8_t *data, uint16_t length)
+{
+    for (uint16_t i = 0; i < length && json->state != DONE; i++)
+    {
+        uint8_t byte = data[i];
+
+        if (json->state == NUMBER)
+        {
+            if ((byte >= '0' && byte <= '9') || byte == '.' || byte == 'e' || byte == 'E' || byte == '+' || byte == '-')
+            {
+                json_stream_value_add(json, byte);
+                continue;
+            }
+            // the number ends at the first byte that is not part of it, which is parsed next
+            json_stream_emit(json, JSON_STREAM_NUMBER);
+            if (json->state == DONE)
+                break;
+        }
+        json_stream_byte(json, byte);
+    }
+}
+
+uint8_t json_stream_done(const json_stream_t *json)
+{
+    return json->state == DONE && !(json->flags & JSON_STREAM_ERROR);
+}
+
+uint8_t json_stream_error(const json_stream_t *json)
+{
+    return (json->flags & JSON_STREAM_ERROR) != 0;
+}
+
+/* ---- Bindings ------------------------------------------------------------------- */
+
+static bool json_stream_to_uint(const char *value, unsigned long max, unsigned long *result)
+{
+    char *end;
+    if (value[0] < '0' || value[0] > '9')
+        return false;
+    *result = strtoul(value, &end, 10);
+    return *end == '\0' && *result <= max;
+}
+
+uint8_t json_stream_bind(const json_stream_binding_t *bindings, uint8_t count,
+                         const char *path, json_stream_type_t type, const char *value,
+                         uint8_t truncated)
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const json_stream_binding_t *binding = &bindings[i];
+        unsigned long number;
+
+        if (strcmp(binding->path, path) != 0)
+            continue;
+        if (truncated)
+            return 1; // only the start of it arrived
+
+        switch (binding->type)
+        {
+        case JSON_STREAM_BIND_BOOL:
+            if (type == JSON_STREAM_TRUE || type == JSON_STREAM_FALSE)
+                *(bool *)binding->target = type == JSON_STREAM_TRUE;
+            break;
+        case JSON_STREAM_BIND_UINT8:
+            if (type == JSON_STREAM_NUMBER && json_stream_to_uint(value, 0xFF, &number))
+                *(uint8_t *)binding->target = number;
+            break;
+        case JSON_STREAM_BIND_UINT16:
+            if (type == JSON_STREAM_NUMBER && json_stream_to_uint(value, 0xFFFF, &number))
+                *(uint16_t *)binding->target = number;
+            break;
+        case JSON_STREAM_BIND_STRING:
+            if (type == JSON_STREAM_STRING && strlen(value) < binding->size)
+                strcpy((char *)binding->target, value);
+            break;
+        }
+        return 1;
+    }
+    return 0;
+}
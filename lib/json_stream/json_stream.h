@@ -0,0 +1,164 @@
+/**
+ * @file json_stream.h
+ * @brief Streaming JSON tokenizer with path matching.
+ * 
+ * The document is fed in pieces of any size, e.g. straight from the HTTP body callback,
+ * and is parsed in one pass in a fixed amount of memory. Every scalar value is reported
+ * together with its path: object members are joined with '.', array elements get their
+ * index in brackets, so {"security":{"alarmWindow":{"start":"22:00"}},"a":[1,2]} gives
+ * "security.alarmWindow.start", "a[0]" and "a[1]". Strings are unescaped.
+ * 
+ * json_stream_bind() stores a value into a variable when its path is in a table, so a
+ * document can be mapped onto a struct without any other code.
+ */
+#pragma once
+#include <stdint.h>
+
+/**
+ * @brief Longest path that is reported, including the terminating '\0'. Paths that do
+ * not fit are cut off and end with '?', so they never match a binding.
+ * 
+ */
+#ifndef JSON_STREAM_PATH_SIZE
+#define JSON_STREAM_PATH_SIZE 48
+#endif
+
+/**
+ * @brief Longest value that is reported, including the terminating '\0'. Longer
+ * values are cut off and reported as truncated.
+ * 
+ */
+#ifndef JSON_STREAM_VALUE_SIZE
+#define JSON_STREAM_VALUE_SIZE 128
+#endif
+
+/**
+ * @brief Deepest nesting of objects and arrays; a deeper document is an error. At most
+ * 8, one bit of json_stream_t.arrays per level.
+ * 
+ */
+#ifndef JSON_STREAM_MAX_DEPTH
+#define JSON_STREAM_MAX_DEPTH 8
+#endif
+
+#if JSON_STREAM_PATH_SIZE > 255 || JSON_STREAM_VALUE_SIZE > 255
+#error "JSON_STREAM_PATH_SIZE and JSON_STREAM_VALUE_SIZE must be at most 255"
+#endif
+
+#if JSON_STREAM_MAX_DEPTH > 8
+#error "JSON_STREAM_MAX_DEPTH must be at most 8"
+#endif
+
+/**
+ * @brief Type of a reported value.
+ * 
+ */
+typedef enum {
+    JSON_STREAM_STRING,
+    JSON_STREAM_NUMBER,         /**< value holds the number as written. */
+    JSON_STREAM_TRUE,
+    JSON_STREAM_FALSE,
+    JSON_STREAM_NULL
+} json_stream_type_t;
+
+/**
+ * @brief Type definition for the value callback.
+ * 
+ * @param path Path of the value, e.g. "watering.soilMin".
+ * @param type Type of the value.
+ * @param value The value as text. Only valid during the call.
+ * @param truncated 1 if the value was longer than JSON_STREAM_VALUE_SIZE - 1 and only
+ * its start is in value.
+ */
+typedef void (*json_stream_callback_t)(const char *path, json_stream_type_t type, const char *value,
+                                       uint8_t truncated);
+
+/**
+ * @brief State of one document. Use the functions, not the fields.
+ * 
+ */
+typedef struct {
+    uint8_t  state;
+    uint8_t  depth;
+    uint8_t  flags;
+    uint8_t  arrays;                                /* bit n set: level n is an array */
+    uint8_t  path_length;
+    uint8_t  base_length[JSON_STREAM_MAX_DEPTH];    /* path length of the container */
+    uint8_t  index[JSON_STREAM_MAX_DEPTH];          /* element index within arrays */
+    uint8_t  value_length;
+    uint8_t  literal;                               /* progress through true/false/null or \uXXXX */
+    uint16_t unicode;
+    char     path[JSON_STREAM_PATH_SIZE];
+    char     value[JSON_STREAM_VALUE_SIZE];
+    json_stream_callback_t on_value;
+} json_stream_t;
+
+/**
+ * @brief Prepare the tokenizer for a new document.
+ * 
+ * @param json The tokenizer.
+ * @param on_value Called for every scalar value.
+ */
+void json_stream_init(json_stream_t *json, json_stream_callback_t on_value);
+
+/**
+ * @brief Parse the next part of the document. Bytes after the end of it are ignored.
+ * 
+ * @param json The tokenizer.
+ * @param data Received bytes.
+ * @param length Number of bytes in data.
+ */
+void json_stream_feed(json_stream_t *json, const uint8_t *data, uint16_t length);
+
+/**
+ * @brief Check whether a complete document has been parsed.
+ * 
+ * @param json The tokenizer.
+ * @return uint8_t 1 if the top level value is complete and no error was found.
+ */
+uint8_t json_stream_done(const json_stream_t *json);
+
+/**
+ * @brief Check whether the document was malformed. Parsing stops at the first error.
+ * 
+ * @param json The tokenizer.
+ * @return uint8_t 1 if an error was found.
+ */
+uint8_t json_stream_error(const json_stream_t *json);
+
+/**
+ * @brief Type of the variable a binding stores into.
+ * 
+ */
+typedef enum {
+    JSON_STREAM_BIND_BOOL,      /**< bool, from true or false. */
+    JSON_STREAM_BIND_UINT8,     /**< uint8_t, from a number 0..255. */
+    JSON_STREAM_BIND_UINT16,    /**< uint16_t, from a number 0..65535. */
+    JSON_STREAM_BIND_STRING     /**< char array of size bytes, from a string. */
+} json_stream_bind_type_t;
+
+/**
+ * @brief Where the value of one path is stored.
+ * 
+ */
+typedef struct {
+    const char *path;
+    json_stream_bind_type_t type;
+    void *target;
+    uint8_t size;               /**< Size of target, only used for strings. */
+} json_stream_binding_t;
+
+/**
+ * @brief Store a value if its path is in the table, for use in the value callback.
+ * 
+ * The target is left unchanged when the value has the wrong type, is out of range,
+ * was truncated by the tokenizer or, for strings, does not fit.
+ * 
+ * @param bindings The table.
+ * @param count Number of entries in the table.
+ * @param path, type, value, truncated As passed to the value callback.
+ * @return uint8_t 1 if the path was found in the table, 0 if not.
+ */
+uint8_t json_stream_bind(const json_stream_binding_t *bindings, uint8_t count,
+                         const char *path, json_stream_type_t type, const char *value,
+                         uint8_t truncated);
@@ -0,0 +1,191 @@
+#include "json_writer.h"
+#include <string.h>
+
+void json_writer_init(json_writer_t *w, json_writer_sink_t sink)
+{
+    w->sink = sink;
+    w->length = 0;
+    w->depth = 0;
+    w->empty = 1;
+    w->skip = 0;
+    w->dropped = false;
+}
+
+uint16_t json_writer_length(const json_writer_t *w)
+{
+    return w->length;
+}
+
+bool json_writer_dropped(const json_writer_t *w)
+{
+    return w->dropped;
+}
+
+static void json_writer_put(json_writer_t *w, const char *data, uint16_t length)
+{
+    if (w->sink != NULL && length > 0)
+        w->sink((const uint8_t *)data, length);
+    w->length += length;
+}
+
+static void json_writer_put_char(json_writer_t *w, char c)
+{
+    json_writer_put(w, &c, 1);
+}
+
+void json_writer_raw(json_writer_t *w, const char *text)
+{
+    json_writer_put(w, text, strlen(text));
+}
+
+void json_writer_raw_uint(json_writer_t *w, uint32_t value)
+{
+    char digits[10];
+    uint8_t i = sizeof(digits);
+    do
+    {
+        digits[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+    json_writer_put(w, digits + i, sizeof(digits) - i);
+}
+
+// Text between quotes; runs that need no escaping go to the sink in one piece
+static void json_writer_quoted(json_writer_t *w, const char *text)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    json_writer_put_char(w, '"');
+    const char *run = text;
+    for (; *text != '\0'; text++)
+    {
+        uint8_t c = (uint8_t)*text;
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        json_writer_put(w, run, text - run);
+        run = text + 1;
+
+        char escape[6] = {'\\', (char)c};
+        uint8_t length = 2;
+        if (c == '\n')
+            escape[1] = 'n';
+        else if (c == '\r')
+            escape[1] = 'r';
+        else if (c == '\t')
+            escape[1] = 't';
+        else if (c < 0x20)
+        {
+            escape[1] = 'u';
+            escape[2] = '0';
+            escape[3] = '0';
+            escape[4] = hex[c >> 4];
+            escape[5] = hex[c & 0x0F];
+            length = 6;
+        }
+        json_writer_put(w, escape, length);
+    }
+    json_writer_put(w, run, text - run);
+    json_writer_put_char(w, '"');
+}
+
+// Comma and key in front of every value; false inside a container that is left out
+static bool json_writer_member(json_writer_t *w, const char *key)
+{
+    if (w->skip)
+        return false;
+
+    uint8_t level = 1 << w->depth;
+    if (w->empty & level)
+        w->empty &= ~level;
+    else
+        json_writer_put_char(w, ',');
+
+    if (key != NULL)
+    {
+        json_writer_quoted(w, key);
+        json_writer_put_char(w, ':');
+    }
+    return true;
+}
+
+static void json_writer_open(json_writer_t *w, const char *key, char bracket)
+{
+    // No bit left for its level: leave it out up to the matching close
+    if (w->skip || w->depth == JSON_WRITER_MAX_DEPTH - 1)
+    {
+        w->skip++;
+        w->dropped = true;
+        return;
+    }
+    json_writer_member(w, key);
+    json_writer_put_char(w, bracket);
+    w->depth++;
+    w->empty |= 1 << w->depth;
+}
+
+static void json_writer_close(json_writer_t *w, char bracket)
+{
+    if (w->skip)
+    {
+        w->skip--;
+        return;
+    }
+    json_writer_put_char(w, bracket);
+    if (w->depth > 0)
+        w->depth--;
+}
+
+void json_writer_begin_object(json_writer_t *w, const char *key)
+{
+    json_writer_open(w, key, '{');
+}
+
+void json_writer_end_object(json_writer_t *w)
+{
+    json_writer_close(w, '}');
+}
+
+void json_writer_begin_array(json_writer_t *w, const char *key)
+{
+    json_writer_open(w, key, '[');
+}
+
+void json_writer_end_array(json_writer_t *w)
+{
+    json_writer_close(w, ']');
+}
+
+void json_writer_int(json_writer_t *w, const char *key, int32_t value)
+{
+    if (!json_writer_member(w, key))
+        return;
+    if (value < 0)
+    {
+        json_writer_put_char(w, '-');
+        json_writer_raw_uint(w, -(uint32_t)value);
+    }
+    else
+        json_writer_raw_uint(w, value);
+}
+
+void json_writer_uint(json_writer_t *w, const char *key, uint32_t value)
+{
+    if (!json_writer_member(w, key))
+        return;
+    json_writer_raw_uint(w, value);
+}
+
+void json_writer_bool(json_writer_t *w, const char *key, bool value)
+{
+    if (!json_writer_member(w, key))
+        return;
+    json_writer_raw(w, value ? "true" : "false");
+}
+
+void json_writer_string(json_writer_t *w, const char *key, const char *value)
+{
+    if (!json_writer_member(w, key))
+        return;
+    json_writer_quoted(w, value);
+}
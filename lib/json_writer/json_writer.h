@@ -0,0 +1,145 @@
+/**
+ * @file json_writer.h
+ * @brief Streaming JSON writer without an output buffer.
+ *
+ * Every piece of the document is handed to a sink as soon as it is written, e.g. to
+ * wifi_TCP_write() while an AT+CIPSEND is in progress, so the document never has to
+ * exist in memory as a whole. Numbers are converted by hand, so printf is not needed.
+ *
+ * A writer without a sink only counts. Writing the same document once without a sink
+ * gives its length, e.g. for Content-Length, before it is written for real:
+ *
+ *     json_writer_t w;
+ *     json_writer_init(&w, NULL);
+ *     write_document(&w);
+ *     uint16_t length = json_writer_length(&w);
+ *
+ * Members of an object take a key, values in an array and the top level value take NULL.
+ * Commas are inserted automatically.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief Nesting limit. At most JSON_WRITER_MAX_DEPTH - 1 objects and arrays can be
+ * open at the same time. A deeper one is left out with everything in it up to its
+ * end, so the rest of the document stays valid, and json_writer_dropped() tells.
+ *
+ */
+#define JSON_WRITER_MAX_DEPTH 8
+
+/**
+ * @brief Type definition for the function that receives the written bytes.
+ *
+ * @param data The bytes. Only valid during the call.
+ * @param length Number of bytes.
+ */
+typedef void (*json_writer_sink_t)(const uint8_t *data, uint16_t length);
+
+/**
+ * @brief State of one document. Use the functions, not the fields.
+ *
+ */
+typedef struct {
+    json_writer_sink_t sink;
+    uint16_t length;
+    uint8_t  depth;
+    uint8_t  empty;         /* bit n set: nothing written yet at level n */
+    uint8_t  skip;          /* containers open past the limit, left out */
+    bool     dropped;
+} json_writer_t;
+
+/**
+ * @brief Prepare the writer for a new document.
+ *
+ * @param w The writer.
+ * @param sink Receives the output. NULL to only count it.
+ */
+void json_writer_init(json_writer_t *w, json_writer_sink_t sink);
+
+/**
+ * @brief Number of bytes written so far, including json_writer_raw() text.
+ *
+ * @param w The writer.
+ * @return uint16_t The length.
+ */
+uint16_t json_writer_length(const json_writer_t *w);
+
+/**
+ * @brief Tell whether a container was left out for nesting too deep.
+ *
+ * @param w The writer.
+ * @return bool true if part of the document is missing.
+ */
+bool json_writer_dropped(const json_writer_t *w);
+
+/**
+ * @brief Start an object. End it with json_writer_end_object().
+ *
+ * @param w The writer.
+ * @param key Member name, or NULL.
+ */
+void json_writer_begin_object(json_writer_t *w, const char *key);
+void json_writer_end_object(json_writer_t *w);
+
+/**
+ * @brief Start an array. End it with json_writer_end_array().
+ *
+ * @param w The writer.
+ * @param key Member name, or NULL.
+ */
+void json_writer_begin_array(json_writer_t *w, const char *key);
+void json_writer_end_array(json_writer_t *w);
+
+/**
+ * @brief Write a signed number.
+ *
+ * @param w The writer.
+ * @param key Member name, or NULL.
+ * @param value The number.
+ */
+void json_writer_int(json_writer_t *w, const char *key, int32_t value);
+
+/**
+ * @brief Write an unsigned number.
+ *
+ * @param w The writer.
+ * @param key Member name, or NULL.
+ * @param value The number.
+ */
+void json_writer_uint(json_writer_t *w, const char *key, uint32_t value);
+
+/**
+ * @brief Write true or false.
+ *
+ * @param w The writer.
+ * @param key Member name, or NULL.
+ * @param value The value.
+ */
+void json_writer_bool(json_writer_t *w, const char *key, bool value);
+
+/**
+ * @brief Write a string. Quotes, backslashes and control characters are escaped.
+ *
+ * @param w The writer.
+ * @param key Member name, or NULL.
+ * @param value Null terminated text.
+ */
+void json_writer_string(json_writer_t *w, const char *key, const char *value);
+
+/**
+ * @brief Write text as it is, e.g. the HTTP headers in front of the document.
+ *
+ * @param w The writer.
+ * @param text Null terminated text.
+ */
+void json_writer_raw(json_writer_t *w, const char *text);
+
+/**
+ * @brief Write an unsigned number as it is, e.g. a Content-Length.
+ *
+ * @param w The writer.
+ * @param value The number.
+ */
+void json_writer_raw_uint(json_writer_t *w, uint32_t value);
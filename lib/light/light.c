@@ -11,14 +11,21 @@
 
 #include "light.h"
 #include "includes.h"
+#include "adc.h"
+#include "fixed.h"
 #ifdef __AVR__
 #include <avr/io.h>
 
-//A15 PK7!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+// 4 conversions per reading, averaged back to 10 bits
+#define LIGHT_EXTRA_BITS 1
+
+static adc_channel_t light_channel = ADC_CHANNEL_NONE;
+
+//A15 PK7!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 /**
  * @brief Initialize ADC for photoresistor
  *
- * This function initializes the ADC to read values from the photoresistor connected to pin PK1 (ADC9).
+ * This function adds the photoresistor on PK7 (ADC15) to the background ADC scan.
  */
 void light_init(void) {
 
@@ -29,52 +36,26 @@ void light_init(void) {
     //GND
     //DDRK|=(1 << PK1);
 
-    // Set reference voltage to AVCC and left adjust ADC result
-    ADMUX = (1 << REFS0);
-    // Enable ADC and set prescaler to 64 (16MHz/128 = 125kHz)
-    // ADC must operate between 50kHz and 200kHz for its full 10-bit resolution
-    ADCSRA = (1 << ADEN) | (1 << ADPS2) | (1 << ADPS1)| (1 << ADPS0);
-    
-
-    // Disable digital input on PK2 (ADC10) (page 287)
-    // This will reduce power consumption on the pin
-    DIDR2 = (1 << ADC15D);
-
+    adc_init();
+    light_channel = adc_add(15, LIGHT_EXTRA_BITS);
 }
 
 /**
  * @brief Read value from photoresistor
  *
- * This function reads the ADC value from the photoresistor connected to pin PK1 (ADC9).
+ * This function returns the latest reading of the background ADC scan, so it does not
+ * wait for a conversion.
  *
  * @return 10-bit ADC value read from the photoresistor
  */
 uint16_t light_read(void) {
-
-uint32_t timeout = 40000;//if 2cc for incrementing and evaluation the timeout is 5ms
-    // The  MUX1:5 should be set to 100111 for choosing ADC15, which ius placed on PK0 (look at page 283)
-    ADMUX |= (1<<MUX2)|(1<<MUX1)|(1<<MUX0);
-    ADMUX &= ~((1<<MUX4)|(1<<MUX3));
-    ADCSRB |= (1<<MUX5);
-
-    // Start the conversion
-    ADCSRA |= (1 << ADSC);
-
-    // Wait for the conversion to complete
-    while ((ADCSRA & (1 << ADSC))&& timeout > 0){timeout--;};
-
-    // Read the 10-bit ADC value
-    // ADCL must be read first, then ADCH
-    uint16_t adc_value = ADCL;
-    adc_value |= (ADCH << 8);
-
-    return adc_value;
+    return adc_latest(light_channel) >> LIGHT_EXTRA_BITS;
 }
 
 uint8_t light_get_percentage(void) {
     uint16_t raw = light_read();
-    uint16_t inverted = 1023.00 - raw;
-    return ((inverted * 100.00) / 1023.00);   
+    // Bright reads low
+    return fixed_percent(1023 - raw, 1023);
 }
 
 #endif
@@ -16,14 +16,15 @@
 /**
  * @brief Initialize ADC for photoresistor
  *
- * This function initializes the ADC to read values from the photoresistor connected to pin PK1 (ADC9).
+ * This function adds the photoresistor on PK7 (ADC15) to the background ADC scan.
  */
 void light_init(void);
 
 /**
  * @brief Read value from photoresistor
  *
- * This function reads the ADC value from the photoresistor connected to pin PK1 (ADC9).
+ * This function returns the latest reading of the background ADC scan, so it does not
+ * wait for a conversion.
  *
  * @return 10-bit ADC value read from the photoresistor
  */
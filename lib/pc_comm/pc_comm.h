@@ -49,6 +49,7 @@ void pc_comm_send_string_blocking(char *string);
 
 /**
  * @brief Send an array of data to the PC without blocking the execution.
+ * The data is copied into the UART transmit ring buffer, so the caller can reuse it right away.
  * 
  * @param str Pointer to the array of data to send.
  * @param len Length of the data to send.
@@ -2,8 +2,16 @@
  * @file periodic_task.c
  * @brief Periodic Task Driver implementation for ATmega2560
  *
- * This file provides the implementation for initializing Timer0 and attaching user functions
- * that will be called at different frequencies.
+ * Hashed timer wheel on a 1 ms Timer5 tick. Slot n holds a doubly linked list of the
+ * timers whose expiry tick is n modulo the wheel size; the links are indices into the
+ * timer table, so the wheel needs no memory beyond the table. The tick only counts
+ * releases, the callbacks run from periodic_task_run() in the main loop.
+ *
+ * Tickless: after each interrupt the compare value is moved as far as the next
+ * expiry (at most PERIODIC_TASK_MAX_SPAN ticks). The interrupt then moves the time
+ * over the whole span at once and walks at most one turn of the wheel, releasing
+ * every timer that is due by then, so its cost does not grow with the span. Adding
+ * or moving a timer shortens a span that would pass it.
  *
  * @author Your Name
  * @date September 2023
@@ -11,202 +19,424 @@
 
 #include "periodic_task.h"
 #include "includes.h"
+#include "timers.h"
+#include <string.h>
+
+#define WHEEL_MASK (PERIODIC_TASK_WHEEL_SIZE - 1)
+#define NIL 0xFF
+
+// Timer5 counts per millisecond tick: 16 MHz / 64
+#define TICK_COUNTS 250U
+// Longest interrupt period; its compare value must fit in 16 bits
+#define PERIODIC_TASK_MAX_SPAN 262U
+
+TIMERS_CLAIM(TIMER5);
+TIMERS_CLAIM(TIMER5_COMPA);
+
+enum
+{
+    FREE,
+    WAITING,    // in the wheel
+    EXPIRED     // one-shot timer out of the wheel, its release not run yet
+};
+
+typedef struct
+{
+    void (*function)(void);
+    uint32_t period;    // 0 for a one-shot timer
+    uint32_t expires;   // tick of the next release
+    uint32_t released;  // tick of the oldest release not run yet
+    uint16_t overruns;
+    uint8_t pending;    // releases not run yet
+    uint8_t priority;
+    uint8_t next, prev; // neighbours in the slot
+    uint8_t state;
+} periodic_task_timer_t;
+
+static periodic_task_timer_t timers[PERIODIC_TASK_MAX_TIMERS];
+static uint8_t wheel[PERIODIC_TASK_WHEEL_SIZE];
+
+static uint32_t now; // last tick that was processed
+static uint16_t tick_span; // ticks from one interrupt to the next
+static uint32_t wakeup; // tick the interrupt must come by, for periodic_task_wake_within()
+static uint8_t wakeup_set;
+
+#ifdef WINDOWS_TEST
+uint16_t periodic_task_slots_walked; // by the last interrupt, for the tests
+#endif
 
+#if PERIODIC_TASK_PROFILE
+static periodic_task_profile_t profiles[PERIODIC_TASK_MAX_TIMERS];
 
-static void (*user_func_a)(void);  // Pointer to first user function
-static void (*user_func_b)(void);  // Pointer to second user function
-static void (*user_func_c)(void);  // Pointer to third user function
-static void (*user_func_d)(void);  // Pointer to fourth user function!
-
-void periodic_task_disable_b();
-
-static uint16_t ocr3_value = 0;
-static uint16_t ocr3c_value = 0;
-static uint16_t ocr4_value = 0;
-static uint16_t ocr5_value = 0;
+static void periodic_task_profile_clear(uint8_t i)
+{
+    memset(&profiles[i], 0, sizeof(profiles[i]));
+    profiles[i].min_us = UINT32_MAX;
+}
 
-static uint16_t cnt_a = 0;
-static uint16_t cnt_b = 0;
-static uint16_t cnt_c = 0;
-static uint16_t cnt_d = 0;
+static void periodic_task_profile_record(uint8_t i, uint32_t us, uint32_t jitter_ms)
+{
+    periodic_task_profile_t *profile = &profiles[i];
+    if (profile->runs < UINT32_MAX)
+        profile->runs++;
+    profile->last_us = us;
+    if (us < profile->min_us)
+        profile->min_us = us;
+    if (us > profile->max_us)
+        profile->max_us = us;
+
+    profile->jitter_ms = jitter_ms > UINT16_MAX ? UINT16_MAX : jitter_ms;
+    if (profile->jitter_ms > profile->max_jitter_ms)
+        profile->max_jitter_ms = profile->jitter_ms;
+
+    uint8_t bucket = 0;
+    while (bucket < PERIODIC_TASK_PROFILE_BUCKETS - 1 && us >= PERIODIC_TASK_PROFILE_BUCKET_US(bucket))
+        bucket++;
+    if (profile->histogram[bucket] < UINT16_MAX)
+        profile->histogram[bucket]++;
+}
+#endif
 
-static uint16_t loops_a = 0;
-static uint16_t loops_b = 0;
-static uint16_t loops_c = 0;
-static uint16_t loops_d = 0;
+static void wheel_insert(uint8_t i)
+{
+    uint8_t slot = timers[i].expires & WHEEL_MASK;
+    timers[i].prev = NIL;
+    timers[i].next = wheel[slot];
+    if (wheel[slot] != NIL)
+        timers[wheel[slot]].prev = i;
+    wheel[slot] = i;
+    timers[i].state = WAITING;
+}
 
+static void wheel_remove(uint8_t i)
+{
+    if (timers[i].prev != NIL)
+        timers[timers[i].prev].next = timers[i].next;
+    else
+        wheel[timers[i].expires & WHEEL_MASK] = timers[i].next;
+    if (timers[i].next != NIL)
+        timers[timers[i].next].prev = timers[i].prev;
+}
 
-// Timer0 Compare Match A interrupt service routine
-#ifndef WINDOWS_TEST
-ISR(TIMER3_COMPA_vect) {
-    if (cnt_a==0)
-    {
-        OCR3A=OCR3A+ocr3_value;
-        cnt_a=loops_a;
-        user_func_a();
-        
-    }
-    else{
-        cnt_a--;
-    }
+static void periodic_task_release(uint8_t i, uint32_t tick)
+{
+    if (timers[i].pending == 0)
+        timers[i].released = tick;
+    else if (timers[i].overruns < UINT16_MAX)
+        timers[i].overruns++; // the previous release has not even started
+    if (timers[i].pending < UINT8_MAX)
+        timers[i].pending++;
 }
 
-ISR(TIMER4_COMPB_vect) {
-    if (cnt_b==0)
+// Release the timers of a slot that are due by now, also those a replan passed
+static void periodic_task_expire(uint8_t slot)
+{
+    for (uint8_t i = wheel[slot]; i != NIL;)
     {
-
-        OCR4B=OCR4B+ocr4_value;
-        cnt_b=loops_b;
-        periodic_task_disable_b();
-        
-        user_func_b();
-
-    }
-    else{
-        cnt_b--;
+        uint8_t next = timers[i].next;
+        if ((int32_t)(timers[i].expires - now) <= 0)
+        {
+            wheel_remove(i);
+            if (timers[i].period != 0)
+            {
+                do
+                {
+                    periodic_task_release(i, timers[i].expires);
+                    timers[i].expires += timers[i].period;
+                } while ((int32_t)(timers[i].expires - now) <= 0);
+                wheel_insert(i);
+            }
+            else
+            {
+                timers[i].state = EXPIRED;
+                periodic_task_release(i, timers[i].expires);
+            }
+        }
+        i = next;
     }
 }
 
-ISR(TIMER3_COMPC_vect) {
-    if (cnt_c==0)
-    {
-        OCR3C=OCR3C+ocr3c_value;
-        cnt_c=loops_c;
-        user_func_c();
-        
-    }
-    else{
-        cnt_c--;
-    }
+static void periodic_task_set_span(uint16_t span)
+{
+    tick_span = span;
+    OCR5A = span * TICK_COUNTS - 1;
 }
 
-ISR(TIMER5_COMPA_vect) {
-    if (cnt_d==0)
+// Ticks from now until something is due, 1 .. PERIODIC_TASK_MAX_SPAN
+static uint16_t periodic_task_quiet_ticks(void)
+{
+    uint32_t quiet = PERIODIC_TASK_MAX_SPAN;
+    if (wakeup_set)
     {
-
-        OCR5A=OCR5A+ocr5_value;
-        cnt_d=loops_d;
-        
-        user_func_d();
-
-    }
-    else{
-        cnt_d--;
+        if ((int32_t)(wakeup - now) <= 0)
+            wakeup_set = 0;
+        else if (wakeup - now < quiet)
+            quiet = wakeup - now;
     }
+    for (uint8_t i = 0; i < PERIODIC_TASK_MAX_TIMERS; i++)
+        if (timers[i].state == WAITING && timers[i].expires - now < quiet)
+            quiet = timers[i].expires - now;
+    return quiet == 0 ? 1 : quiet;
 }
-#endif
-
-
-static void init_timer3(){
-// Set Timer0 to CTC (Clear Timer on Compare Match) mode
-    TCCR3A = 0;
 
-    // Set the prescaler to 1024
-    TCCR3B = (1 << CS32) | (1 << CS30);
-
-    // Enable global interrupts
-    sei();
+// Ticks of the current span that have passed but are not processed yet
+static uint16_t periodic_task_counted(void)
+{
+    uint16_t counts = TCNT5;
+    // The span ended but its interrupt is still to come: the counter restarted
+    if ((TIFR5 & (1 << OCF5A)) && counts < tick_span * (TICK_COUNTS / 2))
+        return tick_span + counts / TICK_COUNTS;
+    return counts / TICK_COUNTS;
 }
 
-static void init_timer4(){
-// Set Timer0 to CTC (Clear Timer on Compare Match) mode
-    TCCR4A = 0;
-
-    // Set the prescaler to 1024
-    TCCR4B = (1 << CS32) | (1 << CS30);
+// Fit the running span to the timers after one was added or moved. Interrupts off.
+static void periodic_task_replan(void)
+{
+#if PERIODIC_TASK_TICKLESS
+    if (TIFR5 & (1 << OCF5A))
+        return; // the interrupt is about to plan anyway
+    uint16_t counted = TCNT5 / TICK_COUNTS;
+    uint16_t span = periodic_task_quiet_ticks();
+    if (span <= counted)
+        span = counted + 1;
+    // Keep the compare value ahead of the counter, which runs on meanwhile
+    if ((uint16_t)(span * TICK_COUNTS - 1) - TCNT5 < 2)
+        span++;
+    periodic_task_set_span(span);
+#endif
+}
 
-    // Enable global interrupts
-    sei();
+// Timer5 Compare Match A interrupt service routine, at the end of each span. It only
+// marks timers as ready; periodic_task_run() calls them.
+#ifndef WINDOWS_TEST
+ISR(TIMER5_COMPA_vect)
+#else
+void TIMER5_COMPA_vect(void)
+#endif
+{
+    now += tick_span;
+    // A span longer than the wheel visits every slot, one turn is enough
+    uint16_t slots = tick_span < PERIODIC_TASK_WHEEL_SIZE ? tick_span : PERIODIC_TASK_WHEEL_SIZE;
+#ifdef WINDOWS_TEST
+    periodic_task_slots_walked = 0;
+#endif
+    for (uint32_t tick = now - slots + 1; slots > 0; slots--, tick++)
+    {
+        periodic_task_expire(tick & WHEEL_MASK);
+#ifdef WINDOWS_TEST
+        periodic_task_slots_walked++;
+#endif
+    }
+#if PERIODIC_TASK_TICKLESS
+    periodic_task_set_span(periodic_task_quiet_ticks());
+#endif
 }
 
-static void init_timer5(){
-// Set Timer0 to CTC (Clear Timer on Compare Match) mode
+void periodic_task_init(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    for (uint8_t i = 0; i < PERIODIC_TASK_MAX_TIMERS; i++)
+        timers[i].state = FREE;
+    for (uint8_t slot = 0; slot < PERIODIC_TASK_WHEEL_SIZE; slot++)
+        wheel[slot] = NIL;
+    now = 0;
+    wakeup_set = 0;
+
+    // CTC mode, 16 MHz / 64 / 250 = 1 kHz
     TCCR5A = 0;
-
-    // Set the prescaler to 1024
-    TCCR5B = (1 << CS32) | (1 << CS30);
-
-    // Enable global interrupts
-    sei();
+    TCCR5B = (1 << WGM52) | (1 << CS51) | (1 << CS50);
+    TCNT5 = 0;
+    periodic_task_set_span(1);
+    TIFR5 = (1 << OCF5A);
+    TIMSK5 |= (1 << OCIE5A);
+    SREG = sreg;
 }
 
+static periodic_task_t periodic_task_start(void (*user_function)(void), uint32_t period, uint32_t delay)
+{
+    if (user_function == NULL || delay == 0)
+        return PERIODIC_TASK_NONE;
 
-void periodic_task_init_a(void (*user_function_a)(void), uint32_t interval_ms_a) {
-    user_func_a = user_function_a;
-    init_timer3();
-
-    // Calculate the OCR3A value
-    /*
-    cnt=(interval_ms_a/1000*(F_CPU/1024))/0xFFFF
-    */
-    cnt_a = (interval_ms_a/1000*(F_CPU/1024))/0xFFFF;//(interval_ms_a*125)>>19;
-    loops_a=cnt_a;
-    ocr3_value=(uint32_t)interval_ms_a*(F_CPU/1024)/1000-(uint32_t)cnt_a*0xFFFF;
-    
-    OCR3A = ocr3_value;
+    periodic_task_t task = PERIODIC_TASK_NONE;
+    uint8_t sreg = SREG;
+    cli();
+    for (uint8_t i = 0; i < PERIODIC_TASK_MAX_TIMERS; i++)
+    {
+        if (timers[i].state == FREE)
+        {
+            timers[i].function = user_function;
+            timers[i].period = period;
+            timers[i].pending = 0;
+            timers[i].overruns = 0;
+            timers[i].priority = 0;
+            timers[i].expires = now + periodic_task_counted() + delay;
+            wheel_insert(i);
+            periodic_task_replan();
+#if PERIODIC_TASK_PROFILE
+            periodic_task_profile_clear(i);
+#endif
+            task = i;
+            break;
+        }
+    }
+    SREG = sreg;
+    return task;
+}
 
-    // Enable Timer3 Compare Match A interrupt
-    TIMSK3 |= (1 << OCIE3A);
+periodic_task_t periodic_task_add(void (*user_function)(void), uint32_t period_ms, uint32_t offset_ms)
+{
+    if (period_ms == 0)
+        return PERIODIC_TASK_NONE;
+    return periodic_task_start(user_function, period_ms, offset_ms + period_ms);
 }
 
+periodic_task_t periodic_task_add_oneshot(void (*user_function)(void), uint32_t delay_ms)
+{
+    return periodic_task_start(user_function, 0, delay_ms);
+}
 
-void periodic_task_init_b(void (*user_function_b)(void), uint32_t interval_ms_b) {
-    user_func_b = user_function_b;
-    init_timer4();
-    TCNT4 = 0;
+void periodic_task_cancel(periodic_task_t task)
+{
+    if (task < 0 || task >= PERIODIC_TASK_MAX_TIMERS)
+        return;
+
+    uint8_t sreg = SREG;
+    cli();
+    if (timers[task].state == WAITING)
+        wheel_remove(task);
+    timers[task].state = FREE;
+    timers[task].pending = 0;
+    SREG = sreg;
+}
 
-    cnt_b = (interval_ms_b/1000*(F_CPU/1024))/0xFFFF;//(interval_ms_a*125)>>19;
-    loops_b=cnt_b;
-    ocr4_value=(uint32_t)interval_ms_b*(F_CPU/1024)/1000-(uint32_t)cnt_b*0xFFFF;
-    
-    uint32_t next_compare = (uint32_t)TCNT4 + ocr4_value;
-    OCR4B = (uint16_t)(next_compare & 0xFFFF);
+void periodic_task_reschedule(periodic_task_t task, uint32_t delay_ms)
+{
+    if (task < 0 || task >= PERIODIC_TASK_MAX_TIMERS || delay_ms == 0)
+        return;
 
-    // Enable Timer3 Compare Match B interrupt
-    TIFR4 |= (1 << OCF4B);
-    TIMSK4 |= (1 << OCIE4B);
+    uint8_t sreg = SREG;
+    cli();
+    if (timers[task].state != FREE)
+    {
+        if (timers[task].state == WAITING)
+            wheel_remove(task);
+        timers[task].expires = now + periodic_task_counted() + delay_ms;
+        wheel_insert(task);
+        periodic_task_replan();
+    }
+    SREG = sreg;
 }
 
-void periodic_task_disable_b( ) {
+void periodic_task_set_priority(periodic_task_t task, uint8_t priority)
+{
+    if (task < 0 || task >= PERIODIC_TASK_MAX_TIMERS)
+        return;
+    timers[task].priority = priority;
+}
 
-    // TIFR1 |= (1 << OCF1A);
-    TIMSK4 &= ~(1 << OCIE4B);
+uint16_t periodic_task_overruns(periodic_task_t task)
+{
+    if (task < 0 || task >= PERIODIC_TASK_MAX_TIMERS)
+        return 0;
 
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t overruns = timers[task].overruns;
+    SREG = sreg;
+    return overruns;
 }
 
-void periodic_task_init_c(void (*user_function_c)(void), uint32_t interval_ms_c) {
-    user_func_c = user_function_c;
-    init_timer3();
-
-    cnt_c = (interval_ms_c/1000*(F_CPU/1024))/0xFFFF;//(interval_ms_a*125)>>19;
-    loops_c=cnt_c;
-    ocr3c_value=(uint32_t)interval_ms_c*(F_CPU/1024)/1000-(uint32_t)cnt_c*0xFFFF;
-    
-    OCR3C = ocr3c_value;
+uint8_t periodic_task_run(void)
+{
+    uint8_t sreg = SREG;
+    cli();
 
+    // Highest priority first, then the one that has waited longest
+    uint8_t best = NIL;
+    for (uint8_t i = 0; i < PERIODIC_TASK_MAX_TIMERS; i++)
+    {
+        if (timers[i].state == FREE || timers[i].pending == 0)
+            continue;
+        if (best == NIL || timers[i].priority > timers[best].priority ||
+            (timers[i].priority == timers[best].priority &&
+             (int32_t)(timers[i].released - timers[best].released) < 0))
+            best = i;
+    }
+    if (best == NIL)
+    {
+        SREG = sreg;
+        return 0;
+    }
 
-    // Enable Timer0 Compare Match C interrupt
-    TIMSK3 |= (1 << OCIE3C);
+    void (*function)(void) = timers[best].function;
+#if PERIODIC_TASK_PROFILE
+    // Lateness against the time now: inside a tickless span now lags behind it
+    uint32_t jitter_ms = now + periodic_task_counted() - timers[best].released;
+#endif
+    if (--timers[best].pending > 0)
+        timers[best].released += timers[best].period;
+    else if (timers[best].state == EXPIRED)
+        timers[best].state = FREE;
+    SREG = sreg;
+
+#if PERIODIC_TASK_PROFILE
+    uint32_t start_us = timers_micros();
+    function();
+    periodic_task_profile_record(best, timers_micros() - start_us, jitter_ms);
+#else
+    function();
+#endif
+    return 1;
 }
 
-void periodic_task_init_d(void (*user_function_d)(void), uint32_t interval_ms_d) {
-    user_func_d = user_function_d;
-    init_timer5();
-
-    cnt_d = (interval_ms_d/1000*(F_CPU/1024))/0xFFFF;//(interval_ms_a*125)>>19;
-    loops_d=cnt_d;
-    ocr5_value=(uint32_t)interval_ms_d*(F_CPU/1024)/1000-(uint32_t)cnt_d*0xFFFF;
-    
-    OCR5A = ocr5_value;
-
+uint32_t periodic_task_ticks(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint32_t ticks = now + periodic_task_counted();
+    SREG = sreg;
+    return ticks;
+}
 
-    // Enable Timer0 Compare Match C interrupt
-    TIMSK5 |= (1 << OCIE5A);
+uint8_t periodic_task_ready(void)
+{
+    for (uint8_t i = 0; i < PERIODIC_TASK_MAX_TIMERS; i++)
+        if (timers[i].state != FREE && timers[i].pending != 0)
+            return 1;
+    return 0;
 }
 
+void periodic_task_wake_within(uint32_t ms)
+{
+    if (ms == 0)
+        ms = 1;
+    uint8_t sreg = SREG;
+    cli();
+    uint32_t at = now + periodic_task_counted() + ms;
+    if (!wakeup_set || (int32_t)(at - wakeup) < 0)
+    {
+        wakeup = at;
+        wakeup_set = 1;
+        periodic_task_replan();
+    }
+    SREG = sreg;
+}
 
-// not done yet... 
-float get_exact_interval_a(void) {
-    return ((float)(OCR3A + 1) / (F_CPU / 1024)) * 1000.0;
+#if PERIODIC_TASK_PROFILE
+uint8_t periodic_task_profile(periodic_task_t task, periodic_task_profile_t *profile)
+{
+    if (task < 0 || task >= PERIODIC_TASK_MAX_TIMERS || timers[task].state == FREE)
+        return 0;
+    *profile = profiles[task];
+    profile->overruns = periodic_task_overruns(task);
+    return 1;
 }
 
+void periodic_task_profile_reset(periodic_task_t task)
+{
+    if (task < 0 || task >= PERIODIC_TASK_MAX_TIMERS)
+        return;
+    periodic_task_profile_clear(task);
+}
+#endif
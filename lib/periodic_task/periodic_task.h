@@ -2,8 +2,30 @@
  * @file periodic_task.h
  * @brief Periodic Task Driver for ATmega2560
  *
- * This file provides the API for initializing Timer0 and attaching user functions
- * that will be called at different frequencies.
+ * Software timers on one hardware timer. Timer5 ticks every millisecond and drives a
+ * hashed timer wheel: every timer is kept in the slot of the tick it expires on, so
+ * each tick only looks at the timers in one slot.
+ *
+ * Any number of tasks, up to PERIODIC_TASK_MAX_TIMERS, share the one hardware timer.
+ * The Timer5 interrupt only marks a timer as ready when it expires (a release). The
+ * callbacks are called by periodic_task_run() from the main loop, so they run with
+ * interrupts enabled and may take as long as they need: UART reception, the display
+ * and the tick itself keep running meanwhile.
+ *
+ * The tick is suppressed while nothing is due: the interrupt comes at the next expiry
+ * instead of every millisecond, so an idle CPU is not woken for nothing (see
+ * PERIODIC_TASK_TICKLESS). Finding the next expiry looks at every timer, so in this
+ * mode adding or moving a timer, periodic_task_wake_within() and each interrupt take
+ * time in proportion to PERIODIC_TASK_MAX_TIMERS.
+ *
+ * Ready tasks run by priority, and tasks of the same priority in the order they were
+ * released. Every release is run, so a task that had to wait catches up. A release
+ * while the previous one of the same task has not started yet is an overrun.
+ *
+ * Every run is measured on timers_micros(): how long the callback took, and how late
+ * it started after its release (the jitter). periodic_task_profile() returns the
+ * statistics of a task, to choose periods that fit and to find a task that starves
+ * the others.
  *
  * @author Laurits Anesen
  * @date September 2023
@@ -11,27 +33,184 @@
 
 #pragma once
 #include <stdint.h>
+
+/**
+ * @brief Number of timers that can exist at the same time.
+ *
+ */
+#ifndef PERIODIC_TASK_MAX_TIMERS
+#define PERIODIC_TASK_MAX_TIMERS 8
+#endif
+
+/**
+ * @brief Number of slots in the wheel, a power of two. A timer further away than this
+ * many ticks is passed over once per turn of the wheel until it is due.
+ *
+ */
+#ifndef PERIODIC_TASK_WHEEL_SIZE
+#define PERIODIC_TASK_WHEEL_SIZE 32
+#endif
+
+#if (PERIODIC_TASK_WHEEL_SIZE & (PERIODIC_TASK_WHEEL_SIZE - 1)) != 0
+#error "PERIODIC_TASK_WHEEL_SIZE must be a power of two"
+#endif
+
+/**
+ * @brief Set to 0 for an interrupt on every millisecond tick.
+ *
+ */
+#ifndef PERIODIC_TASK_TICKLESS
+#define PERIODIC_TASK_TICKLESS 1
+#endif
+
+/**
+ * @brief Set to 0 to leave out the execution time statistics.
+ *
+ */
+#ifndef PERIODIC_TASK_PROFILE
+#define PERIODIC_TASK_PROFILE 1
+#endif
+
 /**
- * @brief Initialize Timer0 and attach the first user function
+ * @brief Number of execution time histogram buckets. Bucket i counts the runs shorter
+ * than PERIODIC_TASK_PROFILE_BUCKET_US(i) that do not fit in bucket i - 1; the last
+ * bucket counts everything longer: < 64 us, < 256 us, < 1 ms, < 4 ms, ...
  *
- * This function initializes Timer0 to call the provided function every XX milliseconds.
+ */
+#define PERIODIC_TASK_PROFILE_BUCKETS 8
+#define PERIODIC_TASK_PROFILE_BUCKET_US(i) (64UL << (2 * (i)))
+
+#if PERIODIC_TASK_MAX_TIMERS > 127
+#error "PERIODIC_TASK_MAX_TIMERS must be at most 127"
+#endif
+
+/**
+ * @brief Handle of a timer, PERIODIC_TASK_NONE if none could be created.
  *
- * @param user_function_a Pointer to the first function to be executed
- * @param interval_ms_a Time interval in milliseconds for the first function
  */
-void periodic_task_init_a(void (*user_function_a)(void), uint32_t interval_ms_a);
+typedef int8_t periodic_task_t;
+#define PERIODIC_TASK_NONE ((periodic_task_t)-1)
 
 /**
- * @brief Attach the second user function
+ * @brief Statistics of the runs of one timer, since it was added or reset.
  *
- * This function sets Timer0 to call the provided function every XX milliseconds.
+ */
+typedef struct
+{
+    uint32_t runs;
+    uint32_t last_us, min_us, max_us;  // execution time of the callback
+    uint16_t jitter_ms, max_jitter_ms; // start of the last and latest run after its release
+    uint16_t overruns;
+    uint16_t histogram[PERIODIC_TASK_PROFILE_BUCKETS]; // runs per execution time, saturating
+} periodic_task_profile_t;
+
+/**
+ * @brief Start the 1 ms tick on Timer5 and remove all timers.
  *
- * @param user_function_b Pointer to the second function to be executed
- * @param interval_ms_b Time interval in milliseconds for the second function
  */
-void periodic_task_init_b(void (*user_function_b)(void), uint32_t interval_ms_b);
+void periodic_task_init(void);
 
-void periodic_task_init_c(void (*user_function_c)(void), uint32_t interval_ms_c);
+/**
+ * @brief Call a function periodically.
+ *
+ * The function is called offset_ms + n * period_ms milliseconds from now, n = 1, 2, ...
+ * An offset spreads tasks with the same period over different ticks.
+ *
+ * @param user_function Function to be executed.
+ * @param period_ms Time interval in milliseconds, at least 1.
+ * @param offset_ms Phase offset in milliseconds.
+ * @return periodic_task_t Handle of the timer, PERIODIC_TASK_NONE if all timers are in use.
+ */
+periodic_task_t periodic_task_add(void (*user_function)(void), uint32_t period_ms, uint32_t offset_ms);
 
-void periodic_task_init_d(void (*user_function_d)(void), uint32_t interval_ms_d);
+/**
+ * @brief Call a function once, delay_ms milliseconds from now. The timer is freed
+ * when the function is called.
+ *
+ * @param user_function Function to be executed.
+ * @param delay_ms Delay in milliseconds, at least 1.
+ * @return periodic_task_t Handle of the timer, PERIODIC_TASK_NONE if all timers are in use.
+ */
+periodic_task_t periodic_task_add_oneshot(void (*user_function)(void), uint32_t delay_ms);
 
+/**
+ * @brief Stop a timer and free it. Releases that have not run yet are dropped.
+ *
+ * @param task Handle of the timer. PERIODIC_TASK_NONE and freed timers are ignored.
+ */
+void periodic_task_cancel(periodic_task_t task);
+
+/**
+ * @brief Move the next run of a timer to delay_ms milliseconds from now. A periodic
+ * timer continues with its period from there.
+ *
+ * @param task Handle of the timer. PERIODIC_TASK_NONE and freed timers are ignored.
+ * @param delay_ms Delay in milliseconds, at least 1.
+ */
+void periodic_task_reschedule(periodic_task_t task, uint32_t delay_ms);
+
+/**
+ * @brief Set the priority of a timer. Ready timers with a higher value run first; new
+ * timers have priority 0.
+ *
+ * @param task Handle of the timer.
+ * @param priority The priority.
+ */
+void periodic_task_set_priority(periodic_task_t task, uint8_t priority);
+
+/**
+ * @brief Run the most urgent ready callback. Call it from the main loop.
+ *
+ * @return uint8_t 1 if a callback ran, 0 if none was ready.
+ */
+uint8_t periodic_task_run(void);
+
+/**
+ * @brief Number of times a timer was released again before its previous release ran.
+ *
+ * @param task Handle of the timer.
+ * @return uint16_t Overruns since the timer was added, saturating at 65535.
+ */
+uint16_t periodic_task_overruns(periodic_task_t task);
+
+/**
+ * @brief Milliseconds since periodic_task_init().
+ *
+ * @return uint32_t Tick count.
+ */
+uint32_t periodic_task_ticks(void);
+
+/**
+ * @brief Check whether a callback is waiting for periodic_task_run(). Does not change
+ * anything, so it can be called with interrupts disabled before going to sleep.
+ *
+ * @return uint8_t 1 if periodic_task_run() has something to run.
+ */
+uint8_t periodic_task_ready(void);
+
+/**
+ * @brief Make the tick interrupt come within ms milliseconds, to wake the CPU for a
+ * deadline that is not a timer, e.g. a sleeping protothread.
+ *
+ * @param ms Milliseconds from now.
+ */
+void periodic_task_wake_within(uint32_t ms);
+
+#if PERIODIC_TASK_PROFILE
+/**
+ * @brief Copy the statistics of a timer.
+ *
+ * @param task Handle of the timer.
+ * @param profile Receives the statistics.
+ * @return uint8_t 1 if the timer exists, 0 if not (profile is left unchanged).
+ */
+uint8_t periodic_task_profile(periodic_task_t task, periodic_task_profile_t *profile);
+
+/**
+ * @brief Clear the statistics of a timer, e.g. after reading them. The overrun count
+ * is kept.
+ *
+ * @param task Handle of the timer.
+ */
+void periodic_task_profile_reset(periodic_task_t task);
+#endif
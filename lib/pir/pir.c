@@ -1,5 +1,7 @@
 #include "pir.h"
 #include "includes.h"
+#include "timers.h"
+#include <stddef.h>
 
 /* -------------------------------------------------------------------------- */
 /*  Desktop-test support: when we are NOT compiling for AVR, we need to       */
@@ -25,21 +27,38 @@ uint8_t EICRA, EIMSK;
 
 static pir_callback_t pir_callback = NULL;
 
+/* Latest raw edge, written by the ISR                                       */
+static volatile uint8_t  raw_level;
+static volatile uint32_t raw_ms;
+
+/* Ring of accepted edges                                                    */
+static pir_event_t queue[PIR_QUEUE_SIZE];
+static uint8_t queue_head, queue_tail;
+static uint16_t dropped;
+
+static uint8_t  level;                      /* accepted level of the pin    */
+static uint32_t last_edge_ms;               /* time of the accepted edge    */
+static uint32_t total_ms;                   /* closed motions, summed up    */
+static uint32_t rate[PIR_RATE_MAX];         /* starts of the last motions   */
+static uint8_t  rate_next, rate_count;
+
 
 /* ---------------- ISR definitions ---------------------------------------- */
 /*  In the production build we use the real AVR ISR syntax.  In the Windows  */
 /*  build we compile a normal function so the unit test can call it.         */
 #if defined(__AVR__)
 ISR(INT2_vect)
-{
-    if (pir_callback) pir_callback();
-}
 #else
 void INT2_vect(void)
+#endif
 {
-    if (pir_callback) pir_callback();
+    /* Only the time stamp; a glitch that is already over changes nothing    */
+    uint8_t now_level = (PIN_sig >> P_sig) & 1;
+    if (now_level != raw_level) {
+        raw_level = now_level;
+        raw_ms = timers_millis();
+    }
 }
-#endif
 
 
 /* ---------------- Driver init ------------------------------------------- */
@@ -49,6 +68,13 @@ void pir_init(pir_callback_t callback)
     DDR_sig  &= ~(1 << P_sig);
     PORT_sig |=  (1 << P_sig);
 
+    queue_head = queue_tail = 0;
+    dropped = 0;
+    total_ms = 0;
+    rate_next = rate_count = 0;
+    level = raw_level = (PIN_sig >> P_sig) & 1;
+    last_edge_ms = raw_ms = timers_millis();
+
     /* Trigger INT2 on both edges (ISC21:20 = 11)                            */
     EICRA |= (1 << ISC21) | (1 << ISC20);
     EIMSK |= (1 << INT2);                 /* Enable external interrupt      */
@@ -57,3 +83,93 @@ void pir_init(pir_callback_t callback)
 
     sei();                                /* Enable global interrupts       */
 }
+
+
+/* ---------------- Debouncing -------------------------------------------- */
+/* Take the latest raw edge once the pin has kept its level for the hold-off */
+static uint8_t pir_pending(uint32_t *edge_ms)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint8_t pending = raw_level != level;
+    *edge_ms = raw_ms;
+    SREG = sreg;
+    return pending;
+}
+
+void pir_poll(void)
+{
+    uint32_t edge_ms;
+    if (!pir_pending(&edge_ms) || timers_millis() - edge_ms < PIR_HOLDOFF_MS)
+        return;
+
+    level = !level;
+    if (level) {
+        rate[rate_next] = edge_ms;
+        rate_next = (rate_next + 1) & (PIR_RATE_MAX - 1);
+        if (rate_count < PIR_RATE_MAX) rate_count++;
+    } else {
+        total_ms += edge_ms - last_edge_ms;
+    }
+    last_edge_ms = edge_ms;
+
+    uint8_t next = (queue_head + 1) & (PIR_QUEUE_SIZE - 1);
+    if (next == queue_tail) {
+        dropped++;
+    } else {
+        queue[queue_head].ms = edge_ms;
+        queue[queue_head].rising = level;
+        queue_head = next;
+    }
+
+    if (level && pir_callback) pir_callback();
+}
+
+uint32_t pir_idle_ms(void)
+{
+    uint32_t edge_ms;
+    if (!pir_pending(&edge_ms))
+        return UINT32_MAX;
+    uint32_t since = timers_millis() - edge_ms;
+    return since >= PIR_HOLDOFF_MS ? 0 : PIR_HOLDOFF_MS - since;
+}
+
+
+/* ---------------- Events and aggregates --------------------------------- */
+uint8_t pir_read_event(pir_event_t *event)
+{
+    if (queue_tail == queue_head)
+        return 0;
+    *event = queue[queue_tail];
+    queue_tail = (queue_tail + 1) & (PIR_QUEUE_SIZE - 1);
+    return 1;
+}
+
+uint16_t pir_dropped(void)
+{
+    return dropped;
+}
+
+uint8_t pir_occupied(void)
+{
+    return level;
+}
+
+uint32_t pir_occupancy_ms(void)
+{
+    return level ? timers_millis() - last_edge_ms : 0;
+}
+
+uint32_t pir_occupied_total_ms(void)
+{
+    return total_ms + pir_occupancy_ms();
+}
+
+uint8_t pir_events_per_minute(void)
+{
+    uint32_t now = timers_millis();
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < rate_count; i++)
+        if (now - rate[i] < 60000UL) count++;
+    return count;
+}
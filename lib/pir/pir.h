@@ -1,2 +1,66 @@
+/*  pir.h – HC-SR501 motion sensor on PD2 (INT2)
+ *
+ *  INT2 fires on both edges and the ISR only notes the time of the latest
+ *  one, from timers_millis(). pir_poll(), from the main loop, accepts an
+ *  edge once the pin has kept its new level for PIR_HOLDOFF_MS: bounces and
+ *  noise bursts shorter than that are dropped. The HC-SR501 holds its
+ *  output for seconds, so real motion always passes. Accepted edges keep
+ *  the time of the edge itself. They go into a small ring for
+ *  pir_read_event() and update the aggregates: how long the area has been
+ *  occupied and how many motions started within the last minute.
+ *
+ *  The callback runs from pir_poll() when a motion starts, once per motion.
+ */
+#pragma once
+#include <stdint.h>
+
+/* Edges closer together than this are bounces or noise                      */
+#ifndef PIR_HOLDOFF_MS
+#define PIR_HOLDOFF_MS 200
+#endif
+
+/* Accepted edges the ring holds; a power of two, at most 128                */
+#ifndef PIR_QUEUE_SIZE
+#define PIR_QUEUE_SIZE 8
+#endif
+
+#if (PIR_QUEUE_SIZE & (PIR_QUEUE_SIZE - 1)) != 0 || PIR_QUEUE_SIZE > 128
+#error "PIR_QUEUE_SIZE must be a power of two and at most 128"
+#endif
+
+/* Motions pir_events_per_minute() can count, a power of two                 */
+#define PIR_RATE_MAX 16
+
 typedef void (*pir_callback_t)(void);
-void pir_init(pir_callback_t callback);
\ No newline at end of file
+
+typedef struct {
+    uint32_t ms;        /* timers_millis() of the edge                      */
+    uint8_t  rising;    /* 1: motion started, 0: it ended                   */
+} pir_event_t;
+
+void pir_init(pir_callback_t callback);
+
+/* Accept a pending edge after its hold-off. Call from the main loop         */
+void pir_poll(void);
+
+/* Time until pir_poll() has something to do, to sleep in between;          */
+/* UINT32_MAX if no edge is pending                                          */
+uint32_t pir_idle_ms(void);
+
+/* Take the oldest edge from the ring. Returns 0 if it is empty              */
+uint8_t pir_read_event(pir_event_t *event);
+
+/* Edges lost because the ring was full, since pir_init()                    */
+uint16_t pir_dropped(void);
+
+/* 1 while the sensor reports motion                                         */
+uint8_t pir_occupied(void);
+
+/* How long the current motion has lasted, 0 while there is none             */
+uint32_t pir_occupancy_ms(void);
+
+/* Time the sensor reported motion in total, since pir_init()                */
+uint32_t pir_occupied_total_ms(void);
+
+/* Motions that started within the last 60 s, at most PIR_RATE_MAX           */
+uint8_t pir_events_per_minute(void);
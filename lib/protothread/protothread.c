@@ -0,0 +1,90 @@
+#include "protothread.h"
+#include "timers.h"
+#include <stddef.h>
+
+typedef struct
+{
+    protothread_fn_t function; // NULL for a free slot
+    protothread_t pt;
+} protothread_slot_t;
+
+static protothread_slot_t slots[PROTOTHREAD_MAX_THREADS];
+
+void protothread_sleep(protothread_t *pt, uint32_t ms)
+{
+    pt->wake_ms = timers_millis() + ms;
+    pt->sleeping = 1;
+}
+
+uint8_t protothread_awake(protothread_t *pt)
+{
+    if (pt->sleeping && (int32_t)(timers_millis() - pt->wake_ms) < 0)
+        return 0;
+    pt->sleeping = 0;
+    return 1;
+}
+
+void protothread_init(void)
+{
+    for (uint8_t i = 0; i < PROTOTHREAD_MAX_THREADS; i++)
+        slots[i].function = NULL;
+}
+
+uint8_t protothread_running(protothread_fn_t thread)
+{
+    for (uint8_t i = 0; i < PROTOTHREAD_MAX_THREADS; i++)
+        if (slots[i].function == thread)
+            return 1;
+    return 0;
+}
+
+uint8_t protothread_spawn(protothread_fn_t thread)
+{
+    if (thread == NULL || protothread_running(thread))
+        return 0;
+
+    for (uint8_t i = 0; i < PROTOTHREAD_MAX_THREADS; i++)
+    {
+        if (slots[i].function == NULL)
+        {
+            PT_INIT(&slots[i].pt);
+            slots[i].function = thread;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+uint32_t protothread_idle_ms(void)
+{
+    uint32_t idle = UINT32_MAX;
+    uint32_t now = timers_millis();
+    for (uint8_t i = 0; i < PROTOTHREAD_MAX_THREADS; i++)
+    {
+        if (slots[i].function == NULL)
+            continue;
+        int32_t left = (int32_t)(slots[i].pt.wake_ms - now);
+        if (!slots[i].pt.sleeping || left <= 0)
+            return 0;
+        if ((uint32_t)left < idle)
+            idle = left;
+    }
+    return idle;
+}
+
+uint8_t protothread_run(void)
+{
+    uint8_t called = 0;
+    for (uint8_t i = 0; i < PROTOTHREAD_MAX_THREADS; i++)
+    {
+        if (slots[i].function == NULL)
+            continue;
+        if (slots[i].pt.sleeping && !protothread_awake(&slots[i].pt))
+            continue;
+
+        called++;
+        if (slots[i].function(&slots[i].pt) >= PT_EXITED)
+            slots[i].function = NULL;
+    }
+    return called;
+}
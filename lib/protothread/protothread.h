@@ -0,0 +1,221 @@
+/**
+ * @file protothread.h
+ * @brief Stackless coroutines (protothreads) and a scheduler for them.
+ *
+ * A protothread is a function that returns where it would otherwise wait, and
+ * continues from the same point when it is called again. The point is kept in a
+ * protothread_t of a few bytes instead of a stack, so a slow sequence (a servo
+ * sweep, a pause between two steps) runs interleaved with everything else:
+ *
+ *     static PT_THREAD(blink(protothread_t *pt))
+ *     {
+ *         static uint8_t i;             // locals do not survive a wait: make them static
+ *         PT_BEGIN(pt);
+ *         for (i = 0; i < 3; i++)
+ *         {
+ *             leds_turnOn(1);
+ *             PT_SLEEP_MS(pt, 200);
+ *             leds_turnOff(1);
+ *             PT_SLEEP_MS(pt, 200);
+ *         }
+ *         PT_END(pt);
+ *     }
+ *
+ *     protothread_spawn(blink);         // protothread_run() in the main loop runs it
+ *
+ * The resume points are case labels of a switch on the line number (Duff's device):
+ * - Local variables lose their value at every wait. Keep state in static variables
+ *   or in a struct that is passed in.
+ * - A protothread must not use a switch statement of its own across a wait.
+ * - Only one wait macro may be written per source line.
+ *
+ * A sleeping protothread is not called until its deadline on timers_millis() has
+ * passed, so waiting costs nothing but a comparison in the scheduler.
+ */
+#pragma once
+#include <stdint.h>
+
+/**
+ * @brief Number of protothreads the scheduler can run at the same time.
+ *
+ */
+#ifndef PROTOTHREAD_MAX_THREADS
+#define PROTOTHREAD_MAX_THREADS 4
+#endif
+
+/**
+ * @brief State of a protothread: where it continues, and until when it sleeps.
+ *
+ */
+typedef struct
+{
+    uint16_t line;    // resume point, 0 to start from the beginning
+    uint8_t sleeping;
+    uint32_t wake_ms; // timers_millis() deadline while sleeping
+} protothread_t;
+
+/**
+ * @brief What a protothread returns: it waits, it gave up its turn, or it is done.
+ *
+ */
+#define PT_WAITING 0
+#define PT_YIELDED 1
+#define PT_EXITED 2
+#define PT_ENDED 3
+
+/**
+ * @brief A protothread function that the scheduler can run.
+ *
+ */
+typedef uint8_t (*protothread_fn_t)(protothread_t *pt);
+
+/**
+ * @brief Declare a protothread: PT_THREAD(name(protothread_t *pt, ...)).
+ *
+ */
+#define PT_THREAD(declaration) uint8_t declaration
+
+/**
+ * @brief Make a protothread start from the beginning the next time it is called.
+ *
+ */
+#define PT_INIT(pt)           \
+    do                        \
+    {                         \
+        (pt)->line = 0;       \
+        (pt)->sleeping = 0;   \
+    } while (0)
+
+/**
+ * @brief Start and end of the body of a protothread.
+ *
+ */
+#define PT_BEGIN(pt)                   \
+    {                                  \
+        uint8_t pt_yield_flag = 1;     \
+        (void)pt_yield_flag;           \
+        switch ((pt)->line)            \
+        {                              \
+        case 0:
+
+#define PT_END(pt)                     \
+        }                              \
+        PT_INIT(pt);                   \
+        return PT_ENDED;               \
+    }
+
+/**
+ * @brief Wait until a condition is true. It is checked every time the protothread runs.
+ *
+ */
+#define PT_WAIT_UNTIL(pt, condition)   \
+    do                                 \
+    {                                  \
+        (pt)->line = __LINE__;         \
+    case __LINE__:                     \
+        if (!(condition))              \
+            return PT_WAITING;         \
+    } while (0)
+
+#define PT_WAIT_WHILE(pt, condition) PT_WAIT_UNTIL(pt, !(condition))
+
+/**
+ * @brief Give the other protothreads a turn, and continue on the next run.
+ *
+ */
+#define PT_YIELD(pt)                   \
+    do                                 \
+    {                                  \
+        pt_yield_flag = 0;             \
+        (pt)->line = __LINE__;         \
+    case __LINE__:                     \
+        if (pt_yield_flag == 0)        \
+            return PT_YIELDED;         \
+    } while (0)
+
+/**
+ * @brief Sleep for ms milliseconds. The scheduler does not call the protothread meanwhile.
+ *
+ */
+#define PT_SLEEP_MS(pt, ms)                                    \
+    do                                                         \
+    {                                                          \
+        protothread_sleep(pt, ms);                             \
+        PT_WAIT_UNTIL(pt, protothread_awake(pt));              \
+    } while (0)
+
+/**
+ * @brief Run a child protothread until it is done. The child is called every time
+ * the parent runs, so it must be declared in a variable of the parent that survives
+ * waits, e.g. a static protothread_t.
+ *
+ */
+#define PT_WAIT_THREAD(pt, thread) PT_WAIT_WHILE(pt, (thread) < PT_EXITED)
+
+/**
+ * @brief Start a child protothread from the beginning and wait until it is done.
+ *
+ */
+#define PT_SPAWN(pt, child, thread)    \
+    do                                 \
+    {                                  \
+        PT_INIT(child);                \
+        PT_WAIT_THREAD(pt, thread);    \
+    } while (0)
+
+/**
+ * @brief Stop the protothread here. The next call starts it from the beginning.
+ *
+ */
+#define PT_EXIT(pt)                    \
+    do                                 \
+    {                                  \
+        PT_INIT(pt);                   \
+        return PT_EXITED;              \
+    } while (0)
+
+/**
+ * @brief Used by PT_SLEEP_MS().
+ *
+ */
+void protothread_sleep(protothread_t *pt, uint32_t ms);
+uint8_t protothread_awake(protothread_t *pt);
+
+/**
+ * @brief Remove all protothreads from the scheduler.
+ *
+ */
+void protothread_init(void);
+
+/**
+ * @brief Start a protothread from the beginning. It runs until it returns PT_EXITED
+ * or PT_ENDED.
+ *
+ * @param thread The protothread function.
+ * @return uint8_t 1 if it was started, 0 if it is already running or all
+ * PROTOTHREAD_MAX_THREADS are in use.
+ */
+uint8_t protothread_spawn(protothread_fn_t thread);
+
+/**
+ * @brief Check whether a protothread is running.
+ *
+ * @param thread The protothread function.
+ * @return uint8_t 1 if it has been spawned and has not finished yet.
+ */
+uint8_t protothread_running(protothread_fn_t thread);
+
+/**
+ * @brief How long the scheduler has nothing to do, to decide whether the CPU can sleep.
+ *
+ * @return uint32_t 0 if a protothread is ready to run, the milliseconds until the
+ * first one wakes up if all are sleeping, UINT32_MAX if none is running.
+ */
+uint32_t protothread_idle_ms(void);
+
+/**
+ * @brief Run every protothread that is not sleeping once. Call it from the main loop.
+ *
+ * @return uint8_t The number of protothreads that were called.
+ */
+uint8_t protothread_run(void);
@@ -2,60 +2,146 @@
 
 #include <servo.h>
 #include "includes.h"
+#include "timers.h"
+
+// Timer3 runs the 50 Hz PWM, OC3A on PE3 is the servo signal, and the overflow
+// advances moves. The buzzer keeps OC3C (PE5) as a plain GPIO
+TIMERS_CLAIM(TIMER3);
+TIMERS_CLAIM(TIMER3_COMPA);
+TIMERS_CLAIM(TIMER3_OVF);
+
+// Prescaler 8: 2 ticks per us, 40000 ticks per 20 ms period
+#define TICKS_PER_US 2
+#define PERIOD_TICKS 40000U
+#define PERIOD_MS 20
+
+#define SETTLE_PERIODS ((SERVO_SETTLE_MS + PERIOD_MS - 1) / PERIOD_MS)
+
+// State of a move, for the overflow interrupt
+static volatile uint16_t pulse;        // OCR3A now
+static volatile uint16_t move_from, move_to;
+static volatile uint16_t move_periods, move_done;
+static volatile uint16_t settle;       // periods until settled
+static volatile uint8_t dosing;        // 1: open and holding, then close
+static volatile uint16_t dose_hold;    // periods
+static volatile uint16_t dose_close;   // pulse to close to
+
+// 500..2120 us for 0..180 degrees
+static uint16_t servo_pulse_ticks(uint8_t angle)
+{
+    if (angle > 180)
+        angle = 180;
+    return (((uint16_t)angle) * 9 + 500) * TICKS_PER_US;
+}
 
-#ifdef __AVR__
-#include <avr/io.h>
+static void servo_attach(void)
+{
+    if (TCCR3A & (1 << COM3A1))
+        return;
 
-#define DDR_SERVO DDRE
-#define P_SERVO PE3
-#define PORT_SERVO PORTE
+    DDR_SERVO |= (1 << P_SERVO);
+    // Fast PWM, TOP = ICR3 (mode 14), clear OC3A at the compare match
+    ICR3 = PERIOD_TICKS - 1;
+    OCR3A = pulse;
+    TCCR3A = (1 << COM3A1) | (1 << WGM31);
+    TCCR3B = (1 << WGM33) | (1 << WGM32) | (1 << CS31);
+}
 
-#include <util/delay.h>
+static void servo_start(uint16_t from, uint16_t to, uint16_t periods)
+{
+    uint8_t sreg = SREG;
+    cli();
+    servo_attach();
+    move_from = from;
+    move_to = to;
+    move_periods = periods;
+    move_done = 0;
+    if (periods == 0)
+        OCR3A = pulse = to;
+    settle = SETTLE_PERIODS;
+    TIFR3 = (1 << TOV3);
+    TIMSK3 |= (1 << TOIE3);
+    SREG = sreg;
+}
 
 void servo(uint8_t angle)
 {
-    // Initialize as output
-    DDR_SERVO |= (1 << P_SERVO);
+    servo_move(angle, 0);
+}
 
-    if (angle < 0)
-        angle = 0;
-    if (angle > 180)
-        angle = 180;
+void servo_move(uint8_t angle, uint16_t duration_ms)
+{
+    dosing = 0;
+    uint16_t from = pulse ? pulse : servo_pulse_ticks(angle);
+    servo_start(from, servo_pulse_ticks(angle), duration_ms / PERIOD_MS);
+}
 
-    // Convert angle to pulse width in microseconds
-    // 500us pulse width for 0 degrees, 2120us pulse width for 180 degrees
-    uint16_t delay_us = ((uint16_t)angle) * 9 + 500;
+void servo_dose(uint8_t open_angle, uint16_t hold_ms, uint8_t close_angle)
+{
+    uint8_t sreg = SREG;
+    cli();
+    dose_hold = hold_ms / PERIOD_MS;
+    dose_close = servo_pulse_ticks(close_angle);
+    dosing = 1;
+    uint16_t from = pulse ? pulse : dose_close;
+    servo_start(from, servo_pulse_ticks(open_angle), 0);
+    SREG = sreg;
+}
 
-    // Initialize Timer2 in normal 
-    uint8_t TCCR2A_state= TCCR2A;//
-    TCCR2A = 0;
+uint8_t servo_busy(void)
+{
+    return (TIMSK3 & (1 << TOIE3)) != 0;
+}
 
-    // Choose prescaler based on delay
-    uint8_t TCCR2B_state= TCCR2B;//    
-    TCCR2B = (1 << CS22) | (1 << CS21); // 256
+#ifndef WINDOWS_TEST
+ISR(TIMER3_OVF_vect)
+#else
+void TIMER3_OVF_vect(void)
+#endif
+{
+    // The new OCR3A takes effect at the next period, double-buffered in hardware
+    if (move_done < move_periods)
+    {
+        move_done++;
+        int32_t span = (int32_t)move_to - move_from;
+        OCR3A = pulse = move_from + (int16_t)(span * move_done / move_periods);
+        settle = SETTLE_PERIODS;
+        return;
+    }
 
-    // Calculate the number of timer ticks needed for the specified delay
-    uint8_t num_ticks = ((F_CPU / 1000000UL) * delay_us) / 256;
+    if (settle)
+    {
+        settle--;
+        return;
+    }
 
-    for (uint16_t i = 0; i < 50; i++)//Wee assume it can get there in 1sec (50*20ms)
+    if (dosing)
     {
-        // Set PA1 high
-        PORT_SERVO |= (1 << P_SERVO);
-        // Reset the timer counter
-        TCNT2 = 0;
-
-        // Wait until the timer counter reaches the required ticks
-        while (TCNT2 < num_ticks)
-        {}
-
-        // Set PA1 low
-        PORT_SERVO &= ~(1 << P_SERVO);
-        
-        _delay_ms(18); // thats dirty TODO, make this pricise.
+        if (dose_hold)
+        {
+            dose_hold--;
+            return;
+        }
+        dosing = 0;
+        move_from = move_to = dose_close;
+        move_periods = move_done = 0;
+        OCR3A = pulse = dose_close;
+        settle = SETTLE_PERIODS;
+        return;
     }
 
-   TCCR2A =TCCR2A_state ; //finished borrowing timer2. 
-   TCCR2B =TCCR2B_state ; //
+    // Settled: nothing to do until the next change
+    TIMSK3 &= ~(1 << TOIE3);
+#if SERVO_DETACH
+    TCCR3A &= ~(1 << COM3A1);
+    PORT_SERVO &= ~(1 << P_SERVO);
+#endif
 }
 
-#endif
\ No newline at end of file
+PT_THREAD(servo_thread(protothread_t *pt, uint8_t angle))
+{
+    PT_BEGIN(pt);
+    servo(angle);
+    PT_WAIT_WHILE(pt, servo_busy());
+    PT_END(pt);
+}
@@ -1,18 +1,80 @@
-
 #ifndef SERVO_H
 #define SERVO_H
 
 #include <stdint.h>
+#include "protothread.h"
 
-
+/*
+ * The servo signal on PE3 is generated by Timer3 in hardware: fast PWM with a
+ * 20 ms period, the pulse width in OCR3A on OC3A. Setting an angle only writes
+ * the compare register and returns.
+ *
+ * A timed move, or a dose (open, hold, close), advances the pulse once per
+ * period from the Timer3 overflow interrupt. That interrupt only runs while
+ * something moves or settles.
+ *
+ * SERVO_SETTLE_MS after the last change the servo counts as settled. With
+ * SERVO_DETACH, the signal is then switched off: the pin stays low and an
+ * idle servo stops jittering and holds by its gears. The next angle attaches
+ * it again.
+ */
 
 #define DDR_SERVO DDRE
 #define PORT_SERVO PORTE
 #define P_SERVO PE3
 
+/* Time the servo needs to reach a new angle after the pulse changed */
+#ifndef SERVO_SETTLE_MS
+#define SERVO_SETTLE_MS 400
+#endif
+
+/* 1: switch the signal off once the servo has settled */
+#ifndef SERVO_DETACH
+#define SERVO_DETACH 1
+#endif
+
+/**
+ * @brief Set the angle and return at once. Stops a move or dose that is running.
+ *
+ * @param angle Angle in degrees, 0 to 180.
+ */
 void servo(uint8_t angle);
 
-#endif 
-#ifdef __AVR__
-#include <avr/io.h>
-#endif
\ No newline at end of file
+/**
+ * @brief Move from the current angle to a new one at an even speed.
+ *
+ * @param angle Angle in degrees, 0 to 180.
+ * @param duration_ms Time the move takes, in steps of 20 ms; 0 to jump.
+ */
+void servo_move(uint8_t angle, uint16_t duration_ms);
+
+/**
+ * @brief Dose: go to open_angle, hold it for hold_ms, then go back to close_angle.
+ *
+ * @param open_angle Angle in degrees while open.
+ * @param hold_ms Time to stay open once there, after SERVO_SETTLE_MS.
+ * @param close_angle Angle in degrees to return to.
+ */
+void servo_dose(uint8_t open_angle, uint16_t hold_ms, uint8_t close_angle);
+
+/**
+ * @brief Tell whether the servo is still moving or settling.
+ *
+ * @return uint8_t 1 until SERVO_SETTLE_MS after the last change of the pulse.
+ */
+uint8_t servo_busy(void);
+
+/**
+ * @brief Set the angle and wait, asleep, until the servo has settled.
+ *
+ * Run it as a child of another protothread:
+ *
+ *     static protothread_t move;
+ *     PT_SPAWN(pt, &move, servo_thread(&move, 90));
+ *
+ * @param pt State of the protothread.
+ * @param angle Angle in degrees, 0 to 180.
+ */
+PT_THREAD(servo_thread(protothread_t *pt, uint8_t angle));
+
+#endif
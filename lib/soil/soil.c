@@ -9,64 +9,47 @@
  * @author Erland Larsen, VIA University College
  */
 #include "soil.h"
+#include "adc.h"
+#include "fixed.h"
 
 #ifdef __AVR__
 #include <avr/io.h>
 
+// Raw 10-bit readings in air and in water
 #define SOIL_DRY 480
 #define SOIL_WET 180
 
+// 16 conversions per reading, 12 bits
+#define SOIL_EXTRA_BITS 2
+
+static adc_channel_t soil_channel = ADC_CHANNEL_NONE;
+
 /**
  * @brief Initialize ADC for Soil Moisture sensor
  *
- * This function initializes the ADC to read values from the Soil Moisture sensor
- * connected to pin SOIL_PIN.
+ * This function adds the Soil Moisture sensor connected to pin SOIL_PIN (ADC8) to the
+ * background ADC scan, oversampled to 12 bits.
  */
 void soil_init()
 {
-
-    // Set reference voltage to AVCC
-    ADMUX = (1 << REFS0);
-    // Enable ADC and set prescaler to 128 (16MHz/128 = 125kHz)
-    // ADC must operate between 50kHz and 200kHz for its full 10-bit resolution
-    ADCSRA = (1 << ADEN) | (1 << ADPS2) | (1 << ADPS1)| (1 << ADPS0);
-    
-
-    // Disable digital input on SOIL_ADC_CHANNEL (page 287)
-    // This will reduce power consumption on the pin
-    DIDR2 = (1 << SOIL_ADC_CHANNEL);
+    adc_init();
+    soil_channel = adc_add(8, SOIL_EXTRA_BITS);
 }
 
 /**
  * @brief Read value from Soil Moisture sensor
  *
- * This function reads the ADC values from the Soil Moisture sensor
- * connected to pin SOIL_PIN.
- * 
- * @return 10-bit ADC value read from the Soil Moisture sensor
+ * This function returns the latest reading of the background ADC scan, so it does not
+ * wait for a conversion.
+ *
+ * @return Soil moisture in percent, 0 (dry) to 100 (wet)
  */
 uint16_t soil_read()
 {
-    uint32_t timeout = 40000;//if 2cc for incrementing and evaluation the timeout is 5ms
-    // The  MUX0:5 should be set to 100000 for choosing ADC8 (look at page 283)
-    ADMUX &= ~((1<<MUX4)|(1<<MUX3)|(1<<MUX2)|(1<<MUX1)|(1<<MUX0));
-    ADCSRB |= (1<<MUX5);
-
-    // Start the conversion
-    ADCSRA |= (1 << ADSC);
-
-    // Wait for the conversion to complete
-    while ((ADCSRA & (1 << ADSC))&& timeout > 0){timeout--;};
-
-    // Read the 10-bit ADC value
-    uint16_t adc_value = ADC;
-
-    float percentage = 100.0 * (adc_value - SOIL_WET) / (SOIL_DRY - SOIL_WET);
-
-    if( 0.0 > percentage ) percentage = 0.0;
-    else if( 100.0 < percentage ) percentage = 100.0;
+    uint16_t adc_value = adc_latest(soil_channel);
 
-    return 100.0 - percentage;
+    // Dry reads high: the dry limit maps to 0 %, the wet one to 100 %
+    return fixed_map(adc_value, SOIL_DRY << SOIL_EXTRA_BITS, SOIL_WET << SOIL_EXTRA_BITS, 0, 100);
 }
 
 #endif
\ No newline at end of file
@@ -20,18 +20,18 @@
 /**
  * @brief Initialize ADC for Soil Moisture sensor
  *
- * This function initializes the ADC to read values from the Soil Moisture sensor
- * connected to pin SOIL_PIN.
+ * This function adds the Soil Moisture sensor connected to pin SOIL_PIN (ADC8) to the
+ * background ADC scan, oversampled to 12 bits.
  */
 void soil_init();
 
 /**
  * @brief Read value from Soil Moisture sensor
  *
- * This function reads the ADC values from the Soil Moisture sensor
- * connected to pin SOIL_PIN.
- * 
- * @return 10-bit ADC value read from the Soil Moisture sensor
+ * This function returns the latest reading of the background ADC scan, so it does not
+ * wait for a conversion.
+ *
+ * @return Soil moisture in percent, 0 (dry) to 100 (wet)
  */
 uint16_t soil_read();
 
@@ -0,0 +1,145 @@
+#ifndef EXCLUDE_SPI
+/**
+ * @file spi.c
+ * @brief Hardware SPI master implementation for ATmega2560
+ *
+ * SPIF is set when a byte has been shifted; reading SPSR and then SPDR clears it. The
+ * interrupt-driven burst writes the next byte from the interrupt of the previous one.
+ */
+
+#include "spi.h"
+#include "includes.h"
+
+#include <stddef.h>
+
+#define SPI_DDR DDRB
+#define SS_BIT PB0
+#define SCK_BIT PB1
+#define MOSI_BIT PB2
+#define MISO_BIT PB3
+
+/* SPCR clock rate bits and SPI2X for F_CPU / 2, 4, 8, ... 128 */
+#define SPI_RATE(spr, spi2x) ((spr) | ((spi2x) << 7))
+static const uint8_t rates[] = {
+    SPI_RATE(0, 1), SPI_RATE(0, 0), SPI_RATE(1, 1), SPI_RATE(1, 0),
+    SPI_RATE(2, 1), SPI_RATE(2, 0), SPI_RATE(3, 0),
+};
+
+static volatile uint8_t busy;
+static const spi_device_t *volatile async_device;
+static const uint8_t *async_tx;
+static uint8_t *async_rx;
+static uint8_t async_length, async_index;
+static spi_callback_t async_done;
+
+void spi_init(void)
+{
+    if (SPCR & (1 << SPE))
+        return;
+
+    // SS is an output, or a low level on it would switch the peripheral to slave
+    SPI_DDR |= (1 << SS_BIT) | (1 << SCK_BIT) | (1 << MOSI_BIT);
+    SPI_DDR &= ~(1 << MISO_BIT);
+    busy = 0;
+    SPCR = (1 << SPE) | (1 << MSTR) | (1 << SPR1) | (1 << SPR0);
+    SPSR = 0;
+}
+
+void spi_device_init(spi_device_t *device, volatile uint8_t *cs_ddr, volatile uint8_t *cs_port,
+                     uint8_t cs_bit, uint32_t clock_hz, uint8_t mode)
+{
+    spi_init();
+
+    uint8_t i = 0;
+    while (i < sizeof(rates) - 1 && (F_CPU >> (i + 1)) > clock_hz)
+        i++;
+
+    device->cs_port = cs_port;
+    device->cs_mask = (1 << cs_bit);
+    device->spcr = (1 << SPE) | (1 << MSTR) | (mode & ((1 << CPOL) | (1 << CPHA))) |
+                   (rates[i] & ((1 << SPR1) | (1 << SPR0)));
+    device->spsr = (rates[i] & 0x80) ? (1 << SPI2X) : 0;
+
+    *cs_port |= device->cs_mask;
+    *cs_ddr |= device->cs_mask;
+}
+
+void spi_select(const spi_device_t *device)
+{
+    SPCR = device->spcr;
+    SPSR = device->spsr;
+    *device->cs_port &= ~device->cs_mask;
+}
+
+void spi_deselect(const spi_device_t *device)
+{
+    *device->cs_port |= device->cs_mask;
+}
+
+uint8_t spi_transfer(uint8_t data)
+{
+    SPDR = data;
+    while (!(SPSR & (1 << SPIF)))
+        ;
+    return SPDR;
+}
+
+void spi_transfer_buffer(const uint8_t *tx, uint8_t *rx, uint8_t length)
+{
+    for (uint8_t i = 0; i < length; i++)
+    {
+        uint8_t data = spi_transfer(tx ? tx[i] : 0x00);
+        if (rx)
+            rx[i] = data;
+    }
+}
+
+uint8_t spi_transfer_async(const spi_device_t *device, const uint8_t *tx, uint8_t *rx,
+                           uint8_t length, spi_callback_t done)
+{
+    if (busy || length == 0)
+        return 0;
+
+    busy = 1;
+    async_device = device;
+    async_tx = tx;
+    async_rx = rx;
+    async_length = length;
+    async_index = 0;
+    async_done = done;
+
+    spi_select(device);
+    SPCR |= (1 << SPIE);
+    SPDR = tx ? tx[0] : 0x00;
+    return 1;
+}
+
+uint8_t spi_busy(void)
+{
+    return busy;
+}
+
+#ifndef WINDOWS_TEST
+ISR(SPI_STC_vect)
+#else
+void SPI_STC_vect(void)
+#endif
+{
+    uint8_t data = SPDR;
+    if (async_rx)
+        async_rx[async_index] = data;
+
+    if (++async_index < async_length)
+    {
+        SPDR = async_tx ? async_tx[async_index] : 0x00;
+        return;
+    }
+
+    SPCR &= ~(1 << SPIE);
+    spi_deselect(async_device);
+    busy = 0;
+    if (async_done)
+        async_done();
+}
+
+#endif//EXCLUDE_SPI
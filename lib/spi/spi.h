@@ -0,0 +1,130 @@
+/**
+ * @file spi.h
+ * @brief Hardware SPI master for ATmega2560
+ *
+ * The SPI peripheral shifts a byte out on MOSI (PB2) and in on MISO (PB3) with the
+ * clock on SCK (PB1). SS (PB0) is made an output, as a master needs it to be; a device
+ * may use it as its chip select.
+ *
+ * Every device on the bus has its own chip select pin, clock and SPI mode, kept in an
+ * spi_device_t. spi_select() applies them and pulls the chip select low:
+ *
+ *     static spi_device_t sensor;
+ *     spi_device_init(&sensor, &DDRB, &PORTB, PB0, 5000000UL, SPI_MODE3);
+ *
+ *     spi_select(&sensor);
+ *     spi_transfer(0x80 | reg);
+ *     uint8_t value = spi_transfer(0x00);
+ *     spi_deselect(&sensor);
+ *
+ * A byte takes 8 SCK periods, 2 us at 4 MHz, so the polled transfers just wait for it.
+ * spi_transfer_async() sends a burst from the SPI interrupt instead and returns at
+ * once; it pays off for long bursts at slow clocks.
+ */
+
+#pragma once
+#include <stdint.h>
+
+/**
+ * @brief SPI modes: clock polarity (CPOL) and phase (CPHA), as in the SPCR register.
+ *
+ */
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x04
+#define SPI_MODE2 0x08
+#define SPI_MODE3 0x0C
+
+/**
+ * @brief A device on the bus. Set up with spi_device_init(); the fields are private.
+ *
+ */
+typedef struct
+{
+    volatile uint8_t *cs_port;
+    uint8_t cs_mask;
+    uint8_t spcr; // enable, master, mode and clock rate bits
+    uint8_t spsr; // double speed bit
+} spi_device_t;
+
+/**
+ * @brief Called from the SPI interrupt when an spi_transfer_async() burst is done and
+ * the device is deselected. Keep it short.
+ *
+ */
+typedef void (*spi_callback_t)(void);
+
+/**
+ * @brief Enable the SPI peripheral as master and set up its pins. Safe to call from
+ * every driver that uses the bus; only the first call changes anything.
+ *
+ */
+void spi_init(void);
+
+/**
+ * @brief Set up a device and its chip select pin, as an output and deselected (high).
+ * Calls spi_init().
+ *
+ * @param device The device.
+ * @param cs_ddr Data direction register of the chip select pin, e.g. &DDRB.
+ * @param cs_port Port register of the chip select pin, e.g. &PORTB.
+ * @param cs_bit Bit of the chip select pin.
+ * @param clock_hz Highest SCK frequency of the device. The clock is the fastest of
+ * F_CPU / 2, 4, 8, ... 128 that does not exceed it, or F_CPU / 128 if all do.
+ * @param mode SPI_MODE0 to SPI_MODE3.
+ */
+void spi_device_init(spi_device_t *device, volatile uint8_t *cs_ddr, volatile uint8_t *cs_port,
+                     uint8_t cs_bit, uint32_t clock_hz, uint8_t mode);
+
+/**
+ * @brief Switch the bus to the clock and mode of a device and select it.
+ *
+ * @param device The device.
+ */
+void spi_select(const spi_device_t *device);
+
+/**
+ * @brief Deselect a device.
+ *
+ * @param device The device.
+ */
+void spi_deselect(const spi_device_t *device);
+
+/**
+ * @brief Send a byte to the selected device and wait for the byte it returns.
+ *
+ * @param data The byte to send.
+ * @return uint8_t The byte received.
+ */
+uint8_t spi_transfer(uint8_t data);
+
+/**
+ * @brief Send and receive a burst of bytes to and from the selected device, waiting for
+ * each one.
+ *
+ * @param tx Bytes to send, or NULL to send 0x00.
+ * @param rx Buffer for the bytes received, or NULL to drop them. May be tx.
+ * @param length Number of bytes.
+ */
+void spi_transfer_buffer(const uint8_t *tx, uint8_t *rx, uint8_t length);
+
+/**
+ * @brief Select a device, send and receive a burst from the SPI interrupt, then
+ * deselect it. The buffers must stay valid until the burst is done. The bus cannot be
+ * used for anything else meanwhile.
+ *
+ * @param device The device.
+ * @param tx Bytes to send, or NULL to send 0x00.
+ * @param rx Buffer for the bytes received, or NULL to drop them. May be tx.
+ * @param length Number of bytes, at least 1.
+ * @param done Called when the burst is done, or NULL.
+ * @return uint8_t 1 if the burst was started, 0 if another one is still running.
+ */
+uint8_t spi_transfer_async(const spi_device_t *device, const uint8_t *tx, uint8_t *rx,
+                           uint8_t length, spi_callback_t done);
+
+/**
+ * @brief Tell whether an spi_transfer_async() burst is running.
+ *
+ * @return uint8_t 1 until the burst is done.
+ */
+uint8_t spi_busy(void);
@@ -0,0 +1,116 @@
+#ifndef EXCLUDE_TIMERS
+
+#include "timers.h"
+#include "includes.h"
+
+TIMERS_CLAIM(TIMER1);
+TIMERS_CLAIM(TIMER1_OVF);
+
+// Timer1 overflows every 65536 ticks, 32.768 ms
+#define TIMER1_OVERFLOW_US 32768UL
+
+static uint8_t timer1_running;
+
+// System time at the last overflow, kept in both units so neither needs a division
+static volatile uint32_t overflow_us;
+static volatile uint32_t overflow_ms;
+static volatile uint16_t overflow_ms_fraction_us; // below 1000
+
+static void timers_add_overflow(uint32_t *us, uint32_t *ms, uint16_t *fraction_us)
+{
+    *us += TIMER1_OVERFLOW_US;
+    *ms += TIMER1_OVERFLOW_US / 1000;
+    *fraction_us += TIMER1_OVERFLOW_US % 1000;
+    if (*fraction_us >= 1000)
+    {
+        *fraction_us -= 1000;
+        (*ms)++;
+    }
+}
+
+#ifndef WINDOWS_TEST
+ISR(TIMER1_OVF_vect)
+#else
+void TIMER1_OVF_vect(void)
+#endif
+{
+    uint32_t us = overflow_us, ms = overflow_ms;
+    uint16_t fraction_us = overflow_ms_fraction_us;
+    timers_add_overflow(&us, &ms, &fraction_us);
+    overflow_us = us;
+    overflow_ms = ms;
+    overflow_ms_fraction_us = fraction_us;
+}
+
+void timer1_start(void)
+{
+    if (timer1_running)
+        return;
+    timer1_running = 1;
+
+    // Normal mode, counting 0..0xFFFF over and over, prescaler 8: 2 MHz
+    uint8_t sreg = SREG;
+    cli();
+    TCCR1A = 0;
+    TCCR1B = (1 << CS11);
+    TCNT1 = 0;
+    TIFR1 = (1 << TOV1);
+    TIMSK1 |= (1 << TOIE1);
+    SREG = sreg;
+}
+
+uint16_t timer1_now(void)
+{
+    // 16-bit reads go through a temporary register that interrupts may use as well
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t ticks = TCNT1;
+    SREG = sreg;
+    return ticks;
+}
+
+void timer1_wait_us(uint16_t us)
+{
+    if (us > 32767)
+        us = 32767;
+    uint16_t ticks = us * TIMER1_TICKS_PER_US;
+    uint16_t start = timer1_now();
+    while ((uint16_t)(timer1_now() - start) < ticks)
+    {
+    }
+}
+
+// Read the counter together with the time of its last overflow
+static uint16_t timers_snapshot(uint32_t *us, uint32_t *ms, uint16_t *fraction_us)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t ticks = TCNT1;
+    *us = overflow_us;
+    *ms = overflow_ms;
+    *fraction_us = overflow_ms_fraction_us;
+    // An overflow that happened while interrupts were off has not been counted yet.
+    // A high count was read before the overflow and belongs to the old period.
+    if ((TIFR1 & (1 << TOV1)) && ticks < 0x8000)
+        timers_add_overflow(us, ms, fraction_us);
+    SREG = sreg;
+    return ticks;
+}
+
+uint32_t timers_millis(void)
+{
+    uint32_t us, ms;
+    uint16_t fraction_us;
+    uint16_t ticks = timers_snapshot(&us, &ms, &fraction_us);
+    return ms + (fraction_us + ticks / TIMER1_TICKS_PER_US) / 1000;
+}
+
+uint32_t timers_micros(void)
+{
+    uint32_t us, ms;
+    uint16_t fraction_us;
+    uint16_t ticks = timers_snapshot(&us, &ms, &fraction_us);
+    return us + ticks / TIMER1_TICKS_PER_US;
+}
+
+#endif//EXCLUDE_TIMERS
@@ -0,0 +1,146 @@
+/**
+ * @file timers.h
+ * @brief Ownership of the hardware timers, and the shared free-running Timer1.
+ *
+ * A driver that uses a timer resource claims it once, at file scope, in its .c file:
+ *
+ *     TIMERS_CLAIM(TIMER1_COMPA);     // OCR1A, its interrupt and the OC1A pin
+ *
+ * Every claim defines a global symbol named after the resource, so a second claim of
+ * the same resource anywhere in the firmware stops the build at link time with
+ * "multiple definition of `timers_claim_TIMER1_COMPA'", naming both files. A resource
+ * name that does not exist fails to compile.
+ *
+ * The resources are:
+ * - TIMERn: the clock of timer n, i.e. its mode and prescaler (TCCRnA/TCCRnB).
+ *   Only its owner may write them or reset the counter.
+ * - TIMERn_COMPA/B/C: a compare channel: OCRnx, its interrupt and its OCnx pin, also
+ *   when the pin is only driven as a plain GPIO.
+ * - TIMERn_CAPT: the input capture unit of a 16-bit timer and its ICPn pin.
+ * - TIMERn_OVF: the overflow interrupt.
+ *
+ * Timer1 is shared: timers.c owns its clock and runs it free, in normal mode at
+ * 2 MHz, and never stops it. Drivers take a compare channel and move the compare
+ * value forward in their interrupt (OCR1A += period), or only read the counter to
+ * measure time, so no driver disturbs another one's timing.
+ *
+ * The overflow of Timer1 extends the counter to the system time: timers_millis() and
+ * timers_micros() count from timer1_start() and never go backwards. Timeouts are
+ * deadlines on them instead of counted delays:
+ *
+ *     uint32_t deadline = timers_millis() + 500;
+ *     while (!done())
+ *         if ((int32_t)(timers_millis() - deadline) >= 0)
+ *             return TIMEOUT;
+ *
+ * Current owners:
+ * | Resource      | Owner         | Use                                        |
+ * |---------------|---------------|--------------------------------------------|
+ * | TIMER1        | timers        | free-running 2 MHz counter                 |
+ * | TIMER1_COMPA  | display       | 1 kHz multiplex interrupt                  |
+ * | TIMER1_COMPB  | hc_sr04       | samples the echo on PL6 in the background  |
+ * | TIMER1_COMPC  | buttons       | 10 ms debounce scan of PF1-PF3             |
+ * | TIMER1_OVF    | timers        | extends Timer1 to timers_millis/micros     |
+ * | TIMER2        | tone          | CTC at twice the note frequency            |
+ * | TIMER2_COMPA  | tone          | toggles the speaker on PA7, plays the queue|
+ * | TIMER3        | servo         | 50 Hz fast PWM, TOP in ICR3                |
+ * | TIMER3_COMPA  | servo         | servo pulse on PE3 (OC3A)                  |
+ * | TIMER3_COMPC  | buzzer        | buzzer on PE5 (OC3C)                       |
+ * | TIMER3_OVF    | servo         | steps moves and doses every 20 ms          |
+ * | TIMER5        | periodic_task | 1 ms CTC tick                              |
+ * | TIMER5_COMPA  | periodic_task | tick interrupt                             |
+ * | TIMER5_CAPT   | dht11         | edges of the DHT11 frame on PL1 (ICP5)     |
+ *
+ * hc_sr04_takeMeasurement() measures time with timer1_now() and needs no claim for
+ * it.
+ * adc triggers its conversions on the Timer1 overflow flag, which needs no claim either.
+ */
+#pragma once
+#include <stdint.h>
+
+/**
+ * @brief Claim a timer resource for the file it is used in. See the list above.
+ *
+ */
+#define TIMERS_CLAIM(resource)                                                       \
+    typedef char timers_resource_##resource[TIMERS_RESOURCE_##resource];             \
+    __attribute__((used)) const uint8_t timers_claim_##resource = 0
+
+/* Resources that can be claimed; anything else does not compile */
+#define TIMERS_RESOURCE_TIMER0 1
+#define TIMERS_RESOURCE_TIMER0_COMPA 1
+#define TIMERS_RESOURCE_TIMER0_COMPB 1
+#define TIMERS_RESOURCE_TIMER0_OVF 1
+#define TIMERS_RESOURCE_TIMER1 1
+#define TIMERS_RESOURCE_TIMER1_COMPA 1
+#define TIMERS_RESOURCE_TIMER1_COMPB 1
+#define TIMERS_RESOURCE_TIMER1_COMPC 1
+#define TIMERS_RESOURCE_TIMER1_CAPT 1
+#define TIMERS_RESOURCE_TIMER1_OVF 1
+#define TIMERS_RESOURCE_TIMER2 1
+#define TIMERS_RESOURCE_TIMER2_COMPA 1
+#define TIMERS_RESOURCE_TIMER2_COMPB 1
+#define TIMERS_RESOURCE_TIMER2_OVF 1
+#define TIMERS_RESOURCE_TIMER3 1
+#define TIMERS_RESOURCE_TIMER3_COMPA 1
+#define TIMERS_RESOURCE_TIMER3_COMPB 1
+#define TIMERS_RESOURCE_TIMER3_COMPC 1
+#define TIMERS_RESOURCE_TIMER3_CAPT 1
+#define TIMERS_RESOURCE_TIMER3_OVF 1
+#define TIMERS_RESOURCE_TIMER4 1
+#define TIMERS_RESOURCE_TIMER4_COMPA 1
+#define TIMERS_RESOURCE_TIMER4_COMPB 1
+#define TIMERS_RESOURCE_TIMER4_COMPC 1
+#define TIMERS_RESOURCE_TIMER4_CAPT 1
+#define TIMERS_RESOURCE_TIMER4_OVF 1
+#define TIMERS_RESOURCE_TIMER5 1
+#define TIMERS_RESOURCE_TIMER5_COMPA 1
+#define TIMERS_RESOURCE_TIMER5_COMPB 1
+#define TIMERS_RESOURCE_TIMER5_COMPC 1
+#define TIMERS_RESOURCE_TIMER5_CAPT 1
+#define TIMERS_RESOURCE_TIMER5_OVF 1
+
+/**
+ * @brief Timer1 counts this many ticks per microsecond / millisecond.
+ *
+ */
+#define TIMER1_TICKS_PER_US 2
+#define TIMER1_TICKS_PER_MS 2000U
+
+/**
+ * @brief Start Timer1 as the free-running counter. Safe to call from every driver
+ * that uses it; only the first call changes anything.
+ *
+ */
+void timer1_start(void);
+
+/**
+ * @brief Read the Timer1 counter. Intervals up to 32 ms are the difference of two
+ * readings, computed in uint16_t.
+ *
+ * @return uint16_t The counter, in TIMER1_TICKS_PER_US ticks per microsecond.
+ */
+uint16_t timer1_now(void);
+
+/**
+ * @brief Busy-wait on the Timer1 counter.
+ *
+ * @param us Microseconds to wait, at most 32767.
+ */
+void timer1_wait_us(uint16_t us);
+
+/**
+ * @brief Milliseconds since timer1_start(). Wraps after 49 days; compare times by
+ * their difference, as int32_t.
+ *
+ * @return uint32_t The system time in milliseconds.
+ */
+uint32_t timers_millis(void);
+
+/**
+ * @brief Microseconds since timer1_start(), with the 0.5 us resolution of Timer1
+ * rounded down. Wraps after 71 minutes; compare times by their difference.
+ *
+ * @return uint32_t The system time in microseconds.
+ */
+uint32_t timers_micros(void);
@@ -5,6 +5,7 @@
 #include "wifi.h"
 #include "uart.h"
 #include "includes.h"
+#include "timers.h"
 
 #define HTTP_BUFFER_SIZE 1024
 
@@ -62,7 +63,7 @@ bool timestamp_sync_via_http(void)
     /* ---------- establish TCP ------------------------------------------------ */
     if (wifi_command_create_TCP_connection(
             "94.130.142.35", 80,
-            http_response_callback, recv_buf) != WIFI_OK)
+            http_response_callback, recv_buf, sizeof(recv_buf)) != WIFI_OK)
     {
         uart_send_string_blocking(USART_0,
                                   "Error TCP with site\n");
@@ -88,12 +89,9 @@ bool timestamp_sync_via_http(void)
 
     /* ---------- wait for response ------------------------------------------- */
     const uint16_t timeout_ms = 10000;
-    uint16_t waited = 0;
-    while (waited < timeout_ms) {
-#ifndef UNIT_TEST
-        _delay_ms(10);
-#endif
-        waited += 10;
+    uint32_t deadline = timers_millis() + timeout_ms;
+    while ((int32_t)(timers_millis() - deadline) < 0) {
+        wifi_poll();                          /* +IPD bytes land in recv_buf  */
         if (strstr(recv_buf, "\r\n\r\n")) {   /* header / body delimiter */
             break;
         }
@@ -1,112 +1,244 @@
 #include "tone.h"
 #include "includes.h"
+#include "timers.h"
+
+#include <stddef.h>
+
+#ifndef WINDOWS_TEST
+#include <avr/pgmspace.h>
+#endif
 
 #define BUZ_BIT PA7
 #define BUZ_DDR DDRA
 #define BUZ_PORT PORTA
 
-void tone_init(){
-BUZ_DDR|=(1<<BUZ_BIT);
-}
-
-
-void tone_play(uint16_t frequency, uint16_t duration) {
-
-
-    // Calculate the half-period delay in microseconds
-    uint16_t delay_us = 500000 / frequency;
+// Timer2 runs only while something plays; its compare interrupt toggles PA7
+TIMERS_CLAIM(TIMER2);
+TIMERS_CLAIM(TIMER2_COMPA);
+
+// Interrupts per second during a rest, only to count its length
+#define REST_RATE 1000
+
+#if (TONE_QUEUE_SIZE & (TONE_QUEUE_SIZE - 1)) != 0
+#error "TONE_QUEUE_SIZE must be a power of 2"
+#endif
+
+// Prescaler shift for CS22..CS20 = 1..7: 1, 8, 32, 64, 128, 256, 1024
+static const uint8_t prescaler_shift[] = {0, 3, 5, 6, 7, 8, 10};
+
+// by Domonkos Gellert Papp
+static const tone_note_t boot[] PROGMEM = {
+    {392, 500}, {392, 500}, {392, 500}, // G4
+    {311, 350}, {466, 150},             // Eb4, B4
+    {392, 500},                         // G4
+    {311, 350}, {466, 150},             // Eb4, B4
+    {392, 1000},                        // G4
+
+    {587, 500}, {587, 500}, {587, 500}, // D5
+    {622, 350}, {466, 150},             // D#5, B4
+    {370, 500},                         // F#4
+    {311, 350}, {466, 150},             // Eb4, B4
+    {392, 1000},                        // G4
+    TONE_END,
+};
+
+static const tone_note_t ack[] PROGMEM = {
+    {1760, 40}, {0, 20}, {2349, 60}, TONE_END,
+};
+
+static const tone_note_t siren[] PROGMEM = {
+    {880, 250}, {660, 250}, TONE_REPEAT,
+};
+
+typedef struct
+{
+    const tone_note_t *melody; // NULL for a single note
+    uint16_t hz, ms;
+    uint8_t priority;
+} tone_request_t;
 
-    // Calculate the number of cycles needed for the specified duration
-    uint16_t loop = (uint16_t) ((uint32_t) duration * 1000 / (2 * delay_us));
+static tone_request_t queue[TONE_QUEUE_SIZE];
+static volatile uint8_t queue_head, queue_tail;
 
+// What plays, for the compare interrupt
+static volatile uint8_t playing, priority;
+static const tone_note_t *volatile melody;
+static volatile uint8_t note_index;
+static volatile uint8_t toggling;
+static volatile uint32_t remaining; // interrupts left of the note
 
+void tone_init(){
+BUZ_DDR|=(1<<BUZ_BIT);
+}
 
-    // Initialize Timer2 in normal mode
-    TCCR2A = 0;
+static void tone_silence(void)
+{
     TCCR2B = 0;
+    TIMSK2 &= ~(1 << OCIE2A);
+    BUZ_PORT &= ~(1 << BUZ_BIT);
+    melody = NULL;
+    playing = 0;
+}
 
-    uint8_t prescaler_bits = 0;
-    uint16_t prescaler_value = 0;
-
-    // Choose prescaler based on delay
-    if (delay_us > 4000) {
-        prescaler_bits = (1 << CS22) | (1 << CS21) | (1 << CS20); // 1024
-        prescaler_value = 1024;
-    } else if (delay_us > 2000) {
-        prescaler_bits = (1 << CS22) | (1 << CS21); // 256
-        prescaler_value = 256;
-    } else if (delay_us > 1000) {
-        prescaler_bits = (1 << CS22) | (1 << CS20); // 128
-        prescaler_value = 128;
-    } else if (delay_us >500) {
-        prescaler_bits = (1 << CS22); // 64
-        prescaler_value = 64;
-    } else if (delay_us >125) {
-        prescaler_bits = (1 << CS21)| (1 << CS20); //32
-        prescaler_value = 32;
-    }
-    else
-     {
-       prescaler_bits = (1 << CS21) ; // 8
-        prescaler_value = 8;
-     }
-
-    // Set the prescaler
-    TCCR2B = prescaler_bits;
+static void tone_load(uint16_t hz, uint16_t ms)
+{
+    uint16_t rate = hz ? (uint16_t)(hz * 2) : REST_RATE;
+    uint32_t ticks = F_CPU / rate;
+
+    // The finest prescaler that fits the half period in 8 bits
+    uint8_t cs = 1;
+    while (cs < sizeof(prescaler_shift) && (ticks >> prescaler_shift[cs - 1]) > 256)
+        cs++;
+    ticks >>= prescaler_shift[cs - 1];
+    if (ticks > 256)
+        ticks = 256;
+
+    remaining = (uint32_t)ms * rate / 1000;
+    if (remaining == 0)
+        remaining = 1;
+    toggling = hz != 0;
+    if (!toggling)
+        BUZ_PORT &= ~(1 << BUZ_BIT);
 
-    // Calculate the number of timer ticks needed for the specified delay
-    uint8_t num_ticks = (F_CPU / 1000000UL) * delay_us / prescaler_value;
+    TCCR2A = (1 << WGM21);
+    OCR2A = ticks - 1;
+    TCNT2 = 0;
+    TCCR2B = cs;
+    TIMSK2 |= (1 << OCIE2A);
+}
 
+// Load the next note of the melody, or of the queue. Interrupts are off
+static void tone_next(void)
+{
+    for (;;)
+    {
+        if (melody)
+        {
+            const tone_note_t *note = &melody[note_index];
+            uint16_t hz = pgm_read_word(&note->hz);
+            uint16_t ms = pgm_read_word(&note->ms);
+            if (ms)
+            {
+                note_index++;
+                tone_load(hz, ms);
+                return;
+            }
+            if (hz == 0xFFFF && note_index)
+            {
+                note_index = 0;
+                continue;
+            }
+            melody = NULL;
+        }
+
+        if (queue_head == queue_tail)
+        {
+            tone_silence();
+            return;
+        }
+
+        tone_request_t *request = &queue[queue_tail];
+        queue_tail = (queue_tail + 1) & (TONE_QUEUE_SIZE - 1);
+        priority = request->priority;
+        if (request->melody)
+        {
+            melody = request->melody;
+            note_index = 0;
+        }
+        else if (request->ms)
+        {
+            tone_load(request->hz, request->ms);
+            return;
+        }
+    }
+}
 
+static uint8_t tone_request(const tone_note_t *notes, uint16_t hz, uint16_t ms, uint8_t request_priority)
+{
+    uint8_t queued = 0;
+    uint8_t sreg = SREG;
+    cli();
+
+    if (playing && request_priority > priority)
+    {
+        queue_head = queue_tail = 0;
+        melody = NULL;
+        playing = 0;
+    }
 
+    if ((!playing || request_priority == priority) &&
+        ((queue_head + 1) & (TONE_QUEUE_SIZE - 1)) != queue_tail)
+    {
+        tone_request_t *request = &queue[queue_head];
+        request->melody = notes;
+        request->hz = hz;
+        request->ms = ms;
+        request->priority = request_priority;
+        queue_head = (queue_head + 1) & (TONE_QUEUE_SIZE - 1);
+        queued = 1;
+
+        if (!playing)
+        {
+            playing = 1;
+            tone_next();
+        }
+    }
 
-    // Generate the tone
-    for (uint16_t i = 0; i < loop; i++) {
-        // Set PA1 high
-        BUZ_PORT |= (1 << BUZ_BIT);
-            // Reset the timer counter
-    TCNT2 = 0;
+    SREG = sreg;
+    return queued;
+}
 
-    // Wait until the timer counter reaches the required ticks
-    while (TCNT2 < num_ticks) {
-        // Busy-wait
-    }
+uint8_t tone_play(uint16_t frequency, uint16_t duration)
+{
+    return tone_request(NULL, frequency, duration, TONE_PRIORITY_NORMAL);
+}
 
-        // Set PA1 low
-        BUZ_PORT &= ~(1 << BUZ_BIT);
-            // Reset the timer counter
-    TCNT2 = 0;
+uint8_t tone_play_melody(const tone_note_t *notes, uint8_t request_priority)
+{
+    return tone_request(notes, 0, 0, request_priority);
+}
 
-    // Wait until the timer counter reaches the required ticks
-    while (TCNT2 < num_ticks) {
-        // Busy-wait
-    }
+uint8_t tone_play_pattern(tone_pattern_t pattern)
+{
+    switch (pattern)
+    {
+    case TONE_BOOT:
+        return tone_play_melody(boot, TONE_PRIORITY_LOW);
+    case TONE_ACK:
+        return tone_play_melody(ack, TONE_PRIORITY_NORMAL);
+    case TONE_SIREN:
+        return tone_play_melody(siren, TONE_PRIORITY_ALARM);
     }
+    return 0;
+}
 
-    TCCR2B = 0;
+void tone_stop(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    queue_head = queue_tail = 0;
+    tone_silence();
+    SREG = sreg;
 }
 
+uint8_t tone_busy(void)
+{
+    return playing;
+}
 
 void tone_play_starwars()
 {
+    tone_play_pattern(TONE_BOOT);
+}
 
-    tone_play(392, 500);  // G4 for 500 ms
-    tone_play(392, 500);  // G4 for 500 ms
-    tone_play(392, 500);  // G4 for 500 ms
-    tone_play(311, 350);  // E♭4 for 350 ms
-    tone_play(466, 150);  // B4 for 150 ms
-    tone_play(392, 500);  // G4 for 500 ms
-    tone_play(311, 350);  // E♭4 for 350 ms
-    tone_play(466, 150);  // B4 for 150 ms
-    tone_play(392, 1000); // G4 for 1000 ms
-
-    tone_play(587, 500);  // D5 for 500 ms
-    tone_play(587, 500);  // D5 for 500 ms
-    tone_play(587, 500);  // D5 for 500 ms
-    tone_play(622, 350);  // D#5 for 350 ms
-    tone_play(466, 150);  // B4 for 150 ms
-    tone_play(370, 500);  // F#4 for 500 ms
-    tone_play(311, 350);  // Eb4 for 350 ms
-    tone_play(466, 150);  // B4 for 150 ms
-    tone_play(392, 1000); // G4 for 1000 ms
-}
\ No newline at end of file
+#ifndef WINDOWS_TEST
+ISR(TIMER2_COMPA_vect)
+#else
+void TIMER2_COMPA_vect(void)
+#endif
+{
+    if (toggling)
+        BUZ_PORT ^= (1 << BUZ_BIT);
+    if (--remaining == 0)
+        tone_next();
+}
@@ -1,4 +1,94 @@
 #include <stdint.h>
+
+/*
+ * The speaker on PA7 plays in the background. Timer2 counts in CTC mode and its
+ * compare interrupt toggles the pin every half period. PA7 has no output compare
+ * pin, so the interrupt does the toggle. The same interrupt counts down the
+ * length of the note and loads the next one, so nothing waits in the main loop.
+ *
+ * A melody is a table of notes in flash, ended with TONE_END, or with TONE_REPEAT
+ * to play it again until tone_stop():
+ *
+ *     static const tone_note_t beep[] PROGMEM = {
+ *         { 1000, 100 }, { 0, 50 }, { 1000, 100 }, TONE_END
+ *     };
+ *     tone_play_melody(beep, TONE_PRIORITY_NORMAL);
+ *
+ * What is asked for while something plays waits in a queue behind it if it has
+ * the same priority. A higher priority interrupts it and drops the queue; a
+ * lower priority is dropped.
+ */
+
+/**
+ * @brief A note: frequency in Hz, 0 for a rest, and length in ms.
+ *
+ */
+typedef struct
+{
+    uint16_t hz;
+    uint16_t ms;
+} tone_note_t;
+
+#define TONE_END {0, 0}
+#define TONE_REPEAT {0xFFFF, 0}
+
+#define TONE_PRIORITY_LOW 0
+#define TONE_PRIORITY_NORMAL 1
+#define TONE_PRIORITY_ALARM 2
+
+/* Melodies and notes that can wait behind the one playing */
+#define TONE_QUEUE_SIZE 4
+
+/**
+ * @brief Built-in patterns for tone_play_pattern().
+ *
+ */
+typedef enum
+{
+    TONE_BOOT,  // the Imperial March, low priority
+    TONE_ACK,   // short chirp, normal priority
+    TONE_SIREN, // two-tone siren until tone_stop(), alarm priority
+} tone_pattern_t;
+
 void tone_init();
-void tone_play(uint16_t frequency, uint16_t duration);
-void tone_play_starwars();// by Domonkos Gellert Papp
\ No newline at end of file
+
+/**
+ * @brief Play a note. Returns at once.
+ *
+ * @param frequency Frequency in Hz, 0 for a rest.
+ * @param duration Length in ms.
+ * @return uint8_t 1 if it plays or is queued, 0 if it was dropped.
+ */
+uint8_t tone_play(uint16_t frequency, uint16_t duration);
+
+/**
+ * @brief Play a melody from flash. Returns at once.
+ *
+ * @param melody Notes in PROGMEM, ended with TONE_END or TONE_REPEAT.
+ * @param priority TONE_PRIORITY_LOW, _NORMAL or _ALARM.
+ * @return uint8_t 1 if it plays or is queued, 0 if it was dropped.
+ */
+uint8_t tone_play_melody(const tone_note_t *melody, uint8_t priority);
+
+/**
+ * @brief Play one of the built-in patterns at its own priority.
+ *
+ * @param pattern TONE_BOOT, TONE_ACK or TONE_SIREN.
+ * @return uint8_t 1 if it plays or is queued, 0 if it was dropped.
+ */
+uint8_t tone_play_pattern(tone_pattern_t pattern);
+
+/**
+ * @brief Stop what plays and drop the queue.
+ *
+ */
+void tone_stop(void);
+
+/**
+ * @brief Tell whether anything plays.
+ *
+ * @return uint8_t 1 until the last note of the queue is done.
+ */
+uint8_t tone_busy(void);
+
+void tone_play_starwars();// by Domonkos Gellert Papp
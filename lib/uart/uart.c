@@ -36,50 +36,294 @@ UART_Callback_t uart_get_rx_callback(USART_t usart){
 
 }
 #ifndef WINDOWS_TEST
+#define UART_ISR(vect) ISR(vect)
+#else
+// Host tests have no interrupt vectors, so the handlers become plain functions
+#define UART_ISR(vect) void vect(void)
+#endif
+
+/*
+ * RX ring buffers, used when a USART is initialised without a callback.
+ * Single producer (the RX ISR writes head) and single consumer (main context
+ * writes tail), so no locking is needed as long as each index is a byte.
+ */
+typedef struct
+{
+    uint8_t *buffer;
+    uint8_t mask; // size - 1
+    volatile uint8_t head;
+    volatile uint8_t tail;
+    volatile uint16_t overflows;
+} uart_rx_ring_t;
+
+static uint8_t uart_rx_buffer0[UART0_RX_BUFFER_SIZE];
+static uint8_t uart_rx_buffer1[UART1_RX_BUFFER_SIZE];
+static uint8_t uart_rx_buffer2[UART2_RX_BUFFER_SIZE];
+static uint8_t uart_rx_buffer3[UART3_RX_BUFFER_SIZE];
+
+static uart_rx_ring_t uart_rx_ring[4] = {
+    {uart_rx_buffer0, UART0_RX_BUFFER_SIZE - 1},
+    {uart_rx_buffer1, UART1_RX_BUFFER_SIZE - 1},
+    {uart_rx_buffer2, UART2_RX_BUFFER_SIZE - 1},
+    {uart_rx_buffer3, UART3_RX_BUFFER_SIZE - 1},
+};
+
+// Bytes collected so far by uart_readline() for each USART
+static uint16_t uart_line_length[4];
+
+// Only store the byte and return - everything else happens in uart_read()
+static inline void uart_rx_store(USART_t usart, uint8_t data, uint8_t data_overrun)
+{
+    uart_rx_ring_t *ring = &uart_rx_ring[usart];
+    uint8_t head = ring->head;
+
+    if (data_overrun)
+        ring->overflows++; // the hardware already lost a byte before this one
+
+    if ((uint8_t)(head - ring->tail) > ring->mask)
+    {
+        ring->overflows++;
+        return;
+    }
+    ring->buffer[head & ring->mask] = data;
+    ring->head = head + 1;
+}
+
 // This is the ISR for USART0 Receive Complete
 #ifndef TARGET_TEST
-ISR(USART0_RX_vect)
+UART_ISR(USART0_RX_vect)
 {
-    // If a valid callback has been set, call it
+    uint8_t status = UCSR0A; // must be read before UDR0
+    uint8_t data = UDR0;
+
+    // If a valid callback has been set, call it. Otherwise queue the byte
     if (usart0_rx_callback != NULL)
-    {
-        // Call the callback function with the received data
-        usart0_rx_callback(UDR0);
-    }
+        usart0_rx_callback(data);
+    else
+        uart_rx_store(USART_0, data, status & (1 << DOR0));
 }
 #endif
 
-ISR(USART1_RX_vect)
+UART_ISR(USART1_RX_vect)
 {
-    // If a valid callback has been set, call it
+    uint8_t status = UCSR1A;
+    uint8_t data = UDR1;
+
     if (usart1_rx_callback != NULL)
+        usart1_rx_callback(data);
+    else
+        uart_rx_store(USART_1, data, status & (1 << DOR1));
+}
+
+UART_ISR(USART2_RX_vect)
+{
+    uint8_t status = UCSR2A;
+    uint8_t data = UDR2;
+
+    if (usart2_rx_callback != NULL)
+        usart2_rx_callback(data);
+    else
+        uart_rx_store(USART_2, data, status & (1 << DOR2));
+}
+
+UART_ISR(USART3_RX_vect)
+{
+    uint8_t status = UCSR3A;
+    uint8_t data = UDR3;
+
+    if (usart3_rx_callback != NULL)
+        usart3_rx_callback(data);
+    else
+        uart_rx_store(USART_3, data, status & (1 << DOR3));
+}
+
+uint16_t uart_rx_available(USART_t usart)
+{
+    if (usart > USART_3)
+        return 0;
+    return (uint8_t)(uart_rx_ring[usart].head - uart_rx_ring[usart].tail);
+}
+
+uint16_t uart_rx_overflows(USART_t usart)
+{
+    if (usart > USART_3)
+        return 0;
+
+    // 16-bit value written by the ISR, read it with interrupts off
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t overflows = uart_rx_ring[usart].overflows;
+    SREG = sreg;
+    return overflows;
+}
+
+uint16_t uart_read(USART_t usart, uint8_t *data, uint16_t max)
+{
+    if (usart > USART_3)
+        return 0;
+
+    uart_rx_ring_t *ring = &uart_rx_ring[usart];
+    uint8_t tail = ring->tail;
+    uint8_t head = ring->head;
+    uint16_t count = 0;
+
+    while (tail != head && count < max)
     {
-        // Call the callback function with the received data
-        usart1_rx_callback(UDR1);
+        data[count++] = ring->buffer[tail & ring->mask];
+        tail++;
     }
+    ring->tail = tail; // hand the slots back to the ISR
+    return count;
 }
 
-ISR(USART2_RX_vect)
+uint16_t uart_readline(USART_t usart, char *line, uint16_t size)
 {
-    // If a valid callback has been set, call it
-    if (usart2_rx_callback != NULL)
+    if (usart > USART_3 || size == 0)
+        return 0;
+
+    uint16_t length = uart_line_length[usart];
+    uint8_t byte;
+
+    while (uart_rx_available(usart) > 0)
     {
-        // Call the callback function with the received data
-        usart2_rx_callback(UDR2);
+        if (length == size - 1)
+        {
+            // Line does not fit, return what we have and continue in the next call
+            line[length] = '\0';
+            uart_line_length[usart] = 0;
+            return length;
+        }
+
+        uart_read(usart, &byte, 1);
+        if (byte == '\r')
+            continue;
+
+        if (byte == '\n')
+        {
+            if (length == 0)
+                continue; // skip empty lines
+            line[length] = '\0';
+            uart_line_length[usart] = 0;
+            return length;
+        }
+
+        line[length++] = (char)byte;
     }
+
+    uart_line_length[usart] = length;
+    return 0;
+}
+
+/*
+ * TX ring buffers. The caller's data is copied in, so the buffer passed to
+ * uart_send_array_nonBlocking() can be reused as soon as the call returns.
+ * head is only written from main context and tail only from the UDRE ISR;
+ * both are free-running 8-bit counters, which is why the size must be a
+ * power of two no larger than 128.
+ */
+#define UART_TX_MASK (UART_TX_BUFFER_SIZE - 1)
+
+typedef struct
+{
+    uint8_t buffer[UART_TX_BUFFER_SIZE];
+    volatile uint8_t head;
+    volatile uint8_t tail;
+} uart_tx_ring_t;
+
+static uart_tx_ring_t uart_tx_ring[4];
+
+static inline uint8_t uart_tx_used(USART_t usart)
+{
+    return (uint8_t)(uart_tx_ring[usart].head - uart_tx_ring[usart].tail);
 }
 
-ISR(USART3_RX_vect)
+uint16_t uart_tx_free(USART_t usart)
 {
+    if (usart > USART_3)
+        return 0;
+    return UART_TX_BUFFER_SIZE - uart_tx_used(usart);
+}
 
-    // If a valid callback has been set, call it
-    if (usart3_rx_callback != NULL)
+// Moves the next queued byte into the data register. Called from the UDRE
+// ISRs, and by hand when the ring is full and interrupts are disabled.
+static inline void uart_tx_next(USART_t usart, volatile uint8_t *udr, volatile uint8_t *ucsrb, uint8_t udrie)
+{
+    uart_tx_ring_t *ring = &uart_tx_ring[usart];
+    uint8_t tail = ring->tail;
+
+    if (tail != ring->head)
     {
-        // Call the callback function with the received data
-        usart3_rx_callback(UDR3);
+        *udr = ring->buffer[tail & UART_TX_MASK];
+        ring->tail = tail + 1;
+    }
+    else
+    {
+        // Nothing left to send, disable the Data Register Empty Interrupt
+        *ucsrb &= ~(1 << udrie);
     }
 }
-#endif
+
+// Enable the Data Register Empty Interrupt so the ISR starts draining the ring
+static void uart_tx_kick(USART_t usart)
+{
+    uint8_t sreg = SREG;
+    cli();
+    switch (usart)
+    {
+    case USART_0:
+        UCSR0B |= (1 << UDRIE0);
+        break;
+    case USART_1:
+        UCSR1B |= (1 << UDRIE1);
+        break;
+    case USART_2:
+        UCSR2B |= (1 << UDRIE2);
+        break;
+    case USART_3:
+        UCSR3B |= (1 << UDRIE3);
+        break;
+    default:
+        break;
+    }
+    SREG = sreg;
+}
+
+// Push one byte out by polling the UDRE flag. Only used when interrupts are
+// disabled (e.g. called from inside an ISR), where the UDRE ISR cannot run.
+static void uart_tx_poll(USART_t usart)
+{
+    switch (usart)
+    {
+    case USART_0:
+        if (UCSR0A & (1 << UDRE0))
+            uart_tx_next(USART_0, &UDR0, &UCSR0B, UDRIE0);
+        break;
+    case USART_1:
+        if (UCSR1A & (1 << UDRE1))
+            uart_tx_next(USART_1, &UDR1, &UCSR1B, UDRIE1);
+        break;
+    case USART_2:
+        if (UCSR2A & (1 << UDRE2))
+            uart_tx_next(USART_2, &UDR2, &UCSR2B, UDRIE2);
+        break;
+    case USART_3:
+        if (UCSR3A & (1 << UDRE3))
+            uart_tx_next(USART_3, &UDR3, &UCSR3B, UDRIE3);
+        break;
+    default:
+        break;
+    }
+}
+
+static void uart_tx_wait(USART_t usart, uint8_t free_needed)
+{
+    while (uart_tx_free(usart) < free_needed)
+    {
+        if (!(SREG & (1 << SREG_I)))
+            uart_tx_poll(usart);
+    }
+}
+
 inline static void uart_init_usart0(uint16_t ubrr, UART_Callback_t callback)
 {
     // Enable transmitter, receiver and the transmit interrupt
@@ -94,13 +338,11 @@ inline static void uart_init_usart0(uint16_t ubrr, UART_Callback_t callback)
     UBRR0H = (uint8_t)(ubrr >> 8);
     UBRR0L = (uint8_t)ubrr;
 
-    if (callback != NULL)
-    {
-        usart0_rx_callback = callback;
+    // Without a callback the received bytes are queued for uart_read()
+    usart0_rx_callback = callback;
 
-        // Enable the USART Receive Complete interrupt
-        UCSR0B |= (1 << RXCIE0);
-    }
+    // Enable the USART Receive Complete interrupt
+    UCSR0B |= (1 << RXCIE0);
 }
 
 inline static void uart_init_usart1(uint16_t ubrr, UART_Callback_t callback)
@@ -117,13 +359,11 @@ inline static void uart_init_usart1(uint16_t ubrr, UART_Callback_t callback)
 
     // Enable transmitter, receiver and the transmit interrupt
 
-    if (callback != NULL)
-    {
-        usart1_rx_callback = callback;
+    // Without a callback the received bytes are queued for uart_read()
+    usart1_rx_callback = callback;
 
-        // Enable the USART Receive Complete interrupt
-        UCSR1B |= (1 << RXCIE1);
-    }
+    // Enable the USART Receive Complete interrupt
+    UCSR1B |= (1 << RXCIE1);
 }
 
 inline static void uart_init_usart2(uint16_t ubrr, UART_Callback_t callback)
@@ -140,13 +380,11 @@ inline static void uart_init_usart2(uint16_t ubrr, UART_Callback_t callback)
     UBRR2H = (uint8_t)(ubrr >> 8);
     UBRR2L = (uint8_t)ubrr;
 
-    if (callback != NULL)
-    {
-        usart2_rx_callback = callback;
+    // Without a callback the received bytes are queued for uart_read()
+    usart2_rx_callback = callback;
 
-        // Enable the USART Receive Complete interrupt
-        UCSR2B |= (1 << RXCIE2);
-    }
+    // Enable the USART Receive Complete interrupt
+    UCSR2B |= (1 << RXCIE2);
 }
 
 inline static void uart_init_usart3(uint16_t ubrr, UART_Callback_t callback)
@@ -163,14 +401,11 @@ inline static void uart_init_usart3(uint16_t ubrr, UART_Callback_t callback)
     UBRR3H = (uint8_t)(ubrr >> 8);
     UBRR3L = (uint8_t)ubrr;
 
-    if (callback != NULL)
-    {
-        usart3_rx_callback = callback;
+    // Without a callback the received bytes are queued for uart_read()
+    usart3_rx_callback = callback;
 
-        // Enable the USART Receive Complete interrupt
-        UCSR3B |= (1 << RXCIE3);
-        
-    }
+    // Enable the USART Receive Complete interrupt
+    UCSR3B |= (1 << RXCIE3);
 }
 
 void uart_init(USART_t usart, uint32_t baudrate, UART_Callback_t callback)
@@ -199,11 +434,18 @@ void uart_init(USART_t usart, uint32_t baudrate, UART_Callback_t callback)
         // Handle error: invalid USART choice
         break;
     }
+
+    // Re-initialising clears UDRIE, so restart the ring if data is still queued
+    if (usart <= USART_3 && uart_tx_used(usart) != 0)
+        uart_tx_kick(usart);
     sei();
 }
 
 void uart_send_blocking(USART_t usart, uint8_t data)
 {
+    // Let anything queued by uart_send_array_nonBlocking() go out first
+    if (usart <= USART_3)
+        uart_tx_wait(usart, UART_TX_BUFFER_SIZE);
 
     switch (usart)
     {
@@ -263,158 +505,58 @@ void uart_send_string_blocking(USART_t usart, char *data){
     uart_send_array_blocking(usart, (uint8_t*)data, strlen(data));
 }
 
-static volatile uint8_t *usart0_transmit_buffer;
-static volatile uint16_t usart0_transmit_index;
-static volatile uint16_t usart0_transmit_length;
-static volatile uint8_t usart0_transmission_in_progress = 0;
-
-static volatile uint8_t *usart1_transmit_buffer;
-static volatile uint16_t usart1_transmit_index;
-static volatile uint16_t usart1_transmit_length;
-static volatile uint8_t usart1_transmission_in_progress = 0;
-
-static volatile uint8_t *usart2_transmit_buffer;
-static volatile uint16_t usart2_transmit_index;
-static volatile uint16_t usart2_transmit_length;
-static volatile uint8_t usart2_transmission_in_progress = 0;
-
-static volatile uint8_t *usart3_transmit_buffer;
-static volatile uint16_t usart3_transmit_index;
-static volatile uint16_t usart3_transmit_length;
-static volatile uint8_t usart3_transmission_in_progress = 0;
-
 void uart_send_array_nonBlocking(USART_t usart, uint8_t *str, uint16_t len)
 {
+    if (usart > USART_3)
+        return;
 
+    uart_tx_ring_t *ring = &uart_tx_ring[usart];
 
-    while (usart0_transmission_in_progress)
-    {
-    }
-
-    cli(); // Disable global interrupts to avoid conflicts during variable update
-    switch (usart)
+    while (len > 0)
     {
-    case USART_0:
-        // Set the transmit buffer, index and length
-        usart0_transmit_buffer = str;
-        usart0_transmit_index = 0;
-        usart0_transmit_length = len;
-
-        // Set the transmission_in_progress flag
-        usart0_transmission_in_progress = 1;
-
-        // Enable the Data Register Empty Interrupt
-        UCSR0B |= (1 << UDRIE0); // Enable USART0 data register empty interrupt
-        break;
-    case USART_1:
-        // Set the transmit buffer, index and length
-        usart1_transmit_buffer = str;
-        usart1_transmit_index = 0;
-        usart1_transmit_length = len;
-
-        // Set the transmission_in_progress flag
-        usart1_transmission_in_progress = 1;
-
-        // Enable the Data Register Empty Interrupt
-        UCSR1B |= (1 << UDRIE1); // Enable USART0 data register empty interrupt
-        break;
-    case USART_2:
-        // Set the transmit buffer, index and length
-        usart2_transmit_buffer = str;
-        usart2_transmit_index = 0;
-        usart2_transmit_length = len;
-
-        // Set the transmission_in_progress flag
-        usart2_transmission_in_progress = 1;
-
-        // Enable the Data Register Empty Interrupt
-        UCSR2B |= (1 << UDRIE2); // Enable USART0 data register empty interrupt
-        break;
-    case USART_3:
-        // Set the transmit buffer, index and length
-        usart3_transmit_buffer = str;
-        usart3_transmit_index = 0;
-        usart3_transmit_length = len;
+        uint8_t space = uart_tx_free(usart);
+        if (space == 0)
+        {
+            // Only wait when the ring is full, and only for a single slot
+            uart_tx_kick(usart);
+            uart_tx_wait(usart, 1);
+            continue;
+        }
 
-        // Set the transmission_in_progress flag
-        usart3_transmission_in_progress = 1;
+        uint8_t head = ring->head;
+        while (space > 0 && len > 0)
+        {
+            ring->buffer[head & UART_TX_MASK] = *str++;
+            head++;
+            space--;
+            len--;
+        }
+        ring->head = head; // publish the new bytes to the ISR
 
-        // Enable the Data Register Empty Interrupt
-        UCSR3B |= (1 << UDRIE3); // Enable USART0 data register empty interrupt
-        break;
-    default:
-        // Handle error: invalid USART choice
-        break;
+        uart_tx_kick(usart);
     }
-
-    sei(); // Enable global interrupts after updating variables
 }
 
-#ifndef WINDOWS_TEST
-
 #ifndef TARGET_TEST
-
-ISR(USART0_UDRE_vect)
+UART_ISR(USART0_UDRE_vect)
 {
-    // Check if we have more data to send
-    if (usart0_transmit_index < usart0_transmit_length)
-    {
-        UDR0 = usart0_transmit_buffer[usart0_transmit_index++]; // Send next character and increment index
-    }
-    else
-    {
-        // Disable the Data Register Empty Interrupt when transmission is complete
-        UCSR0B &= ~(1 << UDRIE0);            // Disable USART0 data register empty interrupt
-        usart0_transmission_in_progress = 0; // Clear the transmission_in_progress flag
-    }
+    uart_tx_next(USART_0, &UDR0, &UCSR0B, UDRIE0);
 }
 #endif
 
-ISR(USART1_UDRE_vect)
+UART_ISR(USART1_UDRE_vect)
 {
-    // Check if we have more data to send
-    if (usart1_transmit_index < usart1_transmit_length)
-    {
-        UDR1 = usart1_transmit_buffer[usart1_transmit_index++]; // Send next character and increment index
-    }
-    else
-    {
-        // Disable the Data Register Empty Interrupt when transmission is complete
-        UCSR1B &= ~(1 << UDRIE1);            // Disable USART0 data register empty interrupt
-        usart1_transmission_in_progress = 0; // Clear the transmission_in_progress flag
-    }
+    uart_tx_next(USART_1, &UDR1, &UCSR1B, UDRIE1);
 }
 
-ISR(USART2_UDRE_vect)
+UART_ISR(USART2_UDRE_vect)
 {
-    // Check if we have more data to send
-    if (usart2_transmit_index < usart2_transmit_length)
-    {
-        UDR2 = usart2_transmit_buffer[usart0_transmit_index++]; // Send next character and increment index
-    }
-    else
-    {
-        // Disable the Data Register Empty Interrupt when transmission is complete
-        UCSR2B &= ~(1 << UDRIE2);            // Disable USART0 data register empty interrupt
-        usart2_transmission_in_progress = 0; // Clear the transmission_in_progress flag
-    }
+    uart_tx_next(USART_2, &UDR2, &UCSR2B, UDRIE2);
 }
 
-ISR(USART3_UDRE_vect)
+UART_ISR(USART3_UDRE_vect)
 {
-    // Check if we have more data to send
-    if (usart3_transmit_index < usart3_transmit_length)
-    {
-        UDR3 = usart3_transmit_buffer[usart3_transmit_index++]; // Send next character and increment index
-    }
-    else
-    {
-        // Disable the Data Register Empty Interrupt when transmission is complete
-        UCSR3B &= ~(1 << UDRIE3);            // Disable USART0 data register empty interrupt
-        usart3_transmission_in_progress = 0; // Clear the transmission_in_progress flag
-    }
+    uart_tx_next(USART_3, &UDR3, &UCSR3B, UDRIE3);
 }
 
-#endif
-
 #endif//EXCLUDE_UART
\ No newline at end of file
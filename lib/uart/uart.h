@@ -11,6 +11,52 @@
 #pragma once
 #include <stdint.h>
 
+/**
+ * @brief Size in bytes of the transmit ring buffer of each USART module.
+ * 
+ * Can be overridden from the build flags (e.g. -DUART_TX_BUFFER_SIZE=128).
+ * Must be a power of two and at most 128.
+ */
+#ifndef UART_TX_BUFFER_SIZE
+#define UART_TX_BUFFER_SIZE 64
+#endif
+
+#if (UART_TX_BUFFER_SIZE & (UART_TX_BUFFER_SIZE - 1)) != 0 || UART_TX_BUFFER_SIZE > 128
+#error "UART_TX_BUFFER_SIZE must be a power of two and at most 128"
+#endif
+
+/**
+ * @brief Size in bytes of the receive ring buffer of a USART module.
+ * 
+ * Only used when the USART is initialised without a callback. Each USART has its
+ * own size, UART0_RX_BUFFER_SIZE to UART3_RX_BUFFER_SIZE, which defaults to
+ * UART_RX_BUFFER_SIZE. USART2 carries the ESP8266 at 115200 baud, whose replies
+ * arrive in bursts longer than 64 bytes, so it gets the largest ring.
+ * Must be a power of two and at most 128.
+ */
+#ifndef UART_RX_BUFFER_SIZE
+#define UART_RX_BUFFER_SIZE 64
+#endif
+
+#ifndef UART0_RX_BUFFER_SIZE
+#define UART0_RX_BUFFER_SIZE UART_RX_BUFFER_SIZE
+#endif
+#ifndef UART1_RX_BUFFER_SIZE
+#define UART1_RX_BUFFER_SIZE UART_RX_BUFFER_SIZE
+#endif
+#ifndef UART2_RX_BUFFER_SIZE
+#define UART2_RX_BUFFER_SIZE 128
+#endif
+#ifndef UART3_RX_BUFFER_SIZE
+#define UART3_RX_BUFFER_SIZE UART_RX_BUFFER_SIZE
+#endif
+
+#define UART_RX_SIZE_VALID(size) (((size) & ((size) - 1)) == 0 && (size) <= 128)
+#if !UART_RX_SIZE_VALID(UART0_RX_BUFFER_SIZE) || !UART_RX_SIZE_VALID(UART1_RX_BUFFER_SIZE) || \
+    !UART_RX_SIZE_VALID(UART2_RX_BUFFER_SIZE) || !UART_RX_SIZE_VALID(UART3_RX_BUFFER_SIZE)
+#error "UARTn_RX_BUFFER_SIZE must be a power of two and at most 128"
+#endif
+
 /**
  * @brief Enumeration for available USART modules.
  * 
@@ -32,9 +78,13 @@ typedef void (*UART_Callback_t)(uint8_t);
 /**
  * @brief Initialize the specified USART module.
  * 
+ * If a callback is given it is called from the receive interrupt for every byte.
+ * With NULL the receive interrupt only stores the byte in a ring buffer, and the
+ * data is fetched from main context with uart_read() or uart_readline().
+ * 
  * @param usart The USART module to be initialized.
  * @param baudrate Desired communication speed.
- * @param callback Callback function for received data.
+ * @param callback Callback function for received data. Can be NULL.
  */
 void uart_init(USART_t usart, uint32_t baudrate, UART_Callback_t callback);
 
@@ -49,12 +99,25 @@ void uart_send_blocking(USART_t usart,uint8_t data);
 /**
  * @brief Send an array of data over UART without blocking.
  * 
+ * The data is copied into the transmit ring buffer of the USART and sent from the
+ * Data Register Empty interrupt, so the caller may reuse the buffer as soon as the
+ * function returns. It only waits if the ring buffer is full, and then only until
+ * there is room for the remaining bytes.
+ * 
  * @param usart The USART module to use.
  * @param str Pointer to the array of data to send.
  * @param len Length of the data to send.
  */
 void uart_send_array_nonBlocking(USART_t usart,  uint8_t *str, uint16_t len);
 
+/**
+ * @brief Get the number of bytes that can be queued without waiting.
+ * 
+ * @param usart The USART module.
+ * @return uint16_t Free space in the transmit ring buffer.
+ */
+uint16_t uart_tx_free(USART_t usart);
+
 /**
  * @brief Send an array of data over UART using blocking method.
  * 
@@ -78,4 +141,47 @@ void uart_send_string_blocking(USART_t usart, char *data);
  * @param usart The USART module.
  * @return UART_Callback_t The callback function currently in use.
  */
-UART_Callback_t uart_get_rx_callback(USART_t usart);
\ No newline at end of file
+UART_Callback_t uart_get_rx_callback(USART_t usart);
+
+/**
+ * @brief Copy received bytes out of the receive ring buffer.
+ * 
+ * @param usart The USART module.
+ * @param data Buffer for the received bytes.
+ * @param max Size of the buffer.
+ * @return uint16_t Number of bytes copied, 0 if nothing has been received.
+ */
+uint16_t uart_read(USART_t usart, uint8_t *data, uint16_t max);
+
+/**
+ * @brief Assemble a line from the receive ring buffer.
+ * 
+ * Call it repeatedly with the same buffer. Received bytes are appended to the buffer
+ * until a '\n' arrives; then the line is null-terminated and its length returned.
+ * '\r' characters and empty lines are skipped. A line longer than size - 1 is
+ * returned in pieces.
+ * 
+ * @param usart The USART module.
+ * @param line Buffer that holds the line while it is being assembled.
+ * @param size Size of the buffer.
+ * @return uint16_t Length of the completed line, or 0 if no line is complete yet.
+ */
+uint16_t uart_readline(USART_t usart, char *line, uint16_t size);
+
+/**
+ * @brief Get the number of received bytes waiting in the receive ring buffer.
+ * 
+ * @param usart The USART module.
+ * @return uint16_t Number of bytes that uart_read() can return right now.
+ */
+uint16_t uart_rx_available(USART_t usart);
+
+/**
+ * @brief Get the number of received bytes that have been lost.
+ * 
+ * Counts bytes dropped because the ring buffer was full, and data overruns reported by the hardware.
+ * 
+ * @param usart The USART module.
+ * @return uint16_t Number of lost bytes since start-up.
+ */
+uint16_t uart_rx_overflows(USART_t usart);
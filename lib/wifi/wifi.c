@@ -1,5 +1,7 @@
+#ifndef EXCLUDE_WIFI
 #include "wifi.h"
 #include "includes.h"
+#include "timers.h"
 
 
 #include "uart.h"
@@ -8,83 +10,475 @@ static uint8_t wifi_dataBuffer[WIFI_DATABUFFERSIZE];
 static uint8_t wifi_dataBufferIndex;
 static uint32_t wifi_baudrate;
 
+/* ------------------------------------------------------------------------- */
+/*  AT command engine                                                         */
+/*                                                                            */
+/*  One command is in flight at a time. Every received byte is fed through    */
+/*  the +IPD parser and, while a command is active, through a small set of    */
+/*  terminator matchers that advance one byte at a time, so the response is   */
+/*  never scanned twice.                                                      */
+/* ------------------------------------------------------------------------- */
+#define WIFI_NO_TIMEOUT 0xFF
+
+// Terminators, in the order they are matched
+#define WIFI_TOKEN_OK    0
+#define WIFI_TOKEN_ERROR 1
+#define WIFI_TOKEN_FAIL  2
+#define WIFI_TOKENS      3
+static const char *const wifi_tokens[WIFI_TOKENS] = {"OK\r\n", "ERROR", "FAIL"};
+static uint8_t wifi_token_progress[WIFI_TOKENS];
+
+#define WIFI_SEEN_OK    (1 << 0)
+#define WIFI_SEEN_ERROR (1 << 1)
+#define WIFI_SEEN_FAIL  (1 << 2)
+static uint8_t wifi_seen;
+
+static enum
+{
+    WIFI_IDLE,
+    WIFI_WAIT_RESPONSE, // waiting for OK / ERROR / FAIL
+    WIFI_WAIT_PROMPT,   // AT+CIPSEND sent, waiting for '>'
+} wifi_state = WIFI_IDLE;
+
+static WIFI_Command_Callback_t wifi_command_callback;
+static WIFI_Command_Callback_t wifi_user_callback; // of a command that is post-processed first
+static WIFI_ERROR_MESSAGE_t wifi_last_result;
+static uint8_t wifi_has_deadline;
+static uint32_t wifi_deadline_ms; // timers_millis() at which the command gives up
+static uint16_t wifi_received_count;
+
+// AT+CIPSEND payload: written by wifi_payload_writer once the module prompts for it
+static WIFI_TCP_Writer_t wifi_payload_writer;
+static uint8_t *wifi_payload;
+static uint16_t wifi_payload_length;
+static uint16_t wifi_payload_written;
+
+/* ---- +IPD parser ---------------------------------------------------------- */
+#define IPD_PREFIX "+IPD,"
+#define PREFIX_LENGTH 5
+
+static WIFI_TCP_Callback_t callback_when_message_received_static;
+static char *received_message_buffer_static_pointer;
+static uint16_t received_message_buffer_size;
+static WIFI_TCP_Stream_Callback_t wifi_TCP_stream_callback;
+
+static enum { IDLE, MATCH_PREFIX, LENGTH, DATA } wifi_ipd_state = IDLE;
+static uint16_t wifi_ipd_length, wifi_ipd_index;
+static uint8_t wifi_ipd_prefix_index;
+
+/* ---- DNS cache ----------------------------------------------------------------- */
+typedef struct
+{
+    char host[WIFI_DNS_CACHE_HOST_SIZE];
+    char ip[16];
+    WIFI_ERROR_MESSAGE_t result; // WIFI_OK, or the error the lookup failed with
+    uint32_t expires_ms;
+} wifi_dns_entry_t;
+
+static wifi_dns_entry_t wifi_dns_cache[WIFI_DNS_CACHE_SIZE];
+static uint16_t wifi_dns_ttl_s = WIFI_DNS_CACHE_TTL_S;
+static uint16_t wifi_dns_negative_ttl_s = WIFI_DNS_CACHE_NEGATIVE_TTL_S;
 
+/* ---- Unsolicited result codes ------------------------------------------------ */
+// Only short status lines are of interest, longer lines are skipped
+#define WIFI_URC_LINE_SIZE 20
+static char wifi_urc_line[WIFI_URC_LINE_SIZE];
+static uint8_t wifi_urc_length;
+static uint8_t wifi_TCP_connected;
 
 
 void wifi_init()
 {
     wifi_baudrate = 115200;
+    wifi_state = WIFI_IDLE;
+    wifi_ipd_state = IDLE;
+    wifi_payload_writer = NULL;
+    wifi_payload_length = wifi_payload_written = 0;
+    wifi_command_callback = NULL;
+    wifi_user_callback = NULL;
+    wifi_urc_length = 0;
+    wifi_TCP_connected = 0;
+    wifi_dns_cache_clear();
     uart_init(USART_WIFI, wifi_baudrate, NULL);
 }
 
-/*
-void wifi_transmit(uint8_t *data, uint8_t length)
-{
-    uart_send_array_blocking(USART_WIFI, data, length);
-}*/
-
-void static wifi_clear_databuffer_and_index()
+static void wifi_clear_databuffer_and_index()
 {
     for (uint16_t i = 0; i < WIFI_DATABUFFERSIZE; i++)
         wifi_dataBuffer[i] = 0;
     wifi_dataBufferIndex = 0;
 }
 
-void static wifi_command_callback(uint8_t received_byte)
+static void wifi_reset_matchers(void)
 {
-    wifi_dataBuffer[wifi_dataBufferIndex] = received_byte;
-    wifi_dataBufferIndex++;
+    for (uint8_t i = 0; i < WIFI_TOKENS; i++)
+        wifi_token_progress[i] = 0;
+    wifi_seen = 0;
+    wifi_received_count = 0;
 }
-WIFI_ERROR_MESSAGE_t wifi_command(const char *str, uint16_t timeOut_s)
+
+// Map what has been seen to an error message, same priority as always: OK, ERROR, FAIL
+static WIFI_ERROR_MESSAGE_t wifi_classify_response(void)
 {
-    UART_Callback_t callback_state = uart_get_rx_callback(USART_WIFI);
-    uart_init(USART_WIFI, wifi_baudrate, wifi_command_callback);
+    if (wifi_received_count == 0)
+        return WIFI_ERROR_NOT_RECEIVING;
+    if (wifi_seen & WIFI_SEEN_OK)
+        return WIFI_OK;
+    if (wifi_seen & WIFI_SEEN_ERROR)
+        return WIFI_ERROR_RECEIVED_ERROR;
+    if (wifi_seen & WIFI_SEEN_FAIL)
+        return WIFI_FAIL;
+    return WIFI_ERROR_RECEIVING_GARBAGE;
+}
 
-    char sendbuffer[128];
-    strcpy(sendbuffer, str);
+static void wifi_finish(void)
+{
+    wifi_last_result = wifi_classify_response();
+    wifi_state = WIFI_IDLE;
+    wifi_payload_writer = NULL;
+    wifi_payload_length = wifi_payload_written = 0;
+
+    WIFI_Command_Callback_t callback = wifi_command_callback;
+    wifi_command_callback = NULL;
+    if (callback != NULL)
+        callback(wifi_last_result);
+}
+
+static void wifi_send_text(const char *str)
+{
+    uart_send_array_nonBlocking(USART_WIFI, (uint8_t *)str, strlen(str));
+}
 
-    uart_send_string_blocking(USART_WIFI, strcat(sendbuffer, "\r\n"));
+static WIFI_ERROR_MESSAGE_t wifi_start(const char *str, uint8_t timeOut_s, WIFI_Command_Callback_t callback)
+{
+    if (wifi_state != WIFI_IDLE)
+        return WIFI_ERROR_BUSY;
+
+    wifi_clear_databuffer_and_index();
+    wifi_reset_matchers();
+    wifi_command_callback = callback;
+    wifi_has_deadline = timeOut_s != WIFI_NO_TIMEOUT;
+    wifi_deadline_ms = timers_millis() + timeOut_s * 1000UL;
+    wifi_state = (wifi_payload_writer != NULL) ? WIFI_WAIT_PROMPT : WIFI_WAIT_RESPONSE;
+
+    wifi_send_text(str);
+    wifi_send_text("\r\n");
+    return WIFI_OK;
+}
 
-    // better wait sequence...
-    for (uint16_t i = 0; i < timeOut_s * 100UL; i++) // timeout after 20 sec
+// Deliver bytes of the +IPD message being received; length never goes past its end
+static void wifi_ipd_data(const uint8_t *data, uint16_t length)
+{
+    if (wifi_TCP_stream_callback != NULL)
+        wifi_TCP_stream_callback(data, length);
+
+    for (uint16_t i = 0; i < length; i++)
     {
-        _delay_ms(10);
-        if (strstr((char *)wifi_dataBuffer, "OK\r\n") != NULL)
-            break;
+        // bytes that do not fit in the buffer are dropped, room is kept for the '\0'
+        if (received_message_buffer_static_pointer != NULL && wifi_ipd_index < received_message_buffer_size - 1)
+            received_message_buffer_static_pointer[wifi_ipd_index] = data[i];
+        wifi_ipd_index++;
     }
 
-    WIFI_ERROR_MESSAGE_t error;
-
-    if (wifi_dataBufferIndex == 0)
-        error=WIFI_ERROR_NOT_RECEIVING;
-    else if (strstr((char *)wifi_dataBuffer, "OK") != NULL)
-        error=WIFI_OK;
-    else if (strstr((char *)wifi_dataBuffer, "ERROR") != NULL)
-        error= WIFI_ERROR_RECEIVED_ERROR;
-    else if (strstr((char *)wifi_dataBuffer, "FAIL") != NULL)
-        error= WIFI_FAIL;
-    else
-        error= WIFI_ERROR_RECEIVING_GARBAGE;
-    
-    wifi_clear_databuffer_and_index();
-    uart_init(USART_WIFI, wifi_baudrate, callback_state);
-    return error; 
+    if (wifi_ipd_index == wifi_ipd_length)
+    {
+        // message is complete, null terminate the string
+        if (received_message_buffer_static_pointer != NULL)
+            received_message_buffer_static_pointer[wifi_ipd_index < received_message_buffer_size ? wifi_ipd_index : received_message_buffer_size - 1] = '\0';
+        wifi_ipd_state = IDLE;
 
+        if (callback_when_message_received_static != NULL)
+            callback_when_message_received_static();
+    }
+}
 
+// Returns 1 if the byte belonged to a +IPD message and must not be matched as a response
+static uint8_t wifi_ipd_byte(uint8_t byte)
+{
+    switch (wifi_ipd_state)
+    {
+    case IDLE:
+        if (byte == IPD_PREFIX[0])
+        {
+            wifi_ipd_state = MATCH_PREFIX;
+            wifi_ipd_prefix_index = 1;
+        }
+        break;
+
+    case MATCH_PREFIX:
+        if (byte == IPD_PREFIX[wifi_ipd_prefix_index])
+        {
+            if (++wifi_ipd_prefix_index == PREFIX_LENGTH)
+            {
+                wifi_ipd_state = LENGTH;
+                wifi_ipd_length = 0;
+            }
+        }
+        else
+        {
+            // not the expected character, it may be the start of a new prefix
+            wifi_ipd_state = IDLE;
+            return wifi_ipd_byte(byte);
+        }
+        break;
 
+    case LENGTH:
+        if (byte >= '0' && byte <= '9')
+        {
+            wifi_ipd_length = wifi_ipd_length * 10 + (byte - '0');
+        }
+        else if (byte == ':' && wifi_ipd_length > 0)
+        {
+            wifi_ipd_state = DATA;
+            wifi_ipd_index = 0;
+        }
+        else
+        {
+            // not the expected character, reset to IDLE
+            wifi_ipd_state = IDLE;
+        }
+        break;
+
+    case DATA:
+        wifi_ipd_data(&byte, 1);
+        return 1;
+    }
+    return 0;
 }
 
-WIFI_ERROR_MESSAGE_t wifi_command_AT()
+static uint8_t wifi_urc_line_ends_with(const char *suffix)
 {
-    return wifi_command("AT", 1);
+    uint8_t suffix_length = strlen(suffix);
+    return wifi_urc_length >= suffix_length &&
+           memcmp(wifi_urc_line + wifi_urc_length - suffix_length, suffix, suffix_length) == 0;
 }
 
-WIFI_ERROR_MESSAGE_t wifi_command_join_AP(char *ssid, char *password)
+// Track the state of the TCP/SSL link from the status lines the module prints,
+// whether they answer a command or arrive on their own ("CLOSED" when the server hangs up)
+static void wifi_urc_byte(uint8_t byte)
 {
-   /* WIFI_ERROR_MESSAGE_t error = wifi_command_AT();
+    if (byte == '\r')
+        return;
+
+    if (byte != '\n')
+    {
+        if (wifi_urc_length < WIFI_URC_LINE_SIZE)
+            wifi_urc_line[wifi_urc_length++] = byte;
+        else
+            wifi_urc_length = WIFI_URC_LINE_SIZE + 1; // too long to be a status line
+        return;
+    }
+
+    if (wifi_urc_length <= WIFI_URC_LINE_SIZE)
+    {
+        if (wifi_urc_line_ends_with("CLOSED") || wifi_urc_line_ends_with("WIFI DISCONNECT"))
+            wifi_TCP_connected = 0;
+        else if (wifi_urc_line_ends_with("CONNECT") || wifi_urc_line_ends_with("ALREADY CONNECTED"))
+            wifi_TCP_connected = 1;
+    }
+    wifi_urc_length = 0;
+}
+
+static void wifi_response_byte(uint8_t byte)
+{
+    wifi_received_count++;
+    if (wifi_dataBufferIndex < WIFI_DATABUFFERSIZE - 1)
+        wifi_dataBuffer[wifi_dataBufferIndex++] = byte;
+
+    if (wifi_state == WIFI_WAIT_PROMPT && byte == '>')
+    {
+        // The module is ready for the payload; what follows is SEND OK / SEND FAIL
+        WIFI_TCP_Writer_t writer = wifi_payload_writer;
+        wifi_payload_writer = NULL;
+        wifi_payload_written = 0;
+        writer();
+
+        // The module waits for exactly the announced number of bytes, a writer that
+        // came up short must not leave it hanging
+        static const uint8_t padding[8] = {' ', ' ', ' ', ' ', ' ', ' ', ' ', ' '};
+        while (wifi_payload_written < wifi_payload_length)
+            wifi_TCP_write(padding, sizeof(padding));
+        wifi_payload_length = wifi_payload_written = 0;
+
+        wifi_reset_matchers();
+        wifi_state = WIFI_WAIT_RESPONSE;
+        return;
+    }
+
+    for (uint8_t i = 0; i < WIFI_TOKENS; i++)
+    {
+        const char *token = wifi_tokens[i];
+        uint8_t progress = wifi_token_progress[i];
+
+        if (byte == (uint8_t)token[progress])
+            progress++;
+        else
+            progress = (byte == (uint8_t)token[0]) ? 1 : 0;
+
+        if (i == WIFI_TOKEN_OK && progress >= 2 && wifi_state != WIFI_WAIT_PROMPT)
+            wifi_seen |= WIFI_SEEN_OK;
+
+        if (token[progress] == '\0')
+        {
+            progress = 0;
+            if (i == WIFI_TOKEN_ERROR)
+                wifi_seen |= WIFI_SEEN_ERROR;
+            else if (i == WIFI_TOKEN_FAIL)
+                wifi_seen |= WIFI_SEEN_FAIL;
+
+            // A prompt is what we want after AT+CIPSEND, an OK alone is not enough
+            if (!(wifi_state == WIFI_WAIT_PROMPT && i == WIFI_TOKEN_OK))
+            {
+                wifi_finish();
+                return;
+            }
+        }
+        wifi_token_progress[i] = progress;
+    }
+}
+
+void wifi_poll(void)
+{
+    uint8_t chunk[16];
+    uint16_t count;
+
+    while ((count = uart_read(USART_WIFI, chunk, sizeof(chunk))) > 0)
+    {
+        for (uint16_t i = 0; i < count; i++)
+        {
+            if (wifi_ipd_state == DATA)
+            {
+                // hand over the payload in one piece instead of byte by byte
+                uint16_t length = count - i;
+                if (length > wifi_ipd_length - wifi_ipd_index)
+                    length = wifi_ipd_length - wifi_ipd_index;
+                wifi_ipd_data(chunk + i, length);
+                i += length - 1;
+                continue;
+            }
+            if (wifi_ipd_byte(chunk[i]))
+                continue;
+            wifi_urc_byte(chunk[i]);
+            if (wifi_state != WIFI_IDLE)
+                wifi_response_byte(chunk[i]);
+        }
+    }
+
+    if (wifi_state != WIFI_IDLE && wifi_has_deadline && (int32_t)(timers_millis() - wifi_deadline_ms) >= 0)
+        wifi_finish();
+}
+
+uint8_t wifi_busy(void)
+{
+    return wifi_state != WIFI_IDLE;
+}
+
+uint16_t wifi_rx_overflows(void)
+{
+    return uart_rx_overflows(USART_WIFI);
+}
+
+uint8_t wifi_TCP_is_connected(void)
+{
+    return wifi_TCP_connected;
+}
+
+void wifi_TCP_set_receive_buffer(char *received_message_buffer, uint16_t size)
+{
+    // no room for even the '\0'
+    if (size == 0)
+        received_message_buffer = NULL;
+    received_message_buffer_static_pointer = received_message_buffer;
+    received_message_buffer_size = size;
+}
+
+void wifi_TCP_set_stream_callback(WIFI_TCP_Stream_Callback_t callback)
+{
+    wifi_TCP_stream_callback = callback;
+}
+
+WIFI_ERROR_MESSAGE_t wifi_command_async(const char *str, uint8_t timeOut_s, WIFI_Command_Callback_t callback)
+{
+    if (timeOut_s == 0)
+        timeOut_s = 1;
+    else if (timeOut_s == WIFI_NO_TIMEOUT)
+        timeOut_s = WIFI_NO_TIMEOUT - 1;
+    return wifi_start(str, timeOut_s, callback);
+}
+
+void wifi_TCP_write(const uint8_t *data, uint16_t length)
+{
+    if (length > wifi_payload_length - wifi_payload_written)
+        length = wifi_payload_length - wifi_payload_written;
+    if (length == 0)
+        return;
+    uart_send_array_nonBlocking(USART_WIFI, (uint8_t *)data, length);
+    wifi_payload_written += length;
+}
+
+WIFI_ERROR_MESSAGE_t wifi_command_TCP_transmit_stream_async(uint16_t length, WIFI_TCP_Writer_t writer, WIFI_Command_Callback_t callback)
+{
+    if (wifi_state != WIFI_IDLE)
+        return WIFI_ERROR_BUSY;
+
+    char sendbuffer[20];
+    sprintf(sendbuffer, "AT+CIPSEND=%u", length);
+
+    wifi_payload_writer = writer;
+    wifi_payload_length = length;
+    WIFI_ERROR_MESSAGE_t error = wifi_command_async(sendbuffer, 20, callback);
     if (error != WIFI_OK)
-        return error;*/
+        wifi_payload_writer = NULL;
+    return error;
+}
+
+static void wifi_payload_from_buffer(void)
+{
+    wifi_TCP_write(wifi_payload, wifi_payload_length);
+}
+
+WIFI_ERROR_MESSAGE_t wifi_command_TCP_transmit_async(uint8_t *data, uint16_t length, WIFI_Command_Callback_t callback)
+{
+    if (wifi_state != WIFI_IDLE)
+        return WIFI_ERROR_BUSY;
+
+    wifi_payload = data;
+    return wifi_command_TCP_transmit_stream_async(length, wifi_payload_from_buffer, callback);
+}
+
+/* ---- Blocking wrappers ------------------------------------------------------ */
+
+// Poll the engine until the command in flight is done, or give up after timeOut_s
+static WIFI_ERROR_MESSAGE_t wifi_wait_for_result(uint16_t timeOut_s)
+{
+    uint32_t deadline = timers_millis() + timeOut_s * 1000UL;
+    while ((int32_t)(timers_millis() - deadline) < 0)
+    {
+        wifi_poll();
+        if (!wifi_busy())
+            return wifi_last_result;
+    }
+    wifi_poll();
+    if (wifi_busy())
+        wifi_finish();
+    return wifi_last_result;
+}
+
+WIFI_ERROR_MESSAGE_t wifi_command(const char *str, uint16_t timeOut_s)
+{
+    WIFI_ERROR_MESSAGE_t error = wifi_start(str, WIFI_NO_TIMEOUT, NULL);
+    if (error != WIFI_OK)
+        return error;
+    return wifi_wait_for_result(timeOut_s);
+}
 
+WIFI_ERROR_MESSAGE_t wifi_command_AT()
+{
+    return wifi_command("AT", 1);
+}
+
+WIFI_ERROR_MESSAGE_t wifi_command_join_AP_async(char *ssid, char *password, WIFI_Command_Callback_t callback)
+{
     char sendbuffer[128];
     strcpy(sendbuffer, "AT+CWJAP=\"");
     strcat(sendbuffer, ssid);
@@ -92,7 +486,15 @@ WIFI_ERROR_MESSAGE_t wifi_command_join_AP(char *ssid, char *password)
     strcat(sendbuffer, password);
     strcat(sendbuffer, "\"");
 
-    return wifi_command(sendbuffer, 20);
+    return wifi_command_async(sendbuffer, 20, callback);
+}
+
+WIFI_ERROR_MESSAGE_t wifi_command_join_AP(char *ssid, char *password)
+{
+    WIFI_ERROR_MESSAGE_t error = wifi_command_join_AP_async(ssid, password, NULL);
+    if (error != WIFI_OK)
+        return error;
+    return wifi_wait_for_result(20);
 }
 
 WIFI_ERROR_MESSAGE_t wifi_command_disable_echo()
@@ -100,47 +502,73 @@ WIFI_ERROR_MESSAGE_t wifi_command_disable_echo()
     return wifi_command("ATE0", 1);
 }
 
-WIFI_ERROR_MESSAGE_t wifi_command_get_ip_from_URL(char * url, char *ip_address){
-    char sendbuffer[128];
-    strcpy(sendbuffer, "AT+CIPDOMAIN=\"");
-    strcat(sendbuffer, url);
-    strcat(sendbuffer, "\"");
-    
-    uint16_t timeOut_s = 5;
-
+/* ---- DNS cache ----------------------------------------------------------------- */
 
-     UART_Callback_t callback_state = uart_get_rx_callback(USART_WIFI);
-    uart_init(USART_WIFI, wifi_baudrate, wifi_command_callback);
+static uint8_t wifi_dns_entry_valid(const wifi_dns_entry_t *entry)
+{
+    return entry->host[0] != '\0' && (int32_t)(entry->expires_ms - timers_millis()) > 0;
+}
 
-    uart_send_string_blocking(USART_WIFI, strcat(sendbuffer, "\r\n"));
+static wifi_dns_entry_t *wifi_dns_lookup(const char *url)
+{
+    for (uint8_t i = 0; i < WIFI_DNS_CACHE_SIZE; i++)
+        if (wifi_dns_entry_valid(&wifi_dns_cache[i]) && strcmp(wifi_dns_cache[i].host, url) == 0)
+            return &wifi_dns_cache[i];
+    return NULL;
+}
 
-    // better wait sequence...
-    for (uint16_t i = 0; i < timeOut_s * 100UL; i++) // timeout after 20 sec
+static void wifi_dns_store(const char *url, const char *ip_address, WIFI_ERROR_MESSAGE_t result)
+{
+    if (strlen(url) >= WIFI_DNS_CACHE_HOST_SIZE)
+        return;
+
+    // Reuse the entry of the same host, else a free one, else the one that expires first
+    wifi_dns_entry_t *entry = NULL;
+    for (uint8_t i = 0; i < WIFI_DNS_CACHE_SIZE && entry == NULL; i++)
+        if (strcmp(wifi_dns_cache[i].host, url) == 0)
+            entry = &wifi_dns_cache[i];
+    for (uint8_t i = 0; i < WIFI_DNS_CACHE_SIZE && entry == NULL; i++)
+        if (!wifi_dns_entry_valid(&wifi_dns_cache[i]))
+            entry = &wifi_dns_cache[i];
+    if (entry == NULL)
     {
-        _delay_ms(10);
-        if (strstr((char *)wifi_dataBuffer, "OK\r\n") != NULL)
-            break;
+        entry = &wifi_dns_cache[0];
+        for (uint8_t i = 1; i < WIFI_DNS_CACHE_SIZE; i++)
+            if ((int32_t)(wifi_dns_cache[i].expires_ms - entry->expires_ms) < 0)
+                entry = &wifi_dns_cache[i];
     }
 
-    WIFI_ERROR_MESSAGE_t error;
-
-    if (wifi_dataBufferIndex == 0)
-        error=WIFI_ERROR_NOT_RECEIVING;
-    else if (strstr((char *)wifi_dataBuffer, "OK") != NULL)
-        error=WIFI_OK;
-    else if (strstr((char *)wifi_dataBuffer, "ERROR") != NULL)
-        error= WIFI_ERROR_RECEIVED_ERROR;
-    else if (strstr((char *)wifi_dataBuffer, "FAIL") != NULL)
-        error= WIFI_FAIL;
-    else
-        error= WIFI_ERROR_RECEIVING_GARBAGE;
-    
-   
+    strcpy(entry->host, url);
+    strcpy(entry->ip, ip_address);
+    entry->result = result;
+    entry->expires_ms = timers_millis() + (result == WIFI_OK ? wifi_dns_ttl_s : wifi_dns_negative_ttl_s) * 1000UL;
+}
 
+void wifi_dns_cache_set_ttl(uint16_t ttl_s, uint16_t negative_ttl_s)
+{
+    wifi_dns_ttl_s = ttl_s;
+    wifi_dns_negative_ttl_s = negative_ttl_s;
+}
 
+void wifi_dns_cache_invalidate(const char *ip_address)
+{
+    for (uint8_t i = 0; i < WIFI_DNS_CACHE_SIZE; i++)
+        if (wifi_dns_cache[i].result == WIFI_OK && strcmp(wifi_dns_cache[i].ip, ip_address) == 0)
+            wifi_dns_cache[i].host[0] = '\0';
+}
 
+void wifi_dns_cache_clear(void)
+{
+    for (uint8_t i = 0; i < WIFI_DNS_CACHE_SIZE; i++)
+        wifi_dns_cache[i].host[0] = '\0';
+}
 
+// Lookup in flight: where the answer goes
+static char *wifi_dns_url;
+static char *wifi_dns_ip_address;
 
+static void wifi_dns_done(WIFI_ERROR_MESSAGE_t error)
+{
     char *ipStart = strstr((char *)wifi_dataBuffer, "CIPDOMAIN:");
     if (ipStart != NULL) {
         // Move the pointer to the start of the IP address
@@ -150,42 +578,67 @@ WIFI_ERROR_MESSAGE_t wifi_command_get_ip_from_URL(char * url, char *ip_address){
         char * ipEnd = strchr(ipStart, '\r');
         if (ipEnd != NULL && (ipEnd - ipStart) < 16) {
             // Copy the IP address into the buffer
-            strncpy(ip_address, ipStart, ipEnd - ipStart);
-            ip_address[ipEnd - ipStart] = '\0';
-            
-        } }
-
-    //sscanf((char *)wifi_dataBuffer, "%*IPDOMAIN:%15[^\r\n]", ip_address);
-
-    //sscanf(wifi_dataBuffer, "+CIPDOMAIN:%15[^\r\n]", ip_address)
-    //strcpy(ip_address, wifi_dataBuffer);
-
-   // for (int i = 0; i < 50; i++)
-    //{
-   //     ip_address[i] =wifi_dataBuffer[i];
-   // }
-    
+            strncpy(wifi_dns_ip_address, ipStart, ipEnd - ipStart);
+            wifi_dns_ip_address[ipEnd - ipStart] = '\0';
 
+            if (error == WIFI_OK)
+                wifi_dns_store(wifi_dns_url, wifi_dns_ip_address, WIFI_OK);
+        }
+    }
 
+    // A failed lookup is remembered for a short while, so a missing network does
+    // not cost a full AT round trip on every request
+    if (error != WIFI_OK)
+        wifi_dns_store(wifi_dns_url, "", error);
 
-    wifi_clear_databuffer_and_index();
-    uart_init(USART_WIFI, wifi_baudrate, callback_state);
-    return error; 
-
-
+    WIFI_Command_Callback_t callback = wifi_user_callback;
+    wifi_user_callback = NULL;
+    if (callback != NULL)
+        callback(error);
 }
 
+static WIFI_ERROR_MESSAGE_t wifi_dns_start(char *url, char *ip_address, WIFI_Command_Callback_t callback)
+{
+    if (wifi_state != WIFI_IDLE)
+        return WIFI_ERROR_BUSY;
 
+    char sendbuffer[128];
+    strcpy(sendbuffer, "AT+CIPDOMAIN=\"");
+    strcat(sendbuffer, url);
+    strcat(sendbuffer, "\"");
 
+    wifi_dns_url = url;
+    wifi_dns_ip_address = ip_address;
+    wifi_user_callback = callback;
+    return wifi_command_async(sendbuffer, 5, wifi_dns_done);
+}
 
+WIFI_ERROR_MESSAGE_t wifi_command_get_ip_from_URL_async(char *url, char *ip_address, WIFI_Command_Callback_t callback)
+{
+    wifi_dns_entry_t *cached = wifi_dns_lookup(url);
+    if (cached != NULL) {
+        if (cached->result == WIFI_OK)
+            strcpy(ip_address, cached->ip);
+        if (callback != NULL)
+            callback(cached->result);
+        return WIFI_OK;
+    }
+    return wifi_dns_start(url, ip_address, callback);
+}
 
+WIFI_ERROR_MESSAGE_t wifi_command_get_ip_from_URL(char * url, char *ip_address){
+    wifi_dns_entry_t *cached = wifi_dns_lookup(url);
+    if (cached != NULL) {
+        if (cached->result == WIFI_OK)
+            strcpy(ip_address, cached->ip);
+        return cached->result;
+    }
 
-
-
-
-
-
-
+    WIFI_ERROR_MESSAGE_t error = wifi_dns_start(url, ip_address, NULL);
+    if (error != WIFI_OK)
+        return error;
+    return wifi_wait_for_result(5);
+}
 
 WIFI_ERROR_MESSAGE_t wifi_command_quit_AP(){
 
@@ -202,161 +655,140 @@ WIFI_ERROR_MESSAGE_t wifi_command_set_to_single_Connection()
     return wifi_command("AT+CIPMUX=0", 1);
 }
 
-WIFI_ERROR_MESSAGE_t wifi_command_close_TCP_connection()
+WIFI_ERROR_MESSAGE_t wifi_command_close_TCP_connection_async(WIFI_Command_Callback_t callback)
 {
-    return wifi_command("AT+CIPCLOSE", 5);
+    WIFI_ERROR_MESSAGE_t error = wifi_command_async("AT+CIPCLOSE", 5, callback);
+    if (error == WIFI_OK)
+        wifi_TCP_connected = 0;
+    return error;
 }
 
-
-
-#define BUF_SIZE 128
-#define IPD_PREFIX "+IPD,"
-#define PREFIX_LENGTH 5
-
-WIFI_TCP_Callback_t callback_when_message_received_static;
-char *received_message_buffer_static_pointer;
-void static wifi_TCP_callback(uint8_t byte)
+WIFI_ERROR_MESSAGE_t wifi_command_close_TCP_connection()
 {
-    static enum { IDLE, MATCH_PREFIX, LENGTH, DATA } state = IDLE;
-    static int length = 0, index = 0, prefix_index = 0;
-
-    switch(state) {
-        case IDLE:
-            if(byte == IPD_PREFIX[0]) {
-                state = MATCH_PREFIX;
-                prefix_index = 1;
-            }
-            break;
-
-        case MATCH_PREFIX:
-            if(byte == IPD_PREFIX[prefix_index]) {
-                if(prefix_index == PREFIX_LENGTH - 1) {
-                    state = LENGTH;
-                } else {
-                    prefix_index++;
-                }
-            } else {
-                // not the expected character, reset to IDLE
-                state = IDLE;
-                prefix_index = 0;
-            }
-            break;
-
-        case LENGTH:
-            if(byte >= '0' && byte <= '9') {
-                length = length * 10 + (byte - '0');
-            } else if(byte == ':') {
-                state = DATA;
-                index = 0; // reset index to start storing data
-            } else {
-                // not the expected character, reset to IDLE
-                state = IDLE;
-                length = 0;
-            }
-            break;
-
-        case DATA:
-            if(index < length) {
-                received_message_buffer_static_pointer[index++] = byte;
-            }
-            if(index == length) {
-                // message is complete, null terminate the string
-                received_message_buffer_static_pointer[index] = '\0';
+    WIFI_ERROR_MESSAGE_t error = wifi_command("AT+CIPCLOSE", 5);
+    wifi_TCP_connected = 0;
+    return error;
+}
 
-                // reset to IDLE
-                state = IDLE;
-                length = 0;
-                index = 0;
+// Address of the connection being created, forgotten by the DNS cache if it fails
+static char wifi_connect_ip[16];
 
-            wifi_clear_databuffer_and_index();
-            callback_when_message_received_static();
-            }
-            break;
-    }
-  
+static void wifi_connect_done(WIFI_ERROR_MESSAGE_t error)
+{
+    if (error == WIFI_OK)
+        wifi_TCP_connected = 1;
+    else if (!wifi_TCP_connected)
+        wifi_dns_cache_invalidate(wifi_connect_ip); // the host may have moved, look it up again next time
+
+    WIFI_Command_Callback_t callback = wifi_user_callback;
+    wifi_user_callback = NULL;
+    if (callback != NULL)
+        callback(error);
 }
 
-WIFI_ERROR_MESSAGE_t wifi_command_create_TCP_connection(char *IP, uint16_t port, WIFI_TCP_Callback_t callback_when_message_received, char *received_message_buffer)
+static WIFI_ERROR_MESSAGE_t wifi_start_connection(const char *type, char *IP, uint16_t port, WIFI_TCP_Callback_t callback_when_message_received, char *received_message_buffer, uint16_t size, WIFI_Command_Callback_t callback)
 {
-    received_message_buffer_static_pointer = received_message_buffer;
+    if (wifi_state != WIFI_IDLE)
+        return WIFI_ERROR_BUSY;
+
+    wifi_TCP_set_receive_buffer(received_message_buffer, size);
     callback_when_message_received_static = callback_when_message_received;
+    wifi_TCP_stream_callback = NULL;
     char sendbuffer[128];
     char portString[7];
 
-    strcpy(sendbuffer, "AT+CIPSTART=\"TCP\",\"");
-    
+    strcpy(sendbuffer, "AT+CIPSTART=\"");
+    strcat(sendbuffer, type);
+    strcat(sendbuffer, "\",\"");
+
     strcat(sendbuffer, IP);
     strcat(sendbuffer, "\",");
     sprintf(portString, "%u", port);
     strcat(sendbuffer, portString);
 
-    WIFI_ERROR_MESSAGE_t errorMessage = wifi_command(sendbuffer, 20);
-    if (errorMessage != WIFI_OK)
-        return errorMessage;
-    else
-        uart_init(USART_WIFI, wifi_baudrate, wifi_TCP_callback);
-
-    wifi_clear_databuffer_and_index();
-    return errorMessage;
+    strncpy(wifi_connect_ip, IP, sizeof(wifi_connect_ip) - 1);
+    wifi_connect_ip[sizeof(wifi_connect_ip) - 1] = '\0';
+    wifi_user_callback = callback;
+    return wifi_command_async(sendbuffer, 20, wifi_connect_done);
 }
 
-WIFI_ERROR_MESSAGE_t wifi_command_TCP_transmit(uint8_t * data, uint16_t length){
-    char sendbuffer[128];
-    char portString[7];
-    strcpy(sendbuffer, "AT+CIPSEND=");
-    sprintf(portString, "%u", length);
-    strcat(sendbuffer, portString);
+static WIFI_ERROR_MESSAGE_t wifi_create_connection(const char *type, char *IP, uint16_t port, WIFI_TCP_Callback_t callback_when_message_received, char *received_message_buffer, uint16_t size)
+{
+    WIFI_ERROR_MESSAGE_t error = wifi_start_connection(type, IP, port, callback_when_message_received, received_message_buffer, size, NULL);
+    if (error != WIFI_OK)
+        return error;
+    return wifi_wait_for_result(20);
+}
 
-    WIFI_ERROR_MESSAGE_t errorMessage = wifi_command(sendbuffer, 20);
-    if (errorMessage != WIFI_OK)
-        return errorMessage;
-    
-uart_send_array_blocking(USART_WIFI, data,  length);
-return WIFI_OK;
+WIFI_ERROR_MESSAGE_t wifi_command_create_TCP_connection(char *IP, uint16_t port, WIFI_TCP_Callback_t callback_when_message_received, char *received_message_buffer, uint16_t size)
+{
+    return wifi_create_connection("TCP", IP, port, callback_when_message_received, received_message_buffer, size);
 }
 
-WIFI_ERROR_MESSAGE_t wifi_command_get_MAC(char *mac_buffer)
+WIFI_ERROR_MESSAGE_t wifi_command_create_SSL_connection(char *IP, uint16_t port, WIFI_TCP_Callback_t callback_when_message_received, char *received_message_buffer, uint16_t size)
 {
-    char sendbuffer[] = "AT+CIFSR";
-    uint16_t timeOut_s = 5;
+    return wifi_create_connection("SSL", IP, port, callback_when_message_received, received_message_buffer, size);
+}
 
-    UART_Callback_t callback_state = uart_get_rx_callback(USART_WIFI);
-    uart_init(USART_WIFI, wifi_baudrate, wifi_command_callback);
+WIFI_ERROR_MESSAGE_t wifi_command_create_TCP_connection_async(char *IP, uint16_t port, WIFI_Command_Callback_t callback)
+{
+    return wifi_start_connection("TCP", IP, port, NULL, NULL, 0, callback);
+}
 
-    uart_send_string_blocking(USART_WIFI, strcat(sendbuffer, "\r\n"));
+WIFI_ERROR_MESSAGE_t wifi_command_create_SSL_connection_async(char *IP, uint16_t port, WIFI_Command_Callback_t callback)
+{
+    return wifi_start_connection("SSL", IP, port, NULL, NULL, 0, callback);
+}
 
-    for (uint16_t i = 0; i < timeOut_s * 100UL; i++) {
-        _delay_ms(10);
-        if (strstr((char *)wifi_dataBuffer, "OK\r\n") != NULL)
-            break;
-    }
+WIFI_ERROR_MESSAGE_t wifi_command_TCP_transmit(uint8_t * data, uint16_t length){
+    WIFI_ERROR_MESSAGE_t error = wifi_command_TCP_transmit_async(data, length, NULL);
+    if (error != WIFI_OK)
+        return error;
+    return wifi_wait_for_result(20);
+}
 
-    WIFI_ERROR_MESSAGE_t error;
+WIFI_ERROR_MESSAGE_t wifi_command_TCP_transmit_stream(uint16_t length, WIFI_TCP_Writer_t writer){
+    WIFI_ERROR_MESSAGE_t error = wifi_command_TCP_transmit_stream_async(length, writer, NULL);
+    if (error != WIFI_OK)
+        return error;
+    return wifi_wait_for_result(20);
+}
 
-    if (wifi_dataBufferIndex == 0)
-        error = WIFI_ERROR_NOT_RECEIVING;
-    else if (strstr((char *)wifi_dataBuffer, "OK") != NULL)
-        error = WIFI_OK;
-    else if (strstr((char *)wifi_dataBuffer, "ERROR") != NULL)
-        error = WIFI_ERROR_RECEIVED_ERROR;
-    else if (strstr((char *)wifi_dataBuffer, "FAIL") != NULL)
-        error = WIFI_FAIL;
-    else
-        error = WIFI_ERROR_RECEIVING_GARBAGE;
+static char *wifi_mac_buffer;
 
-    
+static void wifi_mac_done(WIFI_ERROR_MESSAGE_t error)
+{
     char *macStart = strstr((char *)wifi_dataBuffer, "+CIFSR:STAMAC,\"");
     if (macStart != NULL) {
         macStart += strlen("+CIFSR:STAMAC,\"");
         char *macEnd = strchr(macStart, '"');
         if (macEnd != NULL && (macEnd - macStart) < 18) {
-            strncpy(mac_buffer, macStart, macEnd - macStart);
-            mac_buffer[macEnd - macStart] = '\0';
+            strncpy(wifi_mac_buffer, macStart, macEnd - macStart);
+            wifi_mac_buffer[macEnd - macStart] = '\0';
         }
     }
 
-    // wifi_command_enable_echo();
-    wifi_clear_databuffer_and_index();
-    uart_init(USART_WIFI, wifi_baudrate, callback_state);
-    return error;
+    WIFI_Command_Callback_t callback = wifi_user_callback;
+    wifi_user_callback = NULL;
+    if (callback != NULL)
+        callback(error);
+}
+
+WIFI_ERROR_MESSAGE_t wifi_command_get_MAC_async(char *mac_buffer, WIFI_Command_Callback_t callback)
+{
+    if (wifi_state != WIFI_IDLE)
+        return WIFI_ERROR_BUSY;
+
+    wifi_mac_buffer = mac_buffer;
+    wifi_user_callback = callback;
+    return wifi_command_async("AT+CIFSR", 5, wifi_mac_done);
+}
+
+WIFI_ERROR_MESSAGE_t wifi_command_get_MAC(char *mac_buffer)
+{
+    WIFI_ERROR_MESSAGE_t error = wifi_command_get_MAC_async(mac_buffer, NULL);
+    if (error != WIFI_OK)
+        return error;
+    return wifi_wait_for_result(5);
 }
+#endif//EXCLUDE_WIFI
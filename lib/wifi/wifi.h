@@ -18,6 +18,38 @@
  */
 #define USART_WIFI USART_2
 
+/**
+ * @brief Number of host names wifi_command_get_ip_from_URL() remembers.
+ * 
+ */
+#ifndef WIFI_DNS_CACHE_SIZE
+#define WIFI_DNS_CACHE_SIZE 3
+#endif
+
+/**
+ * @brief Longest host name that is cached, including the terminating '\0'.
+ * 
+ */
+#ifndef WIFI_DNS_CACHE_HOST_SIZE
+#define WIFI_DNS_CACHE_HOST_SIZE 32
+#endif
+
+/**
+ * @brief Default time in seconds a resolved address is reused.
+ * 
+ */
+#ifndef WIFI_DNS_CACHE_TTL_S
+#define WIFI_DNS_CACHE_TTL_S 3600
+#endif
+
+/**
+ * @brief Default time in seconds a failed lookup is remembered.
+ * 
+ */
+#ifndef WIFI_DNS_CACHE_NEGATIVE_TTL_S
+#define WIFI_DNS_CACHE_NEGATIVE_TTL_S 30
+#endif
+
 /**
  * @brief Enumerated list of possible error messages from the WiFi module.
  * 
@@ -27,7 +59,8 @@ typedef enum{
     WIFI_FAIL,                       /**< General failure or operation not successful. */
     WIFI_ERROR_RECEIVED_ERROR,       /**< Received an error message from the module. */
     WIFI_ERROR_NOT_RECEIVING,        /**< No data received from the module. */
-    WIFI_ERROR_RECEIVING_GARBAGE     /**< Received unintelligible data from the module. */
+    WIFI_ERROR_RECEIVING_GARBAGE,    /**< Received unintelligible data from the module. */
+    WIFI_ERROR_BUSY                  /**< Another command is still waiting for its response. */
 } WIFI_ERROR_MESSAGE_t;
 
 /**
@@ -36,12 +69,144 @@ typedef enum{
  */
 typedef void (*WIFI_TCP_Callback_t)();
 
+/**
+ * @brief Type definition for the callback that receives TCP data as it arrives.
+ * 
+ * @param data Received bytes, only valid during the call.
+ * @param length Number of bytes in data.
+ */
+typedef void (*WIFI_TCP_Stream_Callback_t)(const uint8_t *data, uint16_t length);
+
+/**
+ * @brief Type definition for a function that writes a TCP payload with wifi_TCP_write().
+ * 
+ */
+typedef void (*WIFI_TCP_Writer_t)(void);
+
+/**
+ * @brief Type definition for the completion callback of an asynchronous command.
+ * 
+ * @param result Error message based on the response from the module.
+ */
+typedef void (*WIFI_Command_Callback_t)(WIFI_ERROR_MESSAGE_t result);
+
 /**
  * @brief Initialize the WiFi module. After it have been initialized it can take up to 4 seconds before its ready. 
  * 
  */
 void wifi_init();
 
+/**
+ * @brief Process everything the WiFi module has sent since the last call.
+ * 
+ * Advances the command in flight, invokes its completion callback when the response
+ * is complete, and delivers received TCP data. Call it often from the main loop; the
+ * UART receive buffer only holds a few milliseconds of data at 115200 baud.
+ */
+void wifi_poll(void);
+
+/**
+ * @brief Check whether a command is waiting for its response.
+ * 
+ * @return uint8_t 1 if a command is in flight, 0 if a new one can be started.
+ */
+uint8_t wifi_busy(void);
+
+/**
+ * @brief Number of bytes from the module that were lost because the UART receive
+ * buffer was full, or because the hardware overran, since startup.
+ * 
+ * Whatever was being received when it changes is incomplete, e.g. a TCP response.
+ * 
+ * @return uint16_t Count that only grows, and wraps around.
+ */
+uint16_t wifi_rx_overflows(void);
+
+/**
+ * @brief Check whether the TCP/SSL link is up.
+ * 
+ * Set when a connection is created, cleared by wifi_command_close_TCP_connection() and
+ * when the module reports CLOSED or WIFI DISCONNECT on its own, e.g. because the server
+ * closed the connection. The state is updated by wifi_poll().
+ * 
+ * @return uint8_t 1 if connected, 0 if not.
+ */
+uint8_t wifi_TCP_is_connected(void);
+
+/**
+ * @brief Change where received TCP data is stored, without reconnecting.
+ * 
+ * Each +IPD message is written from the start of the buffer and null terminated. Data
+ * that does not fit in size - 1 bytes is dropped.
+ * 
+ * @param received_message_buffer Buffer to hold the received message.
+ * @param size Size of the buffer in bytes.
+ */
+void wifi_TCP_set_receive_buffer(char *received_message_buffer, uint16_t size);
+
+/**
+ * @brief Receive TCP data as a stream instead of (or as well as) in a buffer.
+ * 
+ * The callback is called from wifi_poll() with the payload of each +IPD message, in
+ * pieces as it is read from the UART, so received data can be processed without
+ * being stored. Creating a connection removes the callback again.
+ * 
+ * @param callback Called with received data, NULL to stop.
+ */
+void wifi_TCP_set_stream_callback(WIFI_TCP_Stream_Callback_t callback);
+
+/**
+ * @brief Send an AT command without waiting for the response.
+ * 
+ * The command is queued on the UART and the function returns immediately. The
+ * response is matched by wifi_poll(), which calls the callback once OK, ERROR or FAIL
+ * has been received, or when the timeout runs out.
+ * 
+ * @param command The command without the trailing "\r\n", e.g. "AT+CIPCLOSE".
+ * @param timeOut_s Timeout in seconds, checked by wifi_poll() against timers_millis().
+ * @param callback Called from wifi_poll() with the result. Can be NULL.
+ * @return WIFI_ERROR_MESSAGE_t WIFI_OK if the command was sent, WIFI_ERROR_BUSY if another command is in flight.
+ */
+WIFI_ERROR_MESSAGE_t wifi_command_async(const char *command, uint8_t timeOut_s, WIFI_Command_Callback_t callback);
+
+/**
+ * @brief Transmit data over an established TCP connection without waiting.
+ * 
+ * Sends AT+CIPSEND, sends the data once the module answers with the '>' prompt, and
+ * completes when SEND OK (or an error) is received. The data must stay valid until
+ * the callback has been called.
+ * 
+ * @param data Pointer to the data to transmit.
+ * @param length Length of the data to transmit.
+ * @param callback Called from wifi_poll() with the result. Can be NULL.
+ * @return WIFI_ERROR_MESSAGE_t WIFI_OK if the command was sent, WIFI_ERROR_BUSY if another command is in flight.
+ */
+WIFI_ERROR_MESSAGE_t wifi_command_TCP_transmit_async(uint8_t *data, uint16_t length, WIFI_Command_Callback_t callback);
+
+/**
+ * @brief Transmit a payload that is generated while it is sent, without waiting.
+ * 
+ * Sends AT+CIPSEND=length. When the module answers with the '>' prompt, writer is
+ * called from wifi_poll() and writes the payload with wifi_TCP_write(), straight into
+ * the UART transmit buffer, so the payload never has to exist in memory as a whole.
+ * The writer must write exactly length bytes: more are cut off, and if it writes less
+ * the rest is filled with spaces.
+ * 
+ * @param length Number of bytes the writer produces.
+ * @param writer Writes the payload.
+ * @param callback Called from wifi_poll() with the result. Can be NULL.
+ * @return WIFI_ERROR_MESSAGE_t WIFI_OK if the command was sent, WIFI_ERROR_BUSY if another command is in flight.
+ */
+WIFI_ERROR_MESSAGE_t wifi_command_TCP_transmit_stream_async(uint16_t length, WIFI_TCP_Writer_t writer, WIFI_Command_Callback_t callback);
+
+/**
+ * @brief Write part of the payload. Only has an effect inside a WIFI_TCP_Writer_t.
+ * 
+ * @param data Bytes to send; they are copied before the function returns.
+ * @param length Number of bytes.
+ */
+void wifi_TCP_write(const uint8_t *data, uint16_t length);
+
 /**
  * @brief Send an AT command to the WiFi module to check if it's responsive.
  * 
@@ -58,6 +223,16 @@ WIFI_ERROR_MESSAGE_t wifi_command_AT();
  */
 WIFI_ERROR_MESSAGE_t wifi_command_join_AP(char *ssid, char *password);
 
+/**
+ * @brief Join an Access Point without waiting. See wifi_command_async().
+ * 
+ * @param ssid Network SSID to join.
+ * @param password Password for the SSID.
+ * @param callback Called from wifi_poll() with the result. Can be NULL.
+ * @return WIFI_ERROR_MESSAGE_t WIFI_OK if the command was sent, WIFI_ERROR_BUSY if another command is in flight.
+ */
+WIFI_ERROR_MESSAGE_t wifi_command_join_AP_async(char *ssid, char *password, WIFI_Command_Callback_t callback);
+
 /**
  * @brief Disable echo from the WiFi module.
  * 
@@ -87,26 +262,119 @@ WIFI_ERROR_MESSAGE_t wifi_command_set_to_single_Connection();
  * @return WIFI_ERROR_MESSAGE_t 
  */
 WIFI_ERROR_MESSAGE_t wifi_command_get_ip_from_URL(char * url, char *ip_address);
+
+/**
+ * @brief Look up the IP of a host without waiting.
+ * 
+ * A host in the cache is answered at once: the callback is called before the
+ * function returns. Otherwise AT+CIPDOMAIN is sent and the callback is called from
+ * wifi_poll(). url and ip_address must stay valid until then.
+ * 
+ * @param url The host name.
+ * @param ip_address Buffer of at least 16 bytes for the IP.
+ * @param callback Called with the result of the lookup. Can be NULL.
+ * @return WIFI_ERROR_MESSAGE_t WIFI_OK if the lookup was started or answered, WIFI_ERROR_BUSY if another command is in flight.
+ */
+WIFI_ERROR_MESSAGE_t wifi_command_get_ip_from_URL_async(char *url, char *ip_address, WIFI_Command_Callback_t callback);
+
+/**
+ * @brief Set how long wifi_command_get_ip_from_URL() reuses its results.
+ * 
+ * Within the TTL a host is answered from the cache without AT+CIPDOMAIN. A failed
+ * lookup is cached too, and returns the same error until negative_ttl_s has passed.
+ * Entries age by timers_millis(). Changing the TTL applies to new entries only.
+ * 
+ * @param ttl_s Seconds a resolved address is reused.
+ * @param negative_ttl_s Seconds a failed lookup is remembered, 0 to not remember failures.
+ */
+void wifi_dns_cache_set_ttl(uint16_t ttl_s, uint16_t negative_ttl_s);
+
+/**
+ * @brief Forget every host that resolved to ip_address.
+ * 
+ * Done automatically when creating a connection to the address fails.
+ * 
+ * @param ip_address The address that did not work.
+ */
+void wifi_dns_cache_invalidate(const char *ip_address);
+
+/**
+ * @brief Forget all cached lookups. wifi_init() does this as well.
+ * 
+ */
+void wifi_dns_cache_clear(void);
 /**
  * @brief Establish a TCP connection using the WiFi module.
  * 
  * @param IP IP address to connect to.
  * @param port Port number to use for the connection.
  * @param callback_when_message_received Callback executed when a message is received.
- * @param received_message_buffer Buffer to hold the received message.
+ * @param received_message_buffer Buffer to hold the received message, or NULL.
+ * @param size Size of the buffer in bytes; see wifi_TCP_set_receive_buffer().
  * @return WIFI_ERROR_MESSAGE_t Error message based on the response from the module.
  */
-WIFI_ERROR_MESSAGE_t wifi_command_create_TCP_connection(char *IP, uint16_t port, WIFI_TCP_Callback_t callback_when_message_received, char *received_message_buffer);
+WIFI_ERROR_MESSAGE_t wifi_command_create_TCP_connection(char *IP, uint16_t port, WIFI_TCP_Callback_t callback_when_message_received, char *received_message_buffer, uint16_t size);
+
+/**
+ * @brief Establish an SSL connection using the WiFi module.
+ * 
+ * Same as wifi_command_create_TCP_connection(), but the module does the TLS handshake.
+ * Data is sent and received with the TCP functions.
+ * 
+ * @param IP IP address to connect to.
+ * @param port Port number to use for the connection.
+ * @param callback_when_message_received Callback executed when a message is received.
+ * @param received_message_buffer Buffer to hold the received message, or NULL.
+ * @param size Size of the buffer in bytes; see wifi_TCP_set_receive_buffer().
+ * @return WIFI_ERROR_MESSAGE_t Error message based on the response from the module.
+ */
+WIFI_ERROR_MESSAGE_t wifi_command_create_SSL_connection(char *IP, uint16_t port, WIFI_TCP_Callback_t callback_when_message_received, char *received_message_buffer, uint16_t size);
+
+/**
+ * @brief Establish a TCP connection without waiting.
+ * 
+ * Received data is only delivered to the callback of wifi_TCP_set_stream_callback(),
+ * which has to be set again once the connection is up.
+ * 
+ * @param IP IP address to connect to.
+ * @param port Port number to use for the connection.
+ * @param callback Called from wifi_poll() with the result. Can be NULL.
+ * @return WIFI_ERROR_MESSAGE_t WIFI_OK if the command was sent, WIFI_ERROR_BUSY if another command is in flight.
+ */
+WIFI_ERROR_MESSAGE_t wifi_command_create_TCP_connection_async(char *IP, uint16_t port, WIFI_Command_Callback_t callback);
+
+/**
+ * @brief Establish an SSL connection without waiting. See wifi_command_create_TCP_connection_async().
+ * 
+ * @param IP IP address to connect to.
+ * @param port Port number to use for the connection.
+ * @param callback Called from wifi_poll() with the result. Can be NULL.
+ * @return WIFI_ERROR_MESSAGE_t WIFI_OK if the command was sent, WIFI_ERROR_BUSY if another command is in flight.
+ */
+WIFI_ERROR_MESSAGE_t wifi_command_create_SSL_connection_async(char *IP, uint16_t port, WIFI_Command_Callback_t callback);
 
 /**
  * @brief Transmit data over an established TCP connection.
  * 
+ * Blocks until the module has answered SEND OK, SEND FAIL or ERROR.
+ * 
  * @param data Pointer to the data to transmit.
  * @param length Length of the data to transmit.
  * @return WIFI_ERROR_MESSAGE_t Error message based on the response from the module.
  */
 WIFI_ERROR_MESSAGE_t wifi_command_TCP_transmit(uint8_t *data, uint16_t length);
 
+/**
+ * @brief Transmit a generated payload over an established TCP connection.
+ * 
+ * Blocking version of wifi_command_TCP_transmit_stream_async().
+ * 
+ * @param length Number of bytes the writer produces.
+ * @param writer Writes the payload with wifi_TCP_write().
+ * @return WIFI_ERROR_MESSAGE_t Error message based on the response from the module.
+ */
+WIFI_ERROR_MESSAGE_t wifi_command_TCP_transmit_stream(uint16_t length, WIFI_TCP_Writer_t writer);
+
 /**
  * @brief Disconnect from the current Access Point (AP).
  * 
@@ -120,10 +388,27 @@ WIFI_ERROR_MESSAGE_t wifi_command_quit_AP();
  */
 WIFI_ERROR_MESSAGE_t wifi_command_close_TCP_connection();
 
+/**
+ * @brief Close the TCP connection without waiting. The link counts as down at once.
+ * 
+ * @param callback Called from wifi_poll() with the result. Can be NULL.
+ * @return WIFI_ERROR_MESSAGE_t WIFI_OK if the command was sent, WIFI_ERROR_BUSY if another command is in flight.
+ */
+WIFI_ERROR_MESSAGE_t wifi_command_close_TCP_connection_async(WIFI_Command_Callback_t callback);
+
 /**
  * @brief Get the MAC address of the ESP8266 module.
  * 
  * @param mac_buffer A pointer to a buffer of at least 18 bytes (to store the MAC string).
  * @return WIFI_ERROR_MESSAGE_t Result of the operation.
  */
-WIFI_ERROR_MESSAGE_t wifi_command_get_MAC(char *mac_buffer);
\ No newline at end of file
+WIFI_ERROR_MESSAGE_t wifi_command_get_MAC(char *mac_buffer);
+
+/**
+ * @brief Get the MAC address without waiting. mac_buffer must stay valid until the callback.
+ * 
+ * @param mac_buffer A pointer to a buffer of at least 18 bytes (to store the MAC string).
+ * @param callback Called from wifi_poll() with the result. Can be NULL.
+ * @return WIFI_ERROR_MESSAGE_t WIFI_OK if the command was sent, WIFI_ERROR_BUSY if another command is in flight.
+ */
+WIFI_ERROR_MESSAGE_t wifi_command_get_MAC_async(char *mac_buffer, WIFI_Command_Callback_t callback);
\ No newline at end of file
@@ -16,6 +16,7 @@
 #include <util/delay.h>
 #include <avr/interrupt.h>
 #include <avr/eeprom.h>
+#include <avr/sleep.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
@@ -28,17 +29,26 @@
 
 #define API_HOST    "api.com"
 #define API_PORT    443
+#define API_TRANSPORT HTTP_SESSION_SSL
 
 /* ML predictor (GET) */
 #define PREDICT_HOST "mal.com"
 #define PREDICT_PORT 443
+#define PREDICT_TRANSPORT HTTP_SESSION_SSL
 #define PREDICT_EP   "/v1/predict"
 
 #define CFG_USE_EEPROM 1          /* 0 = RAM-only                  */
+#define TELEMETRY_TASK_PROFILE 1  /* 1 = task timings in telemetry */
+#define TAMPER_ACT_THRESHOLD  50  /* 3.1 g, 62.5 mg per step       */
+#define TAMPER_TAP_THRESHOLD  48  /* 3 g shock ...                 */
+#define TAMPER_TAP_DURATION   32  /* ... shorter than 20 ms        */
 /* ------------------------------------------------------------------ */
 
 #include "pc_comm.h"
 #include "wifi.h"
+#include "http_session.h"
+#include "json_stream.h"
+#include "json_writer.h"
 #include "clock.h"
 
 /* sensors */
@@ -59,6 +69,8 @@
 #include "tone.h"
 /* scheduler */
 #include "periodic_task.h"
+#include "protothread.h"
+#include "timers.h"
 
 /* endpoints we still use */
 #define SETTINGS_EP   "/v1/settings"
@@ -126,20 +138,19 @@ static uint32_t hours_since_fert = 0;
 /* ML flag set by predictor task */
 static bool ml_recommend_water = false;
 
+/* set by net_start() once the device joined the AP and logged in */
+static bool net_ready = false;
+
 static char device_mac[18] = "";
 static char g_auth_token[128] = "";
 
-static char txbuf[512], rxbuf[512], json[768];
-
 /* ===================== HELPERS ================================== */
 static void dbg(const char* fmt, ...) {
     char b[128]; va_list ap; va_start(ap, fmt);
-    vsnprintf(b, sizeof(b), fmt, ap); va_end(ap);
-    pc_comm_send_string_blocking(b);
+    int n = vsnprintf(b, sizeof(b), fmt, ap); va_end(ap);
+    if (n >= (int)sizeof(b)) n = sizeof(b) - 1;
+    if (n > 0) pc_comm_send_array_nonBlocking((uint8_t*)b, n);   /* copied into the TX ring */
 }
-#ifndef buttons_4_pressed
-static inline uint8_t buttons_4_pressed(void) { return 0; }
-#endif
 
 static bool parse_hhmm(const char* s, uint8_t* h, uint8_t* m) {
     if (strlen(s) < 5) return false;
@@ -153,140 +164,173 @@ static inline bool in_light_window(uint8_t h, uint8_t on, uint8_t off) {
     return (h >= on) || (h < off);
 }
 
-/* ============ BASIC HTTP (GET + POST) =========================== */
-static bool http_basic_get(const char* host, uint16_t port,
-    const char* path,
-    char* buf, size_t len) {
-    char ip[32] = "";
-    if (wifi_command_get_ip_from_URL((char*)host, ip) != WIFI_OK) return false;
-    if (wifi_command_create_TCP_connection(ip, port, NULL, buf) != WIFI_OK) return false;
-    int hl = snprintf(txbuf, sizeof(txbuf),
-        "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n",
-        path, host);
-    wifi_command_TCP_transmit((uint8_t*)txbuf, hl);
-    _delay_ms(500);
-    wifi_command_close_TCP_connection();
-    char* p = strstr(buf, "\r\n\r\n"); if (!p) return false;
-    memmove(buf, p + 4, strlen(p + 4) + 1);
-    return true;
-}
-static bool http_basic_post(const char* host, uint16_t port,
-    const char* path, const char* body,
-    char* buf, size_t len) {
-    char ip[32] = "";
-    if (wifi_command_get_ip_from_URL((char*)host, ip) != WIFI_OK) return false;
-    if (wifi_command_create_TCP_connection(ip, port, NULL, buf) != WIFI_OK) return false;
-    int bl = strlen(body);
-    int hl = snprintf(txbuf, sizeof(txbuf),
-        "POST %s HTTP/1.1\r\nHost: %s\r\nContent-Type: application/json\r\n"
-        "Content-Length: %d\r\nConnection: close\r\n\r\n", path, host, bl);
-    wifi_command_TCP_transmit((uint8_t*)txbuf, hl);
-    wifi_command_TCP_transmit((uint8_t*)body, bl);
-    _delay_ms(500);
-    wifi_command_close_TCP_connection();
-    char* p = strstr(buf, "\r\n\r\n"); if (!p) return false;
-    memmove(buf, p + 4, strlen(p + 4) + 1);
-    return true;
-}
-/* auth helpers identical to previous version (POST login/register, GET/POST with Bearer) */
-static int http_auth_xfer(bool is_post, const char* path_q,
-    const char* body, char* buf, size_t len) {
-    char ip[32] = "";
-    if (wifi_command_get_ip_from_URL(API_HOST, ip) != WIFI_OK) return -1;
-    if (wifi_command_create_TCP_connection(ip, API_PORT, NULL, buf) != WIFI_OK) return -1;
-    int bl = body ? strlen(body) : 0;
-    int hl = snprintf(txbuf, sizeof(txbuf),
-        "%s %s HTTP/1.1\r\nHost: %s\r\nAuthorization: %s\r\n"
-        "Content-Type: application/json\r\nContent-Length: %d\r\n"
-        "Connection: close\r\n\r\n",
-        is_post ? \"POST\":\"GET\",path_q,API_HOST,g_auth_token,bl);
-        wifi_command_TCP_transmit((uint8_t*)txbuf, hl);
-    if (is_post && bl) wifi_command_TCP_transmit((uint8_t*)body, bl);
-    _delay_ms(500);
-    wifi_command_close_TCP_connection();
-    int status = 0; char* l = strstr(buf, "HTTP/"); if (l) sscanf(l, "HTTP/%*s %d", &status);
-    char* p = strstr(buf, "\r\n\r\n"); if (p) memmove(buf, p + 4, strlen(p + 4) + 1); else buf[0] = '\0';
-    return status;
-}
-static int http_get_auth(const char* path_q) { return http_auth_xfer(false, path_q, NULL, rxbuf, sizeof(rxbuf)); }
-static int http_post_auth(const char* path_q, const char* body) { return http_auth_xfer(true, path_q, body, rxbuf, sizeof(rxbuf)); }
-
-/* ---------- AUTHENTICATE DEVICE -------------------------------- */
-static void authenticate_device(void) {
-    char payload[64]; snprintf(payload, sizeof(payload),
-        "{\"username\":\"%s\",\"password\":\"worker\"}", device_mac);
-    if (http_basic_post(API_HOST, API_PORT, LOGIN_EP, payload, rxbuf, sizeof(rxbuf))) {
-        char* p = strstr(rxbuf, "\"token\":\""); if (p) {
-            p += 9; char* q = strchr(p, '\"');
-            if (q && (q - p) < (int)(sizeof(g_auth_token) - 8)) {
-                snprintf(g_auth_token, sizeof(g_auth_token), "Bearer %.*s", (int)(q - p), p);
-                dbg("AUTH login OK\n"); return;
-            }
-        }
+/* ============ HTTP REQUESTS ===================================== */
+/* Every request goes over the keep-alive session, which only reconnects
+   when the host changes or the module reported the link as closed.
+   Requests are not formatted into a buffer: http_write_request() writes
+   the request line, headers and JSON body straight into the AT+CIPSEND
+   payload. It runs once without a sink to count the bytes, then again
+   while the single CIPSEND goes out, so both runs must write the same.
+   A request is a protothread: it waits for the session and the reply
+   while the main loop goes on. The response body is parsed as it
+   arrives and its values handed to on_value */
+typedef struct {
+    const char* method;
+    const char* host;
+    uint16_t port;
+    HTTP_SESSION_Transport_t transport;
+    const char* path;
+    bool dev_query;                         /* append ?dev=<mac>      */
+    bool auth;                              /* send the bearer token  */
+    void (*body)(json_writer_t* w);         /* NULL: no body          */
+} http_request_t;
+
+static const http_request_t* http_req;
+
+static void http_write_request(json_writer_t* w) {
+    const http_request_t* r = http_req;
+    json_writer_raw(w, r->method); json_writer_raw(w, " "); json_writer_raw(w, r->path);
+    if (r->dev_query) { json_writer_raw(w, "?dev="); json_writer_raw(w, device_mac); }
+    json_writer_raw(w, " HTTP/1.1\r\nHost: "); json_writer_raw(w, r->host);
+    if (r->auth) { json_writer_raw(w, "\r\nAuthorization: "); json_writer_raw(w, g_auth_token); }
+    if (r->body) {
+        json_writer_t dry; json_writer_init(&dry, NULL); r->body(&dry);
+        json_writer_raw(w, "\r\nContent-Type: application/json\r\nContent-Length: ");
+        json_writer_raw_uint(w, json_writer_length(&dry));
     }
-    memset(rxbuf, 0, sizeof(rxbuf));
-    if (http_basic_post(API_HOST, API_PORT, REGISTER_EP, payload, rxbuf, sizeof(rxbuf))) {
-        char* p = strstr(rxbuf, "\"token\":\""); if (p) {
-            p += 9; char* q = strchr(p, '\"');
-            if (q && (q - p) < (int)(sizeof(g_auth_token) - 8)) {
-                snprintf(g_auth_token, sizeof(g_auth_token), "Bearer %.*s", (int)(q - p), p);
-                dbg("AUTH register OK\n"); return;
-            }
-        }
+    json_writer_raw(w, "\r\nConnection: keep-alive\r\n\r\n");
+    if (r->body) r->body(w);
+}
+static void http_send_request(void) {
+    json_writer_t w; json_writer_init(&w, wifi_TCP_write);
+    http_write_request(&w);
+}
+
+/* ============ JSON RESPONSES ==================================== */
+/* Response bodies are parsed while they arrive; values are only taken
+   from 2xx responses */
+static json_stream_t json_in;
+static void json_in_start(json_stream_callback_t on_value) { json_stream_init(&json_in, on_value); }
+static void json_in_feed(const uint8_t* data, uint16_t length) {
+    uint16_t status = http_session_response()->status;
+    if (status >= 200 && status < 300) json_stream_feed(&json_in, data, length);
+}
+
+/* The session takes one request at a time; http_req and json_in belong
+   to the request that holds it. The status is http_session_status() */
+static protothread_t http_session_pt;
+static uint16_t http_req_length;
+static PT_THREAD(http_request(protothread_t* pt, const http_request_t* r, json_stream_callback_t on_value)) {
+    PT_BEGIN(pt);
+    PT_WAIT_WHILE(pt, http_session_busy());
+    {
+        json_writer_t dry; json_writer_init(&dry, NULL);
+        http_req = r; http_write_request(&dry);
+        http_req_length = json_writer_length(&dry);
+        if (on_value) json_in_start(on_value);
     }
+    PT_SPAWN(pt, &http_session_pt, http_session_request_writer(&http_session_pt, r->host, r->port,
+        r->transport, http_req_length, http_send_request, on_value ? json_in_feed : NULL));
+    PT_END(pt);
+}
+
+/* ---------- AUTHENTICATE DEVICE -------------------------------- */
+static void auth_json_value(const char* path, json_stream_type_t type, const char* value, uint8_t truncated) {
+    if (type == JSON_STREAM_STRING && !truncated && strcmp(path, "token") == 0 &&
+        strlen(value) < sizeof(g_auth_token) - 8)
+        snprintf(g_auth_token, sizeof(g_auth_token), "Bearer %s", value);
+}
+static void login_body(json_writer_t* w) {
+    json_writer_begin_object(w, NULL);
+    json_writer_string(w, "username", device_mac);
+    json_writer_string(w, "password", "worker");
+    json_writer_end_object(w);
+}
+static const http_request_t login_req = {
+    "POST", API_HOST, API_PORT, API_TRANSPORT, LOGIN_EP, false, false, login_body };
+static const http_request_t register_req = {
+    "POST", API_HOST, API_PORT, API_TRANSPORT, REGISTER_EP, false, false, login_body };
+static PT_THREAD(authenticate_device(protothread_t* pt)) {
+    static protothread_t req;
+    PT_BEGIN(pt);
+    g_auth_token[0] = '\0';
+    PT_SPAWN(pt, &req, http_request(&req, &login_req, auth_json_value));
+    if (g_auth_token[0]) { dbg("AUTH login OK\n"); PT_EXIT(pt); }
+    PT_SPAWN(pt, &req, http_request(&req, &register_req, auth_json_value));
+    if (g_auth_token[0]) { dbg("AUTH register OK\n"); PT_EXIT(pt); }
     dbg("AUTH failed\n");
+    PT_END(pt);
 }
 
 /* ---------- SETTINGS FETCH / PARSE ------------------------------ */
-static void cfg_parse_json(const char* js) {
-    char* p;
-    if ((p = strstr(js, "\"watering\""))) {
-        CFG.watering_manual = strstr(p, "\"manual\":true") != NULL;
-        if ((p = strstr(p, "soilMin"))) CFG.soil_min = atoi(p + 8);
-        if ((p = strstr(p, "soilMax"))) CFG.soil_max = atoi(p + 8);
-        if ((p = strstr(p, "maxPumpSeconds"))) CFG.max_pump_seconds = (uint16_t)atoi(p + 15);
-        if ((p = strstr(p, "fertHours")))      CFG.fert_hours = (uint16_t)atoi(p + 10);
-    }
-    if ((p = strstr(js, "\"lighting\""))) {
-        CFG.lighting_manual = strstr(p, "\"manual\":true") != NULL;
-        if ((p = strstr(p, "luxLow"))) CFG.lux_low = (uint16_t)atoi(p + 7);
-        if ((p = strstr(p, "onHour"))) CFG.on_h = (uint8_t)atoi(p + 7);
-        if ((p = strstr(p, "offHour")))CFG.off_h = (uint8_t)atoi(p + 8);
-    }
-    if ((p = strstr(js, "\"security\""))) {
-        CFG.security_armed = strstr(p, "\"armed\":true") != NULL;
-        if ((p = strstr(p, "alarmWindow"))) {
-            if ((p = strstr(p, "start\""))) {
-                char t[6] = { 0 }; strncpy(t, p + 8, 5);
-                parse_hhmm(t, &CFG.alarm_start_h, &CFG.alarm_start_m);
-            }
-            if ((p = strstr(p, "end\""))) {
-                char t[6] = { 0 }; strncpy(t, p + 6, 5);
-                parse_hhmm(t, &CFG.alarm_end_h, &CFG.alarm_end_m);
-            }
-        }
-    }
-    if ((p = strstr(js, "updatedAt\""))) {
-        p += 11; char* q = strchr(p, '\"');
-        if (q && (q - p) < (int)sizeof(cfg_rev)) { memcpy(cfg_rev, p, q - p); cfg_rev[q - p] = '\0'; }
-    }
+/* The document is parsed into a copy, which replaces CFG only when it
+   arrived complete */
+static gh_cfg_t cfg_next;
+static char cfg_rev_next[sizeof(cfg_rev)];
+static const json_stream_binding_t cfg_bindings[] = {
+    { "watering.manual",         JSON_STREAM_BIND_BOOL,   &cfg_next.watering_manual,  0 },
+    { "watering.soilMin",        JSON_STREAM_BIND_UINT8,  &cfg_next.soil_min,         0 },
+    { "watering.soilMax",        JSON_STREAM_BIND_UINT8,  &cfg_next.soil_max,         0 },
+    { "watering.maxPumpSeconds", JSON_STREAM_BIND_UINT16, &cfg_next.max_pump_seconds, 0 },
+    { "watering.fertHours",      JSON_STREAM_BIND_UINT16, &cfg_next.fert_hours,       0 },
+    { "lighting.manual",         JSON_STREAM_BIND_BOOL,   &cfg_next.lighting_manual,  0 },
+    { "lighting.luxLow",         JSON_STREAM_BIND_UINT16, &cfg_next.lux_low,          0 },
+    { "lighting.onHour",         JSON_STREAM_BIND_UINT8,  &cfg_next.on_h,             0 },
+    { "lighting.offHour",        JSON_STREAM_BIND_UINT8,  &cfg_next.off_h,            0 },
+    { "security.armed",          JSON_STREAM_BIND_BOOL,   &cfg_next.security_armed,   0 },
+    { "meta.updatedAt",          JSON_STREAM_BIND_STRING, cfg_rev_next, sizeof(cfg_rev_next) },
+    { "updatedAt",               JSON_STREAM_BIND_STRING, cfg_rev_next, sizeof(cfg_rev_next) },
+};
+static void cfg_json_value(const char* path, json_stream_type_t type, const char* value, uint8_t truncated) {
+    if (json_stream_bind(cfg_bindings, sizeof(cfg_bindings) / sizeof(cfg_bindings[0]), path, type, value, truncated))
+        return;
+    if (type != JSON_STREAM_STRING || truncated) return;
+    if (strcmp(path, "security.alarmWindow.start") == 0)
+        parse_hhmm(value, &cfg_next.alarm_start_h, &cfg_next.alarm_start_m);
+    else if (strcmp(path, "security.alarmWindow.end") == 0)
+        parse_hhmm(value, &cfg_next.alarm_end_h, &cfg_next.alarm_end_m);
 }
-static void fetch_settings(void) {
-    char path[64]; snprintf(path, sizeof(path), "%s?dev=%s", SETTINGS_EP, device_mac);
-    int s = http_get_auth(path);
-    if (s >= 200 && s < 300) { cfg_parse_json(rxbuf); cfg_save(); }
+static const http_request_t settings_req = {
+    "GET", API_HOST, API_PORT, API_TRANSPORT, SETTINGS_EP, true, true, NULL };
+static PT_THREAD(fetch_settings(protothread_t* pt)) {
+    static protothread_t req;
+    PT_BEGIN(pt);
+    PT_WAIT_WHILE(pt, http_session_busy());   /* cfg_next is ours from here */
+    cfg_next = CFG; strcpy(cfg_rev_next, cfg_rev);
+    PT_SPAWN(pt, &req, http_request(&req, &settings_req, cfg_json_value));
+    int s = http_session_status();
+    if (s >= 200 && s < 300 && json_stream_done(&json_in)) {
+        uint8_t sreg = SREG; cli(); CFG = cfg_next; SREG = sreg;
+        strcpy(cfg_rev, cfg_rev_next);
+        cfg_save();
+    }
     else dbg("SET HTTP %d\n", s);
-    memset(rxbuf, 0, sizeof(rxbuf));
+    PT_END(pt);
 }
 
 /* ---------- ML PREDICT (GET) ------------------------------------ */
-static bool ml_predict_water(void) {
-    char path[128]; snprintf(path, sizeof(path), "%s?dev=%s", PREDICT_EP, device_mac);
-    if (!http_basic_get(PREDICT_HOST, PREDICT_PORT, path, rxbuf, sizeof(rxbuf)))
-        return false;
-    char* p = strstr(rxbuf, "\"recommendWater\":");
-    if (!p) return false;
-    return strstr(p, "true") != NULL;
+static bool ml_recommend_next;
+static void predict_json_value(const char* path, json_stream_type_t type, const char* value, uint8_t truncated) {
+    if (strcmp(path, "recommendWater") == 0) ml_recommend_next = (type == JSON_STREAM_TRUE);
+}
+static const http_request_t predict_req = {
+    "GET", PREDICT_HOST, PREDICT_PORT, PREDICT_TRANSPORT, PREDICT_EP, true, false, NULL };
+static PT_THREAD(ml_predict_water(protothread_t* pt)) {
+    static protothread_t req;
+    PT_BEGIN(pt);
+    ml_recommend_next = false;
+    PT_SPAWN(pt, &req, http_request(&req, &predict_req, predict_json_value));
+    ml_recommend_water = http_session_status() > 0 && ml_recommend_next;
+    PT_END(pt);
+}
+
+/* ==================== SEQUENCES ================================= */
+/* Slow actuator sequences run as protothreads next to the tasks */
+static PT_THREAD(fert_dispense(protothread_t* pt)) {
+    PT_BEGIN(pt);
+    servo_dose(90, 600, 0);
+    PT_WAIT_WHILE(pt, servo_busy());
+    PT_END(pt);
 }
 
 /* ==================== TASKS ===================================== */
@@ -295,13 +339,20 @@ static void task_tick_1s(void) {
     static bool hb; hb = !hb; hb ? leds_turnOn(4) : leds_turnOff(4);
     display_int(clk.second);
     if (A_pump) pump_runtime_s++;
+    hc_sr04_ping();     /* a reading per second feeds the median window */
+}
+/* The DHT11 reads in the background; a failed reading keeps the last values */
+static void dht11_done(DHT11_ERROR_MESSAGE_t status) {
+    uint8_t hum, temp;
+    if (status == DHT11_OK && dht11_result(&hum, NULL, &temp, NULL) == DHT11_OK) {
+        S_hum = hum; S_temp = temp;
+        hc_sr04_set_temperature((int8_t)temp);
+    }
 }
 static void task_sample_5s(void) {
-    uint8_t d; dht11_get(&S_hum, &d, &S_temp, &d);
+    dht11_start(dht11_done);
     S_soil = soil_read(); S_lux = light_read();
-    S_lvl_cm = hc_sr04_takeMeasurement();
     adxl345_read_xyz(&S_ax, &S_ay, &S_az);
-    if (abs(S_ax) > 800 || abs(S_ay) > 800 || abs(S_az - 1024) > 800) S_tamper = true;
 }
 static void task_logic_5s(void) {
     /* -------- WATERING ---------- */
@@ -328,8 +379,7 @@ static void task_logic_5s(void) {
         }
     }
     /* -------- FERTILIZER --------- */
-    if (!A_fert_done && hours_since_fert >= CFG.fert_hours) {
-        servo(90); _delay_ms(600); servo(0);
+    if (!A_fert_done && hours_since_fert >= CFG.fert_hours && protothread_spawn(fert_dispense)) {
         A_fert_done = true; hours_since_fert = 0;
     }
     /* -------- SECURITY ---------- */
@@ -337,84 +387,323 @@ static void task_logic_5s(void) {
     uint16_t st = CFG.alarm_start_h * 60 + CFG.alarm_start_m;
     uint16_t en = CFG.alarm_end_h * 60 + CFG.alarm_end_m;
     if ((S_motion || S_tamper) && CFG.security_armed && time_in_window(cur, st, en)) {
+        if (!alarm_active) tone_play_pattern(TONE_SIREN);
         alarm_active = true; S_motion = false; S_tamper = false;
     }
-    if (alarm_active) { leds_toggle(3); buzzer_beep(); }
+    if (alarm_active) leds_toggle(3);
     else leds_turnOff(3);
 }
+/* The network tasks only start their protothread; one that is still
+   waiting for its reply is not started twice */
 static void task_predict_10m(void) {
-    ml_recommend_water = ml_predict_water();
+    if (net_ready) protothread_spawn(ml_predict_water);
 }
 static void pir_cb(void) { S_motion = true; }
+/* The chip watches every sample for shocks; the readings report the
+   strongest sample of the last 320 ms in its FIFO */
+static void tamper_cb(uint8_t events) {
+    if (!(events & (ADXL345_EVENT_ACTIVITY | ADXL345_EVENT_SINGLE_TAP))) return;
+    S_tamper = true;
+    adxl345_sample_t fifo[32];
+    uint8_t n = adxl345_read_fifo(fifo, 32);
+    uint32_t peak = 0;
+    for (uint8_t i = 0; i < n; i++) {
+        int32_t x = fifo[i].x, y = fifo[i].y, z = fifo[i].z;
+        uint32_t m = x * x + y * y + z * z;
+        if (m >= peak) { peak = m; S_ax = x; S_ay = y; S_az = z; }
+    }
+}
 
-static void task_cloud_60s(void) {
-    char ts[32]; clock_to_string(&clk, ts, sizeof(ts));
-    snprintf(json, sizeof(json),
-        "{\"ts\":\"%s\",\"cfgRev\":\"%s\",\"temp\":%d,\"hum\":%d,"
-        "\"soil\":%d,\"lux\":%u,\"lvl\":%u,"
-        "\"accel\":[%d,%d,%d],\"motion\":%s,\"tamper\":%s}",
-        ts, cfg_rev, S_temp, S_hum, S_soil, S_lux, S_lvl_cm,
-        S_ax, S_ay, S_az, S_motion ? \"true\":\"false\",S_tamper?\"true\":\"false\"");
+/* ---------- TELEMETRY (POST) ------------------------------------ */
+/* The readings are copied first: the body is written twice (length,
+   then payload) and must not change in between */
+static struct {
+    char ts[32], cfg_rev[sizeof(cfg_rev)];
+    uint8_t temp, hum, soil;
+    uint16_t lux, lvl;
+    int16_t ax, ay, az;
+    bool motion, tamper;
+    uint8_t motions_per_min;
+    uint32_t occupied_ms;     /* since the previous report */
+#if TELEMETRY_TASK_PROFILE
+    uint8_t task_count;
+    struct {
+        const char* name;
+        uint32_t runs, last_us, max_us;
+        uint16_t max_jitter_ms, overruns;
+    } tasks[PERIODIC_TASK_MAX_TIMERS];
+#endif
+} tel;
+#if TELEMETRY_TASK_PROFILE
+static void tel_copy_task_profiles(void);   /* after the task table */
+#endif
+static void telemetry_body(json_writer_t* w) {
+    json_writer_begin_object(w, NULL);
+    json_writer_string(w, "ts", tel.ts);
+    json_writer_string(w, "cfgRev", tel.cfg_rev);
+    json_writer_uint(w, "temp", tel.temp);
+    json_writer_uint(w, "hum", tel.hum);
+    json_writer_uint(w, "soil", tel.soil);
+    json_writer_uint(w, "lux", tel.lux);
+    json_writer_uint(w, "lvl", tel.lvl);
+    json_writer_begin_array(w, "accel");
+    json_writer_int(w, NULL, tel.ax);
+    json_writer_int(w, NULL, tel.ay);
+    json_writer_int(w, NULL, tel.az);
+    json_writer_end_array(w);
+    json_writer_bool(w, "motion", tel.motion);
+    json_writer_bool(w, "tamper", tel.tamper);
+    json_writer_uint(w, "motionsPerMin", tel.motions_per_min);
+    json_writer_uint(w, "occupiedMs", tel.occupied_ms);
+#if TELEMETRY_TASK_PROFILE
+    json_writer_begin_array(w, "tasks");
+    for (uint8_t i = 0; i < tel.task_count; i++) {
+        json_writer_begin_object(w, NULL);
+        json_writer_string(w, "name", tel.tasks[i].name);
+        json_writer_uint(w, "runs", tel.tasks[i].runs);
+        json_writer_uint(w, "lastUs", tel.tasks[i].last_us);
+        json_writer_uint(w, "maxUs", tel.tasks[i].max_us);
+        json_writer_uint(w, "maxJitterMs", tel.tasks[i].max_jitter_ms);
+        json_writer_uint(w, "overruns", tel.tasks[i].overruns);
+        json_writer_end_object(w);
+    }
+    json_writer_end_array(w);
+#endif
+    json_writer_end_object(w);
+}
+static const http_request_t telemetry_req = {
+    "POST", API_HOST, API_PORT, API_TRANSPORT, TELEMETRY_EP, true, true, telemetry_body };
+static PT_THREAD(cloud_upload(protothread_t* pt)) {
+    static protothread_t req;
+    PT_BEGIN(pt);
+    clock_to_string(&clk, tel.ts, sizeof(tel.ts));
+    strcpy(tel.cfg_rev, cfg_rev);
+    uint8_t sreg = SREG; cli();
+    tel.temp = S_temp; tel.hum = S_hum; tel.soil = S_soil;
+    tel.lux = S_lux; tel.lvl = S_lvl_cm;
+    tel.ax = S_ax; tel.ay = S_ay; tel.az = S_az;
+    tel.motion = S_motion; tel.tamper = S_tamper;
     S_motion = false; S_tamper = false;
-    char path[64]; snprintf(path, sizeof(path), "%s?dev=%s", TELEMETRY_EP, device_mac);
-    int s = http_post_auth(path, json);
+    SREG = sreg;
+    static uint32_t occupied_reported;
+    uint32_t occupied = pir_occupied_total_ms();
+    tel.occupied_ms = occupied - occupied_reported; occupied_reported = occupied;
+    tel.motions_per_min = pir_events_per_minute();
+#if TELEMETRY_TASK_PROFILE
+    tel_copy_task_profiles();
+#endif
+    PT_SPAWN(pt, &req, http_request(&req, &telemetry_req, NULL));
+    int s = http_session_status();
     if (s < 200 || s >= 300) dbg("TEL HTTP %d\n", s);
+    PT_END(pt);
+}
+static void task_cloud_60s(void) {
+    if (net_ready) protothread_spawn(cloud_upload);
+}
+static void task_settings_1h(void) {
+    if (net_ready) protothread_spawn(fetch_settings);
 }
 
 /* ==================== INIT / MAIN ================================== */
+/* PC port: 'p' dumps the timings of every task, 'r' clears them; the
+   dump runs from the main loop, not from the receive interrupt */
+static volatile bool profile_dump_requested, profile_reset_requested;
+static void pc_comm_rx(char c) {
+    if (c == 'p') profile_dump_requested = true;
+    else if (c == 'r') profile_reset_requested = true;
+}
+
 static void init_all(void) {
-    pc_comm_init(115200, NULL); cfg_load();
+    timer1_start();                       /* system time for every timeout */
+    pc_comm_init(115200, pc_comm_rx); cfg_load();
     buttons_init(); leds_init(); display_init(); buzzer_beep();
     dht11_init(); soil_init(); light_init();
     hc_sr04_init(); adxl345_init(); pir_init(pir_cb);
+    adxl345_on_event(tamper_cb); adxl345_fifo_stream(0);
+    adxl345_enable_activity(TAMPER_ACT_THRESHOLD, TAMPER_ACT_THRESHOLD / 2, 2);
+    adxl345_enable_tap(TAMPER_TAP_THRESHOLD, TAMPER_TAP_DURATION);
     pump_init(); servo(0); lightbulb_init(); tone_init();
     clock_init(&clk, 2025, 6, 18, 12, 0, 0);
+    sei();   /* the wifi replies arrive through the UART RX interrupt */
+    tone_play_pattern(TONE_BOOT);         /* plays on while wifi connects */
+    wifi_init();
+}
 
-    wifi_init(); wifi_command_disable_echo();
-    wifi_command_set_mode_to_1(); wifi_command_set_to_single_Connection();
-    wifi_command_join_AP(WIFI_SSID, WIFI_PASS); _delay_ms(500);
-
-    if (wifi_command_get_MAC(device_mac) == WIFI_OK) dbg("MAC %s\n", device_mac);
+/* ---------- NETWORK START --------------------------------------- */
+/* Joining the AP takes seconds, so the module is set up, the device
+   logs in and the settings are fetched by a protothread; the sensors,
+   pump interlock and alarm run from the start. The network tasks wait
+   for net_ready. The settings run as their own protothread, so the
+   hourly task does not start a second fetch next to this one */
+static volatile bool net_step_done;
+static WIFI_ERROR_MESSAGE_t net_step_result;
+static void net_step(WIFI_ERROR_MESSAGE_t result) { net_step_result = result; net_step_done = true; }
+static void net_sent(WIFI_ERROR_MESSAGE_t sent) { if (sent != WIFI_OK) net_step(sent); }
+/* Send an asynchronous wifi command and wait for its answer */
+#define NET_COMMAND(pt, command) \
+    do { net_step_done = false; net_sent(command); PT_WAIT_UNTIL(pt, net_step_done); } while (0)
+
+static PT_THREAD(net_start(protothread_t* pt)) {
+    static protothread_t child;
+    PT_BEGIN(pt);
+    NET_COMMAND(pt, wifi_command_async("ATE0", 1, net_step));
+    NET_COMMAND(pt, wifi_command_async("AT+CWMODE=1", 1, net_step));
+    NET_COMMAND(pt, wifi_command_async("AT+CIPMUX=0", 1, net_step));
+    NET_COMMAND(pt, wifi_command_join_AP_async(WIFI_SSID, WIFI_PASS, net_step));
+    PT_SLEEP_MS(pt, 500);
+
+    NET_COMMAND(pt, wifi_command_get_MAC_async(device_mac, net_step));
+    if (net_step_result == WIFI_OK) dbg("MAC %s\n", device_mac);
     else { strcpy(device_mac, "UNKNOWN"); dbg("MAC ERR\n"); }
 
-    authenticate_device();
-    tone_play_starwars();
-    fetch_settings();
+    PT_SPAWN(pt, &child, authenticate_device(&child));
+    net_ready = true;
+    protothread_spawn(fetch_settings);
+    PT_END(pt);
 }
+/* The tasks run from periodic_task_run() in the main loop, by priority;
+   the offsets keep tasks with the same period out of each other's way,
+   logic runs after sampling */
+static const struct {
+    void (*fn)(void);
+    uint32_t period_ms, offset_ms;
+    uint8_t priority;
+    const char* name;
+} task_table[] = {
+    { task_tick_1s,     1000,    0,   3, "tick"     },
+    { task_sample_5s,   5000,    100, 2, "sample"   },
+    { task_logic_5s,    5000,    200, 2, "logic"    },
+    { task_cloud_60s,   60000,   300, 0, "cloud"    },
+    { task_predict_10m, 600000,  400, 0, "predict"  },
+    { task_settings_1h, 3600000, 500, 0, "settings" },
+};
+#define TASK_COUNT (sizeof(task_table) / sizeof(task_table[0]))
+static periodic_task_t task_ids[TASK_COUNT];
+
 static void start_tasks(void) {
-    periodic_task_init_a(task_tick_1s, 1000);
-    periodic_task_init_b(task_sample_5s, 5000);
-    periodic_task_init_c(task_logic_5s, 5000);
-    periodic_task_init_d(task_cloud_60s, 60000);
-    periodic_task_init_d(task_predict_10m, 600000);
-    periodic_task_init_d(fetch_settings, 3600000);
+    protothread_init();
+    periodic_task_init();
+    for (uint8_t i = 0; i < TASK_COUNT; i++) {
+        task_ids[i] = periodic_task_add(task_table[i].fn, task_table[i].period_ms, task_table[i].offset_ms);
+        periodic_task_set_priority(task_ids[i], task_table[i].priority);
+    }
+}
+static void report_overruns(void) {
+    static uint16_t seen[TASK_COUNT];
+    for (uint8_t i = 0; i < TASK_COUNT; i++) {
+        uint16_t n = periodic_task_overruns(task_ids[i]);
+        if (n != seen[i]) { dbg("OVERRUN %s %u\n", task_table[i].name, n); seen[i] = n; }
+    }
 }
 
-int main(void) {
-    init_all(); start_tasks(); sei();
-    for (;;) {
-        poll_buttons();
-        if (alarm_active && buttons_3_pressed()) {
-            alarm_active = false; buzzer_beep(); leds_turnOff(3);
+/* ---------- TASK PROFILE ---------------------------------------- */
+static void dump_task_profiles(void) {
+    dbg("TASK     RUNS      LAST_US    MIN_US     MAX_US     JIT_MS MAXJIT OVR\n");
+    for (uint8_t i = 0; i < TASK_COUNT; i++) {
+        periodic_task_profile_t p;
+        if (!periodic_task_profile(task_ids[i], &p)) continue;
+        dbg("%-8s %-9lu %-10lu %-10lu %-10lu %-6u %-6u %u\n", task_table[i].name,
+            (unsigned long)p.runs, (unsigned long)p.last_us,
+            (unsigned long)(p.runs ? p.min_us : 0), (unsigned long)p.max_us,
+            p.jitter_ms, p.max_jitter_ms, p.overruns);
+        dbg("  hist");
+        for (uint8_t b = 0; b < PERIODIC_TASK_PROFILE_BUCKETS; b++) dbg(" %u", p.histogram[b]);
+        dbg("\n");
+    }
+}
+static void poll_profile_commands(void) {
+    if (profile_dump_requested) { profile_dump_requested = false; dump_task_profiles(); }
+    if (profile_reset_requested) {
+        profile_reset_requested = false;
+        for (uint8_t i = 0; i < TASK_COUNT; i++) periodic_task_profile_reset(task_ids[i]);
+    }
+}
+#if TELEMETRY_TASK_PROFILE
+static void tel_copy_task_profiles(void) {
+    tel.task_count = 0;
+    for (uint8_t i = 0; i < TASK_COUNT; i++) {
+        periodic_task_profile_t p;
+        if (!periodic_task_profile(task_ids[i], &p)) continue;
+        uint8_t n = tel.task_count++;
+        tel.tasks[n].name = task_table[i].name;
+        tel.tasks[n].runs = p.runs;
+        tel.tasks[n].last_us = p.last_us;
+        tel.tasks[n].max_us = p.max_us;
+        tel.tasks[n].max_jitter_ms = p.max_jitter_ms;
+        tel.tasks[n].overruns = p.overruns;
+    }
+}
+#endif
+
+/* ---------- BUTTONS --------------------------------------------- */
+/* Each press acts once. The shield has three buttons; holding button 3
+   doses the fertilizer, which had no button of its own */
+static void handle_buttons(void) {
+    buttons_event_t e;
+    while (buttons_read_event(&e)) {
+        if (e.type == BUTTONS_PRESS && e.button == 3 && alarm_active) {
+            alarm_active = false; tone_stop(); tone_play_pattern(TONE_ACK); leds_turnOff(3);
         }
-        if (buttons_2_pressed()) {
+        if (e.type == BUTTONS_PRESS && e.button == 2) {
             CFG.lighting_manual = !CFG.lighting_manual;
             if (CFG.lighting_manual) {
                 if (A_light) { lightbulb_off(); A_light = false; leds_turnOff(2); }
                 else { lightbulb_on(); A_light = true; leds_turnOn(2); }
             }
         }
-        if (buttons_1_pressed()) {
+        if (e.type == BUTTONS_PRESS && e.button == 1) {
             if (!A_pump && S_lvl_cm > 5) {
                 A_pump = true; pump_on(); leds_turnOn(1); pump_runtime_s = 0;
             }
         }
-        if (buttons_4_pressed()) {
-            servo(90); _delay_ms(600); servo(0);
-            A_fert_done = true; hours_since_fert = 0; buzzer_beep();
+        if (e.type == BUTTONS_LONG_PRESS && e.button == 3 && protothread_spawn(fert_dispense)) {
+            A_fert_done = true; hours_since_fert = 0; tone_play_pattern(TONE_ACK);
         }
+    }
+}
+
+/* ---------- IDLE SLEEP ------------------------------------------ */
+/* Sleep until the next interrupt when nothing is ready. Idle mode keeps
+   the timers, UART, ADC and external interrupts running; power-save
+   would stop Timer1 and Timer5, which keep the time and the tasks. The
+   check and the sleep are atomic: sei takes effect after sleep_cpu, so
+   an interrupt in between wakes the CPU instead of being missed */
+static void idle_sleep(void) {
+    uint32_t idle = protothread_idle_ms();
+    uint32_t dht_idle = dht11_idle_ms();
+    if (dht_idle < idle) idle = dht_idle;
+    uint32_t pir_idle = pir_idle_ms();
+    if (pir_idle < idle) idle = pir_idle;
+    if (idle == 0) return;
+    if (idle != UINT32_MAX) periodic_task_wake_within(idle);
+    cli();
+    if (!periodic_task_ready() && uart_rx_available(USART_WIFI) == 0 &&
+        !profile_dump_requested && !profile_reset_requested) {
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+    }
+    sei();
+}
+
+int main(void) {
+    init_all(); start_tasks();
+    protothread_spawn(net_start);
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    for (;;) {
+        if (periodic_task_run()) report_overruns();
+        poll_profile_commands();
+        protothread_run();
+        dht11_poll();
+        if (hc_sr04_poll()) S_lvl_cm = hc_sr04_distance_cm();
+        adxl345_poll();
+        pir_poll();
+        wifi_poll();
+        handle_buttons();
         if (A_pump && S_lvl_cm <= 5) {
-            pump_off(); A_pump = false; buzzer_beep(); leds_turnOff(1);
+            pump_off(); A_pump = false; tone_play_pattern(TONE_ACK); leds_turnOff(1);
         }
+        idle_sleep();
     }
 }
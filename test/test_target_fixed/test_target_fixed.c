@@ -0,0 +1,94 @@
+#include "unity.h"
+#include "fixed.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdio.h>
+
+/* The float code the drivers used before, to compare with                  */
+#define SOIL_DRY 1920
+#define SOIL_WET 720
+
+__attribute__((noinline)) static uint16_t soil_float(uint16_t adc_value)
+{
+    float percentage = 100.0 * ((int32_t)adc_value - SOIL_WET) / (SOIL_DRY - SOIL_WET);
+    if (0.0 > percentage) percentage = 0.0;
+    else if (100.0 < percentage) percentage = 100.0;
+    return 100.0 - percentage;
+}
+
+__attribute__((noinline)) static uint8_t light_float(uint16_t raw)
+{
+    uint16_t inverted = 1023.00 - raw;
+    return ((inverted * 100.00) / 1023.00);
+}
+
+__attribute__((noinline)) static uint16_t soil_fixed(uint16_t adc_value)
+{
+    return fixed_map(adc_value, SOIL_DRY, SOIL_WET, 0, 100);
+}
+
+__attribute__((noinline)) static uint8_t light_fixed(uint16_t raw)
+{
+    return fixed_percent(1023 - raw, 1023);
+}
+
+/* Timer1 without a prescaler counts CPU cycles. The mean over a sweep of the
+   input range, with interrupts off so only the call itself is counted       */
+#define SWEEP 64
+static volatile uint16_t sink;
+
+static uint16_t cycles_per_call(uint16_t (*function)(uint16_t), uint16_t range)
+{
+    uint32_t total = 0;
+    uint8_t sreg = SREG;
+    cli();
+    TCCR1A = 0;
+    TCCR1B = (1 << CS10);
+    for (uint16_t i = 0; i < SWEEP; i++)
+    {
+        uint16_t input = (uint32_t)i * range / SWEEP;
+        uint16_t start = TCNT1;
+        sink = function(input);
+        total += (uint16_t)(TCNT1 - start);
+    }
+    TCCR1B = 0;
+    SREG = sreg;
+    return total / SWEEP;
+}
+
+static uint16_t light_float_16(uint16_t raw) { return light_float(raw); }
+static uint16_t light_fixed_16(uint16_t raw) { return light_fixed(raw); }
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_fixed_map_takes_fewer_cycles_than_the_float_soil_code(void)
+{
+    uint16_t before = cycles_per_call(soil_float, 4096);
+    uint16_t after = cycles_per_call(soil_fixed, 4096);
+
+    char message[64];
+    snprintf(message, sizeof(message), "soil: %u -> %u cycles per call", before, after);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_THAN_UINT16(before, after);
+}
+
+void test_fixed_percent_takes_fewer_cycles_than_the_float_light_code(void)
+{
+    uint16_t before = cycles_per_call(light_float_16, 1024);
+    uint16_t after = cycles_per_call(light_fixed_16, 1024);
+
+    char message[64];
+    snprintf(message, sizeof(message), "light: %u -> %u cycles per call", before, after);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_LESS_THAN_UINT16(before, after);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_fixed_map_takes_fewer_cycles_than_the_float_soil_code);
+    RUN_TEST(test_fixed_percent_takes_fewer_cycles_than_the_float_light_code);
+    return UNITY_END();
+}
@@ -33,10 +33,16 @@ void test_display()
 void test_servo(){
      TEST_MESSAGE("INFO! the servo should go to 0deg      :1:_:PASS\n");
      servo(0);
+    while (servo_busy())
+        ;
     TEST_MESSAGE("INFO! the servo should go to 90deg      :1:_:PASS\n");
     servo(90);
+    while (servo_busy())
+        ;
         TEST_MESSAGE("INFO! the servo should go to 180deg      :1:_:PASS\n");
     servo(180);
+    while (servo_busy())
+        ;
 
 
 TEST_ASSERT_TRUE(1);
@@ -3,17 +3,19 @@
 
 #ifndef WINDOWS_TEST
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include <util/delay.h>
 
 void setUp(void) {
     DDRE = 0;
     PORTE = 0;
-    TCCR2A = 0;
-    TCCR2B = 0;
-    TCNT2 = 0;
+    sei();
 }
 
-void tearDown(void) {}
+void tearDown(void) {
+    while (servo_busy())
+        ;
+}
 
 void test_servo_should_set_DDRE_bit_for_output(void) {
     // Act
@@ -22,12 +24,21 @@ void test_servo_should_set_DDRE_bit_for_output(void) {
     TEST_ASSERT_TRUE(DDRE & (1 << PE3));
 }
 
-void test_servo_should_set_and_clear_SERVO_pin(void) {
-    // Arrange
-    PORT_SERVO &= ~(1 << P_SERVO);
+void test_servo_should_drive_the_pin_from_OC3A(void) {
+    // Act
+    servo(90);
+    // Assert
+    TEST_ASSERT_TRUE(TCCR3A & (1 << COM3A1));
+    TEST_ASSERT_EQUAL_UINT16(2620, OCR3A);
+}
+
+void test_servo_should_detach_and_leave_the_pin_LOW(void) {
     // Act
     servo(90);
+    while (servo_busy())
+        ;
     // Assert
+    TEST_ASSERT_FALSE(TCCR3A & (1 << COM3A1));
     TEST_ASSERT_FALSE(PORT_SERVO & (1 << P_SERVO)); // ends LOW
 }
 
@@ -35,23 +46,24 @@ void test_servo_should_clip_angle_above_180(void) {
     // Act
     servo(250);
     // Assert
-    TEST_ASSERT_TRUE(DDRE & (1 << PE3));
+    TEST_ASSERT_EQUAL_UINT16(4240, OCR3A);
 }
 
 void test_servo_should_clip_angle_below_0(void) {
     // Act
     servo(-20);
     // Assert
-    TEST_ASSERT_TRUE(DDRE & (1 << PE3));
+    TEST_ASSERT_EQUAL_UINT16(4240, OCR3A);
 }
 
 int main(void) {
     UNITY_BEGIN();
     RUN_TEST(test_servo_should_set_DDRE_bit_for_output);
-    RUN_TEST(test_servo_should_set_and_clear_SERVO_pin);
+    RUN_TEST(test_servo_should_drive_the_pin_from_OC3A);
+    RUN_TEST(test_servo_should_detach_and_leave_the_pin_LOW);
     RUN_TEST(test_servo_should_clip_angle_above_180);
     RUN_TEST(test_servo_should_clip_angle_below_0);
     return UNITY_END();
 }
 
-#endif
\ No newline at end of file
+#endif
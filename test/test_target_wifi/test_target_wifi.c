@@ -74,15 +74,13 @@ void receive()
 
 void test_wifi_create_TCP_connection()
 {
-    int received_length = 0;
-
     TEST_ASSERT_EQUAL(WIFI_OK,
         wifi_command_create_TCP_connection(
             TCP_SERVER,
             TCP_PORT,
             receive,
             received_buffer,
-            &received_length
+            sizeof(received_buffer)
         )
     );
 
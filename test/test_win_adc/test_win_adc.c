@@ -0,0 +1,193 @@
+/*  test_win_adc.c – unit tests for lib/adc (desktop build)                  */
+#include "unity.h"
+#include "../fff.h"
+#include "adc.h"
+#include "mock_avr_io.h"
+
+/* The mock header only DECLARES these registers; we must DEFINE them here.   */
+uint8_t SREG;
+uint8_t ADMUX, ADCSRA, ADCSRB, ADCL, ADCH, DIDR0, DIDR2;
+
+void cli(void) {}
+void sei(void) {}
+
+extern void ADC_vect(void);               /* from adc.c                      */
+
+FAKE_VOID_FUNC(timer1_start);
+
+/* The input the multiplexer selects, as the hardware reads it at a trigger  */
+static uint8_t selected(void)
+{
+    return (ADMUX & 0x07) | ((ADCSRB & (1 << MUX5)) ? 0x08 : 0);
+}
+
+/* A conversion of the selected input; value_of gives each input a voltage  */
+static uint16_t value_of[16];
+static uint8_t converted[64];
+static uint8_t conversions;
+static void convert(void)
+{
+    uint8_t input = selected();
+    if (conversions < sizeof(converted))
+        converted[conversions] = input;
+    conversions++;
+    ADCL = value_of[input] & 0xFF;
+    ADCH = value_of[input] >> 8;
+    ADC_vect();
+}
+
+static void convert_n(uint16_t n)
+{
+    while (n--)
+        convert();
+}
+
+void setUp(void)
+{
+    RESET_FAKE(timer1_start);
+    ADMUX = ADCSRA = ADCSRB = ADCL = ADCH = DIDR0 = DIDR2 = 0;
+    for (uint8_t i = 0; i < 16; i++)
+        value_of[i] = 0;
+    conversions = 0;
+    adc_init();
+}
+void tearDown(void) {}
+
+/* ------------------------------------------------------------------ */
+void test_adc_init_triggers_on_the_timer1_overflow(void)
+{
+    TEST_ASSERT_EQUAL_UINT8(1, timer1_start_fake.call_count);
+    TEST_ASSERT_TRUE(ADMUX & (1 << REFS0));
+    TEST_ASSERT_EQUAL_UINT8((1 << ADTS2) | (1 << ADTS1), ADCSRB & 0x07);
+    TEST_ASSERT_TRUE(ADCSRA & (1 << ADEN));
+    TEST_ASSERT_TRUE(ADCSRA & (1 << ADATE));
+    TEST_ASSERT_TRUE(ADCSRA & (1 << ADIE));
+    TEST_ASSERT_EQUAL_UINT8(0x07, ADCSRA & 0x07);  /* 125 kHz            */
+}
+
+void test_adc_second_init_keeps_the_channels(void)
+{
+    adc_channel_t soil = adc_add(8, 0);
+    value_of[8] = 321;
+    adc_init();
+    convert();
+    TEST_ASSERT_EQUAL_UINT8(1, timer1_start_fake.call_count);
+    TEST_ASSERT_EQUAL_UINT16(321, adc_latest(soil));
+}
+
+void test_adc_add_sets_the_digital_input_buffers(void)
+{
+    DIDR2 = (1 << 3);                            /* someone else's input      */
+    adc_add(8, 0);
+    adc_add(15, 0);
+    adc_add(2, 0);
+    TEST_ASSERT_EQUAL_UINT8((1 << 0) | (1 << 3) | (1 << 7), DIDR2);
+    TEST_ASSERT_EQUAL_UINT8(1 << 2, DIDR0);
+}
+
+void test_adc_add_returns_the_existing_channel_for_an_input(void)
+{
+    adc_channel_t a = adc_add(8, 2);
+    TEST_ASSERT_EQUAL_INT8(a, adc_add(8, 2));
+    TEST_ASSERT_EQUAL_INT8(ADC_CHANNEL_NONE, adc_add(16, 0));
+    TEST_ASSERT_EQUAL_INT8(ADC_CHANNEL_NONE, adc_add(1, ADC_MAX_EXTRA_BITS + 1));
+}
+
+void test_adc_add_fails_when_full(void)
+{
+    for (uint8_t i = 0; i < ADC_MAX_CHANNELS; i++)
+        TEST_ASSERT_NOT_EQUAL(ADC_CHANNEL_NONE, adc_add(i, 0));
+    TEST_ASSERT_EQUAL_INT8(ADC_CHANNEL_NONE, adc_add(ADC_MAX_CHANNELS, 0));
+}
+
+void test_adc_round_robin_over_the_channels(void)
+{
+    adc_add(8, 0);
+    adc_add(15, 0);
+    adc_add(3, 0);
+    convert_n(7);
+    const uint8_t expected[] = {8, 15, 3, 8, 15, 3, 8};
+    TEST_ASSERT_EQUAL_MEMORY(expected, converted, sizeof(expected));
+}
+
+void test_adc_latest_value_of_each_channel(void)
+{
+    adc_channel_t soil = adc_add(8, 0);
+    adc_channel_t light = adc_add(15, 0);
+    TEST_ASSERT_EQUAL_UINT16(0, adc_latest(soil));   /* nothing yet         */
+
+    value_of[8] = 300;
+    value_of[15] = 1023;
+    convert_n(2);
+    TEST_ASSERT_EQUAL_UINT16(300, adc_latest(soil));
+    TEST_ASSERT_EQUAL_UINT16(1023, adc_latest(light));
+
+    value_of[8] = 301;
+    convert_n(2);
+    TEST_ASSERT_EQUAL_UINT16(301, adc_latest(soil));
+    TEST_ASSERT_EQUAL_UINT16(2, adc_results(soil));
+}
+
+void test_adc_oversampling_adds_bits(void)
+{
+    adc_channel_t soil = adc_add(8, 2);            /* 16 conversions, 12 bits */
+
+    value_of[8] = 1023;
+    convert_n(15);
+    TEST_ASSERT_EQUAL_UINT16(0, adc_results(soil));
+    convert();
+    TEST_ASSERT_EQUAL_UINT16(1, adc_results(soil));
+    TEST_ASSERT_EQUAL_UINT16(4092, adc_latest(soil));
+}
+
+void test_adc_oversampling_resolves_between_steps(void)
+{
+    adc_channel_t soil = adc_add(8, 2);
+
+    /* A voltage a quarter of the way between 300 and 301, with noise         */
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        value_of[8] = (i % 4 == 0) ? 301 : 300;
+        convert();
+    }
+    TEST_ASSERT_EQUAL_UINT16(300 * 4 + 1, adc_latest(soil));
+}
+
+void test_adc_channels_oversample_independently(void)
+{
+    adc_channel_t soil = adc_add(8, 1);            /* 4 conversions         */
+    adc_channel_t light = adc_add(15, 0);
+
+    value_of[8] = 100;
+    value_of[15] = 50;
+    convert_n(4);
+    TEST_ASSERT_EQUAL_UINT16(0, adc_results(soil));
+    TEST_ASSERT_EQUAL_UINT16(2, adc_results(light));
+    convert_n(4);
+    TEST_ASSERT_EQUAL_UINT16(200, adc_latest(soil));
+    TEST_ASSERT_EQUAL_UINT16(4, adc_results(light));
+}
+
+void test_adc_latest_of_a_bad_handle_is_zero(void)
+{
+    TEST_ASSERT_EQUAL_UINT16(0, adc_latest(ADC_CHANNEL_NONE));
+    TEST_ASSERT_EQUAL_UINT16(0, adc_latest(3));
+}
+
+/* ------------------------------------------------------------------ */
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_adc_init_triggers_on_the_timer1_overflow);
+    RUN_TEST(test_adc_second_init_keeps_the_channels);
+    RUN_TEST(test_adc_add_sets_the_digital_input_buffers);
+    RUN_TEST(test_adc_add_returns_the_existing_channel_for_an_input);
+    RUN_TEST(test_adc_add_fails_when_full);
+    RUN_TEST(test_adc_round_robin_over_the_channels);
+    RUN_TEST(test_adc_latest_value_of_each_channel);
+    RUN_TEST(test_adc_oversampling_adds_bits);
+    RUN_TEST(test_adc_oversampling_resolves_between_steps);
+    RUN_TEST(test_adc_channels_oversample_independently);
+    RUN_TEST(test_adc_latest_of_a_bad_handle_is_zero);
+    return UNITY_END();
+}
@@ -4,15 +4,18 @@
 #include <string.h>
 
 /* ---------- SPI spy (linked via --wrap=spi_transfer) -------------------- */
-static uint8_t spi_buffer[16];
+static uint8_t spi_buffer[64];
 static uint8_t spi_tx_cnt;
 static uint8_t spi_rx_cnt;
-static uint8_t spi_script[16];
+static uint8_t spi_script[64];
+static uint8_t spi_deselected_cnt;     /* bytes sent while CS was high    */
 
 /*  IMPORTANT: name must be __wrap_spi_transfer so the linker substitutes it
  *  for the real spi_transfer() when tests are built.                        */
 uint8_t __wrap_spi_transfer(uint8_t byte)
 {
+    if (PORTB & (1 << PB1))
+        spi_deselected_cnt++;
     spi_buffer[spi_tx_cnt++] = byte;
     return spi_script[spi_rx_cnt++];
 }
@@ -20,7 +23,7 @@ uint8_t __wrap_spi_transfer(uint8_t byte)
 /* ---------- Helpers ----------------------------------------------------- */
 static void reset_spy(void)
 {
-    spi_tx_cnt = spi_rx_cnt = 0;
+    spi_tx_cnt = spi_rx_cnt = spi_deselected_cnt = 0;
     memset(spi_buffer,  0, sizeof spi_buffer);
     memset(spi_script,  0, sizeof spi_script);
 }
@@ -41,6 +44,16 @@ void test_init_writes_correct_registers(void)
     TEST_ASSERT_EQUAL_UINT8(0x05, spi_buffer[3]);   /* ±16 g - 13 bit */
 }
 
+void test_chip_select_is_PB1_of_the_J9_wiring(void)
+{
+    DDRB = PORTB = 0;
+    adxl345_init();
+
+    TEST_ASSERT_EQUAL_UINT8((1 << PB1), DDRB);
+    TEST_ASSERT_EQUAL_UINT8((1 << PB1), PORTB);     /* deselected again      */
+    TEST_ASSERT_EQUAL_UINT8(0, spi_deselected_cnt);
+}
+
 void test_xyz_read_assembles_int16_correctly(void)
 {
     /* script the six data bytes returned by the device                       */
@@ -57,10 +70,115 @@ void test_xyz_read_assembles_int16_correctly(void)
     TEST_ASSERT_EQUAL_INT16(0x9ABC, z);
 }
 
+/* ---------- FIFO and interrupts ---------------------------------------- */
+extern void PCINT2_vect(void);                     /* from adxl345.c        */
+
+static uint8_t events_seen, event_calls;
+static void on_event(uint8_t events) { events_seen = events; event_calls++; }
+
+static void setup_events(void)
+{
+    adxl345_init();
+    PCICR = PCMSK2 = PINK = 0;
+    events_seen = event_calls = 0;
+    adxl345_on_event(on_event);
+    adxl345_enable_activity(50, 25, 2);
+    reset_spy();
+}
+
+void test_activity_configures_the_chip_and_the_pin_change(void)
+{
+    adxl345_init();
+    PCICR = PCMSK2 = 0;
+    reset_spy();
+    adxl345_enable_activity(50, 25, 2);
+
+    const uint8_t expected[] = {
+        0x24, 50, 0x25, 25, 0x26, 2, 0x27, 0xFF,   /* thresholds, ac x/y/z   */
+        0x2D, 0x28,                                /* link + measure         */
+        0x2E, 0x00, 0x2F, 0x00, 0x2E, 0x18,        /* act/inact on INT1      */
+    };
+    TEST_ASSERT_EQUAL_UINT8(sizeof expected, spi_tx_cnt);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, spi_buffer, sizeof expected);
+    TEST_ASSERT_BITS_HIGH((1 << PCINT21) | (1 << PCINT22), PCMSK2);
+    TEST_ASSERT_BITS_HIGH((1 << PCIE2), PCICR);
+}
+
+void test_tap_and_watermark_add_to_the_interrupts(void)
+{
+    setup_events();
+    adxl345_enable_tap(48, 32);
+    TEST_ASSERT_EQUAL_UINT8(0x1D, spi_buffer[0]);
+    TEST_ASSERT_EQUAL_UINT8(48,   spi_buffer[1]);
+    TEST_ASSERT_EQUAL_UINT8(0x58, spi_buffer[11]); /* + single tap, INT1     */
+
+    reset_spy();
+    adxl345_fifo_stream(16);
+    TEST_ASSERT_EQUAL_UINT8(0x38, spi_buffer[0]);
+    TEST_ASSERT_EQUAL_UINT8(0x90, spi_buffer[1]);  /* stream, watermark 16  */
+    TEST_ASSERT_EQUAL_UINT8(0x02, spi_buffer[5]);  /* watermark on INT2     */
+    TEST_ASSERT_EQUAL_UINT8(0x5A, spi_buffer[7]);
+}
+
+void test_poll_is_free_while_the_pins_are_low(void)
+{
+    setup_events();
+    adxl345_poll();
+    TEST_ASSERT_EQUAL_UINT8(0, spi_tx_cnt);
+    TEST_ASSERT_EQUAL_UINT8(0, event_calls);
+}
+
+void test_poll_reports_the_events_after_the_interrupt(void)
+{
+    setup_events();
+    PINK = (1 << PK5);
+    PCINT2_vect();
+    PINK = 0;                                       /* pulse is over        */
+
+    spi_script[1] = 0x93;           /* data ready, activity, overrun         */
+    adxl345_poll();
+    TEST_ASSERT_EQUAL_UINT8(0xB0, spi_buffer[0]);   /* read INT_SOURCE      */
+    TEST_ASSERT_EQUAL_UINT8(1, event_calls);
+    TEST_ASSERT_EQUAL_UINT8(ADXL345_EVENT_ACTIVITY, events_seen);
+
+    adxl345_poll();                                 /* reported once         */
+    TEST_ASSERT_EQUAL_UINT8(1, event_calls);
+}
+
+void test_read_fifo_drains_every_entry(void)
+{
+    setup_events();
+    spi_script[1] = 0x03;                           /* 3 entries            */
+    for (uint8_t i = 0; i < 3; i++) {
+        spi_script[2 + 7 * i + 1] = 10 * i + 1;     /* X low byte           */
+        spi_script[2 + 7 * i + 6] = 0xFF;           /* Z high byte          */
+    }
+
+    adxl345_sample_t samples[32];
+    TEST_ASSERT_EQUAL_UINT8(3, adxl345_read_fifo(samples, 32));
+    TEST_ASSERT_EQUAL_UINT8(0xB9, spi_buffer[0]);   /* read FIFO_STATUS     */
+    TEST_ASSERT_EQUAL_UINT8(0xF2, spi_buffer[2]);   /* burst from DATAX0    */
+    TEST_ASSERT_EQUAL_UINT8(0xF2, spi_buffer[16]);
+    TEST_ASSERT_EQUAL_UINT8(2 + 3 * 7, spi_tx_cnt);
+    TEST_ASSERT_EQUAL_INT16(1,  samples[0].x);
+    TEST_ASSERT_EQUAL_INT16(21, samples[2].x);
+    TEST_ASSERT_EQUAL_INT16(-256, samples[2].z);
+
+    reset_spy();
+    spi_script[1] = 0x20;                           /* 32 entries           */
+    TEST_ASSERT_EQUAL_UINT8(2, adxl345_read_fifo(samples, 2));
+}
+
 int main(void)
 {
     UNITY_BEGIN();
     RUN_TEST(test_init_writes_correct_registers);
+    RUN_TEST(test_chip_select_is_PB1_of_the_J9_wiring);
     RUN_TEST(test_xyz_read_assembles_int16_correctly);
+    RUN_TEST(test_activity_configures_the_chip_and_the_pin_change);
+    RUN_TEST(test_tap_and_watermark_add_to_the_interrupts);
+    RUN_TEST(test_poll_is_free_while_the_pins_are_low);
+    RUN_TEST(test_poll_reports_the_events_after_the_interrupt);
+    RUN_TEST(test_read_fifo_drains_every_entry);
     return UNITY_END();
 }
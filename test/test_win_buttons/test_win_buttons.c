@@ -1,7 +1,18 @@
 #include "unity.h"
+#include "../fff.h"
 #include "buttons.h"
 #include "mock_avr_io.h"
 
+/* Registers and Timer1 the scan interrupt uses                             */
+uint8_t SREG, TIMSK1, TIFR1;
+uint16_t OCR1C;
+void cli(void) {}
+
+FAKE_VOID_FUNC(timer1_start);
+FAKE_VALUE_FUNC(uint16_t, timer1_now);
+
+extern void TIMER1_COMPC_vect(void);  /* from buttons.c                     */
+
 /* Unity fixture ---------------------------------------------------------- */
 void setUp(void)
 {
@@ -9,6 +20,10 @@ void setUp(void)
     DDRF  = 0xFF;      /* everything output → buttons_init() must clear    */
     PORTF = 0x00;      /* pull-ups off → buttons_init() must set           */
     PINF  = 0xFF;      /* default high (input not pressed)                 */
+    TIMSK1 = TIFR1 = 0;
+    OCR1C = 0;
+    RESET_FAKE(timer1_start);
+    RESET_FAKE(timer1_now);
 }
 
 void tearDown(void) {}
@@ -55,6 +70,119 @@ void test_simultaneous_two_button_presses(void)
     TEST_ASSERT_TRUE(buttons_3_pressed());
 }
 
+/* ---- Debounced events ------------------------------------------------- */
+/* Hold the pins for a number of scans                                      */
+static void scan(uint8_t pressed_mask, uint16_t scans)
+{
+    PINF = (uint8_t)~pressed_mask;
+    while (scans--)
+        TIMER1_COMPC_vect();
+}
+
+static void expect_event(uint8_t button, buttons_event_type_t type)
+{
+    buttons_event_t e;
+    TEST_ASSERT_EQUAL_UINT8(1, buttons_read_event(&e));
+    TEST_ASSERT_EQUAL_UINT8(button, e.button);
+    TEST_ASSERT_EQUAL_INT(type, e.type);
+}
+
+static void expect_no_event(void)
+{
+    buttons_event_t e;
+    TEST_ASSERT_EQUAL_UINT8(0, buttons_read_event(&e));
+}
+
+void test_buttons_init_starts_the_scan_interrupt(void)
+{
+    timer1_now_fake.return_val = 1000;
+    buttons_init();
+    TEST_ASSERT_EQUAL(1, timer1_start_fake.call_count);
+    TEST_ASSERT_BITS_HIGH((1 << OCIE1C), TIMSK1);
+    TEST_ASSERT_EQUAL_UINT16(1000 + BUTTONS_SCAN_MS * 2000, OCR1C);
+    TIMER1_COMPC_vect();
+    TEST_ASSERT_EQUAL_UINT16(1000 + 2 * BUTTONS_SCAN_MS * 2000, OCR1C);
+}
+
+void test_press_and_release_fire_once(void)
+{
+    buttons_init();
+    scan(1 << PF1, BUTTONS_DEBOUNCE_SCANS - 1);
+    expect_no_event();                          /* not stable yet          */
+    scan(1 << PF1, 1);
+    expect_event(1, BUTTONS_PRESS);
+    scan(1 << PF1, 20);
+    expect_no_event();                          /* held: nothing more      */
+    scan(0, BUTTONS_DEBOUNCE_SCANS);
+    expect_event(1, BUTTONS_RELEASE);
+    expect_no_event();
+}
+
+void test_bounces_are_ignored(void)
+{
+    buttons_init();
+    for (uint8_t i = 0; i < 10; i++) {
+        scan(1 << PF2, 1);
+        scan(0, 1);
+    }
+    expect_no_event();
+}
+
+void test_long_press_once(void)
+{
+    buttons_init();
+    scan(1 << PF3, BUTTONS_DEBOUNCE_SCANS);
+    expect_event(3, BUTTONS_PRESS);
+    scan(1 << PF3, BUTTONS_LONG_MS / BUTTONS_SCAN_MS - 1);
+    expect_no_event();
+    scan(1 << PF3, 1);
+    expect_event(3, BUTTONS_LONG_PRESS);
+    scan(1 << PF3, 200);
+    expect_no_event();
+}
+
+void test_double_press(void)
+{
+    buttons_init();
+    scan(1 << PF1, 5);
+    scan(0, 10);
+    scan(1 << PF1, 5);
+    expect_event(1, BUTTONS_PRESS);
+    expect_event(1, BUTTONS_RELEASE);
+    expect_event(1, BUTTONS_PRESS);
+    expect_event(1, BUTTONS_DOUBLE_PRESS);
+
+    scan(0, BUTTONS_DOUBLE_MS / BUTTONS_SCAN_MS + 5);   /* too slow        */
+    scan(1 << PF1, 5);
+    expect_event(1, BUTTONS_RELEASE);
+    expect_event(1, BUTTONS_PRESS);
+    expect_no_event();
+}
+
+void test_buttons_are_independent(void)
+{
+    buttons_init();
+    scan((1 << PF1) | (1 << PF3), BUTTONS_DEBOUNCE_SCANS);
+    expect_event(1, BUTTONS_PRESS);
+    expect_event(3, BUTTONS_PRESS);
+    scan(1 << PF3, BUTTONS_DEBOUNCE_SCANS);
+    expect_event(1, BUTTONS_RELEASE);
+    expect_no_event();
+}
+
+void test_full_queue_keeps_the_oldest(void)
+{
+    buttons_init();
+    for (uint8_t i = 0; i < BUTTONS_QUEUE_SIZE; i++) {
+        scan(1 << PF2, BUTTONS_DEBOUNCE_SCANS);
+        scan(0, BUTTONS_DOUBLE_MS / BUTTONS_SCAN_MS + 1);
+    }
+    expect_event(2, BUTTONS_PRESS);
+    for (uint8_t i = 1; i < BUTTONS_QUEUE_SIZE - 1; i++)
+        TEST_ASSERT_TRUE(buttons_read_event(&(buttons_event_t){0}));
+    expect_no_event();
+}
+
 /* ----------------------------------------------------------------------- */
 int main(void)
 {
@@ -63,5 +191,12 @@ int main(void)
     RUN_TEST(test_button1_pressed_detects_low_level);
     RUN_TEST(test_button2_pressed_detects_low_level);
     RUN_TEST(test_simultaneous_two_button_presses);
+    RUN_TEST(test_buttons_init_starts_the_scan_interrupt);
+    RUN_TEST(test_press_and_release_fire_once);
+    RUN_TEST(test_bounces_are_ignored);
+    RUN_TEST(test_long_press_once);
+    RUN_TEST(test_double_press);
+    RUN_TEST(test_buttons_are_independent);
+    RUN_TEST(test_full_queue_keeps_the_oldest);
     return UNITY_END();
 }
@@ -0,0 +1,259 @@
+/*  test_win_dht11.c – unit tests for lib/dht11 (desktop build)              */
+#include "unity.h"
+#include "../fff.h"
+#include "dht11.h"
+#include "mock_avr_io.h"
+
+#include <string.h>
+
+/* The mock header only DECLARES these registers; we must DEFINE them here.   */
+uint8_t  SREG;
+uint8_t  DDRL, PORTL, PINL;
+uint8_t  TCCR5B, TIMSK5, TIFR5;
+uint16_t TCNT5, OCR5A, ICR5;
+
+void cli(void) {}
+void sei(void) {}
+
+extern void TIMER5_CAPT_vect(void);       /* from dht11.c                    */
+
+FAKE_VOID_FUNC(timer1_start);
+FAKE_VALUE_FUNC(uint16_t, timer1_now);
+FAKE_VALUE_FUNC(uint32_t, timers_millis);
+
+static uint32_t now_ms;
+static uint32_t clock_read(void) { return now_ms; }
+
+/* Timer1 time of the edge being captured, 2 ticks per microsecond           */
+static uint16_t now_ticks;
+static uint16_t ticks_read(void) { return now_ticks; }
+
+static DHT11_ERROR_MESSAGE_t done_status;
+static uint8_t done_calls;
+static void done(DHT11_ERROR_MESSAGE_t status)
+{
+    done_status = status;
+    done_calls++;
+}
+
+static void run_for(uint32_t ms)
+{
+    while (ms--)
+    {
+        now_ms++;
+        dht11_poll();
+    }
+}
+
+/* One falling edge, captured `age` Timer5 counts before the interrupt        */
+static void edge_after(uint16_t us, uint16_t age)
+{
+    now_ticks += us * 2;
+    ICR5 = 100;
+    TCNT5 = 100 + age;
+    now_ticks += age * 8;
+    TIMER5_CAPT_vect();
+    now_ticks -= age * 8;
+}
+
+/* The sensor's answer to a start pulse: response, 40 bits, end of frame      */
+static void send_frame(const uint8_t bytes[5])
+{
+    edge_after(30, 0);                           /* response pulls low        */
+    edge_after(160, 0);                          /* 80 us low, 80 us high     */
+    for (uint8_t bit = 0; bit < 40; bit++)
+    {
+        uint8_t one = (bytes[bit / 8] >> (7 - bit % 8)) & 1;
+        edge_after(one ? 120 : 77, bit % 3);     /* some captures wait       */
+    }
+}
+
+static void frame_of(uint8_t frame[5], uint8_t hum, uint8_t hum_dec, uint8_t temp, uint8_t temp_dec)
+{
+    frame[0] = hum; frame[1] = hum_dec; frame[2] = temp; frame[3] = temp_dec;
+    frame[4] = (uint8_t)(hum + hum_dec + temp + temp_dec);
+}
+
+void setUp(void)
+{
+    RESET_FAKE(timer1_start);
+    RESET_FAKE(timer1_now);
+    RESET_FAKE(timers_millis);
+    timer1_now_fake.custom_fake = ticks_read;
+    timers_millis_fake.custom_fake = clock_read;
+    now_ms = 10000;
+    now_ticks = 0;
+    DDRL = PORTL = PINL = 0;
+    TCCR5B = TIMSK5 = TIFR5 = 0;
+    TCNT5 = ICR5 = 0;
+    OCR5A = 249;
+    done_calls = 0;
+    dht11_init();
+}
+void tearDown(void) {}
+
+/* ------------------------------------------------------------------ */
+void test_dht11_start_pulse_holds_the_line_low_for_20ms(void)
+{
+    TEST_ASSERT_EQUAL(DHT11_OK, dht11_start(done));
+    TEST_ASSERT_TRUE(DDRL & (1 << PL1));
+    TEST_ASSERT_FALSE(PORTL & (1 << PL1));
+
+    run_for(19);
+    TEST_ASSERT_TRUE(DDRL & (1 << PL1));
+    TEST_ASSERT_FALSE(TIMSK5 & (1 << ICIE5));
+
+    run_for(1);
+    TEST_ASSERT_FALSE(DDRL & (1 << PL1));         /* released, pulled up      */
+    TEST_ASSERT_TRUE(PORTL & (1 << PL1));
+    TEST_ASSERT_TRUE(TIMSK5 & (1 << ICIE5));
+    TEST_ASSERT_FALSE(TCCR5B & (1 << ICES5));     /* falling edges            */
+}
+
+void test_dht11_decodes_a_frame_from_the_captured_edges(void)
+{
+    uint8_t frame[5];
+    frame_of(frame, 45, 0, 23, 7);
+
+    dht11_start(done);
+    run_for(20);
+    send_frame(frame);
+    TEST_ASSERT_FALSE(TIMSK5 & (1 << ICIE5));     /* stops after the frame    */
+    TEST_ASSERT_EQUAL_UINT32(0, dht11_idle_ms());
+
+    dht11_poll();
+    TEST_ASSERT_EQUAL_UINT8(1, done_calls);
+    TEST_ASSERT_EQUAL(DHT11_OK, done_status);
+    TEST_ASSERT_FALSE(dht11_busy());
+
+    uint8_t hum = 0, temp = 0, temp_dec = 0;
+    TEST_ASSERT_EQUAL(DHT11_OK, dht11_result(&hum, NULL, &temp, &temp_dec));
+    TEST_ASSERT_EQUAL_UINT8(45, hum);
+    TEST_ASSERT_EQUAL_UINT8(23, temp);
+    TEST_ASSERT_EQUAL_UINT8(7, temp_dec);
+}
+
+void test_dht11_capture_across_the_timer5_wrap(void)
+{
+    uint8_t frame[5];
+    frame_of(frame, 0xAA, 0x55, 0xFF, 0x01);
+
+    dht11_start(done);
+    run_for(20);
+    edge_after(30, 0);
+    edge_after(160, 0);
+    for (uint8_t bit = 0; bit < 40; bit++)
+    {
+        uint8_t one = (frame[bit / 8] >> (7 - bit % 8)) & 1;
+        now_ticks += (one ? 120 : 77) * 2;
+        ICR5 = 248;                              /* captured before the wrap  */
+        TCNT5 = 2;                               /* 3 counts, 24 ticks ago    */
+        now_ticks += 24;
+        TIMER5_CAPT_vect();
+        now_ticks -= 24;
+    }
+    dht11_poll();
+
+    uint8_t values[4];
+    TEST_ASSERT_EQUAL(DHT11_OK, dht11_result(&values[0], &values[1], &values[2], &values[3]));
+    TEST_ASSERT_EQUAL_MEMORY(frame, values, 4);
+}
+
+void test_dht11_retries_a_bad_checksum_after_the_interval(void)
+{
+    uint8_t bad[5], good[5];
+    frame_of(good, 50, 0, 20, 0);
+    memcpy(bad, good, 5);
+    bad[4]++;
+
+    dht11_start(done);
+    run_for(20);
+    send_frame(bad);
+    dht11_poll();
+    TEST_ASSERT_EQUAL_UINT8(0, done_calls);
+    TEST_ASSERT_TRUE(dht11_busy());
+
+    run_for(1970);                               /* 2 s after the first start */
+    TEST_ASSERT_FALSE(DDRL & (1 << PL1));
+    run_for(10);
+    TEST_ASSERT_TRUE(DDRL & (1 << PL1));         /* second start pulse        */
+
+    run_for(20);
+    send_frame(good);
+    dht11_poll();
+    TEST_ASSERT_EQUAL_UINT8(1, done_calls);
+    TEST_ASSERT_EQUAL(DHT11_OK, done_status);
+}
+
+void test_dht11_fails_after_the_retries(void)
+{
+    dht11_start(done);
+    run_for(DHT11_RETRIES * 2000 + 2000);        /* no sensor, no edges       */
+    TEST_ASSERT_EQUAL_UINT8(1, done_calls);
+    TEST_ASSERT_EQUAL(DHT11_FAIL, done_status);
+    TEST_ASSERT_FALSE(dht11_busy());
+
+    uint8_t hum = 99;
+    TEST_ASSERT_EQUAL(DHT11_FAIL, dht11_result(&hum, NULL, NULL, NULL));
+    TEST_ASSERT_EQUAL_UINT8(99, hum);
+}
+
+void test_dht11_rejects_an_edge_out_of_timing(void)
+{
+    uint8_t frame[5];
+    frame_of(frame, 40, 0, 20, 0);
+
+    dht11_start(done);
+    run_for(20);
+    edge_after(30, 0);
+    edge_after(160, 0);
+    edge_after(20, 0);                           /* glitch, not a bit         */
+    for (uint8_t bit = 1; bit < 40; bit++)
+        edge_after(((frame[bit / 8] >> (7 - bit % 8)) & 1) ? 120 : 77, 0);
+    dht11_poll();
+    TEST_ASSERT_EQUAL_UINT8(0, done_calls);
+    TEST_ASSERT_TRUE(dht11_busy());              /* retrying                  */
+}
+
+void test_dht11_keeps_the_minimum_interval(void)
+{
+    uint8_t frame[5];
+    frame_of(frame, 40, 0, 20, 0);
+
+    dht11_start(done);
+    run_for(20);
+    send_frame(frame);
+    dht11_poll();
+
+    run_for(500);
+    TEST_ASSERT_EQUAL(DHT11_OK, dht11_start(done));
+    TEST_ASSERT_FALSE(DDRL & (1 << PL1));        /* waits for the interval    */
+    TEST_ASSERT_EQUAL_UINT32(1480, dht11_idle_ms());
+
+    run_for(1479);
+    TEST_ASSERT_FALSE(DDRL & (1 << PL1));
+    run_for(1);
+    TEST_ASSERT_TRUE(DDRL & (1 << PL1));
+}
+
+void test_dht11_start_while_reading_is_busy(void)
+{
+    dht11_start(done);
+    TEST_ASSERT_EQUAL(DHT11_BUSY, dht11_start(done));
+    TEST_ASSERT_EQUAL(DHT11_BUSY, dht11_get(NULL, NULL, NULL, NULL));
+}
+
+/* ------------------------------------------------------------------ */
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_dht11_start_pulse_holds_the_line_low_for_20ms);
+    RUN_TEST(test_dht11_decodes_a_frame_from_the_captured_edges);
+    RUN_TEST(test_dht11_capture_across_the_timer5_wrap);
+    RUN_TEST(test_dht11_retries_a_bad_checksum_after_the_interval);
+    RUN_TEST(test_dht11_fails_after_the_retries);
+    RUN_TEST(test_dht11_rejects_an_edge_out_of_timing);
+    RUN_TEST(test_dht11_keeps_the_minimum_interval);
+    RUN_TEST(test_dht11_start_while_reading_is_busy);
+    return UNITY_END();
+}
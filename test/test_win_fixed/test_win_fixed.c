@@ -0,0 +1,125 @@
+/*  test_win_fixed.c – unit tests for lib/fixed (desktop build)              */
+#include "unity.h"
+#include "fixed.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+/* The float code the drivers used before, as the reference                 */
+#define SOIL_DRY 1920
+#define SOIL_WET 720
+static uint16_t soil_float(uint16_t adc_value)
+{
+    float percentage = 100.0 * ((int32_t)adc_value - SOIL_WET) / (SOIL_DRY - SOIL_WET);
+    if (0.0 > percentage) percentage = 0.0;
+    else if (100.0 < percentage) percentage = 100.0;
+    return 100.0 - percentage;
+}
+static uint8_t light_float(uint16_t raw)
+{
+    uint16_t inverted = 1023.00 - raw;
+    return ((inverted * 100.00) / 1023.00);
+}
+
+static uint16_t soil_fixed(uint16_t adc_value)
+{
+    return fixed_map(adc_value, SOIL_DRY, SOIL_WET, 0, 100);
+}
+static uint8_t light_fixed(uint16_t raw)
+{
+    return fixed_percent(1023 - raw, 1023);
+}
+
+/* ------------------------------------------------------------------ */
+void test_fixed_constants(void)
+{
+    TEST_ASSERT_EQUAL_INT16(256, FIXED_Q8_8_ONE);
+    TEST_ASSERT_EQUAL_INT16(64, FIXED_Q8_8(0.25));
+    TEST_ASSERT_EQUAL_INT16(-384, FIXED_Q8_8(-1.5));
+    TEST_ASSERT_EQUAL_INT32(205887, FIXED_Q16_16(3.14159265));
+    TEST_ASSERT_EQUAL_INT16(-2, FIXED_Q8_8_INT(FIXED_Q8_8(-1.5)));
+    TEST_ASSERT_EQUAL_INT32(3, FIXED_Q16_16_INT(FIXED_Q16_16(3.14159265)));
+}
+
+void test_fixed_q8_8_mul_rounds_and_saturates(void)
+{
+    TEST_ASSERT_EQUAL_INT16(FIXED_Q8_8(3.75), fixed_q8_8_mul(FIXED_Q8_8(1.5), FIXED_Q8_8(2.5)));
+    TEST_ASSERT_EQUAL_INT16(FIXED_Q8_8(-3.75), fixed_q8_8_mul(FIXED_Q8_8(-1.5), FIXED_Q8_8(2.5)));
+    TEST_ASSERT_EQUAL_INT16(1, fixed_q8_8_mul(1, 128));          /* 1/512 rounds up  */
+    TEST_ASSERT_EQUAL_INT16(INT16_MAX, fixed_q8_8_mul(FIXED_Q8_8(100), FIXED_Q8_8(2)));
+    TEST_ASSERT_EQUAL_INT16(INT16_MIN, fixed_q8_8_mul(FIXED_Q8_8(-100), FIXED_Q8_8(2)));
+}
+
+void test_fixed_q8_8_ratio(void)
+{
+    TEST_ASSERT_EQUAL_INT16(FIXED_Q8_8(0.5), fixed_q8_8_ratio(1, 2));
+    TEST_ASSERT_EQUAL_INT16(85, fixed_q8_8_ratio(1, 3));          /* 85.33           */
+    TEST_ASSERT_EQUAL_INT16(171, fixed_q8_8_ratio(2, 3));         /* 170.67          */
+    TEST_ASSERT_EQUAL_INT16(-171, fixed_q8_8_ratio(2, -3));
+    TEST_ASSERT_EQUAL_INT16(INT16_MAX, fixed_q8_8_ratio(1000, 1));
+    TEST_ASSERT_EQUAL_INT16(INT16_MIN, fixed_q8_8_ratio(-128, 1));
+    TEST_ASSERT_EQUAL_INT16(INT16_MIN, fixed_q8_8_ratio(-1000, 1));
+}
+
+void test_fixed_q16_16_mul_and_ratio(void)
+{
+    TEST_ASSERT_EQUAL_INT32(FIXED_Q16_16(-7.5), fixed_q16_16_mul(FIXED_Q16_16(2.5), FIXED_Q16_16(-3)));
+    TEST_ASSERT_EQUAL_INT32(INT32_MAX, fixed_q16_16_mul(FIXED_Q16_16(300), FIXED_Q16_16(300)));
+    TEST_ASSERT_EQUAL_INT32(21845, fixed_q16_16_ratio(1, 3));
+    TEST_ASSERT_EQUAL_INT32(FIXED_Q16_16(-0.25), fixed_q16_16_ratio(-1, 4));
+    TEST_ASSERT_EQUAL_INT32(INT32_MIN, fixed_q16_16_ratio(-65535, 1));
+}
+
+void test_fixed_map_saturates_at_both_ends(void)
+{
+    TEST_ASSERT_EQUAL_INT32(0, fixed_map(-5, 0, 1023, 0, 100));
+    TEST_ASSERT_EQUAL_INT32(100, fixed_map(2000, 0, 1023, 0, 100));
+    TEST_ASSERT_EQUAL_INT32(50, fixed_map(512, 0, 1023, 0, 100));  /* 50.05 */
+    TEST_ASSERT_EQUAL_INT32(-40, fixed_map(0, 0, 100, -40, 60));
+    TEST_ASSERT_EQUAL_INT32(10, fixed_map(50, 0, 100, -40, 60));
+}
+
+void test_fixed_map_inverted_ranges(void)
+{
+    TEST_ASSERT_EQUAL_INT32(0, fixed_map(3000, 1920, 720, 0, 100));
+    TEST_ASSERT_EQUAL_INT32(100, fixed_map(0, 1920, 720, 0, 100));
+    TEST_ASSERT_EQUAL_INT32(50, fixed_map(1320, 1920, 720, 0, 100));
+    TEST_ASSERT_EQUAL_INT32(75, fixed_map(25, 0, 100, 100, 0));
+    TEST_ASSERT_EQUAL_INT32(65535, fixed_map(65535, 0, 65535, 0, 65535));
+}
+
+void test_fixed_percent(void)
+{
+    TEST_ASSERT_EQUAL_UINT8(0, fixed_percent(0, 1023));
+    TEST_ASSERT_EQUAL_UINT8(100, fixed_percent(1023, 1023));
+    TEST_ASSERT_EQUAL_UINT8(100, fixed_percent(5000, 1023));
+    TEST_ASSERT_EQUAL_UINT8(50, fixed_percent(1, 2));
+    TEST_ASSERT_EQUAL_UINT8(33, fixed_percent(1, 3));
+    TEST_ASSERT_EQUAL_UINT8(67, fixed_percent(2, 3));
+    TEST_ASSERT_EQUAL_UINT8(1, fixed_percent(1, 100));
+    TEST_ASSERT_EQUAL_UINT8(1, fixed_percent(21474836UL, 4000000000UL));
+}
+
+/* Rounding instead of truncation moves a result by at most one percent     */
+void test_fixed_matches_the_float_code_within_one_percent(void)
+{
+    for (uint16_t raw = 0; raw <= 1023; raw++)
+        TEST_ASSERT_INT_WITHIN(1, light_float(raw), light_fixed(raw));
+    for (uint16_t adc = 0; adc <= 4095; adc++)
+        TEST_ASSERT_INT_WITHIN(1, soil_float(adc), soil_fixed(adc));
+}
+
+/* ------------------------------------------------------------------ */
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_fixed_constants);
+    RUN_TEST(test_fixed_q8_8_mul_rounds_and_saturates);
+    RUN_TEST(test_fixed_q8_8_ratio);
+    RUN_TEST(test_fixed_q16_16_mul_and_ratio);
+    RUN_TEST(test_fixed_map_saturates_at_both_ends);
+    RUN_TEST(test_fixed_map_inverted_ranges);
+    RUN_TEST(test_fixed_percent);
+    RUN_TEST(test_fixed_matches_the_float_code_within_one_percent);
+    return UNITY_END();
+}
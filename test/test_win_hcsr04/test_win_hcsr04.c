@@ -3,9 +3,9 @@
 #include "../fff.h"          /* <-- only include – do NOT define globals     */
 
 #include "hc_sr04.h"         /* unit under test                             */
+#include "timers.h"
 #include "mock_avr_io.h"     /* AVR-register names / externs                */
 
-#include <pthread.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -14,40 +14,33 @@
 FAKE_VOID_FUNC(sei);
 FAKE_VOID_FUNC(cli);
 FAKE_VOID_FUNC(_delay_us, int);
+FAKE_VOID_FUNC(timer1_start);
+FAKE_VALUE_FUNC(uint16_t, timer1_now);
 
 /* -------------------------------------------------------------------------- */
 /*    Materialise every register the driver or mock refers to on the host     */
 uint8_t  DDRC, DDRL, PORTL, PINL, TCCR1B;
-uint8_t  TCNT1;                 /* 8-bit symbol declared in mock header      */
-uint16_t TCNT1_word;            /* 16-bit counter used in the driver macro   */
+uint8_t  SREG, TIMSK1, TIFR1;
+uint16_t OCR1B;
+static uint16_t timer1_counter;           /* the shared 2 MHz Timer1     */
 
-/* -------------------------------------------------------------------------- */
-/*                    Custom _delay_us fake – drives Echo line                */
-static int delay_call_cnt;
-
-static void *echo_low_thread(void *arg)
-{
-    (void)arg;
+static uint16_t timer1_now_stub(void) { return timer1_counter; }
 
-    for (volatile int i = 0; i < 2000; ++i) ;   /* tiny busy-spin            */
-
-    TCNT1_word = 400;                           /* deterministic distance    */
-    PINL      &= ~(1 << PL6);                   /* Echo LOW – pulse ends     */
-    return NULL;
-}
+/* -------------------------------------------------------------------------- */
+/*            Custom timer1_now fake – drives Echo line per reading           */
+/*  takeMeasurement() reads the timer before the rising edge, at its start,   */
+/*  once while the echo is high and once at the end: the echo rises at the    */
+/*  first reading and falls at the third, 40000 ticks (20 ms) after it began  */
+static uint8_t echo_reads;
 
-static void _delay_us_stub(int us)
+static uint16_t echo_timer1_now(void)
 {
-    (void)us;
-    delay_call_cnt++;
+    static const uint16_t readings[] = { 0, 0, 20000, 40000 };
+    uint8_t n = echo_reads++;
 
-    if (delay_call_cnt == 2) {                  /* after trigger pulse       */
-        PINL |= (1 << PL6);                     /* Echo rises                */
-
-        pthread_t tid;
-        pthread_create(&tid, NULL, echo_low_thread, NULL);
-        pthread_detach(tid);
-    }
+    if (n == 0) PINL |=  (1 << PL6);            /* Echo rises                */
+    if (n == 2) PINL &= ~(1 << PL6);            /* Echo LOW – pulse ends     */
+    return readings[n < 3 ? n : 3];
 }
 
 /* -------------------------------------------------------------------------- */
@@ -55,11 +48,18 @@ static void _delay_us_stub(int us)
 void setUp(void)
 {
     memset(&DDRC, 0, sizeof DDRC);              /* clear all fake registers  */
-    DDRL = PORTL = PINL = TCCR1B = TCNT1 = 0;
-    TCNT1_word   = 0;
-    delay_call_cnt = 0;
-
-    _delay_us_fake.custom_fake = _delay_us_stub;
+    DDRL = PORTL = PINL = TCCR1B = 0;
+    TIMSK1 = TIFR1 = 0;
+    OCR1B = 0;
+    timer1_counter = 0;
+    echo_reads = 0;
+
+    RESET_FAKE(timer1_start);
+    RESET_FAKE(timer1_now);
+    RESET_FAKE(_delay_us);
+    timer1_now_fake.custom_fake = timer1_now_stub;
+    hc_sr04_init();
+    RESET_FAKE(timer1_start);
 }
 
 void tearDown(void) {}
@@ -72,11 +72,13 @@ void test_init_sets_trigger_pin_output(void)
     DDRL = 0x00;
     hc_sr04_init();
     TEST_ASSERT_BITS_HIGH((1 << PL7), DDRL);    /* Trigger pin is output     */
+    TEST_ASSERT_EQUAL(1, timer1_start_fake.call_count);
 }
 
 void test_takeMeasurement_returns_expected_distance(void)
 {
     PORTL &= ~(1 << PL7);                       /* ensure Trigger LOW        */
+    timer1_now_fake.custom_fake = echo_timer1_now;
 
     uint16_t dist = hc_sr04_takeMeasurement();
 
@@ -84,8 +86,120 @@ void test_takeMeasurement_returns_expected_distance(void)
     TEST_ASSERT_BITS_LOW((1 << PL7), PORTL);
     TEST_ASSERT_EQUAL(2, _delay_us_fake.call_count);
 
-    /* With TCNT1_word = 400 → distance = 400 × 343 / 125 = 1097 cm          */
-    TEST_ASSERT_EQUAL_UINT16(1097, dist);
+    /* 40000 ticks at 2 MHz → distance = 40000 × 343 / 40000 = 343 cm       */
+    TEST_ASSERT_EQUAL_UINT16(343, dist);
+    TEST_ASSERT_EQUAL(4, timer1_now_fake.call_count);
+    TEST_ASSERT_EQUAL_UINT8(0, TCCR1B);         /* shared timer left alone   */
+}
+
+void test_takeMeasurement_times_out_without_echo(void)
+{
+    timer1_now_fake.custom_fake = NULL;         /* Echo never rises          */
+    /* 15 ms between readings; the counter wraps around three times       */
+    uint16_t readings[] = { 0, 30000, 60000, 24464, 54464, 18928, 48928, 13392, 43392 };
+    SET_RETURN_SEQ(timer1_now, readings, 9);
+
+    TEST_ASSERT_EQUAL_UINT16(0, hc_sr04_takeMeasurement());
+    TEST_ASSERT_EQUAL(8, timer1_now_fake.call_count);   /* gave up at 105 ms */
+}
+
+/* ---- Background measurement -------------------------------------------- */
+extern void TIMER1_COMPB_vect(void);          /* from hc_sr04.c              */
+
+/* Run the sampling interrupt at each compare match until the measurement is  */
+/* over; the echo is high from rise to fall ticks after the ping             */
+static uint16_t samples;
+static void echo(uint16_t rise, uint16_t fall)
+{
+    uint16_t ping = timer1_counter;
+    samples = 0;
+    while (TIMSK1 & (1 << OCIE1B)) {
+        timer1_counter = OCR1B;
+        uint16_t t = timer1_counter - ping;
+        if (t >= rise && t < fall) PINL |=  (1 << PL6);
+        else                       PINL &= ~(1 << PL6);
+        TIMER1_COMPB_vect();
+        samples++;
+    }
+}
+
+static uint16_t ranged(uint16_t echo_ticks)
+{
+    TEST_ASSERT_EQUAL_UINT8(1, hc_sr04_ping());
+    echo(1000, 1000 + echo_ticks);
+    TEST_ASSERT_EQUAL_UINT8(1, hc_sr04_poll());
+    return hc_sr04_distance_cm();
+}
+
+void test_ping_triggers_and_starts_sampling(void)
+{
+    timer1_counter = 1234;
+
+    TEST_ASSERT_EQUAL_UINT8(1, hc_sr04_ping());
+    TEST_ASSERT_BITS_LOW((1 << PL7), PORTL);
+    TEST_ASSERT_EQUAL(2, _delay_us_fake.call_count);
+    TEST_ASSERT_BITS_HIGH((1 << OCIE1B), TIMSK1);
+    TEST_ASSERT_EQUAL_UINT16(1234 + HC_SR04_SAMPLE_US * 2, OCR1B);
+    TEST_ASSERT_EQUAL_UINT8(1, hc_sr04_busy());
+    TEST_ASSERT_EQUAL_UINT8(0, hc_sr04_ping());  /* one at a time          */
+    TEST_ASSERT_EQUAL_UINT8(0, hc_sr04_poll());
+}
+
+void test_background_measurement_of_the_echo(void)
+{
+    timer1_counter = 60000;                     /* wraps during the echo     */
+
+    /* 11648 ticks = 5.824 ms ≈ 100 cm at 20 °C                             */
+    TEST_ASSERT_EQUAL_UINT16(100, ranged(11648));
+    TEST_ASSERT_BITS_LOW((1 << OCIE1B), TIMSK1);  /* stopped sampling       */
+    TEST_ASSERT_EQUAL_UINT8(0, hc_sr04_busy());
+    TEST_ASSERT_EQUAL_UINT16(1000 / 50 + 11648 / 50 + 1, samples);
+}
+
+void test_background_measurement_times_out_without_echo(void)
+{
+    hc_sr04_ping();
+    echo(0xFFFF, 0xFFFF);                       /* never rises               */
+    TEST_ASSERT_EQUAL_UINT16(5 * 2000 / 50, samples);   /* gave up at 5 ms  */
+    TEST_ASSERT_EQUAL_UINT8(1, hc_sr04_poll());
+    TEST_ASSERT_EQUAL_UINT16(0, hc_sr04_distance_cm());
+}
+
+void test_background_measurement_clamps_a_long_echo(void)
+{
+    hc_sr04_ping();
+    echo(1000, 0xFFFF);                         /* never falls               */
+    TEST_ASSERT_EQUAL_UINT8(1, hc_sr04_poll());
+    TEST_ASSERT_EQUAL_UINT16(412, hc_sr04_distance_cm()); /* 24 ms, ~4 m    */
+}
+
+void test_median_drops_a_stray_echo(void)
+{
+    ranged(11648);                              /* 100 cm                    */
+    ranged(11765);                              /* 101 cm                    */
+    ranged(35000);                              /* 300 cm: a stray echo      */
+    TEST_ASSERT_EQUAL_UINT16(101, hc_sr04_distance_cm());
+    ranged(11532);                              /*  99 cm                    */
+    TEST_ASSERT_EQUAL_UINT16(100, hc_sr04_distance_cm());
+    ranged(11648);
+    ranged(11648);
+    ranged(11648);                              /* stray one out of window   */
+    TEST_ASSERT_EQUAL_UINT16(100, hc_sr04_distance_cm());
+}
+
+void test_speed_of_sound_follows_the_temperature(void)
+{
+    hc_sr04_set_temperature(0);
+    TEST_ASSERT_EQUAL_UINT16(96, ranged(11648));   /* 331.3 m/s             */
+
+    hc_sr04_init();
+    hc_sr04_set_temperature(40);
+    TEST_ASSERT_EQUAL_UINT16(104, ranged(11648));  /* 355.5 m/s             */
+
+    hc_sr04_init();
+    hc_sr04_set_temperature(-10);
+    TEST_ASSERT_EQUAL_UINT16(95, ranged(11648));   /* 325.2 m/s             */
+    hc_sr04_set_temperature(20);
 }
 
 /* -------------------------------------------------------------------------- */
@@ -96,6 +210,13 @@ int main(void)
 
     RUN_TEST(test_init_sets_trigger_pin_output);
     RUN_TEST(test_takeMeasurement_returns_expected_distance);
+    RUN_TEST(test_takeMeasurement_times_out_without_echo);
+    RUN_TEST(test_ping_triggers_and_starts_sampling);
+    RUN_TEST(test_background_measurement_of_the_echo);
+    RUN_TEST(test_background_measurement_times_out_without_echo);
+    RUN_TEST(test_background_measurement_clamps_a_long_echo);
+    RUN_TEST(test_median_drops_a_stray_echo);
+    RUN_TEST(test_speed_of_sound_follows_the_temperature);
 
     return UNITY_END();
 }
@@ -0,0 +1,203 @@
+/*  test_win_http_parser.c – unit tests for lib/http_parser (desktop build)  */
+#include "unity.h"
+#include "http_parser.h"
+
+#include <string.h>
+
+static http_parser_t parser;
+static char          body[256];
+static uint16_t      body_length;
+static uint16_t      body_calls;
+
+static void on_body(const uint8_t *data, uint16_t length)
+{
+    memcpy(body + body_length, data, length);
+    body_length += length;
+    body[body_length] = '\0';
+    body_calls++;
+}
+
+static void feed(const char *text)
+{
+    http_parser_feed(&parser, (const uint8_t *)text, strlen(text));
+}
+
+static void feed_byte_by_byte(const char *text)
+{
+    while (*text)
+        http_parser_feed(&parser, (const uint8_t *)text++, 1);
+}
+
+void setUp(void)
+{
+    http_parser_init(&parser, on_body);
+    body[0] = '\0';
+    body_length = 0;
+    body_calls = 0;
+}
+
+void tearDown(void) {}
+
+/* -------------------------------------------------------------------------- */
+void test_http_parser_content_length_body(void)
+{
+    feed("HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello");
+
+    TEST_ASSERT_TRUE(http_parser_done(&parser));
+    TEST_ASSERT_EQUAL(200, parser.status);
+    TEST_ASSERT_EQUAL(5, parser.content_length);
+    TEST_ASSERT_EQUAL_STRING("hello", body);
+    TEST_ASSERT_EQUAL(1, body_calls);                /* one piece, no copy */
+    TEST_ASSERT_EQUAL(0, parser.flags & HTTP_PARSER_ERROR);
+}
+
+void test_http_parser_byte_by_byte(void)
+{
+    feed_byte_by_byte("HTTP/1.0 404 Not Found\r\nContent-Length: 3\r\n\r\nnop");
+
+    TEST_ASSERT_TRUE(http_parser_done(&parser));
+    TEST_ASSERT_EQUAL(404, parser.status);
+    TEST_ASSERT_EQUAL_STRING("nop", body);
+}
+
+void test_http_parser_not_done_before_whole_body(void)
+{
+    feed("HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\n12345");
+
+    TEST_ASSERT_FALSE(http_parser_done(&parser));
+    feed("67890");
+    TEST_ASSERT_TRUE(http_parser_done(&parser));
+    TEST_ASSERT_EQUAL_STRING("1234567890", body);
+}
+
+void test_http_parser_ignores_bytes_after_response(void)
+{
+    feed("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nokHTTP/1.1 500");
+
+    TEST_ASSERT_EQUAL(200, parser.status);
+    TEST_ASSERT_EQUAL_STRING("ok", body);
+}
+
+void test_http_parser_headers_of_interest(void)
+{
+    feed("HTTP/1.1 200 OK\r\n"
+         "date: Wed, 18 Jun 2025 12:34:56 GMT\r\n"
+         "X-Some-Very-Long-Header-Name-That-Is-Ignored: with a long value as well\r\n"
+         "CONNECTION: Close\r\n"
+         "content-length:0\r\n"
+         "\r\n");
+
+    TEST_ASSERT_TRUE(http_parser_done(&parser));
+    TEST_ASSERT_EQUAL_STRING("Wed, 18 Jun 2025 12:34:56 GMT", parser.date);
+    TEST_ASSERT_TRUE(parser.flags & HTTP_PARSER_CONNECTION_CLOSE);
+    TEST_ASSERT_EQUAL(0, parser.content_length);
+    TEST_ASSERT_EQUAL(0, body_calls);
+}
+
+void test_http_parser_chunked(void)
+{
+    feed_byte_by_byte("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                      "4\r\n{\"a\"\r\n"
+                      "9;name=value\r\n:1234567}\r\n"
+                      "0\r\n"
+                      "X-Trailer: yes\r\n"
+                      "\r\n");
+
+    TEST_ASSERT_TRUE(http_parser_done(&parser));
+    TEST_ASSERT_TRUE(parser.flags & HTTP_PARSER_CHUNKED);
+    TEST_ASSERT_EQUAL(0, parser.flags & HTTP_PARSER_ERROR);
+    TEST_ASSERT_EQUAL_STRING("{\"a\":1234567}", body);
+}
+
+void test_http_parser_chunked_in_one_piece(void)
+{
+    feed("HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip, chunked\r\n\r\n"
+         "2\r\nhi\r\n1\r\n!\r\n0\r\n\r\n");
+
+    TEST_ASSERT_TRUE(http_parser_done(&parser));
+    TEST_ASSERT_EQUAL_STRING("hi!", body);
+}
+
+void test_http_parser_body_until_close(void)
+{
+    feed("HTTP/1.1 200 OK\r\n\r\nsome ");
+    feed("more");
+    TEST_ASSERT_FALSE(http_parser_done(&parser));
+
+    http_parser_finish(&parser);
+    TEST_ASSERT_TRUE(http_parser_done(&parser));
+    TEST_ASSERT_EQUAL(0, parser.flags & HTTP_PARSER_ERROR);
+    TEST_ASSERT_EQUAL_STRING("some more", body);
+}
+
+void test_http_parser_close_before_end_is_error(void)
+{
+    feed("HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nabc");
+    http_parser_finish(&parser);
+
+    TEST_ASSERT_TRUE(http_parser_done(&parser));
+    TEST_ASSERT_TRUE(parser.flags & HTTP_PARSER_ERROR);
+}
+
+void test_http_parser_no_content(void)
+{
+    feed("HTTP/1.1 204 No Content\r\n\r\n");
+
+    TEST_ASSERT_TRUE(http_parser_done(&parser));
+    TEST_ASSERT_EQUAL(204, parser.status);
+}
+
+void test_http_parser_skips_interim_response(void)
+{
+    feed("HTTP/1.1 100 Continue\r\n\r\n"
+         "HTTP/1.1 201 Created\r\nContent-Length: 2\r\n\r\nid");
+
+    TEST_ASSERT_TRUE(http_parser_done(&parser));
+    TEST_ASSERT_EQUAL(201, parser.status);
+    TEST_ASSERT_EQUAL_STRING("id", body);
+}
+
+void test_http_parser_not_http_is_error(void)
+{
+    feed("ERROR\r\n");
+
+    TEST_ASSERT_TRUE(http_parser_done(&parser));
+    TEST_ASSERT_TRUE(parser.flags & HTTP_PARSER_ERROR);
+    TEST_ASSERT_EQUAL(0, parser.status);
+}
+
+void test_http_parser_bad_content_length_is_error(void)
+{
+    feed("HTTP/1.1 200 OK\r\nContent-Length: 12a\r\n\r\n");
+
+    TEST_ASSERT_TRUE(parser.flags & HTTP_PARSER_ERROR);
+}
+
+void test_http_parser_without_body_callback(void)
+{
+    http_parser_init(&parser, NULL);
+    feed("HTTP/1.1 200 OK\r\nContent-Length: 3\r\n\r\nabc");
+
+    TEST_ASSERT_TRUE(http_parser_done(&parser));
+}
+
+/* -------------------------------------------------------------------------- */
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_http_parser_content_length_body);
+    RUN_TEST(test_http_parser_byte_by_byte);
+    RUN_TEST(test_http_parser_not_done_before_whole_body);
+    RUN_TEST(test_http_parser_ignores_bytes_after_response);
+    RUN_TEST(test_http_parser_headers_of_interest);
+    RUN_TEST(test_http_parser_chunked);
+    RUN_TEST(test_http_parser_chunked_in_one_piece);
+    RUN_TEST(test_http_parser_body_until_close);
+    RUN_TEST(test_http_parser_close_before_end_is_error);
+    RUN_TEST(test_http_parser_no_content);
+    RUN_TEST(test_http_parser_skips_interim_response);
+    RUN_TEST(test_http_parser_not_http_is_error);
+    RUN_TEST(test_http_parser_bad_content_length_is_error);
+    RUN_TEST(test_http_parser_without_body_callback);
+    return UNITY_END();
+}
@@ -0,0 +1,506 @@
+/*  test_win_http_session.c – unit tests for lib/http_session (desktop build) */
+#include "unity.h"
+#include "../fff.h"
+
+#include "http_session.h"
+#include "wifi.h"
+
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+/*                       FFF fake-function declarations                       */
+FAKE_VALUE_FUNC(uint32_t, timers_millis);
+FAKE_VALUE_FUNC(uint8_t, wifi_busy);
+FAKE_VALUE_FUNC(uint16_t, wifi_rx_overflows);
+FAKE_VALUE_FUNC(uint8_t, wifi_TCP_is_connected);
+FAKE_VOID_FUNC(wifi_TCP_set_stream_callback, WIFI_TCP_Stream_Callback_t);
+FAKE_VALUE_FUNC(WIFI_ERROR_MESSAGE_t, wifi_command_get_ip_from_URL_async,
+                char *, char *, WIFI_Command_Callback_t);
+FAKE_VALUE_FUNC(WIFI_ERROR_MESSAGE_t, wifi_command_create_TCP_connection_async,
+                char *, uint16_t, WIFI_Command_Callback_t);
+FAKE_VALUE_FUNC(WIFI_ERROR_MESSAGE_t, wifi_command_create_SSL_connection_async,
+                char *, uint16_t, WIFI_Command_Callback_t);
+FAKE_VALUE_FUNC(WIFI_ERROR_MESSAGE_t, wifi_command_TCP_transmit_stream_async,
+                uint16_t, WIFI_TCP_Writer_t, WIFI_Command_Callback_t);
+FAKE_VOID_FUNC(wifi_TCP_write, const uint8_t *, uint16_t);
+FAKE_VALUE_FUNC(WIFI_ERROR_MESSAGE_t, wifi_command_close_TCP_connection_async,
+                WIFI_Command_Callback_t);
+
+/* -------------------------------------------------------------------------- */
+/*  A fake module and server. Every command completes on the next poll, the  */
+/*  way wifi_poll() would call its callback. Each transmit queues the reply,  */
+/*  which is then streamed in pieces of at most 10 bytes, one per poll.       */
+/*  What the writer sends is kept.                                           */
+static uint8_t                    link_up;
+static WIFI_TCP_Stream_Callback_t stream_callback;
+
+static WIFI_Command_Callback_t    pending;         /* command in flight     */
+static WIFI_ERROR_MESSAGE_t       pending_result;
+static uint8_t                    pending_link;    /* link_up when done     */
+
+static const char *reply;          /* queued for the next request          */
+static uint16_t    reply_pos;
+static uint8_t     reply_sent;     /* a request was transmitted             */
+static uint8_t     close_after_reply;
+static uint8_t     fail_next_transmit;
+static WIFI_ERROR_MESSAGE_t dns_result;
+static uint16_t    overflow_at;    /* reply byte where the UART ring overflows */
+static uint16_t    overflows;
+
+static char        sent[256];      /* payload of the last transmit          */
+static uint16_t    sent_length;
+
+/*  The system clock: every reading takes a millisecond                        */
+static uint32_t    now_ms;
+
+static uint32_t clock_read(void) { return now_ms++; }
+
+static uint8_t  fake_is_connected(void) { return link_up; }
+static uint8_t  fake_busy(void) { return pending != NULL; }
+static uint16_t fake_rx_overflows(void) { return overflows; }
+
+static void fake_set_stream_callback(WIFI_TCP_Stream_Callback_t callback)
+{
+    stream_callback = callback;
+}
+
+static WIFI_ERROR_MESSAGE_t fake_start(WIFI_Command_Callback_t callback,
+                                       WIFI_ERROR_MESSAGE_t result, uint8_t link)
+{
+    if (pending != NULL)
+        return WIFI_ERROR_BUSY;
+    pending = callback;
+    pending_result = result;
+    pending_link = link;
+    return WIFI_OK;
+}
+
+static WIFI_ERROR_MESSAGE_t fake_get_ip(char *url, char *ip, WIFI_Command_Callback_t cb)
+{
+    (void)url;
+    strcpy(ip, "10.0.0.1");
+    return fake_start(cb, dns_result, link_up);
+}
+
+static WIFI_ERROR_MESSAGE_t fake_connect(char *ip, uint16_t port, WIFI_Command_Callback_t cb)
+{
+    (void)ip; (void)port;
+    stream_callback = NULL;
+    return fake_start(cb, WIFI_OK, 1);
+}
+
+static void fake_write(const uint8_t *data, uint16_t length)
+{
+    TEST_ASSERT_TRUE(sent_length + length < sizeof(sent));
+    memcpy(sent + sent_length, data, length);
+    sent_length += length;
+    sent[sent_length] = '\0';
+}
+
+static WIFI_ERROR_MESSAGE_t fake_transmit(uint16_t length, WIFI_TCP_Writer_t writer,
+                                          WIFI_Command_Callback_t cb)
+{
+    if (pending != NULL)
+        return WIFI_ERROR_BUSY;
+    sent_length = 0;
+    sent[0] = '\0';
+    writer();
+    TEST_ASSERT_EQUAL(length, sent_length);
+
+    if (fail_next_transmit) {
+        fail_next_transmit = 0;
+        return fake_start(cb, WIFI_ERROR_RECEIVED_ERROR, 0);
+    }
+    reply_pos = 0;
+    reply_sent = 1;
+    return fake_start(cb, WIFI_OK, link_up);
+}
+
+static WIFI_ERROR_MESSAGE_t fake_close(WIFI_Command_Callback_t cb)
+{
+    WIFI_ERROR_MESSAGE_t result = fake_start(cb, WIFI_OK, 0);
+    if (result == WIFI_OK)
+        link_up = 0;
+    return result;
+}
+
+/*  What wifi_poll() does in the main loop                                    */
+static uint32_t polls;
+static void server_poll(void)
+{
+    polls++;
+    if (pending != NULL) {
+        WIFI_Command_Callback_t callback = pending;
+        pending = NULL;
+        link_up = pending_link;
+        if (callback != NULL)
+            callback(pending_result);
+        return;
+    }
+
+    if (reply == NULL || !reply_sent || !link_up)
+        return;
+    uint16_t remaining = strlen(reply) - reply_pos;
+    if (remaining == 0)
+        return;
+
+    uint16_t n = remaining > 10 ? 10 : remaining;
+    if (overflow_at && reply_pos + n > overflow_at) {
+        overflow_at = 0;
+        overflows++;
+    }
+    if (stream_callback != NULL)
+        stream_callback((const uint8_t *)reply + reply_pos, n);
+    reply_pos += n;
+
+    if (reply_pos == strlen(reply)) {
+        reply_sent = 0;
+        if (close_after_reply)
+            link_up = 0;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+static char response[128];
+static const char head[] = "GET / HTTP/1.1\r\nHost: api.com\r\n\r\n";
+
+/*  The main loop: run the request and poll the module until it is done      */
+static protothread_t pt;
+#define RUN(thread)                                        \
+    do {                                                   \
+        PT_INIT(&pt);                                      \
+        while ((thread) < PT_EXITED)                       \
+            server_poll();                                 \
+    } while (0)
+
+static int16_t request(const char *host)
+{
+    RUN(http_session_request(&pt, host, 443, HTTP_SESSION_SSL,
+                             (const uint8_t *)head, strlen(head), NULL, 0,
+                             response, sizeof(response)));
+    return http_session_status();
+}
+
+void setUp(void)
+{
+    http_session_close();                     /* link of the previous test */
+    pending = NULL;
+
+    RESET_FAKE(timers_millis);
+    RESET_FAKE(wifi_busy);
+    RESET_FAKE(wifi_rx_overflows);
+    RESET_FAKE(wifi_TCP_is_connected);
+    RESET_FAKE(wifi_TCP_set_stream_callback);
+    RESET_FAKE(wifi_command_get_ip_from_URL_async);
+    RESET_FAKE(wifi_command_create_TCP_connection_async);
+    RESET_FAKE(wifi_command_create_SSL_connection_async);
+    RESET_FAKE(wifi_command_TCP_transmit_stream_async);
+    RESET_FAKE(wifi_TCP_write);
+    RESET_FAKE(wifi_command_close_TCP_connection_async);
+
+    timers_millis_fake.custom_fake                            = clock_read;
+    wifi_busy_fake.custom_fake                                = fake_busy;
+    wifi_rx_overflows_fake.custom_fake                        = fake_rx_overflows;
+    wifi_TCP_is_connected_fake.custom_fake                    = fake_is_connected;
+    wifi_TCP_set_stream_callback_fake.custom_fake             = fake_set_stream_callback;
+    wifi_command_get_ip_from_URL_async_fake.custom_fake       = fake_get_ip;
+    wifi_command_create_TCP_connection_async_fake.custom_fake = fake_connect;
+    wifi_command_create_SSL_connection_async_fake.custom_fake = fake_connect;
+    wifi_command_TCP_transmit_stream_async_fake.custom_fake   = fake_transmit;
+    wifi_TCP_write_fake.custom_fake                           = fake_write;
+    wifi_command_close_TCP_connection_async_fake.custom_fake  = fake_close;
+
+    link_up = 0;
+    reply = NULL;
+    reply_pos = 0;
+    reply_sent = 0;
+    close_after_reply = 0;
+    fail_next_transmit = 0;
+    dns_result = WIFI_OK;
+    overflow_at = 0;
+    sent_length = 0;
+    polls = 0;
+    memset(response, 0, sizeof(response));
+}
+
+void tearDown(void) {}
+
+/* -------------------------------------------------------------------------- */
+void test_http_session_first_request_connects(void)
+{
+    reply = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nhi";
+
+    TEST_ASSERT_EQUAL(200, request("api.com"));
+    TEST_ASSERT_EQUAL(1, wifi_command_get_ip_from_URL_async_fake.call_count);
+    TEST_ASSERT_EQUAL(1, wifi_command_create_SSL_connection_async_fake.call_count);
+    TEST_ASSERT_EQUAL_STRING("hi", response);
+    TEST_ASSERT_TRUE(http_session_is_open());
+}
+
+void test_http_session_second_request_reuses_link(void)
+{
+    reply = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nhi";
+    request("api.com");
+
+    reply = "HTTP/1.1 201 Created\r\ncontent-length: 0\r\n\r\n";
+    TEST_ASSERT_EQUAL(201, request("api.com"));
+
+    TEST_ASSERT_EQUAL(1, wifi_command_get_ip_from_URL_async_fake.call_count);
+    TEST_ASSERT_EQUAL(1, wifi_command_create_SSL_connection_async_fake.call_count);
+    TEST_ASSERT_EQUAL(0, wifi_command_close_TCP_connection_async_fake.call_count);
+    TEST_ASSERT_EQUAL(2, wifi_command_TCP_transmit_stream_async_fake.call_count);
+}
+
+void test_http_session_waits_for_whole_body(void)
+{
+    reply = "HTTP/1.1 200 OK\r\nContent-Length: 30\r\n\r\n"
+            "012345678901234567890123456789";
+
+    TEST_ASSERT_EQUAL(200, request("api.com"));
+    TEST_ASSERT_EQUAL_STRING("012345678901234567890123456789", response);
+}
+
+void test_http_session_chunked_body_ends_at_last_chunk(void)
+{
+    reply = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+            "2\r\nhi\r\n3\r\n!!!\r\n0\r\n\r\n";
+
+    TEST_ASSERT_EQUAL(200, request("api.com"));
+    TEST_ASSERT_EQUAL_STRING("hi!!!", response);
+    TEST_ASSERT_TRUE(http_session_is_open());
+}
+
+void test_http_session_reconnects_after_server_closed_link(void)
+{
+    reply = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+    request("api.com");
+
+    link_up = 0;                              /* CLOSED while idle         */
+    TEST_ASSERT_EQUAL(200, request("api.com"));
+    TEST_ASSERT_EQUAL(2, wifi_command_create_SSL_connection_async_fake.call_count);
+}
+
+void test_http_session_retries_once_when_send_fails(void)
+{
+    reply = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+    request("api.com");
+
+    fail_next_transmit = 1;                   /* link died unnoticed       */
+    TEST_ASSERT_EQUAL(200, request("api.com"));
+    TEST_ASSERT_EQUAL(2, wifi_command_create_SSL_connection_async_fake.call_count);
+    TEST_ASSERT_EQUAL(3, wifi_command_TCP_transmit_stream_async_fake.call_count);
+}
+
+void test_http_session_other_host_opens_new_link(void)
+{
+    reply = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+    request("api.com");
+    request("mal.com");
+
+    TEST_ASSERT_EQUAL(2, wifi_command_get_ip_from_URL_async_fake.call_count);
+    TEST_ASSERT_EQUAL_STRING("mal.com", wifi_command_get_ip_from_URL_async_fake.arg0_val);
+    TEST_ASSERT_EQUAL(1, wifi_command_close_TCP_connection_async_fake.call_count);
+}
+
+void test_http_session_connection_close_header_closes_link(void)
+{
+    reply = "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+
+    TEST_ASSERT_EQUAL(200, request("api.com"));
+    TEST_ASSERT_FALSE(http_session_is_open());
+}
+
+void test_http_session_no_reply_times_out(void)
+{
+    uint32_t start_ms = now_ms;
+    TEST_ASSERT_EQUAL(-1, request("api.com"));
+    TEST_ASSERT_TRUE(now_ms - start_ms >= HTTP_SESSION_RESPONSE_TIMEOUT_MS);
+    TEST_ASSERT_EQUAL(1, wifi_command_TCP_transmit_stream_async_fake.call_count);
+    TEST_ASSERT_FALSE(http_session_is_open());
+}
+
+void test_http_session_dns_failure(void)
+{
+    dns_result = WIFI_ERROR_NOT_RECEIVING;
+
+    TEST_ASSERT_EQUAL(-1, request("api.com"));
+    TEST_ASSERT_EQUAL(0, wifi_command_create_SSL_connection_async_fake.call_count);
+}
+
+void test_http_session_body_until_close(void)
+{
+    reply = "HTTP/1.1 200 OK\r\n\r\nuntil the end";
+    close_after_reply = 1;
+
+    TEST_ASSERT_EQUAL(200, request("api.com"));
+    TEST_ASSERT_EQUAL_STRING("until the end", response);
+    TEST_ASSERT_FALSE(http_session_is_open());
+}
+
+void test_http_session_date_header_is_kept(void)
+{
+    reply = "HTTP/1.1 200 OK\r\nDate: Wed, 18 Jun 2025 12:00:00 GMT\r\n"
+            "Content-Length: 0\r\n\r\n";
+
+    request("api.com");
+    TEST_ASSERT_EQUAL_STRING("Wed, 18 Jun 2025 12:00:00 GMT",
+                             http_session_response()->date);
+}
+
+void test_http_session_response_is_bounded(void)
+{
+    char small[16];
+    reply = "HTTP/1.1 200 OK\r\nContent-Length: 20\r\n\r\n"
+            "01234567890123456789";
+
+    RUN(http_session_request(&pt, "api.com", 443, HTTP_SESSION_SSL,
+                             (const uint8_t *)head, strlen(head),
+                             NULL, 0, small, sizeof(small)));
+    TEST_ASSERT_EQUAL(200, http_session_status());
+    TEST_ASSERT_EQUAL_STRING("012345678901234", small);
+    TEST_ASSERT_TRUE(http_session_is_open());         /* body was consumed */
+}
+
+static char     streamed[64];
+static uint16_t streamed_status;
+static void on_body(const uint8_t *data, uint16_t length)
+{
+    strncat(streamed, (const char *)data, length);
+    streamed_status = http_session_response()->status;
+}
+
+void test_http_session_stream_hands_body_to_callback(void)
+{
+    streamed[0] = '\0';
+    reply = "HTTP/1.1 200 OK\r\nContent-Length: 25\r\n\r\n"
+            "{\"a\":\"larger than 10\"}";
+
+    RUN(http_session_request_stream(&pt, "api.com", 443, HTTP_SESSION_SSL,
+                                    (const uint8_t *)head, strlen(head),
+                                    NULL, 0, on_body));
+    TEST_ASSERT_EQUAL(200, http_session_status());
+    TEST_ASSERT_EQUAL_STRING("{\"a\":\"larger than 10\"}", streamed);
+    TEST_ASSERT_EQUAL(200, streamed_status);
+}
+
+void test_http_session_head_and_body_go_out_in_one_transmit(void)
+{
+    static const char post[] = "POST /t HTTP/1.1\r\nContent-Length: 7\r\n\r\n";
+    reply = "HTTP/1.1 204 No Content\r\nContent-Length: 0\r\n\r\n";
+
+    RUN(http_session_request_stream(&pt, "api.com", 443, HTTP_SESSION_SSL,
+                                    (const uint8_t *)post, strlen(post),
+                                    (const uint8_t *)"{\"a\":1}", 7, NULL));
+    TEST_ASSERT_EQUAL(204, http_session_status());
+    TEST_ASSERT_EQUAL(1, wifi_command_TCP_transmit_stream_async_fake.call_count);
+    TEST_ASSERT_EQUAL(strlen(post) + 7, wifi_command_TCP_transmit_stream_async_fake.arg0_val);
+    TEST_ASSERT_EQUAL_STRING("POST /t HTTP/1.1\r\nContent-Length: 7\r\n\r\n{\"a\":1}", sent);
+}
+
+static void write_request(void)
+{
+    wifi_TCP_write((const uint8_t *)"GET /w HTTP/1.1\r\n", 17);
+    wifi_TCP_write((const uint8_t *)"\r\n", 2);
+}
+
+void test_http_session_writer_is_called_again_on_retry(void)
+{
+    reply = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+    request("api.com");
+
+    fail_next_transmit = 1;
+    RUN(http_session_request_writer(&pt, "api.com", 443, HTTP_SESSION_SSL,
+                                    19, write_request, NULL));
+    TEST_ASSERT_EQUAL(200, http_session_status());
+    TEST_ASSERT_EQUAL(3, wifi_command_TCP_transmit_stream_async_fake.call_count);
+    TEST_ASSERT_EQUAL_STRING("GET /w HTTP/1.1\r\n\r\n", sent);
+}
+
+void test_http_session_request_returns_while_it_waits(void)
+{
+    reply = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nhi";
+
+    PT_INIT(&pt);
+    TEST_ASSERT_EQUAL(PT_WAITING, http_session_request(&pt, "api.com", 443, HTTP_SESSION_SSL,
+                                                       (const uint8_t *)head, strlen(head), NULL, 0,
+                                                       response, sizeof(response)));
+    TEST_ASSERT_TRUE(http_session_busy());
+    TEST_ASSERT_EQUAL(1, wifi_command_get_ip_from_URL_async_fake.call_count);
+    TEST_ASSERT_EQUAL(0, wifi_command_create_SSL_connection_async_fake.call_count);
+
+    while (http_session_request(&pt, "api.com", 443, HTTP_SESSION_SSL,
+                                (const uint8_t *)head, strlen(head), NULL, 0,
+                                response, sizeof(response)) < PT_EXITED)
+        server_poll();
+    TEST_ASSERT_FALSE(http_session_busy());
+    TEST_ASSERT_EQUAL(200, http_session_status());
+    TEST_ASSERT_TRUE(polls > 5);               /* the main loop kept running */
+}
+
+void test_http_session_second_request_waits_for_the_first(void)
+{
+    static protothread_t other;
+    static char other_response[32];
+    reply = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nhi";
+
+    PT_INIT(&pt);
+    PT_INIT(&other);
+    uint8_t first = PT_WAITING, second = PT_WAITING;
+    while (first < PT_EXITED || second < PT_EXITED) {
+        if (first < PT_EXITED)
+            first = http_session_request(&pt, "api.com", 443, HTTP_SESSION_SSL,
+                                         (const uint8_t *)head, strlen(head), NULL, 0,
+                                         response, sizeof(response));
+        if (second < PT_EXITED)
+            second = http_session_request(&other, "api.com", 443, HTTP_SESSION_SSL,
+                                          (const uint8_t *)head, strlen(head), NULL, 0,
+                                          other_response, sizeof(other_response));
+        /* the second one is only sent after the first got its response     */
+        if (first < PT_EXITED)
+            TEST_ASSERT_TRUE(wifi_command_TCP_transmit_stream_async_fake.call_count <= 1);
+        server_poll();
+    }
+    TEST_ASSERT_EQUAL_STRING("hi", response);
+    TEST_ASSERT_EQUAL_STRING("hi", other_response);
+    TEST_ASSERT_EQUAL(2, wifi_command_TCP_transmit_stream_async_fake.call_count);
+    TEST_ASSERT_EQUAL(1, wifi_command_create_SSL_connection_async_fake.call_count);
+}
+
+void test_http_session_lost_bytes_fail_the_response(void)
+{
+    reply = "HTTP/1.1 200 OK\r\nContent-Length: 30\r\n\r\n"
+            "012345678901234567890123456789";
+    overflow_at = 45;                          /* inside the body           */
+    overflows = 3;                             /* from before the request   */
+
+    TEST_ASSERT_EQUAL(-1, request("api.com"));
+    TEST_ASSERT_FALSE(http_session_is_open());
+    TEST_ASSERT_EQUAL(1, wifi_command_TCP_transmit_stream_async_fake.call_count);
+    TEST_ASSERT_EQUAL_STRING("0", response);   /* nothing after the gap     */
+}
+
+/* -------------------------------------------------------------------------- */
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_http_session_first_request_connects);
+    RUN_TEST(test_http_session_second_request_reuses_link);
+    RUN_TEST(test_http_session_waits_for_whole_body);
+    RUN_TEST(test_http_session_chunked_body_ends_at_last_chunk);
+    RUN_TEST(test_http_session_reconnects_after_server_closed_link);
+    RUN_TEST(test_http_session_retries_once_when_send_fails);
+    RUN_TEST(test_http_session_other_host_opens_new_link);
+    RUN_TEST(test_http_session_connection_close_header_closes_link);
+    RUN_TEST(test_http_session_no_reply_times_out);
+    RUN_TEST(test_http_session_dns_failure);
+    RUN_TEST(test_http_session_body_until_close);
+    RUN_TEST(test_http_session_date_header_is_kept);
+    RUN_TEST(test_http_session_response_is_bounded);
+    RUN_TEST(test_http_session_stream_hands_body_to_callback);
+    RUN_TEST(test_http_session_head_and_body_go_out_in_one_transmit);
+    RUN_TEST(test_http_session_writer_is_called_again_on_retry);
+    RUN_TEST(test_http_session_request_returns_while_it_waits);
+    RUN_TEST(test_http_session_second_request_waits_for_the_first);
+    RUN_TEST(test_http_session_lost_bytes_fail_the_response);
+    return UNITY_END();
+}
@@ -0,0 +1,263 @@
+/*  test_win_json_stream.c – unit tests for lib/json_stream (desktop build)  */
+#include "unity.h"
+#include "json_stream.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+static json_stream_t json;
+static char          seen[512];          /* "path=value;" for every value   */
+static uint8_t       seen_count;
+static uint8_t       seen_truncated;     /* values reported as truncated    */
+
+static void on_value(const char *path, json_stream_type_t type, const char *value,
+                     uint8_t truncated)
+{
+    seen_truncated += truncated;
+    static const char *const types = "SNTFZ";
+    size_t used = strlen(seen);
+    snprintf(seen + used, sizeof(seen) - used, "%s%c%s;", path, types[type], value);
+    seen_count++;
+}
+
+static void feed(const char *text)
+{
+    json_stream_feed(&json, (const uint8_t *)text, strlen(text));
+}
+
+static void feed_in_pieces(const char *text, uint8_t piece)
+{
+    uint16_t length = strlen(text);
+    for (uint16_t i = 0; i < length; i += piece)
+        json_stream_feed(&json, (const uint8_t *)text + i,
+                         length - i < piece ? length - i : piece);
+}
+
+void setUp(void)
+{
+    json_stream_init(&json, on_value);
+    seen[0] = '\0';
+    seen_count = 0;
+    seen_truncated = 0;
+}
+
+void tearDown(void) {}
+
+/* -------------------------------------------------------------------------- */
+void test_json_stream_flat_object(void)
+{
+    feed("{\"a\":1,\"b\":\"x\",\"c\":true,\"d\":false,\"e\":null}");
+
+    TEST_ASSERT_TRUE(json_stream_done(&json));
+    TEST_ASSERT_EQUAL_STRING("aN1;bSx;cTtrue;dFfalse;eZnull;", seen);
+}
+
+void test_json_stream_nested_paths(void)
+{
+    feed("{\"security\":{\"armed\":true,\"alarmWindow\":{\"start\":\"22:00\",\"end\":\"06:30\"}},"
+         "\"accel\":[1,-2,{\"z\":3.5e2}],\"after\":0}");
+
+    TEST_ASSERT_TRUE(json_stream_done(&json));
+    TEST_ASSERT_EQUAL_STRING("security.armedTtrue;"
+                             "security.alarmWindow.startS22:00;"
+                             "security.alarmWindow.endS06:30;"
+                             "accel[0]N1;accel[1]N-2;accel[2].zN3.5e2;"
+                             "afterN0;", seen);
+}
+
+void test_json_stream_whitespace_everywhere(void)
+{
+    feed(" {\r\n \"a\" : [ 1 , 2 ] ,\n\t\"b\" : { } , \"c\" : [ ] , \"d\":\"v\" } ");
+
+    TEST_ASSERT_TRUE(json_stream_done(&json));
+    TEST_ASSERT_EQUAL_STRING("a[0]N1;a[1]N2;dSv;", seen);
+}
+
+void test_json_stream_resumes_across_any_split(void)
+{
+    const char *doc = "{\"watering\":{\"soilMin\":35,\"manual\":false},"
+                      "\"s\":\"a\\\"b\\\\c\\u0041\\u00e9\",\"n\":[true,null]}";
+    const char *expected = "watering.soilMinN35;watering.manualFfalse;"
+                           "sSa\"b\\cA?;n[0]Ttrue;n[1]Znull;";
+
+    for (uint8_t piece = 1; piece < 8; piece++) {
+        setUp();
+        feed_in_pieces(doc, piece);
+        TEST_ASSERT_TRUE(json_stream_done(&json));
+        TEST_ASSERT_EQUAL_STRING(expected, seen);
+    }
+}
+
+void test_json_stream_long_string_is_cut(void)
+{
+    char doc[JSON_STREAM_VALUE_SIZE + 32];
+    char expected[JSON_STREAM_VALUE_SIZE + 8];
+
+    strcpy(doc, "{\"t\":\"");
+    for (int i = 0; i < JSON_STREAM_VALUE_SIZE + 10; i++) strcat(doc, "x");
+    strcat(doc, "\"}");
+    feed(doc);
+
+    strcpy(expected, "tS");
+    for (int i = 0; i < JSON_STREAM_VALUE_SIZE - 1; i++) strcat(expected, "x");
+    strcat(expected, ";");
+    TEST_ASSERT_TRUE(json_stream_done(&json));
+    TEST_ASSERT_EQUAL_STRING(expected, seen);
+    TEST_ASSERT_EQUAL(1, seen_truncated);
+}
+
+void test_json_stream_longest_value_is_not_truncated(void)
+{
+    char doc[JSON_STREAM_VALUE_SIZE + 32];
+
+    strcpy(doc, "{\"t\":\"");
+    for (int i = 0; i < JSON_STREAM_VALUE_SIZE - 1; i++) strcat(doc, "x");
+    strcat(doc, "\",\"u\":1}");
+    feed(doc);
+
+    TEST_ASSERT_EQUAL(2, seen_count);
+    TEST_ASSERT_EQUAL(0, seen_truncated);
+}
+
+void test_json_stream_long_path_never_matches(void)
+{
+    char doc[2 * JSON_STREAM_PATH_SIZE];
+    strcpy(doc, "{\"");
+    for (int i = 0; i < JSON_STREAM_PATH_SIZE; i++) strcat(doc, "k");
+    strcat(doc, "\":1}");
+    feed(doc);
+
+    TEST_ASSERT_EQUAL(1, seen_count);
+    TEST_ASSERT_EQUAL('?', json.path[JSON_STREAM_PATH_SIZE - 2]);
+}
+
+void test_json_stream_ignores_bytes_after_document(void)
+{
+    feed("{\"a\":1} {\"b\":2}");
+
+    TEST_ASSERT_TRUE(json_stream_done(&json));
+    TEST_ASSERT_EQUAL_STRING("aN1;", seen);
+}
+
+void test_json_stream_not_done_before_end(void)
+{
+    feed("{\"a\":{\"b\":1}");
+
+    TEST_ASSERT_FALSE(json_stream_done(&json));
+    TEST_ASSERT_FALSE(json_stream_error(&json));
+}
+
+void test_json_stream_errors(void)
+{
+    const char *bad[] = { "{\"a\" 1}", "{\"a\":1]", "[1,}", "{\"a\":tru}", "{a:1}",
+                          "{\"a\":\"\\uZZ\"}", "[[[[[[[[[1]]]]]]]]]" };
+
+    for (uint8_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        setUp();
+        feed(bad[i]);
+        TEST_ASSERT_TRUE(json_stream_error(&json));
+        TEST_ASSERT_FALSE(json_stream_done(&json));
+    }
+}
+
+/* ---- Bindings ------------------------------------------------------------ */
+static struct {
+    bool     manual;
+    uint8_t  soil_min;
+    uint16_t max_pump;
+    char     rev[8];
+    char     token[200];
+} target;
+
+static const json_stream_binding_t bindings[] = {
+    { "watering.manual",         JSON_STREAM_BIND_BOOL,   &target.manual,   0 },
+    { "watering.soilMin",        JSON_STREAM_BIND_UINT8,  &target.soil_min, 0 },
+    { "watering.maxPumpSeconds", JSON_STREAM_BIND_UINT16, &target.max_pump, 0 },
+    { "meta.updatedAt",          JSON_STREAM_BIND_STRING, target.rev,       sizeof(target.rev) },
+    { "token",                   JSON_STREAM_BIND_STRING, target.token,     sizeof(target.token) },
+};
+
+static uint8_t unbound;
+
+static void bind_value(const char *path, json_stream_type_t type, const char *value,
+                       uint8_t truncated)
+{
+    if (!json_stream_bind(bindings, sizeof(bindings) / sizeof(bindings[0]), path, type, value, truncated))
+        unbound++;
+}
+
+void test_json_stream_bind_stores_values(void)
+{
+    memset(&target, 0, sizeof(target));
+    unbound = 0;
+    json_stream_init(&json, bind_value);
+
+    feed("{\"meta\":{\"updatedAt\":\"rev-7\"},\"other\":1,"
+         "\"watering\":{\"maxPumpSeconds\":600,\"manual\":true,\"soilMin\":42}}");
+
+    TEST_ASSERT_TRUE(target.manual);
+    TEST_ASSERT_EQUAL(42, target.soil_min);
+    TEST_ASSERT_EQUAL(600, target.max_pump);
+    TEST_ASSERT_EQUAL_STRING("rev-7", target.rev);
+    TEST_ASSERT_EQUAL(1, unbound);
+}
+
+void test_json_stream_bind_rejects_bad_values(void)
+{
+    memset(&target, 0, sizeof(target));
+    target.soil_min = 7;
+    target.max_pump = 8;
+    json_stream_init(&json, bind_value);
+
+    feed("{\"watering\":{\"soilMin\":256,\"maxPumpSeconds\":-1,\"manual\":\"yes\"},"
+         "\"meta\":{\"updatedAt\":\"much too long\"}}");
+
+    TEST_ASSERT_EQUAL(7, target.soil_min);
+    TEST_ASSERT_EQUAL(8, target.max_pump);
+    TEST_ASSERT_FALSE(target.manual);
+    TEST_ASSERT_EQUAL_STRING("", target.rev);
+}
+
+void test_json_stream_bind_rejects_truncated_values(void)
+{
+    /* 150 characters fit the 200 byte target, but not the tokenizer       */
+    char doc[JSON_STREAM_VALUE_SIZE + 200];
+    memset(&target, 0, sizeof(target));
+    json_stream_init(&json, bind_value);
+
+    strcpy(doc, "{\"token\":\"");
+    for (int i = 0; i < 150; i++) strcat(doc, "k");
+    strcat(doc, "\",\"watering\":{\"soilMin\":");
+    for (int i = 0; i < JSON_STREAM_VALUE_SIZE; i++) strcat(doc, "0");
+    strcat(doc, "9}}");
+    feed(doc);
+
+    TEST_ASSERT_TRUE(json_stream_done(&json));
+    TEST_ASSERT_EQUAL_STRING("", target.token);
+    TEST_ASSERT_EQUAL(0, target.soil_min);
+
+    json_stream_init(&json, bind_value);       /* a shorter one is stored  */
+    feed("{\"token\":\"kkk\"}");
+    TEST_ASSERT_EQUAL_STRING("kkk", target.token);
+}
+
+/* -------------------------------------------------------------------------- */
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_json_stream_flat_object);
+    RUN_TEST(test_json_stream_nested_paths);
+    RUN_TEST(test_json_stream_whitespace_everywhere);
+    RUN_TEST(test_json_stream_resumes_across_any_split);
+    RUN_TEST(test_json_stream_long_string_is_cut);
+    RUN_TEST(test_json_stream_longest_value_is_not_truncated);
+    RUN_TEST(test_json_stream_long_path_never_matches);
+    RUN_TEST(test_json_stream_ignores_bytes_after_document);
+    RUN_TEST(test_json_stream_not_done_before_end);
+    RUN_TEST(test_json_stream_errors);
+    RUN_TEST(test_json_stream_bind_stores_values);
+    RUN_TEST(test_json_stream_bind_rejects_bad_values);
+    RUN_TEST(test_json_stream_bind_rejects_truncated_values);
+    return UNITY_END();
+}
@@ -0,0 +1,172 @@
+/*  test_win_json_writer.c – unit tests for lib/json_writer (desktop build)  */
+#include "unity.h"
+#include "json_writer.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+static json_writer_t w;
+static char          out[256];           /* everything the sink received     */
+static uint16_t      out_length;
+static uint8_t       sink_calls;
+
+static void sink(const uint8_t *data, uint16_t length)
+{
+    TEST_ASSERT_TRUE(out_length + length < sizeof(out));
+    memcpy(out + out_length, data, length);
+    out_length += length;
+    out[out_length] = '\0';
+    sink_calls++;
+}
+
+void setUp(void)
+{
+    json_writer_init(&w, sink);
+    out[0] = '\0';
+    out_length = 0;
+    sink_calls = 0;
+}
+void tearDown(void) {}
+
+static void write_telemetry(json_writer_t *writer)
+{
+    json_writer_begin_object(writer, NULL);
+    json_writer_string(writer, "ts", "2025-06-18T12:00:00Z");
+    json_writer_uint(writer, "temp", 21);
+    json_writer_uint(writer, "lux", 65535);
+    json_writer_begin_array(writer, "accel");
+    json_writer_int(writer, NULL, -12);
+    json_writer_int(writer, NULL, 0);
+    json_writer_int(writer, NULL, 1024);
+    json_writer_end_array(writer);
+    json_writer_bool(writer, "motion", true);
+    json_writer_bool(writer, "tamper", false);
+    json_writer_end_object(writer);
+}
+
+/* ------------------------------------------------------------------ */
+void test_json_writer_empty_object(void)
+{
+    json_writer_begin_object(&w, NULL);
+    json_writer_end_object(&w);
+    TEST_ASSERT_EQUAL_STRING("{}", out);
+    TEST_ASSERT_EQUAL_UINT16(2, json_writer_length(&w));
+}
+
+void test_json_writer_members_are_separated_by_commas(void)
+{
+    write_telemetry(&w);
+    TEST_ASSERT_EQUAL_STRING("{\"ts\":\"2025-06-18T12:00:00Z\",\"temp\":21,\"lux\":65535,"
+                             "\"accel\":[-12,0,1024],\"motion\":true,\"tamper\":false}", out);
+}
+
+void test_json_writer_dry_run_counts_the_same_length(void)
+{
+    json_writer_t dry;
+    json_writer_init(&dry, NULL);
+    write_telemetry(&dry);
+
+    write_telemetry(&w);
+    TEST_ASSERT_EQUAL_UINT16(strlen(out), json_writer_length(&dry));
+    TEST_ASSERT_EQUAL_UINT16(strlen(out), json_writer_length(&w));
+}
+
+void test_json_writer_dry_run_does_not_call_a_sink(void)
+{
+    json_writer_init(&w, NULL);
+    write_telemetry(&w);
+    TEST_ASSERT_EQUAL_UINT8(0, sink_calls);
+}
+
+void test_json_writer_number_limits(void)
+{
+    json_writer_begin_array(&w, NULL);
+    json_writer_int(&w, NULL, INT32_MIN);
+    json_writer_int(&w, NULL, INT32_MAX);
+    json_writer_uint(&w, NULL, UINT32_MAX);
+    json_writer_uint(&w, NULL, 0);
+    json_writer_end_array(&w);
+    TEST_ASSERT_EQUAL_STRING("[-2147483648,2147483647,4294967295,0]", out);
+}
+
+void test_json_writer_escapes_strings(void)
+{
+    json_writer_begin_object(&w, NULL);
+    json_writer_string(&w, "a\"b", "q\"\\\n\r\t\x01z");
+    json_writer_end_object(&w);
+    TEST_ASSERT_EQUAL_STRING("{\"a\\\"b\":\"q\\\"\\\\\\n\\r\\t\\u0001z\"}", out);
+}
+
+void test_json_writer_plain_string_goes_out_in_one_piece(void)
+{
+    json_writer_string(&w, NULL, "plain text");
+    /* opening quote, text, closing quote */
+    TEST_ASSERT_EQUAL_UINT8(3, sink_calls);
+    TEST_ASSERT_EQUAL_STRING("\"plain text\"", out);
+}
+
+void test_json_writer_nested_containers(void)
+{
+    json_writer_begin_object(&w, NULL);
+    json_writer_begin_object(&w, "a");
+    json_writer_begin_array(&w, "b");
+    json_writer_begin_object(&w, NULL);
+    json_writer_end_object(&w);
+    json_writer_begin_object(&w, NULL);
+    json_writer_uint(&w, "c", 1);
+    json_writer_end_object(&w);
+    json_writer_end_array(&w);
+    json_writer_end_object(&w);
+    json_writer_bool(&w, "d", false);
+    json_writer_end_object(&w);
+    TEST_ASSERT_EQUAL_STRING("{\"a\":{\"b\":[{},{\"c\":1}]},\"d\":false}", out);
+}
+
+void test_json_writer_leaves_out_containers_nested_too_deep(void)
+{
+    for (uint8_t i = 0; i < JSON_WRITER_MAX_DEPTH - 1; i++)
+        json_writer_begin_array(&w, NULL);
+    TEST_ASSERT_FALSE(json_writer_dropped(&w));
+
+    json_writer_begin_object(&w, NULL);            /* one level too deep    */
+    json_writer_uint(&w, "x", 0);
+    json_writer_begin_array(&w, "y");
+    json_writer_end_array(&w);
+    json_writer_end_object(&w);
+    json_writer_uint(&w, NULL, 1);
+    json_writer_uint(&w, NULL, 2);
+    for (uint8_t i = 0; i < JSON_WRITER_MAX_DEPTH - 1; i++)
+        json_writer_end_array(&w);
+
+    TEST_ASSERT_EQUAL_STRING("[[[[[[[1,2]]]]]]]", out);
+    TEST_ASSERT_TRUE(json_writer_dropped(&w));
+}
+
+void test_json_writer_raw_text_and_numbers(void)
+{
+    json_writer_raw(&w, "Content-Length: ");
+    json_writer_raw_uint(&w, 1234);
+    json_writer_raw(&w, "\r\n\r\n");
+    json_writer_begin_object(&w, NULL);
+    json_writer_end_object(&w);
+    TEST_ASSERT_EQUAL_STRING("Content-Length: 1234\r\n\r\n{}", out);
+    TEST_ASSERT_EQUAL_UINT16(26, json_writer_length(&w));
+}
+
+/* ------------------------------------------------------------------ */
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_json_writer_empty_object);
+    RUN_TEST(test_json_writer_members_are_separated_by_commas);
+    RUN_TEST(test_json_writer_dry_run_counts_the_same_length);
+    RUN_TEST(test_json_writer_dry_run_does_not_call_a_sink);
+    RUN_TEST(test_json_writer_number_limits);
+    RUN_TEST(test_json_writer_escapes_strings);
+    RUN_TEST(test_json_writer_plain_string_goes_out_in_one_piece);
+    RUN_TEST(test_json_writer_nested_containers);
+    RUN_TEST(test_json_writer_leaves_out_containers_nested_too_deep);
+    RUN_TEST(test_json_writer_raw_text_and_numbers);
+    return UNITY_END();
+}
@@ -0,0 +1,450 @@
+/*  test_win_periodic_task.c – unit tests for lib/periodic_task (desktop build) */
+#include "unity.h"
+#include "periodic_task.h"
+#include "mock_avr_io.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* The mock header only DECLARES these registers; we must DEFINE them here.   */
+uint8_t  SREG;
+uint8_t  TCCR5A, TCCR5B, TIMSK5, TIFR5;
+uint16_t TCNT5, OCR5A;
+
+void cli(void) {}
+void sei(void) {}
+
+extern void TIMER5_COMPA_vect(void);      /* from periodic_task.c            */
+extern uint16_t periodic_task_slots_walked;
+
+/* The system time the profiler measures with; callbacks move it forward    */
+static uint32_t now_us;
+uint32_t timers_micros(void) { return now_us; }
+
+/* Timer5 in CTC mode: 250 counts a millisecond, the interrupt when the
+   counter passes OCR5A, which the driver moves further while nothing is due */
+static uint32_t interrupts;
+static void count_1ms(void)
+{
+    TCNT5 += 250;
+    if (TCNT5 > OCR5A) {
+        TCNT5 -= OCR5A + 1;
+        interrupts++;
+        TIMER5_COMPA_vect();
+    }
+}
+
+/* Interrupts only; nothing runs until the main loop calls the dispatcher   */
+static void tick_isr(uint32_t ms)
+{
+    while (ms--)
+        count_1ms();
+}
+
+/* Interrupt followed by a main loop that runs everything that is ready     */
+static void tick(uint32_t ms)
+{
+    while (ms--) {
+        count_1ms();
+        while (periodic_task_run())
+            ;
+    }
+}
+
+/* Every callback appends its letter and the tick it ran at                   */
+static char     log_buf[256];
+static void     log_run(char name)
+{
+    size_t used = strlen(log_buf);
+    snprintf(log_buf + used, sizeof(log_buf) - used, "%c%lu ", name,
+             (unsigned long)periodic_task_ticks());
+}
+static void task_a(void) { log_run('a'); }
+static void task_b(void) { log_run('b'); }
+static void task_c(void) { log_run('c'); }
+
+void setUp(void)
+{
+    periodic_task_init();
+    TIFR5 = 0;                 /* init clears the flag by writing a one    */
+    log_buf[0] = '\0';
+    now_us = 0;
+    interrupts = 0;
+}
+void tearDown(void) {}
+
+/* ------------------------------------------------------------------ */
+void test_periodic_task_init_starts_1ms_tick_on_timer5(void)
+{
+    TEST_ASSERT_EQUAL_UINT8((1 << WGM52) | (1 << CS51) | (1 << CS50), TCCR5B);
+    TEST_ASSERT_EQUAL_UINT8(249, OCR5A);
+    TEST_ASSERT_TRUE(TIMSK5 & (1 << OCIE5A));
+}
+
+void test_periodic_task_runs_every_period(void)
+{
+    periodic_task_add(task_a, 10, 0);
+    tick(35);
+    TEST_ASSERT_EQUAL_STRING("a10 a20 a30 ", log_buf);
+}
+
+void test_periodic_task_offset_shifts_the_phase(void)
+{
+    periodic_task_add(task_a, 10, 0);
+    periodic_task_add(task_b, 10, 3);
+    tick(23);
+    TEST_ASSERT_EQUAL_STRING("a10 b13 a20 b23 ", log_buf);
+}
+
+static uint16_t runs[6];
+static void run_0(void) { runs[0]++; }
+static void run_1(void) { runs[1]++; }
+static void run_2(void) { runs[2]++; }
+static void run_3(void) { runs[3]++; }
+static void run_4(void) { runs[4]++; }
+static void run_5(void) { runs[5]++; }
+
+void test_periodic_task_more_tasks_than_hardware_timers(void)
+{
+    /* The six tasks of main.c; three of them used to share one channel  */
+    memset(runs, 0, sizeof(runs));
+    periodic_task_add(run_0, 1000, 0);
+    periodic_task_add(run_1, 5000, 0);
+    periodic_task_add(run_2, 5000, 100);
+    periodic_task_add(run_3, 60000, 0);
+    periodic_task_add(run_4, 600000, 0);
+    periodic_task_add(run_5, 3600000, 0);
+    tick(3600000);
+    TEST_ASSERT_EQUAL_UINT16(3600, runs[0]);
+    TEST_ASSERT_EQUAL_UINT16(720, runs[1]);
+    TEST_ASSERT_EQUAL_UINT16(719, runs[2]);     /* 3600100 is not due yet */
+    TEST_ASSERT_EQUAL_UINT16(60, runs[3]);
+    TEST_ASSERT_EQUAL_UINT16(6, runs[4]);
+    TEST_ASSERT_EQUAL_UINT16(1, runs[5]);
+    TEST_ASSERT_EQUAL_UINT32(3600000, periodic_task_ticks());
+}
+
+void test_periodic_task_same_slot_different_turn(void)
+{
+    /* 5 and 5 + wheel size share a slot                                 */
+    periodic_task_add_oneshot(task_a, 5 + PERIODIC_TASK_WHEEL_SIZE);
+    periodic_task_add_oneshot(task_b, 5);
+    tick(5 + PERIODIC_TASK_WHEEL_SIZE);
+    char expected[32];
+    snprintf(expected, sizeof(expected), "b5 a%u ", 5 + PERIODIC_TASK_WHEEL_SIZE);
+    TEST_ASSERT_EQUAL_STRING(expected, log_buf);
+}
+
+void test_periodic_task_oneshot_runs_once_and_frees_the_timer(void)
+{
+    for (uint8_t i = 0; i < PERIODIC_TASK_MAX_TIMERS; i++)
+        TEST_ASSERT_NOT_EQUAL(PERIODIC_TASK_NONE, periodic_task_add_oneshot(task_a, 3));
+    TEST_ASSERT_EQUAL(PERIODIC_TASK_NONE, periodic_task_add_oneshot(task_b, 3));
+
+    tick(10);
+    TEST_ASSERT_NOT_EQUAL(PERIODIC_TASK_NONE, periodic_task_add_oneshot(task_b, 3));
+}
+
+void test_periodic_task_tasks_due_together_run_in_the_order_added(void)
+{
+    periodic_task_add(task_a, 5, 0);
+    periodic_task_add(task_b, 5, 0);
+    periodic_task_add(task_c, 5, 0);
+    tick(5);
+    TEST_ASSERT_EQUAL_STRING("a5 b5 c5 ", log_buf);
+}
+
+void test_periodic_task_cancel(void)
+{
+    periodic_task_t a = periodic_task_add(task_a, 10, 0);
+    periodic_task_add(task_b, 10, 0);
+    tick(10);
+    periodic_task_cancel(a);
+    tick(10);
+    TEST_ASSERT_EQUAL_STRING("a10 b10 b20 ", log_buf);
+}
+
+static periodic_task_t victim;
+static void cancel_victim(void) { log_run('x'); periodic_task_cancel(victim); }
+
+void test_periodic_task_callback_can_cancel_a_task_due_in_the_same_tick(void)
+{
+    periodic_task_add(cancel_victim, 10, 0);   /* runs first            */
+    victim = periodic_task_add(task_b, 10, 0);
+    tick(20);
+    TEST_ASSERT_EQUAL_STRING("x10 x20 ", log_buf);
+}
+
+void test_periodic_task_reschedule_keeps_the_period(void)
+{
+    periodic_task_t a = periodic_task_add(task_a, 10, 0);
+    tick(4);
+    periodic_task_reschedule(a, 2);
+    tick(20);
+    TEST_ASSERT_EQUAL_STRING("a6 a16 ", log_buf);
+}
+
+static periodic_task_t self;
+static void reschedule_self(void) { log_run('r'); periodic_task_reschedule(self, 3); }
+
+void test_periodic_task_callback_can_reschedule_itself(void)
+{
+    self = periodic_task_add(reschedule_self, 10, 0);
+    tick(17);
+    TEST_ASSERT_EQUAL_STRING("r10 r13 r16 ", log_buf);
+}
+
+void test_periodic_task_interrupt_does_not_run_callbacks(void)
+{
+    periodic_task_add(task_a, 2, 0);
+    tick_isr(2);
+    TEST_ASSERT_EQUAL_STRING("", log_buf);
+
+    TEST_ASSERT_EQUAL_UINT8(1, periodic_task_run());
+    TEST_ASSERT_EQUAL_UINT8(0, periodic_task_run());
+    TEST_ASSERT_EQUAL_STRING("a2 ", log_buf);
+}
+
+void test_periodic_task_higher_priority_runs_first(void)
+{
+    periodic_task_add(task_a, 5, 0);
+    periodic_task_t c = periodic_task_add(task_c, 5, 0);
+    periodic_task_set_priority(c, 2);
+    periodic_task_t b = periodic_task_add(task_b, 5, 0);
+    periodic_task_set_priority(b, 1);
+    tick(5);
+    TEST_ASSERT_EQUAL_STRING("c5 b5 a5 ", log_buf);
+}
+
+void test_periodic_task_same_priority_runs_in_release_order(void)
+{
+    periodic_task_add(task_b, 10, 0);          /* released at 10            */
+    periodic_task_add(task_a, 5, 2);           /* released at 7             */
+    tick_isr(10);
+    while (periodic_task_run())
+        ;
+    TEST_ASSERT_EQUAL_STRING("a10 b10 ", log_buf);
+}
+
+/* A callback that outlasts several ticks                                  */
+static void slow_task(void)
+{
+    log_run('s');
+    tick_isr(3);                              /* interrupts keep coming    */
+}
+
+void test_periodic_task_releases_during_a_slow_callback_are_caught_up(void)
+{
+    periodic_task_add_oneshot(slow_task, 1);
+    periodic_task_t a = periodic_task_add(task_a, 2, 0);
+    tick(1);                                  /* tick 1 plus 3 inside      */
+    TEST_ASSERT_EQUAL_STRING("s1 a4 a4 ", log_buf);
+    TEST_ASSERT_EQUAL_UINT32(4, periodic_task_ticks());
+    TEST_ASSERT_EQUAL_UINT16(1, periodic_task_overruns(a));
+}
+
+void test_periodic_task_no_overrun_when_on_time(void)
+{
+    periodic_task_t a = periodic_task_add(task_a, 2, 0);
+    tick(100);
+    TEST_ASSERT_EQUAL_UINT16(0, periodic_task_overruns(a));
+}
+
+void test_periodic_task_cancel_drops_pending_releases(void)
+{
+    periodic_task_t a = periodic_task_add(task_a, 2, 0);
+    tick_isr(6);
+    periodic_task_cancel(a);
+    TEST_ASSERT_EQUAL_UINT8(0, periodic_task_run());
+}
+
+void test_periodic_task_rejects_invalid_arguments(void)
+{
+    TEST_ASSERT_EQUAL(PERIODIC_TASK_NONE, periodic_task_add(task_a, 0, 0));
+    TEST_ASSERT_EQUAL(PERIODIC_TASK_NONE, periodic_task_add(NULL, 10, 0));
+    TEST_ASSERT_EQUAL(PERIODIC_TASK_NONE, periodic_task_add_oneshot(task_a, 0));
+    periodic_task_cancel(PERIODIC_TASK_NONE);
+    periodic_task_reschedule(PERIODIC_TASK_NONE, 5);
+}
+
+static uint32_t work_us;
+static void working_task(void) { now_us += work_us; }
+
+void test_periodic_task_profile_measures_execution_time(void)
+{
+    periodic_task_t w = periodic_task_add(working_task, 10, 0);
+    work_us = 300;  tick(10);
+    work_us = 5000; tick(10);
+    work_us = 40;   tick(10);
+
+    periodic_task_profile_t p;
+    TEST_ASSERT_EQUAL_UINT8(1, periodic_task_profile(w, &p));
+    TEST_ASSERT_EQUAL_UINT32(3, p.runs);
+    TEST_ASSERT_EQUAL_UINT32(40, p.last_us);
+    TEST_ASSERT_EQUAL_UINT32(40, p.min_us);
+    TEST_ASSERT_EQUAL_UINT32(5000, p.max_us);
+    TEST_ASSERT_EQUAL_UINT16(1, p.histogram[0]);    /* < 64 us               */
+    TEST_ASSERT_EQUAL_UINT16(1, p.histogram[2]);    /* < 1 ms                */
+    TEST_ASSERT_EQUAL_UINT16(1, p.histogram[4]);    /* < 16 ms               */
+}
+
+void test_periodic_task_profile_long_runs_land_in_the_last_bucket(void)
+{
+    periodic_task_t w = periodic_task_add(working_task, 10, 0);
+    work_us = 30000000UL;
+    tick(10);
+
+    periodic_task_profile_t p;
+    periodic_task_profile(w, &p);
+    TEST_ASSERT_EQUAL_UINT16(1, p.histogram[PERIODIC_TASK_PROFILE_BUCKETS - 1]);
+}
+
+void test_periodic_task_profile_measures_release_jitter(void)
+{
+    periodic_task_add_oneshot(slow_task, 1);        /* holds the loop 3 ms   */
+    periodic_task_t a = periodic_task_add(task_a, 2, 0);
+    tick(1);                                        /* a released at 2 and 4 */
+
+    periodic_task_profile_t p;
+    periodic_task_profile(a, &p);
+    TEST_ASSERT_EQUAL_UINT32(2, p.runs);
+    TEST_ASSERT_EQUAL_UINT16(0, p.jitter_ms);       /* the release at 4      */
+    TEST_ASSERT_EQUAL_UINT16(2, p.max_jitter_ms);   /* the release at 2      */
+    TEST_ASSERT_EQUAL_UINT16(1, p.overruns);
+}
+
+void test_periodic_task_profile_jitter_counts_ticks_inside_a_span(void)
+{
+    periodic_task_t a = periodic_task_add(task_a, 210, 0);
+    tick_isr(210);                                  /* released at 210       */
+    uint32_t before = interrupts;
+    tick_isr(50);                                   /* the loop is held up   */
+    TEST_ASSERT_EQUAL_UINT32(before, interrupts);   /* no tick meanwhile     */
+    TEST_ASSERT_EQUAL_UINT8(1, periodic_task_run());
+
+    periodic_task_profile_t p;
+    periodic_task_profile(a, &p);
+    TEST_ASSERT_EQUAL_STRING("a260 ", log_buf);
+    TEST_ASSERT_EQUAL_UINT16(50, p.jitter_ms);
+}
+
+void test_periodic_task_profile_reset(void)
+{
+    periodic_task_t w = periodic_task_add(working_task, 10, 0);
+    work_us = 100;
+    tick(20);
+    periodic_task_profile_reset(w);
+
+    periodic_task_profile_t p;
+    periodic_task_profile(w, &p);
+    TEST_ASSERT_EQUAL_UINT32(0, p.runs);
+    TEST_ASSERT_EQUAL_UINT32(0, p.max_us);
+    TEST_ASSERT_EQUAL_UINT16(0, p.histogram[1]);
+    TEST_ASSERT_EQUAL_UINT8(0, periodic_task_profile(PERIODIC_TASK_NONE, &p));
+}
+
+void test_periodic_task_tick_is_suppressed_while_nothing_is_due(void)
+{
+    periodic_task_add(task_a, 100, 0);
+    tick(200);
+    TEST_ASSERT_EQUAL_STRING("a100 a200 ", log_buf);
+    TEST_ASSERT_TRUE(interrupts <= 4);             /* instead of 200        */
+}
+
+void test_periodic_task_ticks_count_inside_a_long_span(void)
+{
+    periodic_task_add(task_a, 100, 0);
+    tick(1);                                       /* the span grows        */
+    tick(40);
+    TEST_ASSERT_EQUAL_UINT32(41, periodic_task_ticks());
+}
+
+void test_periodic_task_add_shortens_a_long_span(void)
+{
+    periodic_task_add(task_a, 200, 0);
+    tick(11);
+    periodic_task_add_oneshot(task_b, 5);          /* due at 16             */
+    tick(10);
+    TEST_ASSERT_EQUAL_STRING("b16 ", log_buf);
+}
+
+void test_periodic_task_longest_span_keeps_the_compare_in_16_bits(void)
+{
+    periodic_task_add(task_a, 3600000, 0);
+    tick(2);
+    TEST_ASSERT_TRUE((uint32_t)OCR5A + 1 >= 250UL * 200);
+    tick(3600000 - 2);
+    TEST_ASSERT_EQUAL_STRING("a3600000 ", log_buf);
+}
+
+void test_periodic_task_long_span_walks_at_most_one_turn_of_the_wheel(void)
+{
+    periodic_task_add(task_a, 3600000, 0);
+    periodic_task_add(task_b, 600, 0);
+    tick(1);                                       /* span of 262 ticks     */
+    uint32_t before = interrupts;
+    tick(262);
+    TEST_ASSERT_EQUAL_UINT32(before + 1, interrupts);
+    TEST_ASSERT_EQUAL_UINT16(PERIODIC_TASK_WHEEL_SIZE, periodic_task_slots_walked);
+    TEST_ASSERT_EQUAL_UINT32(263, periodic_task_ticks());
+
+    tick(600 - 263);
+    TEST_ASSERT_EQUAL_STRING("b600 ", log_buf);
+}
+
+void test_periodic_task_wake_within(void)
+{
+    periodic_task_add(task_a, 200, 0);
+    tick(10);
+    uint32_t before = interrupts;
+    periodic_task_wake_within(3);
+    tick(3);
+    TEST_ASSERT_EQUAL_UINT32(before + 1, interrupts);
+    TEST_ASSERT_EQUAL_UINT8(0, periodic_task_ready());
+}
+
+void test_periodic_task_ready(void)
+{
+    periodic_task_add(task_a, 5, 0);
+    tick_isr(5);
+    TEST_ASSERT_EQUAL_UINT8(1, periodic_task_ready());
+    periodic_task_run();
+    TEST_ASSERT_EQUAL_UINT8(0, periodic_task_ready());
+}
+
+/* ------------------------------------------------------------------ */
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_periodic_task_init_starts_1ms_tick_on_timer5);
+    RUN_TEST(test_periodic_task_runs_every_period);
+    RUN_TEST(test_periodic_task_offset_shifts_the_phase);
+    RUN_TEST(test_periodic_task_more_tasks_than_hardware_timers);
+    RUN_TEST(test_periodic_task_same_slot_different_turn);
+    RUN_TEST(test_periodic_task_oneshot_runs_once_and_frees_the_timer);
+    RUN_TEST(test_periodic_task_tasks_due_together_run_in_the_order_added);
+    RUN_TEST(test_periodic_task_cancel);
+    RUN_TEST(test_periodic_task_callback_can_cancel_a_task_due_in_the_same_tick);
+    RUN_TEST(test_periodic_task_reschedule_keeps_the_period);
+    RUN_TEST(test_periodic_task_callback_can_reschedule_itself);
+    RUN_TEST(test_periodic_task_interrupt_does_not_run_callbacks);
+    RUN_TEST(test_periodic_task_higher_priority_runs_first);
+    RUN_TEST(test_periodic_task_same_priority_runs_in_release_order);
+    RUN_TEST(test_periodic_task_releases_during_a_slow_callback_are_caught_up);
+    RUN_TEST(test_periodic_task_no_overrun_when_on_time);
+    RUN_TEST(test_periodic_task_cancel_drops_pending_releases);
+    RUN_TEST(test_periodic_task_rejects_invalid_arguments);
+    RUN_TEST(test_periodic_task_profile_measures_execution_time);
+    RUN_TEST(test_periodic_task_profile_long_runs_land_in_the_last_bucket);
+    RUN_TEST(test_periodic_task_profile_measures_release_jitter);
+    RUN_TEST(test_periodic_task_profile_jitter_counts_ticks_inside_a_span);
+    RUN_TEST(test_periodic_task_profile_reset);
+    RUN_TEST(test_periodic_task_tick_is_suppressed_while_nothing_is_due);
+    RUN_TEST(test_periodic_task_ticks_count_inside_a_long_span);
+    RUN_TEST(test_periodic_task_add_shortens_a_long_span);
+    RUN_TEST(test_periodic_task_longest_span_keeps_the_compare_in_16_bits);
+    RUN_TEST(test_periodic_task_long_span_walks_at_most_one_turn_of_the_wheel);
+    RUN_TEST(test_periodic_task_wake_within);
+    RUN_TEST(test_periodic_task_ready);
+    return UNITY_END();
+}
@@ -1,4 +1,5 @@
 #include "unity.h"
+#include "../fff.h"
 #include "pir.h"
 #include "mock_avr_io.h"
 
@@ -6,36 +7,170 @@ static volatile uint8_t callback_hits;
 
 static void fake_cb(void) { callback_hits++; }
 
-/* Provide stub for sei() so native build links                            */
+/* Provide stubs for sei()/cli() so native build links                      */
+uint8_t SREG;
 void sei(void) {}
+void cli(void) {}
 
-void setUp(void)  { callback_hits = 0; }
+/* The system time is a plain variable the tests move forward               */
+FAKE_VALUE_FUNC(uint32_t, timers_millis);
+static uint32_t now_ms;
+static uint32_t timers_millis_stub(void) { return now_ms; }
+
+extern void INT2_vect(void);          /* from pir.c                         */
+
+/* Drive the pin and run the ISR, as the edge would                         */
+static void edge(uint8_t high)
+{
+    if (high) PIND |=  (1 << PD2);
+    else      PIND &= ~(1 << PD2);
+    INT2_vect();
+}
+
+/* Let time pass with the main loop polling                                 */
+static void run_ms(uint32_t ms)
+{
+    while (ms--) {
+        now_ms++;
+        pir_poll();
+    }
+}
+
+void setUp(void)
+{
+    callback_hits = 0;
+    now_ms = 10000;
+    PIND = 0;
+    RESET_FAKE(timers_millis);
+    timers_millis_fake.custom_fake = timers_millis_stub;
+}
 void tearDown(void){}
 
-void test_isr_invokes_callback_once_per_edge(void)
+void test_callback_once_per_motion_after_the_holdoff(void)
 {
     pir_init(fake_cb);
 
-    /* Manually call ISR as desktop runner won’t fire real interrupts       */
-    extern void INT2_vect(void);      /* from pir.c                         */
-    INT2_vect();
-    INT2_vect();
+    edge(1);
+    run_ms(PIR_HOLDOFF_MS - 1);
+    TEST_ASSERT_EQUAL_UINT8(0, callback_hits);      /* still held off       */
+    run_ms(1);
+    TEST_ASSERT_EQUAL_UINT8(1, callback_hits);
+    TEST_ASSERT_EQUAL_UINT8(1, pir_occupied());
 
-    TEST_ASSERT_EQUAL_UINT8(2, callback_hits);
+    edge(0);                                        /* falling: no motion   */
+    run_ms(PIR_HOLDOFF_MS);
+    TEST_ASSERT_EQUAL_UINT8(1, callback_hits);
+    TEST_ASSERT_EQUAL_UINT8(0, pir_occupied());
 }
 
 void test_null_callback_safe(void)
 {
     pir_init(NULL);
-    extern void INT2_vect(void);
     /* Should not crash                                                     */
-    INT2_vect();
+    edge(1);
+    run_ms(PIR_HOLDOFF_MS);
+    TEST_ASSERT_EQUAL_UINT8(1, pir_occupied());
+}
+
+void test_noise_burst_is_dropped(void)
+{
+    pir_init(fake_cb);
+    for (uint8_t i = 0; i < 5; i++) {
+        edge(1); run_ms(3);
+        edge(0); run_ms(7);
+    }
+    run_ms(PIR_HOLDOFF_MS);
+
+    pir_event_t e;
+    TEST_ASSERT_EQUAL_UINT8(0, callback_hits);
+    TEST_ASSERT_EQUAL_UINT8(0, pir_read_event(&e));
+    TEST_ASSERT_EQUAL_UINT8(0, pir_events_per_minute());
+}
+
+void test_events_keep_the_time_of_the_edge(void)
+{
+    pir_init(fake_cb);
+    edge(1);
+    run_ms(3000);
+    edge(0);
+    run_ms(PIR_HOLDOFF_MS);
+
+    pir_event_t e;
+    TEST_ASSERT_EQUAL_UINT8(1, pir_read_event(&e));
+    TEST_ASSERT_EQUAL_UINT8(1, e.rising);
+    TEST_ASSERT_EQUAL_UINT32(10000, e.ms);
+    TEST_ASSERT_EQUAL_UINT8(1, pir_read_event(&e));
+    TEST_ASSERT_EQUAL_UINT8(0, e.rising);
+    TEST_ASSERT_EQUAL_UINT32(13000, e.ms);
+    TEST_ASSERT_EQUAL_UINT8(0, pir_read_event(&e));
+}
+
+void test_short_gap_merges_into_one_motion(void)
+{
+    pir_init(fake_cb);
+    edge(1); run_ms(2000);
+    edge(0); run_ms(50);
+    edge(1); run_ms(2000);                          /* retriggered          */
+    TEST_ASSERT_EQUAL_UINT8(1, callback_hits);
+    TEST_ASSERT_EQUAL_UINT32(4050, pir_occupancy_ms());
+}
+
+void test_occupancy_and_rate(void)
+{
+    pir_init(fake_cb);
+    TEST_ASSERT_EQUAL_UINT32(0, pir_occupancy_ms());
+
+    for (uint8_t i = 0; i < 3; i++) {               /* 3 x 3 s every 19 s   */
+        edge(1); run_ms(3000);
+        edge(0); run_ms(16000);
+    }
+    TEST_ASSERT_EQUAL_UINT32(9000, pir_occupied_total_ms());
+    TEST_ASSERT_EQUAL_UINT8(3, pir_events_per_minute());
+
+    edge(1); run_ms(3000);
+    TEST_ASSERT_EQUAL_UINT32(3000, pir_occupancy_ms());
+    TEST_ASSERT_EQUAL_UINT32(12000, pir_occupied_total_ms());
+    TEST_ASSERT_EQUAL_UINT8(3, pir_events_per_minute()); /* first one aged  */
+
+    edge(0); run_ms(60000);
+    TEST_ASSERT_EQUAL_UINT8(0, pir_events_per_minute());
+}
+
+void test_full_ring_drops_new_edges(void)
+{
+    pir_init(fake_cb);
+    for (uint8_t i = 0; i < PIR_QUEUE_SIZE; i++) {
+        edge(!(i & 1));
+        run_ms(PIR_HOLDOFF_MS);
+    }
+    TEST_ASSERT_EQUAL_UINT16(1, pir_dropped());     /* one slot stays free  */
+
+    pir_event_t e;
+    TEST_ASSERT_EQUAL_UINT8(1, pir_read_event(&e));
+    TEST_ASSERT_EQUAL_UINT32(10000, e.ms);
+}
+
+void test_idle_until_the_holdoff_is_over(void)
+{
+    pir_init(fake_cb);
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, pir_idle_ms());
+    edge(1);
+    now_ms += 50;
+    TEST_ASSERT_EQUAL_UINT32(PIR_HOLDOFF_MS - 50, pir_idle_ms());
+    now_ms += PIR_HOLDOFF_MS;
+    TEST_ASSERT_EQUAL_UINT32(0, pir_idle_ms());
 }
 
 int main(void)
 {
     UNITY_BEGIN();
-    RUN_TEST(test_isr_invokes_callback_once_per_edge);
+    RUN_TEST(test_callback_once_per_motion_after_the_holdoff);
     RUN_TEST(test_null_callback_safe);
+    RUN_TEST(test_noise_burst_is_dropped);
+    RUN_TEST(test_events_keep_the_time_of_the_edge);
+    RUN_TEST(test_short_gap_merges_into_one_motion);
+    RUN_TEST(test_occupancy_and_rate);
+    RUN_TEST(test_full_ring_drops_new_edges);
+    RUN_TEST(test_idle_until_the_holdoff_is_over);
     return UNITY_END();
 }
@@ -0,0 +1,211 @@
+/*  test_win_protothread.c – unit tests for lib/protothread (desktop build)   */
+#include "unity.h"
+#include "../fff.h"
+#include "protothread.h"
+
+#include <stdio.h>
+#include <string.h>
+
+FAKE_VALUE_FUNC(uint32_t, timers_millis);
+
+static uint32_t now_ms;
+static uint32_t clock_read(void) { return now_ms; }
+
+/* Run the scheduler once every millisecond                                   */
+static void run_for(uint32_t ms)
+{
+    while (ms--)
+    {
+        protothread_run();
+        now_ms++;
+    }
+}
+
+/* Every step appends its letter and the time it ran at                       */
+static char log_buf[256];
+static void log_step(char name)
+{
+    size_t used = strlen(log_buf);
+    snprintf(log_buf + used, sizeof(log_buf) - used, "%c%lu ", name, (unsigned long)now_ms);
+}
+
+void setUp(void)
+{
+    RESET_FAKE(timers_millis);
+    timers_millis_fake.custom_fake = clock_read;
+    now_ms = 0;
+    log_buf[0] = '\0';
+    protothread_init();
+}
+void tearDown(void) {}
+
+/* ------------------------------------------------------------------ */
+static PT_THREAD(sleeper(protothread_t *pt))
+{
+    static uint8_t i;
+    PT_BEGIN(pt);
+    for (i = 0; i < 3; i++)
+    {
+        log_step('s');
+        PT_SLEEP_MS(pt, 10);
+    }
+    PT_END(pt);
+}
+
+void test_protothread_sleep_resumes_after_the_delay(void)
+{
+    TEST_ASSERT_EQUAL_UINT8(1, protothread_spawn(sleeper));
+    run_for(40);
+    TEST_ASSERT_EQUAL_STRING("s0 s10 s20 ", log_buf);
+    TEST_ASSERT_FALSE(protothread_running(sleeper));
+}
+
+void test_protothread_sleeping_thread_is_not_called(void)
+{
+    protothread_spawn(sleeper);
+    TEST_ASSERT_EQUAL_UINT8(1, protothread_run());
+    TEST_ASSERT_EQUAL_UINT8(0, protothread_run());
+    now_ms = 9;
+    TEST_ASSERT_EQUAL_UINT8(0, protothread_run());
+    now_ms = 10;
+    TEST_ASSERT_EQUAL_UINT8(1, protothread_run());
+}
+
+static uint8_t flag;
+static PT_THREAD(waiter(protothread_t *pt))
+{
+    PT_BEGIN(pt);
+    PT_WAIT_UNTIL(pt, flag);
+    log_step('w');
+    PT_END(pt);
+}
+
+void test_protothread_wait_until_a_condition(void)
+{
+    flag = 0;
+    protothread_spawn(waiter);
+    run_for(5);
+    TEST_ASSERT_EQUAL_STRING("", log_buf);
+    flag = 1;
+    run_for(1);
+    TEST_ASSERT_EQUAL_STRING("w5 ", log_buf);
+}
+
+static PT_THREAD(yielder_a(protothread_t *pt))
+{
+    PT_BEGIN(pt);
+    log_step('a');
+    PT_YIELD(pt);
+    log_step('a');
+    PT_END(pt);
+}
+
+static PT_THREAD(yielder_b(protothread_t *pt))
+{
+    PT_BEGIN(pt);
+    log_step('b');
+    PT_YIELD(pt);
+    log_step('b');
+    PT_END(pt);
+}
+
+void test_protothread_threads_interleave(void)
+{
+    protothread_spawn(yielder_a);
+    protothread_spawn(yielder_b);
+    run_for(3);
+    TEST_ASSERT_EQUAL_STRING("a0 b0 a1 b1 ", log_buf);
+}
+
+static protothread_t child;
+static PT_THREAD(child_thread(protothread_t *pt, char name))
+{
+    PT_BEGIN(pt);
+    log_step(name);
+    PT_SLEEP_MS(pt, 5);
+    log_step(name);
+    PT_END(pt);
+}
+
+static PT_THREAD(parent(protothread_t *pt))
+{
+    PT_BEGIN(pt);
+    PT_SPAWN(pt, &child, child_thread(&child, 'x'));
+    PT_SLEEP_MS(pt, 2);
+    PT_SPAWN(pt, &child, child_thread(&child, 'y'));
+    log_step('p');
+    PT_END(pt);
+}
+
+void test_protothread_spawn_a_child_and_wait_for_it(void)
+{
+    protothread_spawn(parent);
+    run_for(20);
+    TEST_ASSERT_EQUAL_STRING("x0 x5 y7 y12 p12 ", log_buf);
+}
+
+static PT_THREAD(quitter(protothread_t *pt))
+{
+    PT_BEGIN(pt);
+    log_step('q');
+    if (flag)
+        PT_EXIT(pt);
+    log_step('q');
+    PT_END(pt);
+}
+
+void test_protothread_exit_frees_the_slot(void)
+{
+    flag = 1;
+    protothread_spawn(quitter);
+    run_for(2);
+    TEST_ASSERT_EQUAL_STRING("q0 ", log_buf);
+    TEST_ASSERT_FALSE(protothread_running(quitter));
+}
+
+void test_protothread_is_not_spawned_twice(void)
+{
+    TEST_ASSERT_EQUAL_UINT8(1, protothread_spawn(sleeper));
+    TEST_ASSERT_EQUAL_UINT8(0, protothread_spawn(sleeper));
+    run_for(40);
+    TEST_ASSERT_EQUAL_UINT8(1, protothread_spawn(sleeper));
+}
+
+void test_protothread_spawn_fails_when_all_slots_are_used(void)
+{
+    flag = 0;
+    TEST_ASSERT_EQUAL_UINT8(1, protothread_spawn(sleeper));
+    TEST_ASSERT_EQUAL_UINT8(1, protothread_spawn(waiter));
+    TEST_ASSERT_EQUAL_UINT8(1, protothread_spawn(yielder_a));
+    TEST_ASSERT_EQUAL_UINT8(1, protothread_spawn(yielder_b));
+    TEST_ASSERT_EQUAL_UINT8(0, protothread_spawn(parent));
+    TEST_ASSERT_EQUAL_UINT8(0, protothread_spawn(NULL));
+}
+
+void test_protothread_idle_ms(void)
+{
+    flag = 0;
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, protothread_idle_ms());
+    protothread_spawn(sleeper);
+    TEST_ASSERT_EQUAL_UINT32(0, protothread_idle_ms());   /* not started yet */
+    run_for(3);
+    TEST_ASSERT_EQUAL_UINT32(7, protothread_idle_ms());
+    protothread_spawn(waiter);
+    TEST_ASSERT_EQUAL_UINT32(0, protothread_idle_ms());
+}
+
+/* ------------------------------------------------------------------ */
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_protothread_sleep_resumes_after_the_delay);
+    RUN_TEST(test_protothread_sleeping_thread_is_not_called);
+    RUN_TEST(test_protothread_wait_until_a_condition);
+    RUN_TEST(test_protothread_threads_interleave);
+    RUN_TEST(test_protothread_spawn_a_child_and_wait_for_it);
+    RUN_TEST(test_protothread_exit_frees_the_slot);
+    RUN_TEST(test_protothread_is_not_spawned_twice);
+    RUN_TEST(test_protothread_spawn_fails_when_all_slots_are_used);
+    RUN_TEST(test_protothread_idle_ms);
+    return UNITY_END();
+}
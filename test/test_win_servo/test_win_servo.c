@@ -0,0 +1,157 @@
+/*  test_win_servo.c – unit tests for lib/servo (desktop build)              */
+#include "unity.h"
+#include "../fff.h"
+#include "servo.h"
+#include "mock_avr_io.h"
+
+/* The mock header only DECLARES these registers; we must DEFINE them here.   */
+uint8_t DDRE, PORTE;
+uint8_t TCCR3A, TCCR3B, TIMSK3, TIFR3;
+uint16_t OCR3A, ICR3;
+
+/* Provide stubs for sei()/cli() so native build links                      */
+uint8_t SREG;
+void sei(void) {}
+void cli(void) {}
+
+/* protothread.c sleeps on the system time                                   */
+FAKE_VALUE_FUNC(uint32_t, timers_millis);
+
+extern void TIMER3_OVF_vect(void);    /* from servo.c                       */
+
+#define TICKS(us) ((us) * 2)
+#define SETTLE_PERIODS (SERVO_SETTLE_MS / 20)
+
+/* Let n periods of 20 ms pass                                              */
+static void periods(uint16_t n)
+{
+    while (n--)
+        if (TIMSK3 & (1 << TOIE3))
+            TIMER3_OVF_vect();
+}
+
+void setUp(void)
+{
+    RESET_FAKE(timers_millis);
+    /* Finish whatever the previous test left running                       */
+    periods(1000);
+    DDRE = PORTE = 0;
+    TCCR3A = TCCR3B = TIMSK3 = TIFR3 = 0;
+    OCR3A = ICR3 = 0;
+}
+void tearDown(void) {}
+
+/* ------------------------------------------------------------------ */
+void test_servo_sets_up_a_50Hz_pwm_on_oc3a(void)
+{
+    servo(90);
+
+    TEST_ASSERT_BITS_HIGH((1 << PE3), DDRE);
+    TEST_ASSERT_EQUAL_UINT16(39999, ICR3);      /* 40000 ticks of 0.5 us    */
+    TEST_ASSERT_EQUAL_UINT8((1 << COM3A1) | (1 << WGM31), TCCR3A);
+    TEST_ASSERT_EQUAL_UINT8((1 << WGM33) | (1 << WGM32) | (1 << CS31), TCCR3B);
+}
+
+void test_servo_sets_the_pulse_and_returns(void)
+{
+    servo(0);
+    TEST_ASSERT_EQUAL_UINT16(TICKS(500), OCR3A);
+    servo(90);
+    TEST_ASSERT_EQUAL_UINT16(TICKS(1310), OCR3A);
+    servo(250);                                 /* clipped to 180           */
+    TEST_ASSERT_EQUAL_UINT16(TICKS(2120), OCR3A);
+    TEST_ASSERT_EQUAL_UINT8(1, servo_busy());
+}
+
+void test_servo_detaches_after_settling(void)
+{
+    servo(90);
+    PORTE |= (1 << PE3);
+
+    periods(SETTLE_PERIODS);
+    TEST_ASSERT_EQUAL_UINT8(1, servo_busy());
+    TEST_ASSERT_BITS_HIGH((1 << COM3A1), TCCR3A);
+
+    periods(1);
+    TEST_ASSERT_EQUAL_UINT8(0, servo_busy());
+    TEST_ASSERT_BITS_LOW((1 << COM3A1), TCCR3A);
+    TEST_ASSERT_BITS_LOW((1 << PE3), PORTE);
+
+    servo(0);                                   /* attaches again           */
+    TEST_ASSERT_BITS_HIGH((1 << COM3A1), TCCR3A);
+    TEST_ASSERT_EQUAL_UINT16(TICKS(500), OCR3A);
+}
+
+void test_servo_move_ramps_the_pulse(void)
+{
+    servo(0);
+    periods(1000);
+
+    servo_move(180, 200);                       /* 10 periods               */
+    TEST_ASSERT_EQUAL_UINT16(TICKS(500), OCR3A);
+    periods(1);
+    TEST_ASSERT_EQUAL_UINT16(TICKS(500) + (TICKS(2120) - TICKS(500)) / 10, OCR3A);
+    periods(4);
+    TEST_ASSERT_EQUAL_UINT16(TICKS(1310), OCR3A);
+    periods(5);
+    TEST_ASSERT_EQUAL_UINT16(TICKS(2120), OCR3A);
+
+    periods(SETTLE_PERIODS);
+    TEST_ASSERT_EQUAL_UINT8(1, servo_busy());
+    periods(1);
+    TEST_ASSERT_EQUAL_UINT8(0, servo_busy());
+}
+
+void test_servo_dose_opens_holds_and_closes(void)
+{
+    servo(0);
+    periods(1000);
+
+    servo_dose(90, 600, 0);                     /* hold for 30 periods      */
+    TEST_ASSERT_EQUAL_UINT16(TICKS(1310), OCR3A);
+
+    periods(SETTLE_PERIODS + 30);
+    TEST_ASSERT_EQUAL_UINT16(TICKS(1310), OCR3A);
+    periods(1);
+    TEST_ASSERT_EQUAL_UINT16(TICKS(500), OCR3A);
+    TEST_ASSERT_EQUAL_UINT8(1, servo_busy());
+
+    periods(SETTLE_PERIODS + 1);
+    TEST_ASSERT_EQUAL_UINT8(0, servo_busy());
+    TEST_ASSERT_BITS_LOW((1 << COM3A1), TCCR3A);
+}
+
+void test_servo_cancels_a_dose(void)
+{
+    servo_dose(90, 600, 0);
+    servo(45);
+
+    periods(1000);
+    TEST_ASSERT_EQUAL_UINT16(TICKS(905), OCR3A);
+}
+
+void test_servo_thread_waits_until_settled(void)
+{
+    protothread_t pt;
+    PT_INIT(&pt);
+
+    TEST_ASSERT_EQUAL(PT_WAITING, servo_thread(&pt, 180));
+    TEST_ASSERT_EQUAL_UINT16(TICKS(2120), OCR3A);
+    periods(SETTLE_PERIODS);
+    TEST_ASSERT_EQUAL(PT_WAITING, servo_thread(&pt, 180));
+    periods(1);
+    TEST_ASSERT_EQUAL(PT_ENDED, servo_thread(&pt, 180));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_servo_sets_up_a_50Hz_pwm_on_oc3a);
+    RUN_TEST(test_servo_sets_the_pulse_and_returns);
+    RUN_TEST(test_servo_detaches_after_settling);
+    RUN_TEST(test_servo_move_ramps_the_pulse);
+    RUN_TEST(test_servo_dose_opens_holds_and_closes);
+    RUN_TEST(test_servo_cancels_a_dose);
+    RUN_TEST(test_servo_thread_waits_until_settled);
+    return UNITY_END();
+}
@@ -0,0 +1,131 @@
+/*  test_win_spi.c – unit tests for lib/spi (desktop build)                  */
+#include "unity.h"
+#include "spi.h"
+#include "mock_avr_io.h"
+
+#include <string.h>
+
+/* The mock header only DECLARES these registers; we must DEFINE them here.   */
+uint8_t DDRB, PORTB;
+uint8_t SPCR, SPSR, SPDR;
+
+extern void SPI_STC_vect(void);           /* from spi.c                      */
+
+/* With SPIF set on the host, a polled transfer does not wait and reads back */
+/* the byte it wrote, as a loop-back from MOSI to MISO                        */
+static spi_device_t device;
+
+static uint8_t done_calls;
+static void done(void) { done_calls++; }
+
+void setUp(void)
+{
+    DDRB = PORTB = 0;
+    SPCR = SPSR = SPDR = 0;
+    done_calls = 0;
+    spi_device_init(&device, &DDRB, &PORTB, PB0, 5000000UL, SPI_MODE3);
+}
+void tearDown(void) {}
+
+/* ------------------------------------------------------------------ */
+void test_spi_init_enables_the_master(void)
+{
+    TEST_ASSERT_BITS_HIGH((1 << SPE) | (1 << MSTR), SPCR);
+    TEST_ASSERT_BITS_HIGH((1 << PB0) | (1 << PB1) | (1 << PB2), DDRB);
+    TEST_ASSERT_BITS_LOW((1 << PB3), DDRB);            /* MISO is an input */
+}
+
+void test_spi_device_is_deselected_after_init(void)
+{
+    TEST_ASSERT_BITS_HIGH((1 << PB0), PORTB);
+}
+
+void test_spi_clock_is_the_fastest_not_above_the_device(void)
+{
+    struct { uint32_t hz; uint8_t spr; uint8_t spi2x; } cases[] = {
+        { 8000000UL, 0, 1 },    /* F_CPU / 2                                  */
+        { 5000000UL, 0, 0 },    /* F_CPU / 4 = 4 MHz                          */
+        { 2000000UL, 1, 1 },    /* F_CPU / 8                                  */
+        { 1000000UL, 1, 0 },    /* F_CPU / 16                                 */
+        {  500000UL, 2, 1 },    /* F_CPU / 32                                 */
+        {  250000UL, 2, 0 },    /* F_CPU / 64                                 */
+        {  125000UL, 3, 0 },    /* F_CPU / 128                                */
+        {   10000UL, 3, 0 },    /* slowest there is                           */
+    };
+    for (uint8_t i = 0; i < sizeof cases / sizeof cases[0]; i++) {
+        spi_device_t d;
+        spi_device_init(&d, &DDRB, &PORTB, PB0, cases[i].hz, SPI_MODE0);
+        spi_select(&d);
+        TEST_ASSERT_EQUAL_UINT8(cases[i].spr, SPCR & ((1 << SPR1) | (1 << SPR0)));
+        TEST_ASSERT_EQUAL_UINT8(cases[i].spi2x, (SPSR >> SPI2X) & 1);
+    }
+}
+
+void test_spi_select_applies_the_mode_and_pulls_cs_low(void)
+{
+    spi_select(&device);
+    TEST_ASSERT_BITS_HIGH((1 << CPOL) | (1 << CPHA), SPCR);
+    TEST_ASSERT_BITS_LOW((1 << PB0), PORTB);
+    spi_deselect(&device);
+    TEST_ASSERT_BITS_HIGH((1 << PB0), PORTB);
+}
+
+void test_spi_transfer_buffer_sends_and_receives(void)
+{
+    uint8_t tx[] = { 0xF2, 0x11, 0x22 };
+    uint8_t rx[3] = { 0 };
+
+    spi_select(&device);
+    SPSR |= (1 << SPIF);                               /* stays set        */
+    spi_transfer_buffer(tx, rx, sizeof tx);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(tx, rx, sizeof tx);
+
+    spi_transfer_buffer(NULL, rx, 2);                  /* sends zeros      */
+    TEST_ASSERT_EQUAL_UINT8(0x00, rx[0]);
+    TEST_ASSERT_EQUAL_UINT8(0x00, rx[1]);
+}
+
+void test_spi_async_runs_the_burst_from_the_interrupt(void)
+{
+    uint8_t tx[] = { 0xF2, 0x00, 0x00, 0x00 };
+    uint8_t rx[4];
+    uint8_t device_returns[] = { 0xE5, 0x34, 0x12, 0x78 };
+
+    TEST_ASSERT_EQUAL_UINT8(1, spi_transfer_async(&device, tx, rx, 4, done));
+    TEST_ASSERT_EQUAL_UINT8(1, spi_busy());
+    TEST_ASSERT_BITS_HIGH((1 << SPIE), SPCR);
+    TEST_ASSERT_BITS_LOW((1 << PB0), PORTB);
+    TEST_ASSERT_EQUAL_UINT8(0xF2, SPDR);
+    TEST_ASSERT_EQUAL_UINT8(0, spi_transfer_async(&device, tx, rx, 4, done));
+
+    for (uint8_t i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL_UINT8(0, done_calls);
+        SPDR = device_returns[i];
+        SPI_STC_vect();
+    }
+
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(device_returns, rx, 4);
+    TEST_ASSERT_EQUAL_UINT8(1, done_calls);
+    TEST_ASSERT_EQUAL_UINT8(0, spi_busy());
+    TEST_ASSERT_BITS_LOW((1 << SPIE), SPCR);
+    TEST_ASSERT_BITS_HIGH((1 << PB0), PORTB);
+}
+
+void test_spi_async_rejects_an_empty_burst(void)
+{
+    TEST_ASSERT_EQUAL_UINT8(0, spi_transfer_async(&device, NULL, NULL, 0, done));
+    TEST_ASSERT_EQUAL_UINT8(0, spi_busy());
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_spi_init_enables_the_master);
+    RUN_TEST(test_spi_device_is_deselected_after_init);
+    RUN_TEST(test_spi_clock_is_the_fastest_not_above_the_device);
+    RUN_TEST(test_spi_select_applies_the_mode_and_pulls_cs_low);
+    RUN_TEST(test_spi_transfer_buffer_sends_and_receives);
+    RUN_TEST(test_spi_async_runs_the_burst_from_the_interrupt);
+    RUN_TEST(test_spi_async_rejects_an_empty_burst);
+    return UNITY_END();
+}
@@ -0,0 +1,120 @@
+/*  test_win_timers.c – unit tests for lib/timers (desktop build)              */
+#include "unity.h"
+#include "timers.h"
+#include "mock_avr_io.h"
+
+/* The mock header only DECLARES these registers; we must DEFINE them here.   */
+uint8_t  SREG;
+uint8_t  TCCR1A, TCCR1B, TIMSK1, TIFR1;
+uint16_t TCNT1;
+
+void cli(void) {}
+void sei(void) {}
+
+extern void TIMER1_OVF_vect(void);         /* from timers.c                  */
+
+/* The counters only ever grow, so every test measures from where it starts  */
+static uint32_t start_us;
+
+/* What the hardware does at the end of a period: flag, then the interrupt    */
+static void overflow(void)
+{
+    TCNT1 = 0;
+    TIFR1 = (1 << TOV1);
+    TIMER1_OVF_vect();
+    TIFR1 = 0;
+}
+
+void setUp(void)
+{
+    timer1_start();
+    TCNT1 = 0;
+    TIFR1 = 0;
+    start_us = timers_micros();
+}
+void tearDown(void) {}
+
+/* ------------------------------------------------------------------ */
+void test_timers_start_runs_timer1_free_with_overflow_interrupt(void)
+{
+    TEST_ASSERT_EQUAL_UINT8(0, TCCR1A);
+    TEST_ASSERT_EQUAL_UINT8(1 << CS11, TCCR1B);
+    TEST_ASSERT_TRUE(TIMSK1 & (1 << TOIE1));
+}
+
+void test_timers_micros_follows_the_counter(void)
+{
+    TCNT1 = 2001;                               /* 1000.5 us                 */
+    TEST_ASSERT_EQUAL_UINT32(start_us + 1000, timers_micros());
+    TEST_ASSERT_EQUAL_UINT32(timers_micros() / 1000, timers_millis());
+}
+
+void test_timers_overflow_adds_one_period(void)
+{
+    overflow();
+    TCNT1 = 200;
+    TEST_ASSERT_EQUAL_UINT32(start_us + 32768 + 100, timers_micros());
+}
+
+void test_timers_millis_does_not_drift(void)
+{
+    uint32_t start_ms = timers_millis();
+    for (uint16_t i = 0; i < 1000; i++)
+        overflow();
+    TEST_ASSERT_EQUAL_UINT32(start_us + 32768000UL, timers_micros());
+    TEST_ASSERT_EQUAL_UINT32(start_ms + 32768UL, timers_millis());
+    TEST_ASSERT_EQUAL_UINT32(timers_micros() / 1000, timers_millis());
+}
+
+void test_timers_overflow_not_yet_serviced_is_counted(void)
+{
+    /* The counter wrapped while interrupts were off                          */
+    TCNT1 = 10;
+    TIFR1 = (1 << TOV1);
+    TEST_ASSERT_EQUAL_UINT32(start_us + 32768 + 5, timers_micros());
+    TEST_ASSERT_EQUAL_UINT32(timers_micros() / 1000, timers_millis());
+}
+
+void test_timers_count_read_before_the_overflow_is_not_counted_twice(void)
+{
+    TCNT1 = 0xFFF0;
+    TIFR1 = (1 << TOV1);
+    TEST_ASSERT_EQUAL_UINT32(start_us + 0x7FF8, timers_micros());
+}
+
+void test_timers_time_never_goes_backwards(void)
+{
+    uint32_t last_us = timers_micros(), last_ms = timers_millis();
+    for (uint8_t period = 0; period < 3; period++)
+    {
+        for (uint32_t ticks = 3; ticks <= 0xFFFF; ticks += 97)
+        {
+            TCNT1 = ticks;
+            TEST_ASSERT_TRUE(timers_micros() >= last_us);
+            TEST_ASSERT_TRUE(timers_millis() >= last_ms);
+            last_us = timers_micros();
+            last_ms = timers_millis();
+        }
+        TCNT1 = 3;                              /* wrapped, not serviced yet */
+        TIFR1 = (1 << TOV1);
+        TEST_ASSERT_TRUE(timers_micros() >= last_us);
+        last_us = timers_micros();
+        TIMER1_OVF_vect();
+        TIFR1 = 0;
+        TEST_ASSERT_EQUAL_UINT32(last_us, timers_micros());
+    }
+}
+
+/* ------------------------------------------------------------------ */
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_timers_start_runs_timer1_free_with_overflow_interrupt);
+    RUN_TEST(test_timers_micros_follows_the_counter);
+    RUN_TEST(test_timers_overflow_adds_one_period);
+    RUN_TEST(test_timers_millis_does_not_drift);
+    RUN_TEST(test_timers_overflow_not_yet_serviced_is_counted);
+    RUN_TEST(test_timers_count_read_before_the_overflow_is_not_counted_twice);
+    RUN_TEST(test_timers_time_never_goes_backwards);
+    return UNITY_END();
+}
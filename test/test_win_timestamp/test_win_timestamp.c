@@ -13,12 +13,14 @@ typedef void (*WIFI_TCP_Callback_t)(void);
 typedef enum { USART_0 } USART_t;
 
 /* -------------------------------------------------------------------------- */
-/*  FFF fakes for the three functions timestamp_sync_via_http() relies on    */
+/*  FFF fakes for the functions timestamp_sync_via_http() relies on          */
 FAKE_VALUE_FUNC(WIFI_ERROR_MESSAGE_t, wifi_command_create_TCP_connection,
-                char*, uint16_t, WIFI_TCP_Callback_t, char*)
+                char*, uint16_t, WIFI_TCP_Callback_t, char*, uint16_t)
 FAKE_VALUE_FUNC(WIFI_ERROR_MESSAGE_t, wifi_command_TCP_transmit,
                 uint8_t*, uint16_t)
 FAKE_VOID_FUNC(uart_send_string_blocking, USART_t, char*)
+FAKE_VOID_FUNC(wifi_poll)
+FAKE_VALUE_FUNC(uint32_t, timers_millis)
 
 /* -------------------------------------------------------------------------- */
 void setUp(void)
@@ -27,6 +29,8 @@ void setUp(void)
     RESET_FAKE(wifi_command_create_TCP_connection);
     RESET_FAKE(wifi_command_TCP_transmit);
     RESET_FAKE(uart_send_string_blocking);
+    RESET_FAKE(wifi_poll);
+    RESET_FAKE(timers_millis);
 }
 
 void tearDown(void){}
@@ -35,9 +39,10 @@ void tearDown(void){}
 /* Helper fakes that mimic the Wi-Fi driver behaviour                         */
 static WIFI_ERROR_MESSAGE_t
 tcp_connect_success(char *ip, uint16_t port,
-                    WIFI_TCP_Callback_t cb, char *rx_buf)
+                    WIFI_TCP_Callback_t cb, char *rx_buf, uint16_t size)
 {
     (void)ip; (void)port;
+    TEST_ASSERT_EQUAL_UINT16(1024, size);
     strcpy(rx_buf,
         "HTTP/1.1 200 OK\r\n"
         "Date: Wed, 22 May 2024 15:34:12 GMT\r\n"
@@ -48,9 +53,9 @@ tcp_connect_success(char *ip, uint16_t port,
 
 static WIFI_ERROR_MESSAGE_t
 tcp_connect_fail(char *ip, uint16_t port,
-                 WIFI_TCP_Callback_t cb, char *rx_buf)
+                 WIFI_TCP_Callback_t cb, char *rx_buf, uint16_t size)
 {
-    (void)ip; (void)port; (void)cb; (void)rx_buf;
+    (void)ip; (void)port; (void)cb; (void)rx_buf; (void)size;
     return WIFI_FAIL;
 }
 
@@ -0,0 +1,154 @@
+/*  test_win_tone.c – unit tests for lib/tone (desktop build)                */
+#include "unity.h"
+#include "tone.h"
+#include "mock_avr_io.h"
+
+/* The mock header only DECLARES these registers; we must DEFINE them here.   */
+uint8_t DDRA, PORTA;
+uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, TIMSK2;
+
+/* Provide stubs for sei()/cli() so native build links                      */
+uint8_t SREG;
+void sei(void) {}
+void cli(void) {}
+
+extern void TIMER2_COMPA_vect(void);  /* from tone.c                        */
+
+/* Run the compare interrupt n times, counting the edges on PA7             */
+static uint32_t edges;
+static void interrupts(uint32_t n)
+{
+    while (n-- && (TIMSK2 & (1 << OCIE2A))) {
+        uint8_t before = PORTA;
+        TIMER2_COMPA_vect();
+        if ((before ^ PORTA) & (1 << PA7))
+            edges++;
+    }
+}
+
+static const tone_note_t two_notes[] = {
+    { 1000, 10 }, { 0, 10 }, TONE_END
+};
+
+void setUp(void)
+{
+    tone_stop();
+    DDRA = PORTA = 0;
+    TCCR2A = TCCR2B = TCNT2 = OCR2A = TIMSK2 = 0;
+    edges = 0;
+    tone_init();
+}
+void tearDown(void) {}
+
+/* ------------------------------------------------------------------ */
+void test_tone_play_starts_timer2_and_returns(void)
+{
+    TEST_ASSERT_EQUAL_UINT8(1, tone_play(1000, 100));
+
+    TEST_ASSERT_EQUAL_UINT8(1, tone_busy());
+    TEST_ASSERT_BITS_HIGH((1 << PA7), DDRA);
+    TEST_ASSERT_EQUAL_UINT8((1 << WGM21), TCCR2A);
+    TEST_ASSERT_BITS_HIGH((1 << OCIE2A), TIMSK2);
+    /* 500 us half period: 8000 cycles, 250 ticks at 1/32                   */
+    TEST_ASSERT_EQUAL_UINT8(3, TCCR2B);
+    TEST_ASSERT_EQUAL_UINT8(249, OCR2A);
+}
+
+void test_tone_prescaler_follows_the_frequency(void)
+{
+    struct { uint16_t hz; uint8_t cs; uint8_t ocr; } cases[] = {
+        { 4000, 2, 249 },   /* 2000 cycles / 8                             */
+        { 440,  5, 141 },   /* 18181 cycles / 128                          */
+        { 100,  7,  77 },   /* 80000 cycles / 1024                         */
+    };
+    for (uint8_t i = 0; i < sizeof cases / sizeof cases[0]; i++) {
+        tone_stop();
+        tone_play(cases[i].hz, 10);
+        TEST_ASSERT_EQUAL_UINT8(cases[i].cs, TCCR2B);
+        TEST_ASSERT_EQUAL_UINT8(cases[i].ocr, OCR2A);
+    }
+}
+
+void test_tone_note_toggles_for_its_length_then_stops(void)
+{
+    tone_play(1000, 100);                        /* 200 half periods         */
+
+    interrupts(199);
+    TEST_ASSERT_EQUAL_UINT8(1, tone_busy());
+    interrupts(1);
+    TEST_ASSERT_EQUAL_UINT32(200, edges);
+    TEST_ASSERT_EQUAL_UINT8(0, tone_busy());
+    TEST_ASSERT_EQUAL_UINT8(0, TCCR2B);
+    TEST_ASSERT_BITS_LOW((1 << OCIE2A), TIMSK2);
+    TEST_ASSERT_BITS_LOW((1 << PA7), PORTA);
+}
+
+void test_tone_melody_plays_notes_and_rests(void)
+{
+    tone_play_melody(two_notes, TONE_PRIORITY_NORMAL);
+
+    interrupts(20);                              /* the 1 kHz note           */
+    TEST_ASSERT_EQUAL_UINT32(20, edges);
+    TEST_ASSERT_EQUAL_UINT8(1, tone_busy());
+
+    interrupts(10);                              /* the rest, 1 per ms       */
+    TEST_ASSERT_EQUAL_UINT32(20, edges);
+    TEST_ASSERT_EQUAL_UINT8(0, tone_busy());
+}
+
+void test_tone_queue_plays_requests_in_order(void)
+{
+    tone_play(1000, 10);
+    tone_play(2000, 10);
+    TEST_ASSERT_EQUAL_UINT8(249, OCR2A);
+
+    interrupts(20);
+    TEST_ASSERT_EQUAL_UINT8(3, TCCR2B);          /* 2 kHz: 4000 cycles / 32  */
+    TEST_ASSERT_EQUAL_UINT8(124, OCR2A);
+    interrupts(40);
+    TEST_ASSERT_EQUAL_UINT8(0, tone_busy());
+    TEST_ASSERT_EQUAL_UINT32(60, edges);
+}
+
+void test_tone_queue_drops_when_full(void)
+{
+    TEST_ASSERT_EQUAL_UINT8(1, tone_play(1000, 10));   /* plays            */
+    for (uint8_t i = 0; i < TONE_QUEUE_SIZE - 1; i++)
+        TEST_ASSERT_EQUAL_UINT8(1, tone_play(1000, 10));
+    TEST_ASSERT_EQUAL_UINT8(0, tone_play(1000, 10));
+}
+
+void test_tone_siren_interrupts_a_melody_and_repeats(void)
+{
+    tone_play_pattern(TONE_BOOT);
+    tone_play_melody(two_notes, TONE_PRIORITY_LOW);      /* queued           */
+
+    TEST_ASSERT_EQUAL_UINT8(1, tone_play_pattern(TONE_SIREN));
+    TEST_ASSERT_EQUAL_UINT8(0, tone_play_pattern(TONE_ACK));   /* lower     */
+
+    /* 880 Hz for 250 ms, 660 Hz for 250 ms, and again                      */
+    interrupts(440 + 330);
+    TEST_ASSERT_EQUAL_UINT32(770, edges);
+    interrupts(440 + 330);
+    TEST_ASSERT_EQUAL_UINT32(1540, edges);
+    TEST_ASSERT_EQUAL_UINT8(1, tone_busy());
+
+    tone_stop();
+    TEST_ASSERT_EQUAL_UINT8(0, tone_busy());
+    TEST_ASSERT_BITS_LOW((1 << OCIE2A), TIMSK2);
+    interrupts(1000);
+    TEST_ASSERT_EQUAL_UINT32(1540, edges);       /* the boot queue is gone    */
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_tone_play_starts_timer2_and_returns);
+    RUN_TEST(test_tone_prescaler_follows_the_frequency);
+    RUN_TEST(test_tone_note_toggles_for_its_length_then_stops);
+    RUN_TEST(test_tone_melody_plays_notes_and_rests);
+    RUN_TEST(test_tone_queue_plays_requests_in_order);
+    RUN_TEST(test_tone_queue_drops_when_full);
+    RUN_TEST(test_tone_siren_interrupts_a_melody_and_repeats);
+    return UNITY_END();
+}
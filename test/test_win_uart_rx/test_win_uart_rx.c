@@ -0,0 +1,183 @@
+/*  test_win_uart_rx.c – desktop unit-tests for the lib/uart RX ring buffer  */
+#include "unity.h"
+#include "../fff.h"          /* include only – globals live in test_fff_globals.c */
+
+#include "uart.h"
+#include "mock_avr_io.h"
+
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+FAKE_VOID_FUNC(sei);
+FAKE_VOID_FUNC(cli);
+
+/* Registers touched by uart.c ---------------------------------------------- */
+uint8_t SREG;
+uint8_t UCSR0A, UCSR0B, UCSR0C, UBRR0H, UBRR0L, UDR0;
+uint8_t UCSR1A, UCSR1B, UCSR1C, UBRR1H, UBRR1L, UDR1;
+uint8_t UCSR2A, UCSR2B, UCSR2C, UBRR2H, UBRR2L, UDR2;
+uint8_t UCSR3A, UCSR3B, UCSR3C, UBRR3H, UBRR3L, UDR3;
+
+/* The RX handlers are plain functions in the WINDOWS_TEST build */
+void USART1_RX_vect(void);
+void USART2_RX_vect(void);
+
+static uint8_t callback_bytes;
+static void rx_callback(uint8_t byte) { (void)byte; callback_bytes++; }
+
+/* Pretend the ESP8266 sent something on USART2 */
+static void receive(const char *data, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        UDR2 = (uint8_t)data[i];
+        USART2_RX_vect();
+    }
+}
+
+static void flush(void)
+{
+    uint8_t sink[UART2_RX_BUFFER_SIZE];
+    char line[8];
+    while (uart_read(USART_2, sink, sizeof(sink)) > 0) {}
+    receive("\n", 1);                       /* reset the line assembler    */
+    uart_readline(USART_2, line, sizeof(line));
+}
+
+/* -------------------------------------------------------------------------- */
+void setUp(void)
+{
+    SREG = (1 << SREG_I);
+    UCSR2A = 0;
+    callback_bytes = 0;
+    uart_init(USART_2, 115200, NULL);
+    flush();
+}
+
+void tearDown(void) {}
+
+/* -------------------------------------------------------------------------- */
+void test_init_without_callback_enables_rx_interrupt(void)
+{
+    TEST_ASSERT_BITS_HIGH((1 << RXCIE2), UCSR2B);
+    TEST_ASSERT_EQUAL_PTR(NULL, uart_get_rx_callback(USART_2));
+}
+
+void test_received_bytes_are_read_in_order(void)
+{
+    receive("OK\r\n", 4);
+    TEST_ASSERT_EQUAL(4, uart_rx_available(USART_2));
+
+    uint8_t out[8];
+    TEST_ASSERT_EQUAL(4, uart_read(USART_2, out, sizeof(out)));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY("OK\r\n", out, 4);
+    TEST_ASSERT_EQUAL(0, uart_rx_available(USART_2));
+    TEST_ASSERT_EQUAL(0, uart_read(USART_2, out, sizeof(out)));
+}
+
+void test_read_respects_max(void)
+{
+    receive("abcdef", 6);
+
+    uint8_t out[4];
+    TEST_ASSERT_EQUAL(4, uart_read(USART_2, out, 4));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY("abcd", out, 4);
+    TEST_ASSERT_EQUAL(2, uart_read(USART_2, out, 4));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY("ef", out, 2);
+}
+
+void test_full_ring_counts_overflows(void)
+{
+    uint16_t before = uart_rx_overflows(USART_2);
+    char data[UART2_RX_BUFFER_SIZE + 3];
+    memset(data, 'x', sizeof(data));
+
+    receive(data, sizeof(data));
+
+    TEST_ASSERT_EQUAL(UART2_RX_BUFFER_SIZE, uart_rx_available(USART_2));
+    TEST_ASSERT_EQUAL(before + 3, uart_rx_overflows(USART_2));
+}
+
+void test_each_usart_has_its_own_ring_size(void)
+{
+    TEST_ASSERT_EQUAL(128, UART2_RX_BUFFER_SIZE);   /* the ESP8266 port     */
+
+    uart_init(USART_1, 9600, NULL);
+    uint16_t before = uart_rx_overflows(USART_1);
+    for (uint16_t i = 0; i < UART1_RX_BUFFER_SIZE + 1; i++)
+    {
+        UDR1 = 'y';
+        USART1_RX_vect();
+    }
+    TEST_ASSERT_EQUAL(UART_RX_BUFFER_SIZE, uart_rx_available(USART_1));
+    TEST_ASSERT_EQUAL(before + 1, uart_rx_overflows(USART_1));
+    TEST_ASSERT_EQUAL(0, uart_rx_available(USART_2));
+}
+
+void test_hardware_data_overrun_is_counted(void)
+{
+    uint16_t before = uart_rx_overflows(USART_2);
+    UCSR2A = (1 << DOR2);
+    receive("a", 1);
+    TEST_ASSERT_EQUAL(before + 1, uart_rx_overflows(USART_2));
+}
+
+void test_readline_assembles_line_across_calls(void)
+{
+    char line[32];
+
+    receive("+CIPDOM", 7);
+    TEST_ASSERT_EQUAL(0, uart_readline(USART_2, line, sizeof(line)));
+
+    receive("AIN:1.2.3.4\r\nOK\r\n", 17);
+    TEST_ASSERT_EQUAL(18, uart_readline(USART_2, line, sizeof(line)));
+    TEST_ASSERT_EQUAL_STRING("+CIPDOMAIN:1.2.3.4", line);
+
+    TEST_ASSERT_EQUAL(2, uart_readline(USART_2, line, sizeof(line)));
+    TEST_ASSERT_EQUAL_STRING("OK", line);
+    TEST_ASSERT_EQUAL(0, uart_readline(USART_2, line, sizeof(line)));
+}
+
+void test_readline_skips_empty_lines(void)
+{
+    char line[16];
+    receive("\r\n\r\nready\r\n", 11);
+    TEST_ASSERT_EQUAL(5, uart_readline(USART_2, line, sizeof(line)));
+    TEST_ASSERT_EQUAL_STRING("ready", line);
+}
+
+void test_readline_splits_too_long_lines(void)
+{
+    char line[4];
+    receive("abcdef\n", 7);
+    TEST_ASSERT_EQUAL(3, uart_readline(USART_2, line, sizeof(line)));
+    TEST_ASSERT_EQUAL_STRING("abc", line);
+    TEST_ASSERT_EQUAL(3, uart_readline(USART_2, line, sizeof(line)));
+    TEST_ASSERT_EQUAL_STRING("def", line);
+}
+
+void test_callback_mode_bypasses_ring(void)
+{
+    uart_init(USART_2, 115200, rx_callback);
+    receive("abc", 3);
+
+    TEST_ASSERT_EQUAL(3, callback_bytes);
+    TEST_ASSERT_EQUAL(0, uart_rx_available(USART_2));
+}
+
+/* -------------------------------------------------------------------------- */
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_init_without_callback_enables_rx_interrupt);
+    RUN_TEST(test_received_bytes_are_read_in_order);
+    RUN_TEST(test_read_respects_max);
+    RUN_TEST(test_full_ring_counts_overflows);
+    RUN_TEST(test_each_usart_has_its_own_ring_size);
+    RUN_TEST(test_hardware_data_overrun_is_counted);
+    RUN_TEST(test_readline_assembles_line_across_calls);
+    RUN_TEST(test_readline_skips_empty_lines);
+    RUN_TEST(test_readline_splits_too_long_lines);
+    RUN_TEST(test_callback_mode_bypasses_ring);
+    return UNITY_END();
+}
@@ -0,0 +1,152 @@
+/*  test_win_uart_tx.c – desktop unit-tests for the lib/uart TX ring buffer  */
+#include "unity.h"
+#include "../fff.h"          /* include only – globals live in test_fff_globals.c */
+
+#include "uart.h"
+#include "mock_avr_io.h"
+
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+FAKE_VOID_FUNC(sei);
+FAKE_VOID_FUNC(cli);
+
+/* Registers touched by uart.c ---------------------------------------------- */
+uint8_t SREG;
+uint8_t UCSR0A, UCSR0B, UCSR0C, UBRR0H, UBRR0L, UDR0;
+uint8_t UCSR1A, UCSR1B, UCSR1C, UBRR1H, UBRR1L, UDR1;
+uint8_t UCSR2A, UCSR2B, UCSR2C, UBRR2H, UBRR2L, UDR2;
+uint8_t UCSR3A, UCSR3B, UCSR3C, UBRR3H, UBRR3L, UDR3;
+
+/* The UDRE handlers are plain functions in the WINDOWS_TEST build */
+void USART0_UDRE_vect(void);
+void USART2_UDRE_vect(void);
+
+/* Drain USART0 through its "ISR" and collect what hits the data register */
+static uint16_t drain_usart0(uint8_t *out, uint16_t max)
+{
+    uint16_t n = 0;
+    while ((UCSR0B & (1 << UDRIE0)) && n < max)
+    {
+        uint8_t before = uart_tx_free(USART_0);
+        USART0_UDRE_vect();
+        if (uart_tx_free(USART_0) != before)
+            out[n++] = UDR0;
+    }
+    return n;
+}
+
+/* -------------------------------------------------------------------------- */
+void setUp(void)
+{
+    RESET_FAKE(sei);
+    RESET_FAKE(cli);
+    SREG = (1 << SREG_I);          /* interrupts "enabled"                  */
+    UCSR0A = (1 << UDRE0);
+    uart_init(USART_0, 115200, NULL);
+    uint8_t sink[UART_TX_BUFFER_SIZE];
+    drain_usart0(sink, sizeof(sink));
+}
+
+void tearDown(void) {}
+
+/* -------------------------------------------------------------------------- */
+void test_ring_is_empty_after_init(void)
+{
+    TEST_ASSERT_EQUAL(UART_TX_BUFFER_SIZE, uart_tx_free(USART_0));
+    TEST_ASSERT_BITS_LOW((1 << UDRIE0), UCSR0B);
+}
+
+void test_send_copies_data_and_enables_udre_interrupt(void)
+{
+    char msg[] = "hello";
+    uart_send_array_nonBlocking(USART_0, (uint8_t *)msg, 5);
+    memset(msg, 'x', sizeof(msg) - 1);      /* caller buffer may be reused  */
+
+    TEST_ASSERT_EQUAL(UART_TX_BUFFER_SIZE - 5, uart_tx_free(USART_0));
+    TEST_ASSERT_BITS_HIGH((1 << UDRIE0), UCSR0B);
+
+    uint8_t out[8];
+    TEST_ASSERT_EQUAL(5, drain_usart0(out, sizeof(out)));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY("hello", out, 5);
+    TEST_ASSERT_BITS_LOW((1 << UDRIE0), UCSR0B);
+    TEST_ASSERT_EQUAL(UART_TX_BUFFER_SIZE, uart_tx_free(USART_0));
+}
+
+void test_back_to_back_sends_are_queued_in_order(void)
+{
+    uart_send_array_nonBlocking(USART_0, (uint8_t *)"AT", 2);
+    uart_send_array_nonBlocking(USART_0, (uint8_t *)"\r\n", 2);
+
+    uint8_t out[8];
+    TEST_ASSERT_EQUAL(4, drain_usart0(out, sizeof(out)));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY("AT\r\n", out, 4);
+}
+
+void test_ring_wraps_around(void)
+{
+    uint8_t data[UART_TX_BUFFER_SIZE - 3];
+    uint8_t out[UART_TX_BUFFER_SIZE];
+    for (uint16_t i = 0; i < sizeof(data); i++)
+        data[i] = (uint8_t)i;
+
+    for (uint8_t round = 0; round < 5; round++)
+    {
+        uart_send_array_nonBlocking(USART_0, data, sizeof(data));
+        TEST_ASSERT_EQUAL(sizeof(data), drain_usart0(out, sizeof(out)));
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(data, out, sizeof(data));
+    }
+}
+
+void test_full_ring_is_drained_by_hand_when_interrupts_are_disabled(void)
+{
+    uint8_t data[UART_TX_BUFFER_SIZE + 10];
+    for (uint16_t i = 0; i < sizeof(data); i++)
+        data[i] = (uint8_t)(i + 1);
+
+    SREG = 0;                       /* e.g. called from inside an ISR        */
+    uart_send_array_nonBlocking(USART_0, data, sizeof(data));
+
+    /* the first 10 bytes had to be pushed out by polling UDRE0             */
+    TEST_ASSERT_EQUAL_UINT8(10, UDR0);
+    TEST_ASSERT_EQUAL(0, uart_tx_free(USART_0));
+}
+
+void test_ports_have_separate_rings(void)
+{
+    UCSR2A = (1 << UDRE2);
+    uart_init(USART_2, 115200, NULL);
+    uart_send_array_nonBlocking(USART_2, (uint8_t *)"abc", 3);
+
+    TEST_ASSERT_EQUAL(UART_TX_BUFFER_SIZE, uart_tx_free(USART_0));
+    TEST_ASSERT_EQUAL(UART_TX_BUFFER_SIZE - 3, uart_tx_free(USART_2));
+    TEST_ASSERT_BITS_HIGH((1 << UDRIE2), UCSR2B);
+
+    USART2_UDRE_vect();
+    TEST_ASSERT_EQUAL_UINT8('a', UDR2);
+}
+
+void test_blocking_send_waits_for_queued_data(void)
+{
+    uart_send_array_nonBlocking(USART_0, (uint8_t *)"ab", 2);
+
+    SREG = 0;                       /* nobody else will drain the ring       */
+    uart_send_blocking(USART_0, 'c');
+
+    TEST_ASSERT_EQUAL(UART_TX_BUFFER_SIZE, uart_tx_free(USART_0));
+    TEST_ASSERT_EQUAL_UINT8('c', UDR0);
+}
+
+/* -------------------------------------------------------------------------- */
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_ring_is_empty_after_init);
+    RUN_TEST(test_send_copies_data_and_enables_udre_interrupt);
+    RUN_TEST(test_back_to_back_sends_are_queued_in_order);
+    RUN_TEST(test_ring_wraps_around);
+    RUN_TEST(test_full_ring_is_drained_by_hand_when_interrupts_are_disabled);
+    RUN_TEST(test_ports_have_separate_rings);
+    RUN_TEST(test_blocking_send_waits_for_queued_data);
+    return UNITY_END();
+}
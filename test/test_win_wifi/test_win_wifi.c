@@ -13,16 +13,52 @@
 
 FAKE_VOID_FUNC(sei);
 FAKE_VOID_FUNC(cli);
-FAKE_VOID_FUNC(_delay_ms, int);
+FAKE_VALUE_FUNC(uint32_t, timers_millis);
 
 FAKE_VOID_FUNC(uart_send_string_blocking,   USART_t, char *);
 FAKE_VOID_FUNC(uart_init,                   USART_t, uint32_t, UART_Callback_t);
 FAKE_VOID_FUNC(uart_send_array_blocking,    USART_t, uint8_t *, uint16_t);
+FAKE_VOID_FUNC(uart_send_array_nonBlocking, USART_t, uint8_t *, uint16_t);
 FAKE_VALUE_FUNC(UART_Callback_t, uart_get_rx_callback, USART_t);
+FAKE_VALUE_FUNC(uint16_t, uart_read, USART_t, uint8_t *, uint16_t);
+FAKE_VALUE_FUNC(uint16_t, uart_rx_overflows, USART_t);
 
 uint8_t TEST_BUFFER[128];
 void TCP_Received_callback_func();
 FAKE_VOID_FUNC(TCP_Received_callback_func);
+FAKE_VOID_FUNC(command_done_callback, WIFI_ERROR_MESSAGE_t);
+
+/* -------------------------------------------------------------------------- */
+/*  The "module": bytes waiting in the UART RX ring, and everything sent      */
+static uint8_t  rx_script[256];
+static uint16_t rx_script_len, rx_script_pos;
+static char     tx_capture[256];
+static uint16_t tx_capture_len;
+
+static uint16_t uart_read_from_script(USART_t usart, uint8_t *data, uint16_t max)
+{
+    (void)usart;
+    uint16_t n = 0;
+    while (rx_script_pos < rx_script_len && n < max)
+        data[n++] = rx_script[rx_script_pos++];
+    return n;
+}
+
+/*  The system clock: every reading takes a millisecond, so blocking waits end */
+static uint32_t now_ms;
+
+static uint32_t clock_read(void)
+{
+    return now_ms++;
+}
+
+static void uart_capture_tx(USART_t usart, uint8_t *data, uint16_t length)
+{
+    (void)usart;
+    for (uint16_t i = 0; i < length && tx_capture_len < sizeof(tx_capture) - 1; i++)
+        tx_capture[tx_capture_len++] = (char)data[i];
+    tx_capture[tx_capture_len] = '\0';
+}
 
 /* -------------------------------------------------------------------------- */
 void setUp(void)
@@ -32,8 +68,20 @@ void setUp(void)
     RESET_FAKE(uart_init);
     RESET_FAKE(uart_send_string_blocking);
     RESET_FAKE(uart_send_array_blocking);
+    RESET_FAKE(uart_send_array_nonBlocking);
     RESET_FAKE(uart_get_rx_callback);
+    RESET_FAKE(uart_read);
+    RESET_FAKE(uart_rx_overflows);
     RESET_FAKE(TCP_Received_callback_func);
+    RESET_FAKE(command_done_callback);
+    RESET_FAKE(timers_millis);
+
+    timers_millis_fake.custom_fake = clock_read;
+    rx_script_len = rx_script_pos = 0;
+    tx_capture_len = 0;
+    tx_capture[0] = '\0';
+    uart_read_fake.custom_fake = uart_read_from_script;
+    uart_send_array_nonBlocking_fake.custom_fake = uart_capture_tx;
 }
 
 void tearDown(void) {}
@@ -41,38 +89,26 @@ void tearDown(void) {}
 /* Helpers ------------------------------------------------------------------ */
 static void fake_wifiModule_send(char *cArray, int length)
 {
-    wifi_command_AT();                                     /* arm driver    */
-    UART_Callback_t cb = uart_init_fake.arg2_history[0];    /* first cb      */
-    for (int i = 0; i < length; i++)
-        cb((uint8_t)cArray[i]);                             /* feed bytes    */
+    for (int i = 0; i < length; i++)                        /* feed bytes    */
+        rx_script[rx_script_len++] = (uint8_t)cArray[i];
 }
 
-static void string_send_from_TCP_server(char *cArray)
+static void array_send_from_TCP_server(char *cArray, int length)
 {
     fake_wifiModule_send("OK\r\n", 5);
     TEST_ASSERT_EQUAL(
         WIFI_OK,
         wifi_command_create_TCP_connection(
             "The IP adress", 8000,
-            TCP_Received_callback_func, TEST_BUFFER));
+            TCP_Received_callback_func, TEST_BUFFER, sizeof(TEST_BUFFER)));
 
-    UART_Callback_t cb = uart_init_fake.arg2_val;
-    for (size_t i = 0; i < strlen(cArray); i++)
-        cb((uint8_t)cArray[i]);
+    fake_wifiModule_send(cArray, length);
+    wifi_poll();
 }
 
-static void array_send_from_TCP_server(char *cArray, int length)
+static void string_send_from_TCP_server(char *cArray)
 {
-    fake_wifiModule_send("OK\r\n", 5);
-    TEST_ASSERT_EQUAL(
-        WIFI_OK,
-        wifi_command_create_TCP_connection(
-            "The IP adress", 8000,
-            TCP_Received_callback_func, TEST_BUFFER));
-
-    UART_Callback_t cb = uart_init_fake.arg2_val;
-    for (int i = 0; i < length; i++)
-        cb((uint8_t)cArray[i]);
+    array_send_from_TCP_server(cArray, strlen(cArray));
 }
 
 /* -------------------------------------------------------------------------- */
@@ -85,14 +121,10 @@ void test_wifi_default_callback_func_is_null(void)
 
 void test_wifi_command_AT_sends_correct_stuff_to_uart(void)
 {
-    wifi_init();
-    uart_get_rx_callback_fake.return_val = uart_init_fake.arg2_val;
-
     (void)wifi_command_AT();   /* only check what was sent */
 
-    TEST_ASSERT_EQUAL(USART_2, uart_send_string_blocking_fake.arg0_val);
-    TEST_ASSERT_EQUAL(1,        uart_send_string_blocking_fake.call_count);
-    TEST_ASSERT_EQUAL_STRING("AT\r\n", uart_send_string_blocking_fake.arg1_val);
+    TEST_ASSERT_EQUAL(USART_2, uart_send_array_nonBlocking_fake.arg0_val);
+    TEST_ASSERT_EQUAL_STRING("AT\r\n", tx_capture);
 }
 
 void test_wifi_command_AT_error_code_is_ok_when_receiving_OK_from_hardware(void)
@@ -139,13 +171,13 @@ void test_wifi_TCP_connection_OK(void)
     fake_wifiModule_send("OK\r\n", 5);
     TEST_ASSERT_EQUAL(WIFI_OK,
                       wifi_command_create_TCP_connection(
-                          "The IP adress", 8000, NULL, NULL));
+                          "The IP adress", 8000, NULL, NULL, 0));
 
     fake_wifiModule_send("OK\r\n", 5);
     TEST_ASSERT_EQUAL(WIFI_OK,
                       wifi_command_create_TCP_connection(
                           "The IP adress", 8000,
-                          TCP_Received_callback_func, TEST_BUFFER));
+                          TCP_Received_callback_func, TEST_BUFFER, sizeof(TEST_BUFFER)));
 }
 
 void test_wifi_TCP_connection_failed(void)
@@ -153,7 +185,7 @@ void test_wifi_TCP_connection_failed(void)
     fake_wifiModule_send("FAIL\r\n", 5);
     TEST_ASSERT_EQUAL(WIFI_FAIL,
                       wifi_command_create_TCP_connection(
-                          "The IP adress", 8000, NULL, NULL));
+                          "The IP adress", 8000, NULL, NULL, 0));
 }
 
 /* ---- Receiving ----------------------------------------------------------- */
@@ -180,22 +212,12 @@ void test_wifi_TCP_callback_invoked_when_message_complete(void)
 
 void test_wifi_TCP_callback_not_yet_called_for_incomplete_message(void)
 {
-    const char *partial = "\r\n+IPD,1:";
-
-    fake_wifiModule_send("OK\r\n", 5);
-    TEST_ASSERT_EQUAL(
-        WIFI_OK,
-        wifi_command_create_TCP_connection(
-            "The IP adress", 8000,
-            TCP_Received_callback_func, TEST_BUFFER));
-
-    UART_Callback_t cb = uart_init_fake.arg2_val;
-    for (size_t i = 0; i < strlen(partial); i++)
-        cb((uint8_t)partial[i]);
+    string_send_from_TCP_server("\r\n+IPD,1:");
 
     TEST_ASSERT_EQUAL(0, TCP_Received_callback_func_fake.call_count);
 
-    cb('a');                        /* deliver last byte */
+    fake_wifiModule_send("a", 1);   /* deliver last byte */
+    wifi_poll();
     TEST_ASSERT_EQUAL(1, TCP_Received_callback_func_fake.call_count);
 }
 
@@ -219,31 +241,402 @@ void test_wifi_zeroes_in_data(void)
 /* ---- Sending ------------------------------------------------------------- */
 void test_wifi_send(void)
 {
-    fake_wifiModule_send("OK\r\n", 5);
+    fake_wifiModule_send("OK\r\n> ", 6);
+    fake_wifiModule_send("\r\nRecv 8 bytes\r\n\r\nSEND OK\r\n", 27);
 
     TEST_ASSERT_EQUAL(WIFI_OK,
                       wifi_command_TCP_transmit((uint8_t *)"sendThis", 8));
 
-    TEST_ASSERT_EQUAL_STRING("AT+CIPSEND=8\r\n",
-                             uart_send_string_blocking_fake.arg1_val);
-
-    TEST_ASSERT_EQUAL_STRING("sendThis",
-                             (char *)uart_send_array_blocking_fake.arg1_val);
+    TEST_ASSERT_EQUAL_STRING("AT+CIPSEND=8\r\nsendThis", tx_capture);
 }
 
 void test_wifi_send_data_with_zero(void)
 {
-    fake_wifiModule_send("OK\r\n", 5);
+    fake_wifiModule_send("OK\r\n> ", 6);
+    fake_wifiModule_send("SEND OK\r\n", 9);
 
     const char *msg = "sendTh\0s!A!";
     TEST_ASSERT_EQUAL(WIFI_OK,
                       wifi_command_TCP_transmit((uint8_t *)msg, 11));
 
-    TEST_ASSERT_EQUAL_STRING("AT+CIPSEND=11\r\n",
-                             uart_send_string_blocking_fake.arg1_val);
+    TEST_ASSERT_EQUAL(15 + 11, tx_capture_len);
+    TEST_ASSERT_EQUAL_STRING_LEN("AT+CIPSEND=11\r\n", tx_capture, 15);
+    TEST_ASSERT_EQUAL_MEMORY(msg, tx_capture + 15, 11);
+}
+
+void test_wifi_send_waits_for_prompt_before_data(void)
+{
+    fake_wifiModule_send("OK\r\n", 4);    /* no '>' yet                     */
+
+    TEST_ASSERT_EQUAL(WIFI_OK,
+                      wifi_command_TCP_transmit_async((uint8_t *)"data", 4,
+                                                      command_done_callback));
+    wifi_poll();
+    TEST_ASSERT_EQUAL_STRING("AT+CIPSEND=4\r\n", tx_capture);
+
+    fake_wifiModule_send("> ", 2);
+    wifi_poll();
+    TEST_ASSERT_EQUAL_STRING("AT+CIPSEND=4\r\ndata", tx_capture);
+    TEST_ASSERT_EQUAL(0, command_done_callback_fake.call_count);
+
+    fake_wifiModule_send("SEND FAIL\r\n", 11);
+    wifi_poll();
+    TEST_ASSERT_EQUAL(1, command_done_callback_fake.call_count);
+    TEST_ASSERT_EQUAL(WIFI_FAIL, command_done_callback_fake.arg0_val);
+}
+
+static void write_in_pieces(void)
+{
+    wifi_TCP_write((const uint8_t *)"{\"a\":", 5);
+    wifi_TCP_write((const uint8_t *)"1}", 2);
+}
+
+void test_wifi_send_stream_writes_payload_at_prompt(void)
+{
+    fake_wifiModule_send("OK\r\n> ", 6);
+    fake_wifiModule_send("SEND OK\r\n", 9);
+
+    TEST_ASSERT_EQUAL(WIFI_OK, wifi_command_TCP_transmit_stream(7, write_in_pieces));
+    TEST_ASSERT_EQUAL_STRING("AT+CIPSEND=7\r\n{\"a\":1}", tx_capture);
+}
+
+void test_wifi_send_stream_cuts_off_what_was_not_announced(void)
+{
+    fake_wifiModule_send("OK\r\n> ", 6);
+    fake_wifiModule_send("SEND OK\r\n", 9);
+
+    TEST_ASSERT_EQUAL(WIFI_OK, wifi_command_TCP_transmit_stream(6, write_in_pieces));
+    TEST_ASSERT_EQUAL_STRING("AT+CIPSEND=6\r\n{\"a\":1", tx_capture);
+}
+
+void test_wifi_send_stream_pads_a_short_payload(void)
+{
+    fake_wifiModule_send("OK\r\n> ", 6);
+    fake_wifiModule_send("SEND OK\r\n", 9);
+
+    TEST_ASSERT_EQUAL(WIFI_OK, wifi_command_TCP_transmit_stream(17, write_in_pieces));
+    TEST_ASSERT_EQUAL_STRING("AT+CIPSEND=17\r\n{\"a\":1}          ", tx_capture);
+}
+
+void test_wifi_write_outside_of_a_transmit_is_ignored(void)
+{
+    wifi_TCP_write((const uint8_t *)"stray", 5);
+    TEST_ASSERT_EQUAL(0, tx_capture_len);
+}
+
+/* ---- Asynchronous engine ------------------------------------------------- */
+void test_wifi_async_command_returns_immediately(void)
+{
+    TEST_ASSERT_EQUAL(WIFI_OK,
+                      wifi_command_async("AT+CIPCLOSE", 5, command_done_callback));
+    TEST_ASSERT_TRUE(wifi_busy());
+    TEST_ASSERT_EQUAL_STRING("AT+CIPCLOSE\r\n", tx_capture);
+
+    wifi_poll();
+    TEST_ASSERT_EQUAL(0, command_done_callback_fake.call_count);
+
+    fake_wifiModule_send("CLOSED\r\n\r\nOK\r\n", 14);
+    wifi_poll();
+    TEST_ASSERT_FALSE(wifi_busy());
+    TEST_ASSERT_EQUAL(1, command_done_callback_fake.call_count);
+    TEST_ASSERT_EQUAL(WIFI_OK, command_done_callback_fake.arg0_val);
+}
+
+void test_wifi_async_response_split_over_polls(void)
+{
+    wifi_command_async("AT", 1, command_done_callback);
+
+    fake_wifiModule_send("O", 1);
+    wifi_poll();
+    fake_wifiModule_send("K\r", 2);
+    wifi_poll();
+    TEST_ASSERT_EQUAL(0, command_done_callback_fake.call_count);
+
+    fake_wifiModule_send("\n", 1);
+    wifi_poll();
+    TEST_ASSERT_EQUAL(1, command_done_callback_fake.call_count);
+}
+
+void test_wifi_async_second_command_is_rejected_while_busy(void)
+{
+    wifi_command_async("AT", 1, command_done_callback);
+    TEST_ASSERT_EQUAL(WIFI_ERROR_BUSY, wifi_command_async("AT", 1, NULL));
+
+    fake_wifiModule_send("OK\r\n", 4);
+    wifi_poll();
+    TEST_ASSERT_EQUAL(WIFI_OK, wifi_command_async("AT", 1, NULL));
+    fake_wifiModule_send("OK\r\n", 4);
+    wifi_poll();
+}
+
+void test_wifi_async_times_out(void)
+{
+    wifi_command_async("AT+CWJAP=\"x\",\"y\"", 2, command_done_callback);
+
+    now_ms += 1000;
+    wifi_poll();
+    TEST_ASSERT_TRUE(wifi_busy());
+
+    now_ms += 1000;
+    wifi_poll();
+    TEST_ASSERT_FALSE(wifi_busy());
+    TEST_ASSERT_EQUAL(WIFI_ERROR_NOT_RECEIVING, command_done_callback_fake.arg0_val);
+}
+
+void test_wifi_IPD_data_is_not_mistaken_for_a_response(void)
+{
+    fake_wifiModule_send("OK\r\n", 5);
+    wifi_command_create_TCP_connection("The IP adress", 8000,
+                                       TCP_Received_callback_func, TEST_BUFFER, sizeof(TEST_BUFFER));
+
+    wifi_command_async("AT", 1, command_done_callback);
+    fake_wifiModule_send("+IPD,6:ERROR\n", 13);
+    wifi_poll();
+    TEST_ASSERT_EQUAL(0, command_done_callback_fake.call_count);
+    TEST_ASSERT_EQUAL_STRING("ERROR\n", TEST_BUFFER);
+
+    fake_wifiModule_send("OK\r\n", 4);
+    wifi_poll();
+    TEST_ASSERT_EQUAL(WIFI_OK, command_done_callback_fake.arg0_val);
+}
 
-    TEST_ASSERT_EQUAL_INT8_ARRAY(msg,
-                                 uart_send_array_blocking_fake.arg1_val, 11);
+/* ---- Link state --------------------------------------------------------- */
+void test_wifi_TCP_link_is_up_after_connect(void)
+{
+    TEST_ASSERT_FALSE(wifi_TCP_is_connected());
+    string_send_from_TCP_server("");
+    TEST_ASSERT_TRUE(wifi_TCP_is_connected());
+}
+
+void test_wifi_TCP_link_is_down_after_CLOSED_from_server(void)
+{
+    string_send_from_TCP_server("+IPD,2:hi\r\nCLOSED\r\n");
+
+    TEST_ASSERT_EQUAL_STRING("hi", TEST_BUFFER);
+    TEST_ASSERT_FALSE(wifi_TCP_is_connected());
+}
+
+void test_wifi_TCP_link_is_down_after_close_command(void)
+{
+    string_send_from_TCP_server("");
+    fake_wifiModule_send("CLOSED\r\n\r\nOK\r\n", 14);
+
+    TEST_ASSERT_EQUAL(WIFI_OK, wifi_command_close_TCP_connection());
+    TEST_ASSERT_FALSE(wifi_TCP_is_connected());
+}
+
+void test_wifi_TCP_link_already_connected_counts_as_up(void)
+{
+    fake_wifiModule_send("ALREADY CONNECTED\r\n\r\nERROR\r\n", 28);
+
+    TEST_ASSERT_EQUAL(WIFI_ERROR_RECEIVED_ERROR,
+                      wifi_command_create_TCP_connection(
+                          "The IP adress", 8000,
+                          TCP_Received_callback_func, TEST_BUFFER, sizeof(TEST_BUFFER)));
+    TEST_ASSERT_TRUE(wifi_TCP_is_connected());
+}
+
+void test_wifi_create_SSL_connection_sends_correct_command(void)
+{
+    fake_wifiModule_send("CONNECT\r\n\r\nOK\r\n", 15);
+
+    TEST_ASSERT_EQUAL(WIFI_OK,
+                      wifi_command_create_SSL_connection(
+                          "1.2.3.4", 443,
+                          TCP_Received_callback_func, TEST_BUFFER, sizeof(TEST_BUFFER)));
+    TEST_ASSERT_EQUAL_STRING("AT+CIPSTART=\"SSL\",\"1.2.3.4\",443\r\n", tx_capture);
+    TEST_ASSERT_TRUE(wifi_TCP_is_connected());
+}
+
+void test_wifi_TCP_receive_buffer_is_bounded(void)
+{
+    char small[4] = {'x', 'x', 'x', 'x'};
+
+    string_send_from_TCP_server("");
+    wifi_TCP_set_receive_buffer(small, 3);
+    fake_wifiModule_send("+IPD,5:abcde", 12);
+    wifi_poll();
+
+    TEST_ASSERT_EQUAL_STRING("ab", small);
+    TEST_ASSERT_EQUAL('x', small[3]);
+    TEST_ASSERT_EQUAL(1, TCP_Received_callback_func_fake.call_count);
+}
+
+void test_wifi_TCP_connect_bounds_the_receive_buffer(void)
+{
+    char small[4] = {'x', 'x', 'x', 'x'};
+
+    fake_wifiModule_send("OK\r\n", 5);
+    TEST_ASSERT_EQUAL(WIFI_OK,
+                      wifi_command_create_TCP_connection(
+                          "The IP adress", 8000,
+                          TCP_Received_callback_func, small, 3));
+    fake_wifiModule_send("+IPD,6:abcdef", 13);
+    wifi_poll();
+
+    TEST_ASSERT_EQUAL_STRING("ab", small);
+    TEST_ASSERT_EQUAL('x', small[3]);
+    TEST_ASSERT_EQUAL(1, TCP_Received_callback_func_fake.call_count);
+}
+
+/* ---- DNS cache ---------------------------------------------------------- */
+static void fake_CIPDOMAIN_reply(const char *ip)
+{
+    char reply[64];
+    int length = sprintf(reply, "+CIPDOMAIN:%s\r\n\r\nOK\r\n", ip);
+    fake_wifiModule_send(reply, length);
+}
+
+void test_wifi_get_ip_from_URL_parses_address(void)
+{
+    char ip[16] = "";
+    fake_CIPDOMAIN_reply("93.184.216.34");
+
+    TEST_ASSERT_EQUAL(WIFI_OK, wifi_command_get_ip_from_URL("dr.dk", ip));
+    TEST_ASSERT_EQUAL_STRING("93.184.216.34", ip);
+    TEST_ASSERT_EQUAL_STRING("AT+CIPDOMAIN=\"dr.dk\"\r\n", tx_capture);
+}
+
+void test_wifi_get_ip_from_URL_is_cached(void)
+{
+    char ip[16] = "";
+    fake_CIPDOMAIN_reply("93.184.216.34");
+    wifi_command_get_ip_from_URL("dr.dk", ip);
+    tx_capture_len = 0; tx_capture[0] = '\0';
+
+    ip[0] = '\0';
+    TEST_ASSERT_EQUAL(WIFI_OK, wifi_command_get_ip_from_URL("dr.dk", ip));
+    TEST_ASSERT_EQUAL_STRING("93.184.216.34", ip);
+    TEST_ASSERT_EQUAL_STRING("", tx_capture);              /* nothing sent */
+}
+
+void test_wifi_get_ip_from_URL_cache_expires(void)
+{
+    char ip[16] = "";
+    wifi_dns_cache_set_ttl(2, 1);
+    fake_CIPDOMAIN_reply("1.1.1.1");
+    wifi_command_get_ip_from_URL("dr.dk", ip);
+
+    now_ms += 1000;
+    fake_CIPDOMAIN_reply("2.2.2.2");                      /* not asked yet */
+    wifi_command_get_ip_from_URL("dr.dk", ip);
+    TEST_ASSERT_EQUAL_STRING("1.1.1.1", ip);
+
+    now_ms += 1000;
+    wifi_command_get_ip_from_URL("dr.dk", ip);
+    TEST_ASSERT_EQUAL_STRING("2.2.2.2", ip);
+
+    wifi_dns_cache_set_ttl(WIFI_DNS_CACHE_TTL_S, WIFI_DNS_CACHE_NEGATIVE_TTL_S);
+}
+
+void test_wifi_get_ip_from_URL_failure_is_cached(void)
+{
+    char ip[16] = "";
+    fake_wifiModule_send("DNS Fail\r\n\r\nERROR\r\n", 19);
+
+    TEST_ASSERT_EQUAL(WIFI_ERROR_RECEIVED_ERROR, wifi_command_get_ip_from_URL("nope.dk", ip));
+    tx_capture_len = 0; tx_capture[0] = '\0';
+
+    TEST_ASSERT_EQUAL(WIFI_ERROR_RECEIVED_ERROR, wifi_command_get_ip_from_URL("nope.dk", ip));
+    TEST_ASSERT_EQUAL_STRING("", tx_capture);
+
+    now_ms += WIFI_DNS_CACHE_NEGATIVE_TTL_S * 1000UL;
+    fake_CIPDOMAIN_reply("3.3.3.3");
+    TEST_ASSERT_EQUAL(WIFI_OK, wifi_command_get_ip_from_URL("nope.dk", ip));
+    TEST_ASSERT_EQUAL_STRING("3.3.3.3", ip);
+}
+
+void test_wifi_failed_connect_invalidates_cached_address(void)
+{
+    char ip[16] = "";
+    fake_CIPDOMAIN_reply("4.4.4.4");
+    wifi_command_get_ip_from_URL("dr.dk", ip);
+
+    fake_wifiModule_send("ERROR\r\nCLOSED\r\n", 15);
+    TEST_ASSERT_EQUAL(WIFI_ERROR_RECEIVED_ERROR,
+                      wifi_command_create_TCP_connection(ip, 80, NULL, NULL, 0));
+
+    fake_CIPDOMAIN_reply("5.5.5.5");
+    wifi_command_get_ip_from_URL("dr.dk", ip);
+    TEST_ASSERT_EQUAL_STRING("5.5.5.5", ip);
+}
+
+void test_wifi_dns_cache_evicts_oldest_when_full(void)
+{
+    char ip[16] = "";
+    char host[16];
+    for (int i = 0; i <= WIFI_DNS_CACHE_SIZE; i++) {
+        sprintf(host, "h%d.dk", i);
+        fake_CIPDOMAIN_reply("6.6.6.6");
+        wifi_command_get_ip_from_URL(host, ip);
+        now_ms += 1000;
+    }
+    tx_capture_len = 0; tx_capture[0] = '\0';
+
+    sprintf(host, "h%d.dk", WIFI_DNS_CACHE_SIZE);         /* newest: cached */
+    wifi_command_get_ip_from_URL(host, ip);
+    TEST_ASSERT_EQUAL_STRING("", tx_capture);
+
+    fake_CIPDOMAIN_reply("7.7.7.7");                      /* oldest: gone   */
+    wifi_command_get_ip_from_URL("h0.dk", ip);
+    TEST_ASSERT_EQUAL_STRING("AT+CIPDOMAIN=\"h0.dk\"\r\n", tx_capture);
+}
+
+/* ---- Asynchronous lookups and connections ------------------------------- */
+void test_wifi_get_ip_from_URL_async_answers_from_poll(void)
+{
+    char ip[16] = "";
+    TEST_ASSERT_EQUAL(WIFI_OK, wifi_command_get_ip_from_URL_async("dr.dk", ip, command_done_callback));
+    TEST_ASSERT_EQUAL(0, command_done_callback_fake.call_count);
+
+    fake_CIPDOMAIN_reply("8.8.4.4");
+    wifi_poll();
+    TEST_ASSERT_EQUAL(1, command_done_callback_fake.call_count);
+    TEST_ASSERT_EQUAL(WIFI_OK, command_done_callback_fake.arg0_val);
+    TEST_ASSERT_EQUAL_STRING("8.8.4.4", ip);
+
+    ip[0] = '\0';                                           /* cached now   */
+    TEST_ASSERT_EQUAL(WIFI_OK, wifi_command_get_ip_from_URL_async("dr.dk", ip, command_done_callback));
+    TEST_ASSERT_EQUAL(2, command_done_callback_fake.call_count);
+    TEST_ASSERT_EQUAL_STRING("8.8.4.4", ip);
+    TEST_ASSERT_FALSE(wifi_busy());
+}
+
+void test_wifi_connect_async_tracks_the_link(void)
+{
+    TEST_ASSERT_EQUAL(WIFI_OK, wifi_command_create_SSL_connection_async("1.2.3.4", 443, command_done_callback));
+    TEST_ASSERT_EQUAL_STRING("AT+CIPSTART=\"SSL\",\"1.2.3.4\",443\r\n", tx_capture);
+    TEST_ASSERT_FALSE(wifi_TCP_is_connected());
+
+    fake_wifiModule_send("CONNECT\r\n\r\nOK\r\n", 15);
+    wifi_poll();
+    TEST_ASSERT_EQUAL(WIFI_OK, command_done_callback_fake.arg0_val);
+    TEST_ASSERT_TRUE(wifi_TCP_is_connected());
+
+    TEST_ASSERT_EQUAL(WIFI_OK, wifi_command_close_TCP_connection_async(NULL));
+    TEST_ASSERT_FALSE(wifi_TCP_is_connected());
+    fake_wifiModule_send("CLOSED\r\n\r\nOK\r\n", 14);
+    wifi_poll();
+    TEST_ASSERT_FALSE(wifi_busy());
+}
+
+void test_wifi_get_MAC_async_parses_address(void)
+{
+    char mac[18] = "";
+    TEST_ASSERT_EQUAL(WIFI_OK, wifi_command_get_MAC_async(mac, command_done_callback));
+
+    char reply[] = "+CIFSR:STAIP,\"10.0.0.2\"\r\n+CIFSR:STAMAC,\"aa:bb:cc:dd:ee:ff\"\r\n\r\nOK\r\n";
+    fake_wifiModule_send(reply, strlen(reply));
+    wifi_poll();
+    TEST_ASSERT_EQUAL(1, command_done_callback_fake.call_count);
+    TEST_ASSERT_EQUAL_STRING("aa:bb:cc:dd:ee:ff", mac);
+}
+
+void test_wifi_rx_overflows_come_from_the_wifi_uart(void)
+{
+    uart_rx_overflows_fake.return_val = 7;
+    TEST_ASSERT_EQUAL(7, wifi_rx_overflows());
+    TEST_ASSERT_EQUAL(USART_WIFI, uart_rx_overflows_fake.arg0_val);
 }
 
 /* ---- Quit AP ------------------------------------------------------------- */
@@ -251,8 +644,7 @@ void test_wifi_quit_AP(void)
 {
     fake_wifiModule_send("OK\r\n", 5);
     TEST_ASSERT_EQUAL(WIFI_OK, wifi_command_quit_AP());
-    TEST_ASSERT_EQUAL_STRING("AT+CWQAP\r\n",
-                             uart_send_string_blocking_fake.arg1_val);
+    TEST_ASSERT_EQUAL_STRING("AT+CWQAP\r\n", tx_capture);
 }
 
 /* -------------------------------------------------------------------------- */
@@ -283,6 +675,36 @@ int main(void)
 
     RUN_TEST(test_wifi_send);
     RUN_TEST(test_wifi_send_data_with_zero);
+    RUN_TEST(test_wifi_send_waits_for_prompt_before_data);
+    RUN_TEST(test_wifi_send_stream_writes_payload_at_prompt);
+    RUN_TEST(test_wifi_send_stream_cuts_off_what_was_not_announced);
+    RUN_TEST(test_wifi_send_stream_pads_a_short_payload);
+    RUN_TEST(test_wifi_write_outside_of_a_transmit_is_ignored);
+
+    RUN_TEST(test_wifi_async_command_returns_immediately);
+    RUN_TEST(test_wifi_async_response_split_over_polls);
+    RUN_TEST(test_wifi_async_second_command_is_rejected_while_busy);
+    RUN_TEST(test_wifi_async_times_out);
+    RUN_TEST(test_wifi_IPD_data_is_not_mistaken_for_a_response);
+
+    RUN_TEST(test_wifi_TCP_link_is_up_after_connect);
+    RUN_TEST(test_wifi_TCP_link_is_down_after_CLOSED_from_server);
+    RUN_TEST(test_wifi_TCP_link_is_down_after_close_command);
+    RUN_TEST(test_wifi_TCP_link_already_connected_counts_as_up);
+    RUN_TEST(test_wifi_create_SSL_connection_sends_correct_command);
+    RUN_TEST(test_wifi_TCP_receive_buffer_is_bounded);
+    RUN_TEST(test_wifi_TCP_connect_bounds_the_receive_buffer);
+
+    RUN_TEST(test_wifi_get_ip_from_URL_parses_address);
+    RUN_TEST(test_wifi_get_ip_from_URL_is_cached);
+    RUN_TEST(test_wifi_get_ip_from_URL_cache_expires);
+    RUN_TEST(test_wifi_get_ip_from_URL_failure_is_cached);
+    RUN_TEST(test_wifi_failed_connect_invalidates_cached_address);
+    RUN_TEST(test_wifi_dns_cache_evicts_oldest_when_full);
+    RUN_TEST(test_wifi_get_ip_from_URL_async_answers_from_poll);
+    RUN_TEST(test_wifi_connect_async_tracks_the_link);
+    RUN_TEST(test_wifi_get_MAC_async_parses_address);
+    RUN_TEST(test_wifi_rx_overflows_come_from_the_wifi_uart);
 
     RUN_TEST(test_wifi_quit_AP);
 